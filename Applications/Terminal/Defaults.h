@@ -205,6 +205,10 @@ extern NSString *ScrollBackLinesKey;
 extern NSString *ScrollBackEnabledKey;
 extern NSString *ScrollBackUnlimitedKey;
 extern NSString *ScrollBottomOnInputKey;
+extern NSString *OutputFrameIntervalKey;
+
+// Heavy output redraws are paced to display refresh rate by default
+#define DEFAULT_REFRESH_RATE 60
 
 @interface Defaults (Display)
 - (int)scrollBackLines;
@@ -215,6 +219,9 @@ extern NSString *ScrollBottomOnInputKey;
 - (void)setScrollBackUnlimited:(BOOL)yn;
 - (BOOL)scrollBottomOnInput;
 - (void)setScrollBottomOnInput:(BOOL)yn;
+// Milliseconds of pty output parsing between screen updates. 0 - no pacing.
+- (int)outputFrameInterval;
+- (void)setOutputFrameInterval:(int)ms;
 @end
 
 //----------------------------------------------------------------------------
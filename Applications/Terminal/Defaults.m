@@ -692,6 +692,7 @@ NSString *ScrollBackLinesKey = @"ScrollBackLines";
 NSString *ScrollBackEnabledKey = @"ScrollBackEnabled";
 NSString *ScrollBackUnlimitedKey = @"ScrollBackUnlimited";
 NSString *ScrollBottomOnInputKey = @"ScrollBottomOnInput";
+NSString *OutputFrameIntervalKey = @"OutputFrameInterval";
 //---
 @implementation Defaults (Display)
 - (int)scrollBackLines
@@ -757,6 +758,20 @@ NSString *ScrollBottomOnInputKey = @"ScrollBottomOnInput";
 {
   [self setBool:yn forKey:ScrollBottomOnInputKey];
 }
+- (int)outputFrameInterval
+{
+  if ([self objectForKey:OutputFrameIntervalKey] == nil) {
+    return 1000 / DEFAULT_REFRESH_RATE;
+  }
+  return [self integerForKey:OutputFrameIntervalKey];
+}
+- (void)setOutputFrameInterval:(int)ms
+{
+  if (ms < 0) {
+    ms = 0;
+  }
+  [self setInteger:ms forKey:OutputFrameIntervalKey];
+}
 
 @end
 
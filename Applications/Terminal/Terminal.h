@@ -42,6 +42,8 @@ typedef struct {
 - (void)ts_gotoX:(int)x Y:(int)y;
 - (void)ts_putChar:(screen_char_t)ch count:(int)c atX:(int)x Y:(int)y;
 - (void)ts_putChar:(screen_char_t)ch count:(int)c offset:(int)ofs;
+/* Copies a span of characters that fits in line `y`. */
+- (void)ts_putChars:(const screen_char_t *)chars count:(int)c atX:(int)x Y:(int)y;
 
 /* The portions scrolled/shifted from remain unchanged. However, it's
 assumed that they will be cleared or overwritten before the redraw is
@@ -64,6 +66,9 @@ complete. (TODO check this) */
 
 - initWithTerminalScreen:(id<TerminalScreen>)ats width:(int)w height:(int)h;
 - (void)processByte:(unsigned char)c;
+/* Same as calling processByte: for every byte, but runs of printable
+   characters are put on screen in spans. */
+- (void)processBytes:(const unsigned char *)bytes length:(int)len;
 - (void)setTerminalScreenWidth:(int)w height:(int)h cursorY:(int)cursor_y;
 - (void)handleKeyEvent:(NSEvent *)e;
 - (void)sendString:(NSString *)str;
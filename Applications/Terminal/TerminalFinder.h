@@ -34,6 +34,8 @@
   id findPanel;
   id findTextField;
   id ignoreCaseButton;
+  id regexButton;
+  id highlightAllButton;
   id findNextButton;
   id statusField;
 
@@ -83,6 +83,25 @@ static id sharedFindObject = nil;
   return sharedFindObject;
 }
 
+- (NSButton *)_addCheckBoxWithTitle:(NSString *)title below:(NSButton *)button
+{
+  NSView *superview = [button superview];
+  NSRect frame = [button frame];
+  NSButton *checkBox;
+
+  frame.origin.y += [superview isFlipped] ? frame.size.height : -frame.size.height;
+  checkBox = [[NSButton alloc] initWithFrame:frame];
+  [checkBox setButtonType:NSSwitchButton];
+  [checkBox setTitle:title];
+  [checkBox setFont:[button font]];
+  [checkBox setAutoresizingMask:[button autoresizingMask]];
+  [checkBox sizeToFit];
+  [superview addSubview:checkBox];
+  [checkBox release];
+
+  return checkBox;
+}
+
 - (void)loadUI
 {
   if (!findTextField) {
@@ -94,6 +113,12 @@ static id sharedFindObject = nil;
       [[findTextField window] setFrameAutosaveName:@"FindPanel"];
     }
   }
+  // Options missing in Find.gorm are placed below "Ignore case"
+  if (ignoreCaseButton && !regexButton) {
+    regexButton = [self _addCheckBoxWithTitle:_(@"Regular expression") below:ignoreCaseButton];
+    highlightAllButton = [self _addCheckBoxWithTitle:_(@"Highlight all matches")
+                                               below:regexButton];
+  }
   [findTextField setStringValue:[self findString]];
   [statusField setStringValue:@""];
   [findPanel setDefaultButtonCell:[findNextButton cell]];
@@ -154,37 +179,33 @@ static id sharedFindObject = nil;
 
   tView = [[[NSApp delegate] terminalWindowForWindow:[NSApp mainWindow]] terminalView];
 
-  NSLog(@"TerminalView: %@", tView);
-
   lastFindWasSuccessful = NO;
 
   if (tView) {
-    NSString *textContents = [[tView stringRepresentation] copy];
-    NSUInteger textLength;
-
-    NSLog(@"Terminal contents length: %lu", [textContents length]);
-
-    if (textContents && (textLength = [textContents length])) {
-      NSRange range;
-      unsigned int options = 0;
-
-      if (direction == Backward) {
-        options |= NSBackwardsSearch;
-      }
-      if ([ignoreCaseButton state]) {
-        options |= NSCaseInsensitiveSearch;
-      }
-      range = [textContents findString:[self findString]
-                         selectedRange:[tView selectedRange]
-                               options:options
-                                  wrap:YES];
-      if (range.length) {
-        [tView setSelectedRange:range];
-        [tView scrollRangeToVisible:range];
-        lastFindWasSuccessful = YES;
-      }
+    NSRange range;
+    NSUInteger options = 0;
+
+    if (direction == Backward) {
+      options |= NSBackwardsSearch;
+    }
+    if ([ignoreCaseButton state]) {
+      options |= NSCaseInsensitiveSearch;
+    }
+    if ([regexButton state]) {
+      options |= NSRegularExpressionSearch;
+    }
+    // Contents are scanned in place: no string copy of scrollback is made
+    range = [tView rangeOfString:[self findString]
+                       fromRange:[tView selectedRange]
+                         options:options
+                            wrap:YES];
+    if (range.length) {
+      [tView setSelectedRange:range];
+      [tView scrollRangeToVisible:range];
+      lastFindWasSuccessful = YES;
     }
-    [textContents release];
+    [tView setHighlightString:([highlightAllButton state] ? [self findString] : nil)
+                      options:options];
   }
 
   if (!lastFindWasSuccessful) {
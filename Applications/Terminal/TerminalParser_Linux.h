@@ -81,6 +81,7 @@
 
   iconv_t iconv_state;
   iconv_t iconv_input_state;
+  BOOL iconv_utf8; /* iconv_state converts from UTF-8 */
 
   BOOL alternateAsMeta;
   BOOL sendDoubleEscape;
@@ -21,6 +21,7 @@
 #include <AppKit/NSGraphics.h>
 
 #include <netinet/in.h>
+#include <strings.h>
 
 /* TODO */
 #include <AppKit/NSEvent.h>
@@ -1209,6 +1210,114 @@ static unsigned char color_table[] = {0, 4, 2, 6, 1, 5, 3, 7, 8, 12, 10, 14, 9,
   }
 }
 
+#pragma mark - Batched input
+
+/* Decodes well-formed 2 and 3 byte UTF-8 sequence at `p`. Returns length of
+   sequence or 0 if it is incomplete, invalid or contains 0x9b byte (which
+   processByte: handles as CSI). */
+static inline int utf8_decode(const unsigned char *p, const unsigned char *end, unichar *uc)
+{
+  if (p[0] < 0xe0) {
+    if (end - p < 2 || (p[1] & 0xc0) != 0x80 || p[1] == 0x9b) {
+      return 0;
+    }
+    *uc = ((p[0] & 0x1f) << 6) | (p[1] & 0x3f);
+    return 2;
+  }
+
+  if (end - p < 3 || (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80 || p[1] == 0x9b ||
+      p[2] == 0x9b) {
+    return 0;
+  }
+  if ((p[0] == 0xe0 && p[1] < 0xa0) ||  /* overlong */
+      (p[0] == 0xed && p[1] >= 0xa0)) { /* surrogates */
+    return 0;
+  }
+  *uc = ((p[0] & 0x0f) << 12) | ((p[1] & 0x3f) << 6) | (p[2] & 0x3f);
+  return 3;
+}
+
+/* Puts single cell characters at cursor position wrapping lines the same
+   way PUTCH in processByte: does. */
+- (void)_putRun:(screen_char_t *)run length:(int)len
+{
+  int n;
+
+  while (len > 0) {
+    if (x >= width) {
+      if (!decawm) {
+        break;  // characters past the right margin are dropped
+      }
+      cr();
+      if ((y + 1) == bottom && (top + 1 >= bottom || bottom > height)) {
+        /* scrup() doesn't scroll such region: character is dropped */
+        run++;
+        len--;
+        continue;
+      }
+      lf();
+    }
+    n = width - x;
+    if (n > len) {
+      n = len;
+    }
+    [ts ts_putChars:run count:n atX:x Y:y];
+    x += n;
+    run += n;
+    len -= n;
+  }
+  [ts ts_gotoX:x Y:y];
+}
+
+#define RUN_BUF_SIZE 512
+
+- (void)processBytes:(const unsigned char *)bytes length:(int)len
+{
+  const unsigned char *p = bytes;
+  const unsigned char *end = bytes + len;
+  BOOL singleCell = ![ts useMultiCellGlyphs];
+  screen_char_t run[RUN_BUF_SIZE];
+  screen_char_t ch;
+  int n, l;
+
+  while (p < end) {
+    /* Collect run of printable characters in a state where processByte:
+       would just put them on screen one by one. */
+    if (singleCell && vc_state == ESnormal && !utf_count && !input_buf_len && !decim &&
+        !toggle_meta) {
+      BOOL use_translate = (!iconv_state || translate != translate_maps[0]);
+      BOOL ascii = (use_translate || iconv_utf8);
+      BOOL utf8 = (utf || (iconv_utf8 && !use_translate));
+      BOOL latin = (!utf && use_translate);
+
+      ch.color = color;
+      ch.attr = (intensity) | (underline << 2) | (reverse << 3) | (blink << 4);
+
+      n = 0;
+      while (p < end && n < RUN_BUF_SIZE) {
+        if (*p >= 0x20 && *p < 0x7f && ascii) {
+          ch.ch = use_translate ? translate[*p] : *p;
+          p++;
+        } else if (*p >= 0xa0 && latin) {
+          ch.ch = translate[*p];
+          p++;
+        } else if (*p >= 0xc2 && *p <= 0xef && utf8 && (l = utf8_decode(p, end, &ch.ch))) {
+          p += l;
+        } else {
+          break;
+        }
+        run[n++] = ch;
+      }
+      if (n > 0) {
+        [self _putRun:run length:n];
+        continue;
+      }
+    }
+
+    [self processByte:*p++];
+  }
+}
+
 /*
   Translates '\n' to '\r' when sending.
 */
@@ -1458,12 +1567,15 @@ static unsigned char color_table[] = {0, 4, 2, 6, 1, 5, 3, 7, 8, 12, 10, 14, 9,
 {
   const char *iconv_charset = [charsetName cString];
 
+  iconv_utf8 = NO;
   if (strcmp(iconv_charset, "ISO-8859-1")) {
     iconv_state = iconv_open("UCS-4", iconv_charset);
     if (iconv_state == (iconv_t)-1) {
       iconv_state = NULL;
       NSLog(@"Warning: unable to create iconv handle for conversion from '%s'!", iconv_charset);
       NSLog(@"Falling back to ISO-8859-1 (Latin1).");
+    } else if (!strcasecmp(iconv_charset, "UTF-8") || !strcasecmp(iconv_charset, "UTF8")) {
+      iconv_utf8 = YES;
     }
 
     iconv_input_state = iconv_open(iconv_charset, "UCS-4");
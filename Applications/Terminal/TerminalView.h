@@ -18,6 +18,7 @@
 #import <AppKit/NSScroller.h>
 #import <AppKit/NSView.h>
 #import <AppKit/NSMenu.h>
+#import <AppKit/NSImage.h>
 
 #import "Terminal.h"
 #import "TerminalParser_Linux.h"
@@ -58,6 +59,12 @@ struct selection_range {
   BOOL useMultiCellGlyphs;
   float fx, fy, fx0, fy0;
 
+  // Rendered character cells (see "Cell atlas" in TerminalView.m)
+  BOOL useCellAtlas;
+  NSImage *cellAtlas;
+  struct atlas_entry *atlas_map;
+  int atlas_used;
+
   struct {
     int x0, y0, x1, y1;
   } dirty;
@@ -66,6 +73,19 @@ struct selection_range {
   int write_buf_len;
   int write_buf_size;
 
+  unsigned char *read_buf;
+  int read_buf_size;
+
+  // ---
+  // Output frame pacing
+  // ---
+  NSTimeInterval frame_interval; /* 0 = redraw after every readData */
+  NSTimeInterval frame_start;    /* time first data of current frame was parsed */
+  BOOL frame_pending;            /* redraw of current frame was postponed */
+  unsigned long frame_bytes;     /* bytes parsed in current frame */
+  unsigned long frames_drawn;
+  unsigned long frames_skipped;  /* readData calls that postponed redraw */
+
   // ---
   // Scrolling
   // ---
@@ -78,6 +98,7 @@ struct selection_range {
   int max_sb_depth;          /* maximum scrollback size in lines */
   int curr_sb_depth;         /* current scrollback size in lines */
   int alloc_sb_depth;        /* current number of lines which have allocated memory for */
+  int sb_head;               /* ring buffer line where the next scrolled out line goes */
 
   /* Scrolling by compositing takes a long while, so we break out of such
      loops fairly often to process other events */
@@ -109,6 +130,15 @@ struct selection_range {
   struct selection_range selection;
   NSString *additionalWordCharacters;
 
+  // Search: matches of highlightString in visible part of buffer
+  NSString *highlightString;
+  NSUInteger highlightOptions;
+  NSRegularExpression *highlightExpression;  // compiled highlightString
+  NSRange *highlights;
+  int highlights_count;
+  int highlights_size;
+  BOOL highlights_valid;
+
   // ------
   // Colors
   // ------
@@ -200,6 +230,19 @@ struct selection_range {
 - (void)setScroller:(NSScroller *)sc;
 @end
 
+// Search scans buffer contents in place. Ranges are in terms of
+// stringRepresentation (scrollback + screen). Supported options:
+// NSBackwardsSearch, NSCaseInsensitiveSearch and NSRegularExpressionSearch
+// (regular expression matches don't span lines).
+@interface TerminalView (search)
+- (NSRange)rangeOfString:(NSString *)string
+               fromRange:(NSRange)range
+                 options:(NSUInteger)options
+                    wrap:(BOOL)wrap;
+// Highlights all matches on screen; nil string removes highlighting.
+- (void)setHighlightString:(NSString *)string options:(NSUInteger)options;
+@end
+
 @interface TerminalView (Input_Output) <RunLoopEvents>
 
 - (void)readData;
@@ -27,6 +27,7 @@
 #include <fcntl.h>
 #include <pty.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
 
 #import <AppKit/AppKit.h>
 #import <GNUstepBase/Unicode.h>
@@ -39,6 +40,10 @@
 
 #define SCROLLBACK_CHANGE_STEP 1  // number of screens
 
+// Size of pty read buffer grows up to pending data size within these limits
+#define READ_BUF_MIN 4096
+#define READ_BUF_MAX 65536
+
 @interface NSArray (IsEmpty)
 - (BOOL)isEmpty;
 @end
@@ -80,6 +85,11 @@ NSString *TerminalViewSizeDidChangeNotification = @"TerminalViewSizeDidChange";
 // - (void)_clearSelection;
 // @end
 
+@interface TerminalView (search_private)
+- (void)_invalidateHighlights;
+- (void)_drawHighlights;
+@end
+
 
 #pragma mark - Scrolling
 
@@ -163,6 +173,7 @@ NSString *TerminalViewSizeDidChangeNotification = @"TerminalViewSizeDidChange";
   }
 
   curr_sb_position = new_scroll;
+  [self _invalidateHighlights];
 
   if (update)
     [self _updateScroller];
@@ -255,8 +266,30 @@ NSString *TerminalViewSizeDidChangeNotification = @"TerminalViewSizeDidChange";
 
 #define SCREEN(x, y) (screen[(y) * screen_width + (x)])
 
+/* Scrollback is a ring of alloc_sb_depth lines. Lines are addressed with
+   negative numbers: -1 is the most recent line scrolled out of the screen,
+   -alloc_sb_depth is the oldest one. sb_head is the physical line the next
+   scrolled out line will be written to. */
+#define SCROLLBACK_LINE(y) \
+  (&scrollback[((sb_head + (y) + alloc_sb_depth) % alloc_sb_depth) * screen_width])
+/* Negative character offset (as used by selection) into scrollback. */
+#define SCROLLBACK_ROW(ofs) (-((screen_width - 1 - (ofs)) / screen_width))
+#define SCROLLBACK_CHAR(ofs) \
+  (SCROLLBACK_LINE(SCROLLBACK_ROW(ofs))[(ofs) - SCROLLBACK_ROW(ofs) * screen_width])
+
 static int total_draw = 0;
 
+#define ATLAS_COLUMNS 64
+#define ATLAS_ROWS 32
+#define ATLAS_SLOTS (ATLAS_COLUMNS * ATLAS_ROWS)
+#define ATLAS_MAP_BITS 12
+#define ATLAS_MAP_SIZE (1 << ATLAS_MAP_BITS)  // at least 2 * ATLAS_SLOTS
+
+typedef struct atlas_entry {
+  uint32_t key;  // 0 - unused entry
+  int slot;
+} atlas_entry_t;
+
 
 #pragma mark - Colors
 //
@@ -352,6 +385,40 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   DPSsethsbcolor(gc, h, s, b);
 }
 
+// Converts character to C string in font encoding for DPSshow.
+static void cell_cstring(unichar uch, int encoding, char *buf, unsigned int size)
+{
+  /* we short-circuit utf8 for performance with back-art */
+  /* TODO: short-circuit latin1 too? */
+  if (encoding == NSUTF8StringEncoding) {
+    if (uch >= 0x800) {
+      buf[2] = (uch & 0x3f) | 0x80;
+      uch >>= 6;
+      buf[1] = (uch & 0x3f) | 0x80;
+      uch >>= 6;
+      buf[0] = (uch & 0x0f) | 0xe0;
+      buf[3] = 0;
+    } else if (uch >= 0x80) {
+      buf[1] = (uch & 0x3f) | 0x80;
+      uch >>= 6;
+      buf[0] = (uch & 0x1f) | 0xc0;
+      buf[2] = 0;
+    } else {
+      buf[0] = uch;
+      buf[1] = 0;
+    }
+  } else {
+    if (uch <= 0x80) {
+      buf[0] = uch;
+      buf[1] = 0;
+    } else {
+      unsigned char *pbuf = (unsigned char *)buf;
+      unsigned int dlen = size - 1;
+      GSFromUnicode(&pbuf, &dlen, &uch, 1, encoding, NULL, GSUniTerminate);
+    }
+  }
+}
+
 - (void)updateColors:(Defaults *)prefs
 {
   NSColor *winBG, *winSel, *winText, *winBlink, *winBold, *invBG, *invFG;
@@ -398,6 +465,234 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   INV_FG_H = [invFG hueComponent];
   INV_FG_S = [invFG saturationComponent];
   INV_FG_B = [invFG brightnessComponent];
+
+  [self _invalidateCellAtlas];
+}
+
+#pragma mark - Cell atlas
+
+// ---
+// --- Cell atlas: off-screen image with rendered character cells.
+// ---
+// Every (character, color, attributes) combination met on screen is rendered
+// once (background, glyph and underline) into a slot of the atlas. Dirty
+// cells are then copied from atlas to view. Cells of a row which go into
+// adjacent slots (e.g. repeated words) are copied with a single composite.
+// When atlas is full it's started over.
+
+static inline uint32_t atlas_key(screen_char_t *ch)
+{
+  // Dirty bit is unused in key - 0x80 marks entry as used
+  return ((uint32_t)ch->ch << 16) | ((uint32_t)ch->color << 8) | (ch->attr & 0x7f) | 0x80;
+}
+
+static inline uint32_t atlas_hash(uint32_t key)
+{
+  return (key * 2654435761u) >> (32 - ATLAS_MAP_BITS);
+}
+
+- (void)_invalidateCellAtlas
+{
+  DESTROY(cellAtlas);
+  atlas_used = 0;
+  if (atlas_map) {
+    memset(atlas_map, 0, sizeof(atlas_entry_t) * ATLAS_MAP_SIZE);
+  }
+}
+
+- (void)_setBackgroundColorForCell:(screen_char_t *)ch context:(NSGraphicsContext *)gc
+{
+  if (ch->attr & 0x40) {  // selection
+    DPSsethsbcolor(gc, WIN_SEL_H, WIN_SEL_S, WIN_SEL_B);
+  } else if (ch->attr & 0x8) {  // inverse
+    if ((ch->color & 0x0f) == 15 && (ch->color >> 4) == 15) {
+      DPSsethsbcolor(gc, INV_BG_H, INV_BG_S, INV_BG_B);
+    } else {
+      set_foreground(gc, ch->color & 0x0f, ch->attr & 0x03);
+    }
+  } else if ((ch->color >> 4) == 15) {  // default BG
+    DPSsethsbcolor(gc, WIN_BG_H, WIN_BG_S, WIN_BG_B);
+  } else {
+    set_background(gc, ch->color & 0xf0, ch->attr & 0x03, NO);
+  }
+}
+
+- (void)_setForegroundColorForCell:(screen_char_t *)ch context:(NSGraphicsContext *)gc
+{
+  unsigned char color;
+
+  if (ch->attr & 0x8) {  // inverse
+    if (ch->attr & 0x40) {
+      DPSsethsbcolor(gc, TEXT_NORM_H, TEXT_NORM_S, TEXT_NORM_B);
+    } else {
+      DPSsethsbcolor(gc, INV_FG_H, INV_FG_S, INV_FG_B);
+    }
+  } else if (ch->attr & 0x10) {  // blink
+    if (ch->attr & 0x40) {
+      DPSsethsbcolor(gc, TEXT_NORM_H, TEXT_NORM_S, TEXT_NORM_B);
+    } else {
+      DPSsethsbcolor(gc, TEXT_BLINK_H, TEXT_BLINK_S, TEXT_BLINK_B);
+    }
+  } else {
+    color = ch->color & 0x0f;
+    if (ch->attr & 0x40) {
+      color ^= 0x0f;
+    }
+    if (color == 15 || (ch->attr & 0x40)) {
+      DPSsethsbcolor(gc, TEXT_NORM_H, TEXT_NORM_S, TEXT_NORM_B);
+    } else {
+      set_foreground(gc, color, ch->attr & 0x03);
+    }
+  }
+
+  if ((ch->attr & 3) == 2 && (ch->color & 0x0f) == 15) {  // bold
+    DPSsethsbcolor(gc, TEXT_BOLD_H, TEXT_BOLD_S, TEXT_BOLD_B);
+  }
+}
+
+// Returns atlas slot of cell or -1 if cell is not in atlas yet.
+- (int)_atlasSlotForCell:(screen_char_t *)ch
+{
+  uint32_t key = atlas_key(ch);
+  uint32_t i;
+
+  if (atlas_map == NULL) {
+    return -1;
+  }
+  for (i = atlas_hash(key); atlas_map[i].key != 0; i = (i + 1) & (ATLAS_MAP_SIZE - 1)) {
+    if (atlas_map[i].key == key) {
+      return atlas_map[i].slot;
+    }
+  }
+  return -1;
+}
+
+// Renders cell into a new atlas slot. Atlas is started over if it's full, so
+// previously returned slots become invalid.
+- (int)_atlasAddCell:(screen_char_t *)ch
+{
+  uint32_t key = atlas_key(ch);
+  uint32_t i;
+  NSGraphicsContext *gc;
+  char buf[8];
+  float sx, sy;
+  int slot;
+
+  if (atlas_map == NULL) {
+    atlas_map = calloc(ATLAS_MAP_SIZE, sizeof(atlas_entry_t));
+  }
+  if (cellAtlas == nil) {
+    cellAtlas = [[NSImage alloc] initWithSize:NSMakeSize(ATLAS_COLUMNS * fx, ATLAS_ROWS * fy)];
+  }
+  if (atlas_used == ATLAS_SLOTS) {
+    atlas_used = 0;
+    memset(atlas_map, 0, sizeof(atlas_entry_t) * ATLAS_MAP_SIZE);
+  }
+
+  for (i = atlas_hash(key); atlas_map[i].key != 0; i = (i + 1) & (ATLAS_MAP_SIZE - 1))
+    ;
+
+  slot = atlas_used++;
+  atlas_map[i].key = key;
+  atlas_map[i].slot = slot;
+
+  sx = (slot % ATLAS_COLUMNS) * fx;
+  sy = (slot / ATLAS_COLUMNS) * fy;
+
+  [cellAtlas lockFocus];
+  gc = GSCurrentContext();
+
+  [self _setBackgroundColorForCell:ch context:gc];
+  DPSrectfill(gc, sx, sy, fx, fy);
+
+  [self _setForegroundColorForCell:ch context:gc];
+  if (ch->ch != 0 && ch->ch != 32 && ch->ch != MULTI_CELL_GLYPH) {
+    if ((ch->attr & 3) == 2) {
+      [boldFont set];
+      cell_cstring(ch->ch, boldFont_encoding, buf, sizeof(buf));
+    } else {
+      [font set];
+      cell_cstring(ch->ch, font_encoding, buf, sizeof(buf));
+    }
+    DPSmoveto(gc, sx + fx0, sy + fy0);
+    DPSshow(gc, buf);
+  }
+  if (ch->attr & 0x4) {
+    DPSrectfill(gc, sx, sy, fx, 1);
+  }
+
+  [cellAtlas unlockFocus];
+
+  return slot;
+}
+
+// Copies dirty cells with glyphs or underline from atlas to view. Background
+// of other cells is already drawn.
+- (void)_drawCellsFromAtlasX0:(int)x0 Y0:(int)y0 X1:(int)x1 Y1:(int)y1
+{
+  screen_char_t *ch;
+  int ix, iy, ry;
+  int slot, run_slot, run_len, run_x;
+  float scr_y;
+
+#define FLUSH_RUN()                                                           \
+  do {                                                                        \
+    if (run_len > 0) {                                                        \
+      [cellAtlas compositeToPoint:NSMakePoint(run_x * fx + border_x, scr_y)   \
+                         fromRect:NSMakeRect((run_slot % ATLAS_COLUMNS) * fx, \
+                                             (run_slot / ATLAS_COLUMNS) * fy, \
+                                             run_len * fx, fy)                \
+                        operation:NSCompositeCopy];                           \
+      run_len = 0;                                                            \
+    }                                                                         \
+  } while (0)
+
+  for (iy = y0; iy < y1; iy++) {
+    ry = iy + curr_sb_position;
+    if (ry >= 0) {
+      ch = &SCREEN(x0, ry);
+    } else {
+      ch = &SCROLLBACK_LINE(ry)[x0];
+    }
+
+    scr_y = (screen_height - 1 - iy) * fy + border_y;
+    run_len = 0;
+    run_slot = run_x = 0;
+
+    for (ix = x0; ix < x1; ix++, ch++) {
+      if (!draw_all && !(ch->attr & 0x80)) {
+        FLUSH_RUN();
+        continue;
+      }
+
+      // Clear dirty bit
+      ch->attr &= 0x7f;
+
+      if ((ch->ch == 0 || ch->ch == 32 || ch->ch == MULTI_CELL_GLYPH) && !(ch->attr & 0x4)) {
+        FLUSH_RUN();
+        continue;
+      }
+
+      total_draw++;
+      slot = [self _atlasSlotForCell:ch];
+      if (slot < 0) {
+        // Atlas might be started over: copy pending run first
+        FLUSH_RUN();
+        slot = [self _atlasAddCell:ch];
+      }
+
+      if (run_len > 0 && slot == run_slot + run_len && (slot % ATLAS_COLUMNS) != 0) {
+        run_len++;
+      } else {
+        FLUSH_RUN();
+        run_slot = slot;
+        run_x = ix;
+        run_len = 1;
+      }
+    }
+    FLUSH_RUN();
+  }
+#undef FLUSH_RUN
 }
 
 #pragma mark - Rendering
@@ -405,16 +700,203 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 // ---
 // --- Rendering
 // ---
-- (void)drawRect:(NSRect)r
+// Draws dirty characters glyph by glyph. Background of dirty cells is
+// already drawn.
+- (void)_drawGlyphsX0:(int)x0 Y0:(int)y0 X1:(int)x1 Y1:(int)y1
 {
   int ix, iy;
   char buf[8];
   NSGraphicsContext *cur = GSCurrentContext();
-  int x0, y0, x1, y1;
   NSFont *f, *current_font = nil;
 
   int encoding;
 
+  {
+    int ry;
+    screen_char_t *ch;
+    float scr_y, scr_x;
+
+    /* setting the color is slow, so we try to avoid it */
+    unsigned char last_color, color, last_attr;
+
+    last_color = -1;
+    last_attr = 0;
+    /* Now draw any dirty characters */
+    for (iy = y0; iy < y1; iy++) {
+      ry = iy + curr_sb_position;
+      if (ry >= 0) {
+        ch = &SCREEN(x0, ry);
+      } else {
+        ch = &SCROLLBACK_LINE(ry)[x0];
+      }
+
+      scr_y = (screen_height - 1 - iy) * fy + border_y;
+
+      for (ix = x0; ix < x1; ix++, ch++) {
+        /* no need to draw && not dirty */
+        if (!draw_all && !(ch->attr & 0x80)) {
+          continue;
+        }
+
+        // Clear dirty bit
+        ch->attr &= 0x7f;
+
+        scr_x = ix * fx + border_x;
+
+        //--- FOREGROUND
+        /* ~1700 cycles/change */
+        if ((ch->attr & 0x02) || (ch->ch != 0 && ch->ch != 32)) {
+          if (ch->attr & 0x8) {  //-------------------------------- FG INVERSE
+            color = ch->color & 0xf0;
+            if (ch->attr & 0x40) {
+              color ^= 0x0f;
+            }
+
+            if (color != last_color || ch->attr != last_attr) {
+              last_color = color;
+              last_attr = ch->attr;
+
+              // fprintf(stderr,
+              //         "'%c' FG INVERSE color: %i (%i) attrs: %i (in:%i sel:%i)"
+              //         " FG: %i BG: %i\n",
+              //         ch->ch, ch->color, l_color, ch->attr, l_attr & 0x03,l_attr & 0x40,
+              //         (ch->color & 0x0f), (ch->color>>4));
+
+              if (last_attr & 0x40) {  // selection FG
+                // fprintf(stderr, "'%c' \tFG INVERSE: setting TEXT_NORM\n", ch->ch);
+                DPSsethsbcolor(cur, TEXT_NORM_H, TEXT_NORM_S, TEXT_NORM_B);
+              } else {
+                // fprintf(stderr, "'%c' \tFG INVERSE: setting INV_FG\n", ch->ch);
+                DPSsethsbcolor(cur, INV_FG_H, INV_FG_S, INV_FG_B);
+              }
+            }
+          } else if (ch->attr & 0x10) {  //---------------------------- FG BLINK
+            // fprintf(stderr, "'%c' blink\n", ch->ch);
+            if (ch->attr != last_attr) {
+              last_attr = ch->attr;
+              if (last_attr & 0x40) {  // selection FG
+                // fprintf(stderr, "'%c' \tFG INVERSE: setting TEXT_NORM\n", ch->ch);
+                DPSsethsbcolor(cur, TEXT_NORM_H, TEXT_NORM_S, TEXT_NORM_B);
+              } else {
+                DPSsethsbcolor(cur, TEXT_BLINK_H, TEXT_BLINK_S, TEXT_BLINK_B);
+              }
+            }
+          } else {  //------------------------------------------------ FG NORMAL
+            color = ch->color & 0x0f;
+            if (ch->attr & 0x40) {
+              color ^= 0x0f;
+            }
+
+            if (color != last_color || ch->attr != last_attr) {
+              last_color = color;
+              last_attr = ch->attr;
+
+              // fprintf(stderr,
+              //         "'%c' FG NORMAL color: %i (%i)"
+              //         " attrs: %i (in:%i sel:%i)"
+              //         " FG: %i BG: %i\n",
+              //         ch->ch, ch->color, l_color,
+              //         ch->attr, l_attr & 0x03, l_attr & 0x40,
+              //         (ch->color & 0x0f), (ch->color>>4));
+
+              if (color == 15 || (ch->attr & 0x40)) {
+                // fprintf(stderr,
+                //         "'%c' \tFG NORMAL: setting TEXT_NORM\n",
+                //         ch->ch);
+                DPSsethsbcolor(cur, TEXT_NORM_H, TEXT_NORM_S, TEXT_NORM_B);
+              } else {
+                set_foreground(cur, last_color, last_attr & 0x03);
+              }
+            }
+          }
+        }
+
+        //--- FONTS & ENCODING
+        if (ch->ch != 0 && ch->ch != 32 && ch->ch != MULTI_CELL_GLYPH) {
+          total_draw++;
+          if ((ch->attr & 3) == 2) {
+            encoding = boldFont_encoding;
+            f = boldFont;
+            if ((ch->color & 0x0f) == 15) {
+              DPSsethsbcolor(cur, TEXT_BOLD_H, TEXT_BOLD_S, TEXT_BOLD_B);
+            }
+          } else {
+            encoding = font_encoding;
+            f = font;
+          }
+          if (f != current_font) {
+            /* ~190 cycles/change */
+            [f set];
+            current_font = f;
+          }
+
+          /* we short-circuit utf8 for performance with back-art */
+          /* TODO: short-circuit latin1 too? */
+          if (encoding == NSUTF8StringEncoding) {
+            unichar uch = ch->ch;
+            if (uch >= 0x800) {
+              buf[2] = (uch & 0x3f) | 0x80;
+              uch >>= 6;
+              buf[1] = (uch & 0x3f) | 0x80;
+              uch >>= 6;
+              buf[0] = (uch & 0x0f) | 0xe0;
+              buf[3] = 0;
+            } else if (uch >= 0x80) {
+              buf[1] = (uch & 0x3f) | 0x80;
+              uch >>= 6;
+              buf[0] = (uch & 0x1f) | 0xc0;
+              buf[2] = 0;
+            } else {
+              buf[0] = uch;
+              buf[1] = 0;
+            }
+          } else {
+            unichar uch = ch->ch;
+            if (uch <= 0x80) {
+              buf[0] = uch;
+              buf[1] = 0;
+            } else {
+              unsigned char *pbuf = (unsigned char *)buf;
+              unsigned int dlen = sizeof(buf) - 1;
+              GSFromUnicode(&pbuf, &dlen, &uch, 1, encoding, NULL, GSUniTerminate);
+            }
+          }
+          /* ~580 cycles */
+          DPSmoveto(cur, scr_x + fx0, scr_y + fy0);
+          /* baseline here for mc-case 0.65 */
+          /* ~3800 cycles */
+          DPSshow(cur, buf);
+
+          /* ~95 cycles to ARTGState -DPSshow:... */
+          /* ~343 cycles to isEmpty */
+          /* ~593 cycles to currentpoint */
+          /* ~688 cycles to transform */
+          /* ~1152 cycles to FTFont -drawString:... */
+          /* ~1375 cycles to -drawString:... setup */
+          /* ~1968 cycles cmap lookup */
+          /* ~2718 cycles sbit lookup */
+          /* ~~2750 cycles blit setup */
+          /* ~3140 cycles blit loop, empty call */
+          /* ~3140 cycles blit loop, setup */
+          /* ~3325 cycles blit loop, no write */
+          /* ~3800 cycles total */
+        }
+
+        //--- UNDERLINE
+        if (ch->attr & 0x4) {
+          DPSrectfill(cur, scr_x, scr_y, fx, 1);
+        }
+      }
+    }
+  }
+}
+
+- (void)drawRect:(NSRect)r
+{
+  int ix, iy;
+  NSGraphicsContext *cur = GSCurrentContext();
+  int x0, y0, x1, y1;
+
   NSDebugLLog(@"draw", @"drawRect: (%g %g)+(%g %g) %i\n", r.origin.x, r.origin.y, r.size.width,
               r.size.height, draw_all);
 
@@ -510,7 +992,16 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
       if (ry >= 0) {
         ch = &SCREEN(x0, ry);
       } else {
-        ch = &scrollback[x0 + (alloc_sb_depth + ry) * screen_width];
+        ch = &SCROLLBACK_LINE(ry)[x0];
+      }
+
+      /* skip rows without dirty cells */
+      if (!draw_all) {
+        for (ix = x0; ix < x1 && !(ch[ix - x0].attr & 0x80); ix++)
+          ;
+        if (ix == x1) {
+          continue;
+        }
       }
 
       scr_y = (screen_height - 1 - iy) * fy + border_y;
@@ -579,213 +1070,55 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
             last_color = color;
             last_attr = ch->attr;
 
-            // fprintf(stderr,
-            //         "'%c' BG NORMAL color: %i (%i) attrs: %i (in:%i sel:%i)"
-            //         " FG: %i BG: %i\n",
-            //         ch->ch, ch->color, l_color, ch->attr, l_attr & 0x03,(ch->attr & 0x40),
-            //         (ch->color & 0x0f), (ch->color>>4));
-
-            // Window was resized and added empty chars have no attributes.
-            // Set FG and BG to default values
-            if ((color == 0 && (ch->color >> 4) == 0) && ch->ch == 0) {
-              ch->color = 255;  // default FG/BG
-              last_color = color = ch->color & 0xf0;
-            }
-
-            if (ch->attr & 0x40) {  // selection BG
-              // fprintf(stderr, "'%c' \tBG NORMAL: setting WIN_SEL\n", ch->ch);
-              DPSsethsbcolor(cur, WIN_SEL_H, WIN_SEL_S, WIN_SEL_B);
-            } else if ((ch->color >> 4) == 15) {  // default BG
-              // fprintf(stderr, "'%c' \tBG NORMAL: setting WIN_BG\n", ch->ch);
-              DPSsethsbcolor(cur, WIN_BG_H, WIN_BG_S, WIN_BG_B);
-            } else {
-              set_background(cur, last_color, last_attr & 0x03, NO);
-            }
-          }
-        }
-
-        if (start_x == -1) {
-          start_x = scr_x;
-        }
-      }
-
-      if (start_x != -1) {
-        scr_x = ix * fx + border_x;
-        R(start_x, scr_y, scr_x - start_x, fy);
-      }
-    }
-    //------------------- CHARACTERS ------------------------------------------------
-    last_color = -1;
-    last_attr = 0;
-    /* Now draw any dirty characters */
-    for (iy = y0; iy < y1; iy++) {
-      ry = iy + curr_sb_position;
-      if (ry >= 0) {
-        ch = &SCREEN(x0, ry);
-      } else {
-        ch = &scrollback[x0 + (alloc_sb_depth + ry) * screen_width];
-      }
-
-      scr_y = (screen_height - 1 - iy) * fy + border_y;
-
-      for (ix = x0; ix < x1; ix++, ch++) {
-        /* no need to draw && not dirty */
-        if (!draw_all && !(ch->attr & 0x80)) {
-          continue;
-        }
-
-        // Clear dirty bit
-        ch->attr &= 0x7f;
-
-        scr_x = ix * fx + border_x;
-
-        //--- FOREGROUND
-        /* ~1700 cycles/change */
-        if ((ch->attr & 0x02) || (ch->ch != 0 && ch->ch != 32)) {
-          if (ch->attr & 0x8) {  //-------------------------------- FG INVERSE
-            color = ch->color & 0xf0;
-            if (ch->attr & 0x40) {
-              color ^= 0x0f;
-            }
-
-            if (color != last_color || ch->attr != last_attr) {
-              last_color = color;
-              last_attr = ch->attr;
-
-              // fprintf(stderr,
-              //         "'%c' FG INVERSE color: %i (%i) attrs: %i (in:%i sel:%i)"
-              //         " FG: %i BG: %i\n",
-              //         ch->ch, ch->color, l_color, ch->attr, l_attr & 0x03,l_attr & 0x40,
-              //         (ch->color & 0x0f), (ch->color>>4));
-
-              if (last_attr & 0x40) {  // selection FG
-                // fprintf(stderr, "'%c' \tFG INVERSE: setting TEXT_NORM\n", ch->ch);
-                DPSsethsbcolor(cur, TEXT_NORM_H, TEXT_NORM_S, TEXT_NORM_B);
-              } else {
-                // fprintf(stderr, "'%c' \tFG INVERSE: setting INV_FG\n", ch->ch);
-                DPSsethsbcolor(cur, INV_FG_H, INV_FG_S, INV_FG_B);
-              }
-            }
-          } else if (ch->attr & 0x10) {  //---------------------------- FG BLINK
-            // fprintf(stderr, "'%c' blink\n", ch->ch);
-            if (ch->attr != last_attr) {
-              last_attr = ch->attr;
-              if (last_attr & 0x40) {  // selection FG
-                // fprintf(stderr, "'%c' \tFG INVERSE: setting TEXT_NORM\n", ch->ch);
-                DPSsethsbcolor(cur, TEXT_NORM_H, TEXT_NORM_S, TEXT_NORM_B);
-              } else {
-                DPSsethsbcolor(cur, TEXT_BLINK_H, TEXT_BLINK_S, TEXT_BLINK_B);
-              }
-            }
-          } else {  //------------------------------------------------ FG NORMAL
-            color = ch->color & 0x0f;
-            if (ch->attr & 0x40) {
-              color ^= 0x0f;
-            }
-
-            if (color != last_color || ch->attr != last_attr) {
-              last_color = color;
-              last_attr = ch->attr;
-
-              // fprintf(stderr,
-              //         "'%c' FG NORMAL color: %i (%i)"
-              //         " attrs: %i (in:%i sel:%i)"
-              //         " FG: %i BG: %i\n",
-              //         ch->ch, ch->color, l_color,
-              //         ch->attr, l_attr & 0x03, l_attr & 0x40,
-              //         (ch->color & 0x0f), (ch->color>>4));
-
-              if (color == 15 || (ch->attr & 0x40)) {
-                // fprintf(stderr,
-                //         "'%c' \tFG NORMAL: setting TEXT_NORM\n",
-                //         ch->ch);
-                DPSsethsbcolor(cur, TEXT_NORM_H, TEXT_NORM_S, TEXT_NORM_B);
-              } else {
-                set_foreground(cur, last_color, last_attr & 0x03);
-              }
-            }
-          }
-        }
-
-        //--- FONTS & ENCODING
-        if (ch->ch != 0 && ch->ch != 32 && ch->ch != MULTI_CELL_GLYPH) {
-          total_draw++;
-          if ((ch->attr & 3) == 2) {
-            encoding = boldFont_encoding;
-            f = boldFont;
-            if ((ch->color & 0x0f) == 15) {
-              DPSsethsbcolor(cur, TEXT_BOLD_H, TEXT_BOLD_S, TEXT_BOLD_B);
-            }
-          } else {
-            encoding = font_encoding;
-            f = font;
-          }
-          if (f != current_font) {
-            /* ~190 cycles/change */
-            [f set];
-            current_font = f;
-          }
+            // fprintf(stderr,
+            //         "'%c' BG NORMAL color: %i (%i) attrs: %i (in:%i sel:%i)"
+            //         " FG: %i BG: %i\n",
+            //         ch->ch, ch->color, l_color, ch->attr, l_attr & 0x03,(ch->attr & 0x40),
+            //         (ch->color & 0x0f), (ch->color>>4));
 
-          /* we short-circuit utf8 for performance with back-art */
-          /* TODO: short-circuit latin1 too? */
-          if (encoding == NSUTF8StringEncoding) {
-            unichar uch = ch->ch;
-            if (uch >= 0x800) {
-              buf[2] = (uch & 0x3f) | 0x80;
-              uch >>= 6;
-              buf[1] = (uch & 0x3f) | 0x80;
-              uch >>= 6;
-              buf[0] = (uch & 0x0f) | 0xe0;
-              buf[3] = 0;
-            } else if (uch >= 0x80) {
-              buf[1] = (uch & 0x3f) | 0x80;
-              uch >>= 6;
-              buf[0] = (uch & 0x1f) | 0xc0;
-              buf[2] = 0;
-            } else {
-              buf[0] = uch;
-              buf[1] = 0;
+            // Window was resized and added empty chars have no attributes.
+            // Set FG and BG to default values
+            if ((color == 0 && (ch->color >> 4) == 0) && ch->ch == 0) {
+              ch->color = 255;  // default FG/BG
+              last_color = color = ch->color & 0xf0;
             }
-          } else {
-            unichar uch = ch->ch;
-            if (uch <= 0x80) {
-              buf[0] = uch;
-              buf[1] = 0;
+
+            if (ch->attr & 0x40) {  // selection BG
+              // fprintf(stderr, "'%c' \tBG NORMAL: setting WIN_SEL\n", ch->ch);
+              DPSsethsbcolor(cur, WIN_SEL_H, WIN_SEL_S, WIN_SEL_B);
+            } else if ((ch->color >> 4) == 15) {  // default BG
+              // fprintf(stderr, "'%c' \tBG NORMAL: setting WIN_BG\n", ch->ch);
+              DPSsethsbcolor(cur, WIN_BG_H, WIN_BG_S, WIN_BG_B);
             } else {
-              unsigned char *pbuf = (unsigned char *)buf;
-              unsigned int dlen = sizeof(buf) - 1;
-              GSFromUnicode(&pbuf, &dlen, &uch, 1, encoding, NULL, GSUniTerminate);
+              set_background(cur, last_color, last_attr & 0x03, NO);
             }
           }
-          /* ~580 cycles */
-          DPSmoveto(cur, scr_x + fx0, scr_y + fy0);
-          /* baseline here for mc-case 0.65 */
-          /* ~3800 cycles */
-          DPSshow(cur, buf);
-
-          /* ~95 cycles to ARTGState -DPSshow:... */
-          /* ~343 cycles to isEmpty */
-          /* ~593 cycles to currentpoint */
-          /* ~688 cycles to transform */
-          /* ~1152 cycles to FTFont -drawString:... */
-          /* ~1375 cycles to -drawString:... setup */
-          /* ~1968 cycles cmap lookup */
-          /* ~2718 cycles sbit lookup */
-          /* ~~2750 cycles blit setup */
-          /* ~3140 cycles blit loop, empty call */
-          /* ~3140 cycles blit loop, setup */
-          /* ~3325 cycles blit loop, no write */
-          /* ~3800 cycles total */
         }
 
-        //--- UNDERLINE
-        if (ch->attr & 0x4) {
-          DPSrectfill(cur, scr_x, scr_y, fx, 1);
+        if (start_x == -1) {
+          start_x = scr_x;
         }
       }
+
+      if (start_x != -1) {
+        scr_x = ix * fx + border_x;
+        R(start_x, scr_y, scr_x - start_x, fy);
+      }
+    }
+    //------------------- CHARACTERS ------------------------------------------------
+    /* Glyphs wider than cell can't be taken from atlas */
+    if (useCellAtlas && !useMultiCellGlyphs) {
+      [self _drawCellsFromAtlasX0:x0 Y0:y0 X1:x1 Y1:y1];
+    } else {
+      [self _drawGlyphsX0:x0 Y0:y0 X1:x1 Y1:y1];
     }
   }
 
+  //------------------- SEARCH MATCHES --------------------------------------------
+  if (highlightString) {
+    [self _drawHighlights];
+  }
+
   //------------------- CURSOR ----------------------------------------------------
   if (shouldDrawCursor) {
     float x, y;
@@ -873,6 +1206,35 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   ADD_DIRTY(x, y, c, 1);
 }
 
+- (void)ts_putChars:(const screen_char_t *)chars count:(int)c atX:(int)x Y:(int)y
+{
+  int i;
+  screen_char_t *s;
+
+  NSDebugLLog(@"ts", @"putChars: count: %i at: %i:%i", c, x, y);
+
+  if (y < 0 || y >= screen_height) {
+    return;
+  }
+  if (x < 0) {
+    chars -= x;
+    c += x;
+    x = 0;
+  }
+  if (x + c > screen_width) {
+    c = screen_width - x;
+  }
+  if (c <= 0) {
+    return;
+  }
+  s = &SCREEN(x, y);
+  for (i = 0; i < c; i++, s++) {
+    *s = chars[i];
+    s->attr |= 0x80;
+  }
+  ADD_DIRTY(x, y, c, 1);
+}
+
 - (void)ts_putChar:(screen_char_t)ch count:(int)c offset:(int)ofs
 {
   int i;
@@ -976,32 +1338,34 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   NSDebugLLog(@"ts", @"scrollUp: %i:%i  rows: %i  save: %i", top, bottom, rows, save);
 
   if (save && (top == 0) && (bottom == screen_height)) { /* TODO? */
-    int num;
+    int num, i;
 
     if ((curr_sb_depth + rows) > alloc_sb_depth) {
       [self resizeScrollbackBuffer:YES];
     }
 
-    if (rows < alloc_sb_depth) {
-      memmove(scrollback, &scrollback[screen_width * rows],
-              sizeof(screen_char_t) * screen_width * (alloc_sb_depth - rows));
-      num = rows;
-    } else {
-      num = alloc_sb_depth;
-    }
+    /* Only the last alloc_sb_depth of scrolled out lines will survive */
+    num = (rows < alloc_sb_depth) ? rows : alloc_sb_depth;
 
-    if (num < screen_height) {
-      memmove(&scrollback[screen_width * (alloc_sb_depth - num)], screen,
-              num * screen_width * sizeof(screen_char_t));
-    } else {
-      memmove(&scrollback[screen_width * (alloc_sb_depth - num)], screen,
-              screen_height * screen_width * sizeof(screen_char_t));
-      /* TODO: should this use video_erase_char? */
-      memset(&scrollback[screen_width * (alloc_sb_depth - num + screen_height)], 0,
-             screen_width * (num - screen_height) * sizeof(screen_char_t));
+    /* Saving a line costs one line copy regardless of scrollback depth:
+       it's written over the oldest line of the ring. */
+    for (i = rows - num; i < rows; i++) {
+      d = &scrollback[sb_head * screen_width];
+      if (i < screen_height) {
+        memcpy(d, &SCREEN(0, i), screen_width * sizeof(screen_char_t));
+      } else {
+        /* TODO: should this use video_erase_char? */
+        memset(d, 0, screen_width * sizeof(screen_char_t));
+      }
+      if (++sb_head == alloc_sb_depth) {
+        sb_head = 0;
+      }
     }
 
     curr_sb_depth += num;
+    if (curr_sb_depth > alloc_sb_depth) {
+      curr_sb_depth = alloc_sb_depth;
+    }
     if (curr_sb_depth > max_sb_depth) {
       curr_sb_depth = max_sb_depth;
     }
@@ -1287,7 +1651,6 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 
 - (NSString *)_selectionAsString
 {
-  int ofs = alloc_sb_depth * screen_width;
   NSMutableString *mstr;
   NSString *tmp;
   unichar buf[32];
@@ -1305,7 +1668,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     ws_len = 0;
     while (1) {
       if (i < 0)
-        ch = scrollback[ofs + i].ch;
+        ch = SCROLLBACK_CHAR(i).ch;
       else
         ch = screen[i].ch;
 
@@ -1366,7 +1729,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 
 - (void)_setSelection:(struct selection_range)s
 {
-  int i, j, ofs2;
+  int i, j;
 
   if (s.location < -curr_sb_depth * screen_width) {
     s.length += curr_sb_depth * screen_width + s.location;
@@ -1381,15 +1744,13 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   if (s.length == selection.length && s.location == selection.location)
     return;
 
-  ofs2 = alloc_sb_depth * screen_width;
-
   j = selection.location + selection.length;
   if (j > s.location)
     j = s.location;
 
   for (i = selection.location; i < j && i < 0; i++) {
-    scrollback[ofs2 + i].attr &= 0xbf;
-    scrollback[ofs2 + i].attr |= 0x80;
+    SCROLLBACK_CHAR(i).attr &= 0xbf;
+    SCROLLBACK_CHAR(i).attr |= 0x80;
   }
   for (; i < j; i++) {
     screen[i].attr &= 0xbf;
@@ -1401,8 +1762,8 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     i = selection.location;
   j = selection.location + selection.length;
   for (; i < j && i < 0; i++) {
-    scrollback[ofs2 + i].attr &= 0xbf;
-    scrollback[ofs2 + i].attr |= 0x80;
+    SCROLLBACK_CHAR(i).attr &= 0xbf;
+    SCROLLBACK_CHAR(i).attr |= 0x80;
   }
   for (; i < j; i++) {
     screen[i].attr &= 0xbf;
@@ -1412,8 +1773,8 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   i = s.location;
   j = s.location + s.length;
   for (; i < j && i < 0; i++) {
-    if (!(scrollback[ofs2 + i].attr & 0x40))
-      scrollback[ofs2 + i].attr |= 0xc0;
+    if (!(SCROLLBACK_CHAR(i).attr & 0x40))
+      SCROLLBACK_CHAR(i).attr |= 0xc0;
   }
   for (; i < j; i++) {
     if (!(screen[i].attr & 0x40))
@@ -1588,13 +1949,12 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   }
 
   if (g == 2) { /* select words */
-    int ofs = alloc_sb_depth * screen_width;
     unichar ch, ch2;
     NSCharacterSet *cs;
     int i, j;
 
     if (pos < 0)
-      ch = scrollback[ofs + pos].ch;
+      ch = SCROLLBACK_CHAR(pos).ch;
     else
       ch = screen[pos].ch;
     if (ch == 0)
@@ -1623,7 +1983,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     j *= screen_width;
     for (i = pos - 1; i >= j; i--) {
       if (i < 0)
-        ch2 = scrollback[ofs + i].ch;
+        ch2 = SCROLLBACK_CHAR(i).ch;
       else
         ch2 = screen[i].ch;
       if (ch2 == 0)
@@ -1638,7 +1998,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     j += screen_width;
     for (i = pos + 1; i < j; i++) {
       if (i < 0)
-        ch2 = scrollback[ofs + i].ch;
+        ch2 = SCROLLBACK_CHAR(i).ch;
       else
         ch2 = screen[i].ch;
       if (ch2 == 0)
@@ -1743,6 +2103,290 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 
 @end
 
+#pragma mark - Search
+
+//------------------------------------------------------------------------------
+//--- Search in scrollback and screen contents
+//------------------------------------------------------------------------------
+
+@implementation TerminalView (search)
+
+// Character at position `pos` of contents (see stringRepresentation).
+// `sb_chars` is a number of characters in scrollback.
+#define CONTENTS_CHAR(pos)                                                          \
+  (((pos) < sb_chars) ? SCROLLBACK_CHAR((pos) - sb_chars).ch : screen[(pos) - sb_chars].ch)
+
+static inline unichar search_char(unichar ch, BOOL ignoreCase)
+{
+  if (ch == 0) {
+    ch = ' ';
+  }
+  return ignoreCase ? uni_tolower(ch) : ch;
+}
+
+// Literal search for whole match inside `range` without building strings.
+- (NSRange)_findCharacters:(unichar *)pattern
+                    length:(int)plen
+                   inRange:(NSRange)range
+                   options:(NSUInteger)options
+{
+  BOOL ignoreCase = (options & NSCaseInsensitiveSearch) != 0;
+  int sb_chars = curr_sb_depth * screen_width;
+  int first = range.location;
+  int last = NSMaxRange(range) - plen;
+  int step = 1;
+  int pos, k;
+
+  if (plen == 0 || last < first) {
+    return NSMakeRange(NSNotFound, 0);
+  }
+  if (options & NSBackwardsSearch) {
+    pos = first;
+    first = last;
+    last = pos;
+    step = -1;
+  }
+
+  for (pos = first; pos != last + step; pos += step) {
+    for (k = 0; k < plen; k++) {
+      if (search_char(CONTENTS_CHAR(pos + k), ignoreCase) != pattern[k]) {
+        break;
+      }
+    }
+    if (k == plen) {
+      return NSMakeRange(pos, plen);
+    }
+  }
+
+  return NSMakeRange(NSNotFound, 0);
+}
+
+// Regular expression search: every line in `range` is matched separately.
+// Only one line of characters is converted into a string at a time.
+- (NSRange)_findExpression:(NSRegularExpression *)regex
+                   inRange:(NSRange)range
+                   options:(NSUInteger)options
+{
+  int sb_chars = curr_sb_depth * screen_width;
+  int first_row, last_row, row, step;
+  int row_start, lo, hi, i;
+  unichar line[screen_width];
+  NSString *lineString;
+  NSArray *matches;
+  NSRange found = NSMakeRange(NSNotFound, 0);
+
+  if (range.length == 0) {
+    return found;
+  }
+
+  first_row = range.location / screen_width;
+  last_row = (NSMaxRange(range) - 1) / screen_width;
+  step = 1;
+  if (options & NSBackwardsSearch) {
+    row = first_row;
+    first_row = last_row;
+    last_row = row;
+    step = -1;
+  }
+
+  for (row = first_row; row != last_row + step && found.location == NSNotFound; row += step) {
+    row_start = row * screen_width;
+    lo = MAX((int)range.location, row_start) - row_start;
+    hi = MIN((int)NSMaxRange(range), row_start + screen_width) - row_start;
+
+    for (i = 0; i < screen_width; i++) {
+      line[i] = search_char(CONTENTS_CHAR(row_start + i), NO);
+    }
+    lineString = [[NSString alloc] initWithCharactersNoCopy:line
+                                                     length:screen_width
+                                               freeWhenDone:NO];
+    matches = [regex matchesInString:lineString options:0 range:NSMakeRange(lo, hi - lo)];
+    for (NSTextCheckingResult *match in matches) {
+      if ([match range].length == 0) {
+        continue;
+      }
+      found = [match range];
+      found.location += row_start;
+      if (step > 0) {
+        break;  // first match in line
+      }
+    }
+    [lineString release];
+  }
+
+  return found;
+}
+
+// Returns compiled `string` if `options` ask for regular expression search,
+// nil otherwise or if `string` is not a valid expression.
+- (NSRegularExpression *)_expressionForString:(NSString *)string options:(NSUInteger)options
+{
+  NSRegularExpressionOptions reOptions = 0;
+
+  if ((options & NSRegularExpressionSearch) == 0 || string == nil) {
+    return nil;
+  }
+  if (options & NSCaseInsensitiveSearch) {
+    reOptions |= NSRegularExpressionCaseInsensitive;
+  }
+  return [NSRegularExpression regularExpressionWithPattern:string options:reOptions error:NULL];
+}
+
+// `regex` is `string` compiled with _expressionForString:options:
+- (NSRange)_findString:(NSString *)string
+            expression:(NSRegularExpression *)regex
+               inRange:(NSRange)range
+               options:(NSUInteger)options
+{
+  if (options & NSRegularExpressionSearch) {
+    if (regex == nil) {
+      return NSMakeRange(NSNotFound, 0);
+    }
+    return [self _findExpression:regex inRange:range options:options];
+  } else {
+    int plen = [string length];
+    unichar pattern[plen + 1];
+
+    [string getCharacters:pattern];
+    for (int i = 0; i < plen; i++) {
+      pattern[i] = search_char(pattern[i], (options & NSCaseInsensitiveSearch) != 0);
+    }
+    return [self _findCharacters:pattern length:plen inRange:range options:options];
+  }
+}
+
+// Search starts after (or before if backwards) `range` which is usually the
+// last match (selection) and wraps around contents end (or start).
+- (NSRange)rangeOfString:(NSString *)string
+               fromRange:(NSRange)range
+                 options:(NSUInteger)options
+                    wrap:(BOOL)wrap
+{
+  NSUInteger length = (curr_sb_depth + screen_height) * screen_width;
+  NSRegularExpression *regex;
+  NSRange after, before, found;
+
+  if ([string length] == 0) {
+    return NSMakeRange(NSNotFound, 0);
+  }
+  regex = [self _expressionForString:string options:options];
+  if (NSMaxRange(range) > length) {
+    range = NSMakeRange(length, 0);
+  }
+
+  after = NSMakeRange(NSMaxRange(range), length - NSMaxRange(range));
+  before = NSMakeRange(0, range.location);
+
+  if (options & NSBackwardsSearch) {
+    found = [self _findString:string expression:regex inRange:before options:options];
+    if (found.location == NSNotFound && wrap) {
+      found = [self _findString:string expression:regex inRange:after options:options];
+    }
+  } else {
+    found = [self _findString:string expression:regex inRange:after options:options];
+    if (found.location == NSNotFound && wrap) {
+      found = [self _findString:string expression:regex inRange:before options:options];
+    }
+  }
+
+  if (found.location == NSNotFound) {
+    found.length = 0;
+  }
+  return found;
+}
+
+- (void)setHighlightString:(NSString *)string options:(NSUInteger)options
+{
+  options &= ~NSBackwardsSearch;
+  if ([string length] == 0) {
+    string = nil;
+  }
+  if (string == highlightString ||
+      ([string isEqualToString:highlightString] && options == highlightOptions)) {
+    return;
+  }
+  ASSIGN(highlightString, string);
+  highlightOptions = options;
+  ASSIGN(highlightExpression, [self _expressionForString:string options:options]);
+  highlights_valid = NO;
+  [self setNeedsDisplay:YES];
+}
+
+// Changed cells are redrawn anyway, so matches are just looked up again on
+// next drawRect:.
+- (void)_invalidateHighlights
+{
+  highlights_valid = NO;
+}
+
+// Finds all matches in visible part of contents only.
+- (void)_updateHighlights
+{
+  NSRange visible, found;
+  NSUInteger end;
+
+  highlights_count = 0;
+  highlights_valid = YES;
+  if (highlightString == nil) {
+    return;
+  }
+
+  visible.location = (curr_sb_depth + curr_sb_position) * screen_width;
+  visible.length = screen_height * screen_width;
+  end = NSMaxRange(visible);
+
+  while (visible.length > 0) {
+    found = [self _findString:highlightString
+                   expression:highlightExpression
+                      inRange:visible
+                      options:highlightOptions];
+    if (found.location == NSNotFound) {
+      break;
+    }
+    if (highlights_count == highlights_size) {
+      highlights_size = highlights_size ? highlights_size * 2 : 16;
+      highlights = realloc(highlights, highlights_size * sizeof(NSRange));
+    }
+    highlights[highlights_count++] = found;
+    visible.location = NSMaxRange(found);
+    visible.length = end - visible.location;
+  }
+}
+
+// Frames highlighted matches (called from drawRect:)
+- (void)_drawHighlights
+{
+  NSGraphicsContext *gc = GSCurrentContext();
+  int top = (curr_sb_depth + curr_sb_position) * screen_width;
+  int i, pos, end, row, col, len;
+
+  if (highlights_valid == NO) {
+    [self _updateHighlights];
+  }
+  if (highlights_count == 0) {
+    return;
+  }
+
+  DPSsethsbcolor(gc, WIN_SEL_H, WIN_SEL_S, WIN_SEL_B);
+  for (i = 0; i < highlights_count; i++) {
+    pos = highlights[i].location - top;
+    end = pos + highlights[i].length;
+    // Match might span several lines
+    while (pos < end) {
+      row = pos / screen_width;
+      col = pos % screen_width;
+      len = MIN(end - pos, screen_width - col);
+      DPSrectstroke(gc, col * fx + border_x + 0.5,
+                    (screen_height - 1 - row) * fy + border_y + 0.5, len * fx - 1.0, fy - 1.0);
+      pos += len;
+    }
+  }
+}
+
+#undef CONTENTS_CHAR
+
+@end
+
 
 #pragma mark - Input/Output
 
@@ -1754,15 +2398,20 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 
 - (void)readData
 {
-  char buf[256];
-  int size, total, i;
+  int size, total, i, avail;
+  NSTimeInterval now;
 
   total = 0;
   num_scrolls = 0;
-  dirty.x0 = -1;
 
-  current_x = cursor_x;
-  current_y = cursor_y;
+  now = [NSDate timeIntervalSinceReferenceDate];
+  if (frame_pending == NO) {
+    dirty.x0 = -1;
+    current_x = cursor_x;
+    current_y = cursor_y;
+    frame_start = now;
+    frame_bytes = 0;
+  }
 
   // If previous run required update do it again to catch forked subprocess.
   if (shouldUpdateTitlebar != NO) {
@@ -1775,7 +2424,25 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   NSDebugLLog(@"term", @"receiving output");
 
   while (1) {
-    size = read(master_fd, buf, sizeof(buf));
+    if (ioctl(master_fd, FIONREAD, &avail) < 0 || avail < READ_BUF_MIN) {
+      avail = READ_BUF_MIN;
+    } else if (avail > READ_BUF_MAX) {
+      avail = READ_BUF_MAX;
+    }
+    if (avail > read_buf_size) {
+      unsigned char *buf = realloc(read_buf, avail);
+
+      // Out of memory: keep reading with the old buffer
+      if (buf != NULL) {
+        read_buf = buf;
+        read_buf_size = avail;
+      } else if (read_buf == NULL) {
+        NSLog(@"TerminalView: can't allocate read buffer");
+        break;
+      }
+    }
+
+    size = read(master_fd, read_buf, read_buf_size);
     if (size < 0 && errno == EAGAIN)
       break;
 
@@ -1819,29 +2486,39 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
       break;
     }
 
-    for (i = 0; i < size; i++) {
-      [terminalParser processByte:buf[i]];
-      // Line Feed, Vertical Tabulation, Form Feed, Carriage Return
-      if (isActivityMonitorEnabled &&
-          (buf[i] == 10 || buf[i] == 11 || buf[i] == 12 || buf[i] == 13)) {
-        // fprintf(stderr, "%i\n", buf[i]);
-        shouldUpdateTitlebar = YES;
+    // Line Feed, Vertical Tabulation, Form Feed, Carriage Return
+    if (isActivityMonitorEnabled && !shouldUpdateTitlebar) {
+      for (i = 0; i < size; i++) {
+        if (read_buf[i] >= 10 && read_buf[i] <= 13) {
+          shouldUpdateTitlebar = YES;
+          break;
+        }
       }
     }
+    [terminalParser processBytes:read_buf length:size];
     total += size;
+
     /*
       Don't get stuck processing input forever; give other terminal windows
-      and the user a chance to do things. The numbers affect latency versus
-      throughput. High numbers means more input is processed before the
-      screen is updated, leading to higher throughput but also to more
-      'jerky' updates. Low numbers would give smoother updating and less
-      latency, but throughput goes down.
-
-      TODO: tweak more? seems pretty good now
+      and the user a chance to do things.
+
+      With frame pacing input is parsed until the frame deadline: there's no
+      point in updating screen more often than display can show it.
+      Otherwise numbers affect latency versus throughput. High numbers means
+      more input is processed before the screen is updated, leading to
+      higher throughput but also to more 'jerky' updates. Low numbers would
+      give smoother updating and less latency, but throughput goes down.
     */
-    if (total >= 8192 || (num_scrolls + abs(pending_scroll)) > 10)
+    if (frame_interval > 0) {
+      now = [NSDate timeIntervalSinceReferenceDate];
+      if (now - frame_start >= frame_interval) {
+        break;
+      }
+    } else if (total >= 8192 || (num_scrolls + abs(pending_scroll)) > 10) {
       break;
+    }
   }
+  frame_bytes += total;
 
   if (shouldUpdateTitlebar != NO) {
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
@@ -1849,6 +2526,45 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     });
   }
 
+  /* Heavy output drained before the frame deadline: more is coming soon, so
+     postpone redraw to the deadline and combine it with the next reads.
+     Light input (e.g. keystroke echo) is drawn immediately. */
+  if (frame_interval > 0 && master_fd != -1 && total >= READ_BUF_MIN &&
+      (now - frame_start) < frame_interval) {
+    if (frame_pending == NO) {
+      frame_pending = YES;
+      [self performSelector:@selector(_flushFrame)
+                 withObject:nil
+                 afterDelay:frame_interval - (now - frame_start)];
+    }
+    frames_skipped++;
+    return;
+  }
+
+  [self _flushFrame];
+}
+
+// Issues one redraw of everything that changed since the frame start.
+- (void)_flushFrame
+{
+  if (frame_pending != NO) {
+    [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                             selector:@selector(_flushFrame)
+                                               object:nil];
+    frame_pending = NO;
+  }
+  frames_drawn++;
+  [self _invalidateHighlights];
+
+  NSDebugLLog(@"frame", @"frame %lu: %lu bytes parsed in %.1f ms, %lu frames skipped", frames_drawn,
+              frame_bytes, ([NSDate timeIntervalSinceReferenceDate] - frame_start) * 1000.0,
+              frames_skipped);
+
+  // Window could be resized while redraw was postponed
+  if (current_x >= screen_width || current_y >= screen_height) {
+    current_x = cursor_x;
+    current_y = cursor_y;
+  }
   if (cursor_x != current_x || cursor_y != current_y) {
     ADD_DIRTY(current_x, current_y, 1, 1);
     SCREEN(current_x, current_y).attr |= 0x80;
@@ -2198,20 +2914,25 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 //
 // General idea:
 // - initially allocate memory for SCROLLBACK_CHANGE_STEP terminal screens
-// - realloc scrollback buffer by SCROLLBACK_CHANGE_STEP screens until max_sb_depth will be reached
+// - grow scrollback buffer by at least SCROLLBACK_CHANGE_STEP screens (or by its current depth,
+//   whichever is greater) until max_sb_depth will be reached
 // - on window resize or preference change buffer size should be recalculated
 //
 // Grow/shrink minimum step is 1 screen.
 // Depth (_depth in var names) is a number of lines.
 // Size (_size in var names) is a number of characters.
 //
-// Changes: scrollback, alloc_sb_depth. May change curr_sb_depth on buffer shrinking.
+// Buffer is a ring of lines (see SCROLLBACK_LINE). It's unrolled into the new
+// buffer here, so growing step is geometric to keep amortized cost of saved line low.
+//
+// Changes: scrollback, alloc_sb_depth, sb_head. May change curr_sb_depth on buffer shrinking.
 - (BOOL)changeScrollBackBufferDepth:(int)lines
 {
   screen_char_t *new_scrollback;
-  int char_size = sizeof(screen_char_t);
-  int new_sb_depth;  // lines
-  int new_sb_size;   // characters
+  size_t char_size = sizeof(screen_char_t);
+  int new_sb_depth;    // lines
+  size_t new_sb_size;  // bytes
+  int new_sb_head;
 
   // There's nothing to do here
   if (alloc_sb_depth == lines || lines == 0) {
@@ -2224,7 +2945,16 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   } else if ((lines * screen_width) >= SCROLLBACK_MAX) {
     new_sb_depth = SCROLLBACK_MAX / screen_width;
   } else {
-    new_sb_depth = alloc_sb_depth + (screen_height * SCROLLBACK_CHANGE_STEP);
+    int step = screen_height * SCROLLBACK_CHANGE_STEP;
+    int limit = SCROLLBACK_MAX / screen_width;
+
+    if (step < alloc_sb_depth) {
+      step = alloc_sb_depth;
+    }
+    if (step > limit - alloc_sb_depth) {
+      step = limit - alloc_sb_depth;
+    }
+    new_sb_depth = alloc_sb_depth + step;
   }
 
   if (new_sb_depth > max_sb_depth) {
@@ -2241,48 +2971,31 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
             strerror(errno));
       return NO;
     }
+    memset(new_scrollback, 0, new_sb_size);
+    new_sb_head = 0;
   } else {  // Grow or shrink
-    int used_sb_size = char_size * curr_sb_depth * screen_width;
-    int used_sb_start = (char_size * alloc_sb_depth * screen_width) - used_sb_size;
-    screen_char_t *used_sb_copy = malloc(used_sb_size);
-
-    // Save scrollback contents
-    memcpy(used_sb_copy, &scrollback[used_sb_start], used_sb_size);
+    int used_sb_depth = curr_sb_depth;
+    size_t line_size = char_size * screen_width;
 
-    // fprintf(stderr, "==========================================> used_sb_copy: \n");
-    // for (int i = 0; i < (curr_sb_depth * screen_width); i++) {
-    //   fprintf(stderr, "%c", used_sb_copy[i].ch);
-    // }
-    // fprintf(stderr, "<==========================================\n");
-
-    new_scrollback = realloc(scrollback, new_sb_size);
+    new_scrollback = malloc(new_sb_size);
     if (new_scrollback == NULL) {
       NSLog(@"ERROR: failed to re-allocate scrollback buffer to %d lines (error: %s)\n",
             new_sb_depth, strerror(errno));
-      free(used_sb_copy);
       return NO;
     }
     memset(new_scrollback, 0, new_sb_size);
 
-    // Restore scrollback contents
-    int new_sb_offset;
-    int used_sb_offset;
-    
-    if (used_sb_size > new_sb_size) { // Shrink
-      new_sb_offset = 0;
-      used_sb_offset = (used_sb_size / char_size) - (new_sb_size / char_size);
-      used_sb_size = new_sb_size;
-    } else { // Grow
-      new_sb_offset = (new_sb_size / char_size) - (used_sb_size / char_size);
-      used_sb_offset = 0;
+    // On shrink the oldest lines are dropped
+    if (used_sb_depth > new_sb_depth) {
+      used_sb_depth = new_sb_depth;
     }
 
-    // fprintf(stderr, "new_sb_size: %i, used_sb_size: %i, new chars: %lu, used chars: %lu\n",
-    //         new_sb_size, used_sb_size, new_sb_size/sizeof(screen_char_t),
-    //         used_sb_size/sizeof(screen_char_t));
-
-    memcpy(&new_scrollback[new_sb_offset], &used_sb_copy[used_sb_offset], used_sb_size);
-    free(used_sb_copy);
+    // Unroll used part of the ring: oldest kept line goes to line 0.
+    for (int i = 0; i < used_sb_depth; i++) {
+      memcpy(&new_scrollback[i * screen_width], SCROLLBACK_LINE(i - used_sb_depth), line_size);
+    }
+    new_sb_head = used_sb_depth % new_sb_depth;
+    free(scrollback);
   }
 
   // Debugging info
@@ -2296,6 +3009,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 
   scrollback = new_scrollback;
   alloc_sb_depth = new_sb_depth;
+  sb_head = new_sb_head;
 
   // If buffer size shrinks and used buffer greater than allocated scroll bottom
   // to omit crashes and garbage on screen redraw.
@@ -2345,6 +3059,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   [self setAdditionalWordCharacters:[defaults wordCharacters]];
 
   useMultiCellGlyphs = [defaults useMultiCellGlyphs];
+  useCellAtlas = YES;
 
   screen = malloc(sizeof(screen_char_t) * screen_width * screen_height);
   memset(screen, 0, sizeof(screen_char_t) * screen_width * screen_height);
@@ -2367,6 +3082,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   [self setCursorStyle:[defaults cursorStyle]];
 
   isActivityMonitorEnabled = [defaults isActivityMonitorEnabled];
+  frame_interval = [defaults outputFrameInterval] / 1000.0;
 
   return self;
 }
@@ -2400,13 +3116,24 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 
   free(screen);
   free(scrollback);
+  free(read_buf);
   screen = NULL;
   scrollback = NULL;
+  read_buf = NULL;
 
   DESTROY(additionalWordCharacters);
   DESTROY(font);
   DESTROY(boldFont);
 
+  DESTROY(cellAtlas);
+  free(atlas_map);
+  atlas_map = NULL;
+
+  DESTROY(highlightString);
+  DESTROY(highlightExpression);
+  free(highlights);
+  highlights = NULL;
+
   DESTROY(childTerminalName);
   DESTROY(xtermTitle);
   DESTROY(xtermIconTitle);
@@ -2528,7 +3255,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
     // fprintf(stderr, "* iy=%i ny=%i\n", iy, ny);
 
     if (iy < 0) {
-      src = &scrollback[screen_width * (alloc_sb_depth + iy)];
+      src = SCROLLBACK_LINE(iy);
     } else {
       src = &screen[screen_width * iy];
     }
@@ -2565,6 +3292,8 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   free(scrollback);
   screen = nscreen;
   scrollback = new_sb_buffer;
+  sb_head = 0;
+  [self _invalidateHighlights];
 
   if (cursor_x > screen_width) {
     cursor_x = screen_width - 1;
@@ -2620,7 +3349,6 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 // - (NSString *)stringForRange:(struct selection_range)range
 - (NSString *)stringRepresentation
 {
-  int ofs = alloc_sb_depth * screen_width;
   NSMutableString *mstr = [[NSMutableString alloc] init];
   NSString *tmp;
   unichar buf[32];
@@ -2639,7 +3367,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   len = 0;
   for (int i = start_index; i < end_index; i++) {
     if (i < 0) {
-      ch = scrollback[ofs + i].ch;
+      ch = SCROLLBACK_CHAR(i).ch;
     } else {
       ch = screen[i].ch;
     }
@@ -2731,6 +3459,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   NSDebugLLog(@"term", @"Bounding (%g %g)+(%g %g)", -fx0, -fy0, fx, fy);
   NSDebugLLog(@"term", @"Normal font encoding %i", font_encoding);
 
+  [self _invalidateCellAtlas];
   draw_all = 2;
 }
 
@@ -2742,6 +3471,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 
   NSDebugLLog(@"term", @"Bold font encoding %i", boldFont_encoding);
 
+  [self _invalidateCellAtlas];
   draw_all = 2;
 }
 
@@ -2761,6 +3491,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   if (lines == 0) {
     [self clearBuffer:self];
     alloc_sb_depth = 0;
+    sb_head = 0;
     if (scrollback) {
       free(scrollback);
       scrollback = NULL;
@@ -2981,23 +3712,43 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   [self setNeedsDisplay:YES];
 }
 
+// Full screen repaint benchmark: glyph by glyph rendering versus cell atlas.
 - (void)benchmark:(id)sender
 {
-  int i;
-  double t1, t2;
+  int i, pass;
+  double t1, t2, per_redraw[2];
   NSRect r = [self frame];
+  BOOL savedUseCellAtlas = useCellAtlas;
 
-  t1 = [NSDate timeIntervalSinceReferenceDate];
-  total_draw = 0;
-  for (i = 0; i < 100; i++) {
+  for (pass = 0; pass < 2; pass++) {
+    useCellAtlas = (pass == 1);
+    // Warm up: atlas gets filled with cells on screen
     draw_all = 2;
     [self lockFocus];
     [self drawRect:r];
     [self unlockFocusNeedsFlush:NO];
+
+    t1 = [NSDate timeIntervalSinceReferenceDate];
+    total_draw = 0;
+    for (i = 0; i < 100; i++) {
+      draw_all = 2;
+      [self lockFocus];
+      [self drawRect:r];
+      [self unlockFocusNeedsFlush:NO];
+    }
+    t2 = [NSDate timeIntervalSinceReferenceDate];
+    t2 -= t1;
+    per_redraw[pass] = t2 / i;
+    fprintf(stderr, "%-6s %8.4f  %8.5f/redraw   total_draw=%i (%ix%i cells)\n",
+            useCellAtlas ? "atlas" : "glyph", t2, per_redraw[pass], total_draw, screen_width,
+            screen_height);
+  }
+  if (per_redraw[1] > 0) {
+    fprintf(stderr, "speed-up: %.2fx\n", per_redraw[0] / per_redraw[1]);
   }
-  t2 = [NSDate timeIntervalSinceReferenceDate];
-  t2 -= t1;
-  fprintf(stderr, "%8.4f  %8.5f/redraw   total_draw=%i\n", t2, t2 / i, total_draw);
+
+  useCellAtlas = savedUseCellAtlas;
+  [self setNeedsDisplay:YES];
 }
 
 @end
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Measures output throughput (MB/s of piped text) of the Terminal window this
+# script runs in. Scrollback depth is the one set in the window preferences,
+# so run it in windows with different "Scrollback" settings to compare, e.g.:
+#   defaults write Terminal ScrollBackLines 100000
+#
+# Usage: ScrollbackThroughput.sh [megabytes] [line length]
+
+SIZE_MB=${1:-64}
+LINE_LEN=${2:-79}
+
+DATA=$(mktemp /tmp/ScrollbackThroughput.XXXXXX) || exit 1
+trap 'rm -f "$DATA"' EXIT
+
+# Printable lines of fixed length
+awk -v mb="$SIZE_MB" -v len="$LINE_LEN" 'BEGIN {
+  line = "";
+  for (i = 0; i < len; i++) line = line sprintf("%c", 33 + (i % 94));
+  n = int(mb * 1048576 / (len + 1));
+  for (i = 0; i < n; i++) print line;
+}' > "$DATA"
+
+BYTES=$(wc -c < "$DATA")
+DEPTH=$(defaults read Terminal ScrollBackLines 2>/dev/null | awk '{print $NF}')
+
+START=$(date +%s.%N)
+cat "$DATA"
+END=$(date +%s.%N)
+
+clear
+echo "$BYTES $START $END" | awk -v depth="${DEPTH:-default}" '{
+  t = $3 - $2;
+  printf("Scrollback: %s lines\n", depth);
+  printf("Bytes:      %d\n", $1);
+  printf("Time:       %.3f s\n", t);
+  printf("Throughput: %.2f MB/s\n", ($1 / 1048576) / t);
+}'
@@ -225,6 +225,14 @@ APPKIT_EXPORT NSString *NSShellCommandFileType;
 /** Returns an icon of directory in opened state.*/
 - (NSImage *)iconForOpenedDirectory:(NSString *)fullPath;
 
+// ADDON
+/** Returns an icon of directory which has no special icon.*/
+- (NSImage *)folderIcon;
+
+// ADDON
+/** Returns an icon of file which type is unknown.*/
+- (NSImage *)unknownFiletypeIcon;
+
 // ADDON
 /** Gets the applications cache (generated by the make_services tool)
     and looks up the special entry that contains a dictionary of all
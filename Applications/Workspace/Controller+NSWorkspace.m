@@ -52,6 +52,7 @@
 #import "Processes/ProcessManager.h"
 #import "Workspace+WM.h"
 #import "Controller+NSWorkspace.h"
+#import "IconService.h"
 
 #define PosixExecutePermission (0111)
 
@@ -197,6 +198,9 @@ static NSString *_rootPath = @"/";
   [_wrappers retain];
   // NSDebugLLog(@"NSWorkspace", @"Wrappers list: %@(0=%@)", wrappers, [wrappers objectAtIndex:0]);
 
+  // Viewers request icons from background threads
+  [IconService sharedService];
+
   return self;
 }
 
@@ -662,10 +666,7 @@ static NSLock *raceLock = nil;
           }
           image = iconImage;
         } else {
-          if (folderImage == nil) {
-            folderImage = RETAIN([NSImage _standardImageWithName:@"NXFolder"]);
-          }
-          image = folderImage;
+          image = [self folderIcon];
         }
       }
     }
@@ -761,6 +762,21 @@ static NSLock *raceLock = nil;
   return [self iconForFile:fullPath];
 }
 
+// NEXTSPACE addon
+- (NSImage *)folderIcon
+{
+  if (folderImage == nil) {
+    folderImage = RETAIN([NSImage _standardImageWithName:@"NXFolder"]);
+  }
+  return folderImage;
+}
+
+// NEXTSPACE addon
+- (NSImage *)unknownFiletypeIcon
+{
+  return [self _unknownFiletypeImage];
+}
+
 - (NSDictionary *)applicationsForExtension:(NSString *)ext
 {
   NSDictionary *map;
@@ -1355,11 +1371,14 @@ static NSLock *raceLock = nil;
   NSData *data;
   NSDictionary *dict;
   BOOL isAppListChanged = NO;
+  BOOL isExtPreferencesChanged = NO;
 
   // NSLog(@"NSWorkspace: changed path: %@ - %@ (operation: %@)", changedPath,
   //       [aNotification userInfo][@"ChangedFile"], [aNotification userInfo][@"Operations"]);
 
-  if ([_appDirs doesContain:changedPath]) {
+  // Overflow: events were lost, applications may have changed too
+  if ([_appDirs doesContain:changedPath] ||
+      [[aNotification userInfo][@"Operations"] containsObject:@"Overflow"]) {
     [self findApplications];
     isAppListChanged = YES;
   }
@@ -1372,6 +1391,7 @@ static NSLock *raceLock = nil;
       if (data) {
         dict = [NSDeserializer deserializePropertyListFromData:data mutableContainers:NO];
         ASSIGN(_extPreferences, dict);
+        isExtPreferencesChanged = YES;
       }
       [[self fileSystemMonitor] addPath:_extPreferencesPath];
     } else {
@@ -1394,6 +1414,9 @@ static NSLock *raceLock = nil;
   }
   // Invalidate the cache of icons for file extensions.
   [_iconMap removeAllObjects];
+  if (isAppListChanged != NO || isExtPreferencesChanged != NO) {
+    [[IconService sharedService] invalidateIcons];
+  }
 
   // Update inspector info (may be opened at "Tools" section)
   if (inspector != nil && isAppListChanged != NO) {
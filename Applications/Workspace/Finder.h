@@ -57,6 +57,7 @@
 - (NSWindow *)window;
 
 - (void)addResult:(NSString *)resultString;
+- (void)addResults:(NSArray *)results;
 - (void)finishFind;
 
 @end
@@ -30,6 +30,8 @@
 #import <Preferences/Shelf/ShelfPrefs.h>
 
 #import "Finder.h"
+#import "FinderIndex.h"
+#import "FinderContentSearch.h"
 
 //=============================================================================
 // Custom text field
@@ -78,6 +80,11 @@
 }
 @end
 
+// Results are sent to Finder when there are that many of them...
+#define FIND_BATCH_SIZE 64
+// ...or that many seconds passed since the previous batch
+#define FIND_BATCH_DELAY 0.2
+
 //=============================================================================
 // NSOperation to perform search asynchronously
 //=============================================================================
@@ -87,6 +94,12 @@
   NSArray *searchPaths;
   NSRegularExpression *expression;
   BOOL isContentSearch;
+  FinderContentSearch *contentSearch;
+
+  // Results are sent to Finder in batches
+  NSLock *resultsLock;
+  NSMutableArray *results;
+  NSTimeInterval resultsSendTime;
 }
 - (id)initWithFinder:(Finder *)onwer
                paths:(NSArray *)paths
@@ -100,6 +113,8 @@
   NSDebugLLog(@"Memory", @"[FindWorker] -dealloc");
   [searchPaths release];
   [expression release];
+  [resultsLock release];
+  [results release];
   [super dealloc];
 }
 
@@ -116,53 +131,57 @@
     expression = regexp;
     [expression retain];
     isContentSearch = isContent;
+    resultsLock = [[NSLock alloc] init];
+    results = [[NSMutableArray alloc] init];
   }
 
   return self;
 }
 
-- (BOOL)isTextMatched:(NSString *)text
+// May be called from any thread
+- (void)addResult:(NSString *)path
 {
-  NSUInteger matches;
+  [resultsLock lock];
+  [results addObject:path];
+  [resultsLock unlock];
+  [self sendResults:NO];
+}
 
-  matches = [expression numberOfMatchesInString:text options:0 range:NSMakeRange(0, [text length])];
-  if (matches > 0) {
-    return YES;
+// Sends collected results to Finder if there are enough of them or they
+// wait for too long
+- (void)sendResults:(BOOL)force
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSArray *batch = nil;
+
+  [resultsLock lock];
+  if ([self isCancelled]) {
+    // Finder has moved on to another search
+    [results removeAllObjects];
+  } else if ([results count] > 0 && (force || [results count] >= FIND_BATCH_SIZE ||
+                                     now - resultsSendTime >= FIND_BATCH_DELAY)) {
+    batch = [results copy];
+    [results removeAllObjects];
+    resultsSendTime = now;
   }
+  [resultsLock unlock];
 
-  return NO;
+  if (batch) {
+    [finder performSelectorOnMainThread:@selector(addResults:) withObject:batch waitUntilDone:NO];
+    [batch release];
+  }
 }
 
-- (BOOL)isFileMatched:(NSString *)filePath
+- (BOOL)isTextMatched:(NSString *)text
 {
-  BOOL isMatched = NO;
-  NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:filePath];
-  NSData *dataChunk;
-  NSString *text;
-  // NSUInteger   patternLength = [[expression pattern] length];
-  NSUInteger offset;
-
-  // NSDebugLLog(@"Finder", @"Search for contents in file:%@", filePath);
-
-  dataChunk = [handle readDataOfLength:1024 * 1024];
-  while ([dataChunk length] > 0) {
-    text = [[NSString alloc] initWithData:dataChunk encoding:NSUTF8StringEncoding];
-    [text autorelease];
-    if ([self isTextMatched:text]) {
-      isMatched = YES;
-      break;
-    }
-    // Step down on the pattern length to omit cases when search string
-    // is located across the chunks of data read.
-    // offset = [handle offsetInFile];
-    // if (offset )
-    // [handle seekToFileOffset:offset-patternLength];
+  NSUInteger matches;
 
-    dataChunk = [handle readDataOfLength:1024 * 1024];
+  matches = [expression numberOfMatchesInString:text options:0 range:NSMakeRange(0, [text length])];
+  if (matches > 0) {
+    return YES;
   }
 
-  [handle closeFile];
-  return isMatched;
+  return NO;
 }
 
 - (void)findInDirectory:(NSString *)dirPath
@@ -179,6 +198,8 @@
   dirContents = [fm directoryContentsAtPath:dirPath forPath:nil showHidden:[fm isShowHiddenFiles]];
   itemFormat = ([dirPath isEqualToString:@"/"] == NO) ? @"%@/%@" : @"%@%@";
 
+  [self sendResults:NO];
+
   for (NSString *item in dirContents) {
     if ([self isCancelled]) {
       break;
@@ -191,28 +212,79 @@
       if ([[attrs fileType] isEqualToString:NSFileTypeDirectory] != NO) {
         [self findInDirectory:itemPath];
       } else if (isContentSearch != NO) {
-        if ([self isFileMatched:itemPath]) {
-          [finder performSelectorOnMainThread:@selector(addResult:)
-                                   withObject:itemPath
-                                waitUntilDone:NO];
-        }
+        [contentSearch addFile:itemPath];
       }
       if (isContentSearch == NO && [self isTextMatched:item]) {
-        [finder performSelectorOnMainThread:@selector(addResult:)
-                                 withObject:itemPath
-                              waitUntilDone:NO];
+        [self addResult:itemPath];
       }
     }
   }
 }
 
+// Returns NO if `path` is not indexed yet
+- (BOOL)findInIndexedPath:(NSString *)path
+{
+  OSEFileManager *fm = [OSEFileManager defaultManager];
+  NSArray *found, *unindexed = nil;
+
+  found = [[FinderIndex sharedIndex] pathsMatching:expression
+                                               inPath:path
+                                           showHidden:[fm isShowHiddenFiles]
+                                            unindexed:&unindexed
+                                            operation:self];
+  if (found == nil) {
+    return NO;
+  }
+
+  NSDebugLLog(@"Finder", @"[Finder] %lu indexed results in %@, %lu directories to walk",
+              [found count], path, [unindexed count]);
+  [resultsLock lock];
+  [results addObjectsFromArray:found];
+  [resultsLock unlock];
+  [self sendResults:YES];
+
+  for (NSString *dirPath in unindexed) {
+    if ([self isCancelled]) {
+      break;
+    }
+    [self findInDirectory:dirPath];
+  }
+
+  return YES;
+}
+
 - (void)main
 {
   NSDebugLLog(@"Finder", @"[Finder] will search contents: %@", isContentSearch ? @"Yes" : @"No");
 
+  if (isContentSearch != NO && expression != nil) {
+    contentSearch = [[FinderContentSearch alloc] initWithExpression:expression
+                                                             target:self
+                                                             action:@selector(addResult:)];
+  }
+
   for (NSString *path in searchPaths) {
+    if ([self isCancelled]) {
+      break;
+    }
+    if (isContentSearch == NO && expression != nil && [self findInIndexedPath:path] != NO) {
+      continue;
+    }
     [self findInDirectory:path];
   }
+
+  if (contentSearch != nil) {
+    // Files are searched by content search threads
+    while ([contentSearch waitUntilFinishedBeforeDate:[NSDate dateWithTimeIntervalSinceNow:FIND_BATCH_DELAY]] == NO) {
+      if ([self isCancelled]) {
+        [contentSearch cancel];
+      }
+      [self sendResults:NO];
+    }
+    [contentSearch release];
+    contentSearch = nil;
+  }
+  [self sendResults:YES];
 }
 
 - (BOOL)isReady
@@ -232,6 +304,10 @@
     operationQ = [[NSOperationQueue alloc] init];
   }
 
+  if ([[findScopeButton selectedItem] tag] == 0) {
+    [[FinderIndex sharedIndex] prepareForPaths:searchPaths];
+  }
+
   worker = [[FindWorker alloc] initWithFinder:self
                                         paths:searchPaths
                                    expression:regexp
@@ -444,20 +520,31 @@
 
 - (void)addResult:(NSString *)resultString
 {
-  [variantList addObject:resultString];
+  [self addResults:[NSArray arrayWithObject:resultString]];
+}
+
+- (void)addResults:(NSArray *)results
+{
+  NSMatrix *matrix = [resultList matrixInColumn:0];
+  NSBrowserCell *cell;
+
+  if ([results count] == 0) {
+    return;
+  }
+
+  [variantList addObjectsFromArray:results];
   [resultsFound setStringValue:[NSString stringWithFormat:@"%lu found", [variantList count]]];
-  if ([variantList count] == 1) {
+  if ([variantList count] == [results count]) {
     [resultList reloadColumn:0];
   } else {
-    NSBrowserCell *cell;
-    NSMatrix *matrix = [resultList matrixInColumn:0];
-
-    [matrix addRow];
-    cell = [matrix cellAtRow:[matrix numberOfRows] - 1 column:0];
-    [cell setLeaf:YES];
-    [cell setRefusesFirstResponder:YES];
-    [cell setTitle:resultString];
-    [cell setLoaded:YES];
+    for (NSString *resultString in results) {
+      [matrix addRow];
+      cell = [matrix cellAtRow:[matrix numberOfRows] - 1 column:0];
+      [cell setLeaf:YES];
+      [cell setRefusesFirstResponder:YES];
+      [cell setTitle:resultString];
+      [cell setLoaded:YES];
+    }
     [resultList displayColumn:0];
   }
 }
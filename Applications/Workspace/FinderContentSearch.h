@@ -0,0 +1,64 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2026 NEXTSPACE Team
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Search of regular expression in contents of files.
+//
+// Files are added by the thread which walks directories and searched by a
+// pool of threads. Each file is read in chunks of 4 MiB; files with NUL
+// bytes in the first 8 KiB are binary and skipped. Chunks overlap by 64 KiB,
+// so any match shorter than that is found wherever it is in the file. Before
+// expression runs on a chunk, the chunk is scanned for the longest literal
+// part of expression: ASCII text without it can't match. Text which is not
+// valid UTF-8 is read as Latin-1.
+
+#import <Foundation/Foundation.h>
+
+@interface FinderContentSearch : NSObject
+{
+  NSRegularExpression *expression;
+  id target;
+  SEL action;
+
+  char literal[256];  // lowercased, empty if expression has no literal part
+  size_t literalLength;
+
+  NSCondition *condition;
+  NSMutableArray *files;
+  NSUInteger threadCount;
+  BOOL isFinishing;
+  volatile BOOL isCancelled;
+}
+
+// Starts search threads. `action` of `target` is called with path of every
+// matched file on search threads.
+- (id)initWithExpression:(NSRegularExpression *)regexp target:(id)object action:(SEL)selector;
+
+// Queues file for search. Waits if too many files are queued already.
+- (void)addFile:(NSString *)path;
+
+// Stops search: queued files are not searched.
+- (void)cancel;
+
+// Tells there will be no more files and waits until queued files are
+// searched or `date` comes. Returns YES if search is finished.
+- (BOOL)waitUntilFinishedBeforeDate:(NSDate *)date;
+
+@end
@@ -0,0 +1,373 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2026 NEXTSPACE Team
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#import "FinderIndex.h"
+#import "FinderContentSearch.h"
+
+#define FC_CHUNK_SIZE (4 * 1024 * 1024)
+#define FC_OVERLAP (64 * 1024)
+#define FC_BINARY_CHECK_SIZE 8192
+#define FC_MAX_QUEUED 1024
+#define FC_MAX_THREADS 8
+
+static inline unsigned char fc_lower(unsigned char c)
+{
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline int fc_is_alpha(unsigned char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static int fc_equal(const unsigned char *data, const unsigned char *literal, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    if (fc_lower(data[i]) != literal[i])
+      return 0;
+  }
+  return 1;
+}
+
+// Returns 1 if `data` contains lowercase `literal` of `len` > 1 bytes
+// ignoring ASCII case. Blocks of 16 positions are tested for the first and
+// the last byte of literal at once, the rest is compared on positions where
+// both match.
+static int fc_contains(const unsigned char *data, size_t size, const unsigned char *literal,
+                       size_t len)
+{
+  size_t i = 0;
+
+  if (size < len)
+    return 0;
+
+#ifdef __SSE2__
+  {
+    const __m128i first = _mm_set1_epi8(literal[0]);
+    const __m128i last = _mm_set1_epi8(literal[len - 1]);
+    // Setting bit 5 lowercases letters and only them compare equal then
+    const __m128i first_fold = _mm_set1_epi8(fc_is_alpha(literal[0]) ? 0x20 : 0);
+    const __m128i last_fold = _mm_set1_epi8(fc_is_alpha(literal[len - 1]) ? 0x20 : 0);
+
+    for (; i + len - 1 + 16 <= size; i += 16) {
+      __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + i)), first_fold);
+      __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + i + len - 1)), last_fold);
+      unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                      _mm_cmpeq_epi8(b, last)));
+
+      while (mask) {
+        unsigned bit = __builtin_ctz(mask);
+
+        if (fc_equal(data + i + bit + 1, literal + 1, len - 2))
+          return 1;
+        mask &= mask - 1;
+      }
+    }
+  }
+#endif
+
+  for (; i + len <= size; i++) {
+    if (fc_lower(data[i]) == literal[0] && fc_equal(data + i + 1, literal + 1, len - 1))
+      return 1;
+  }
+  return 0;
+}
+
+static int fc_is_ascii(const unsigned char *data, size_t size)
+{
+  uint64_t bits = 0, word;
+  size_t i = 0;
+
+  for (; i + 8 <= size; i += 8) {
+    memcpy(&word, data + i, 8);
+    bits |= word;
+  }
+  for (; i < size; i++)
+    bits |= data[i];
+
+  return (bits & 0x8080808080808080ULL) == 0;
+}
+
+// Moves `offset` back to the start of line or, if line is too long, to the
+// start of UTF-8 character
+static size_t fc_boundary(const unsigned char *data, size_t offset)
+{
+  size_t limit = (offset > FC_OVERLAP / 2) ? offset - FC_OVERLAP / 2 : 0;
+  size_t i;
+
+  for (i = offset; i > limit; i--) {
+    if (data[i - 1] == '\n')
+      return i;
+  }
+  while (offset > 0 && (data[offset] & 0xc0) == 0x80)
+    offset--;
+  return offset;
+}
+
+// Reads `size` bytes from `offset` or less at the end of file. Returns
+// number of bytes read or -1 on error.
+static ssize_t fc_read(int fd, unsigned char *buffer, size_t size, off_t offset)
+{
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < size) {
+    n = pread(fd, buffer + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0)
+      break;
+    done += n;
+  }
+  return done;
+}
+
+@implementation FinderContentSearch
+
+- (void)dealloc
+{
+  NSDebugLLog(@"Memory", @"[FinderContentSearch] -dealloc");
+  [expression release];
+  [target release];
+  [condition release];
+  [files release];
+  [super dealloc];
+}
+
+- (id)initWithExpression:(NSRegularExpression *)regexp target:(id)object action:(SEL)selector
+{
+  char literals[FI_MAX_LITERALS][FI_MAX_LITERAL];
+  NSUInteger i;
+  int count, l;
+
+  if ((self = [super init]) == nil) {
+    return nil;
+  }
+
+  expression = [regexp retain];
+  target = [object retain];
+  action = selector;
+  condition = [[NSCondition alloc] init];
+  files = [[NSMutableArray alloc] init];
+
+  // Prefilter with the longest ASCII run of literal parts. Non-ASCII
+  // characters may match differently-encoded text ignoring case.
+  count = FIRequiredLiterals([[expression pattern] UTF8String], literals, FI_MAX_LITERALS);
+  for (l = 0; l < count; l++) {
+    size_t start = 0, len;
+
+    for (len = 0;; len++) {
+      unsigned char c = literals[l][len];
+
+      if (c == '\0' || c >= 0x80) {
+        if (len - start > literalLength) {
+          literalLength = len - start;
+          for (i = 0; i < literalLength; i++) {
+            literal[i] = fc_lower(literals[l][start + i]);
+          }
+        }
+        start = len + 1;
+      }
+      if (c == '\0') {
+        break;
+      }
+    }
+  }
+  if (literalLength < 2) {
+    literalLength = 0;
+  }
+  literal[literalLength] = '\0';
+
+  threadCount = [[NSProcessInfo processInfo] activeProcessorCount];
+  threadCount = MAX(1, MIN(threadCount, FC_MAX_THREADS));
+  for (i = 0; i < threadCount; i++) {
+    [NSThread detachNewThreadSelector:@selector(searchThread:) toTarget:self withObject:nil];
+  }
+
+  NSDebugLLog(@"Finder", @"[FinderContentSearch] %lu threads, prefilter: '%s'", threadCount,
+              literal);
+
+  return self;
+}
+
+- (void)addFile:(NSString *)path
+{
+  [condition lock];
+  while ([files count] >= FC_MAX_QUEUED && !isCancelled) {
+    [condition wait];
+  }
+  if (!isCancelled) {
+    [files addObject:path];
+    [condition broadcast];
+  }
+  [condition unlock];
+}
+
+- (void)cancel
+{
+  [condition lock];
+  isCancelled = YES;
+  [files removeAllObjects];
+  [condition broadcast];
+  [condition unlock];
+}
+
+- (BOOL)waitUntilFinishedBeforeDate:(NSDate *)date
+{
+  BOOL isFinished;
+
+  [condition lock];
+  if (!isFinishing) {
+    isFinishing = YES;
+    [condition broadcast];
+  }
+  while (threadCount > 0 && [condition waitUntilDate:date])
+    ;
+  isFinished = (threadCount == 0);
+  [condition unlock];
+
+  return isFinished;
+}
+
+- (BOOL)isMatchedText:(const unsigned char *)data length:(size_t)length
+{
+  NSString *text;
+  BOOL isMatched;
+
+  if (literalLength > 0 && !fc_contains(data, length, (const unsigned char *)literal, literalLength) &&
+      fc_is_ascii(data, length)) {
+    return NO;
+  }
+
+  text = [[NSString alloc] initWithBytes:data length:length encoding:NSUTF8StringEncoding];
+  if (text == nil) {
+    text = [[NSString alloc] initWithBytes:data length:length encoding:NSISOLatin1StringEncoding];
+  }
+  isMatched = ([expression rangeOfFirstMatchInString:text
+                                             options:0
+                                               range:NSMakeRange(0, [text length])]
+                   .location != NSNotFound);
+  [text release];
+
+  return isMatched;
+}
+
+- (BOOL)isMatchedFile:(NSString *)path buffer:(unsigned char *)buffer
+{
+  struct stat st;
+  off_t offset;
+  size_t length, remains, want, end, keep;
+  ssize_t n;
+  BOOL isLast, isMatched = NO;
+  int fd;
+
+  // Don't block on FIFOs and devices
+  if ((fd = open([path fileSystemRepresentation], O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0) {
+    return NO;
+  }
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return NO;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  // Buffer holds `length` bytes of file from `offset`. Next chunk starts at
+  // least FC_OVERLAP bytes before the end of previous.
+  for (offset = 0, length = 0; !isCancelled; offset += keep, length -= keep) {
+    remains = st.st_size - offset - length;
+    want = MIN(FC_CHUNK_SIZE - length, remains);
+    if ((n = fc_read(fd, buffer + length, want, offset + length)) < 0) {
+      break;
+    }
+    // File may be truncated while it's read
+    isLast = (want == remains || (size_t)n < want);
+    length += n;
+
+    if (offset == 0 && memchr(buffer, '\0', MIN(length, FC_BINARY_CHECK_SIZE)) != NULL) {
+      break;
+    }
+
+    end = isLast ? length : fc_boundary(buffer, length - 1);
+    if ([self isMatchedText:buffer length:end]) {
+      isMatched = YES;
+      break;
+    }
+    if (isLast) {
+      break;
+    }
+    keep = fc_boundary(buffer, end - FC_OVERLAP);
+    memmove(buffer, buffer + keep, length - keep);
+  }
+  close(fd);
+
+  return isMatched;
+}
+
+- (void)searchThread:(id)arg
+{
+  NSAutoreleasePool *pool;
+  NSString *path;
+  unsigned char *buffer = malloc(FC_CHUNK_SIZE);
+
+  while (1) {
+    pool = [[NSAutoreleasePool alloc] init];
+
+    [condition lock];
+    while ([files count] == 0 && !isFinishing && !isCancelled) {
+      [condition wait];
+    }
+    if ([files count] == 0 || isCancelled) {
+      threadCount--;
+      [condition broadcast];
+      [condition unlock];
+      [pool release];
+      break;
+    }
+    path = [[files objectAtIndex:0] retain];
+    [files removeObjectAtIndex:0];
+    [condition broadcast];
+    [condition unlock];
+
+    if (buffer != NULL && [self isMatchedFile:path buffer:buffer] && !isCancelled) {
+      [target performSelector:action withObject:path];
+    }
+    [path release];
+    [pool release];
+  }
+  free(buffer);
+}
+
+@end
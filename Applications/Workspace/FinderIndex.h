@@ -0,0 +1,67 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2026 NEXTSPACE Team
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Index of file names under directories searched by Finder.
+//
+// Index of each root directory is built in background and saved into
+// ~/Library/Workspace/FinderIndex as a file which is memory-mapped for
+// queries. Names are found by trigrams of literal parts of regular expression
+// and checked with the expression itself. Files created after the index was
+// built are taken from OSEFileSystemMonitor events; found files are checked
+// for existence, so removed ones are not reported. Directories on other file
+// systems and directories created after the index was built are returned to
+// caller to be searched the usual way.
+
+#import <Foundation/Foundation.h>
+
+#define FI_MAX_LITERALS 8
+#define FI_MAX_LITERAL 256
+
+// Collects literal strings of 3 and more bytes every match of regular
+// expression `re` must contain (ignoring case). Returns their number, 0 if
+// there are none or expression is too complex to tell.
+int FIRequiredLiterals(const char *re, char literals[][FI_MAX_LITERAL], int max);
+
+@interface FinderIndex : NSObject
+{
+  NSString *indexDirectory;
+  NSMutableDictionary *roots;  // root path -> FinderIndexRoot
+  NSOperationQueue *buildQueue;
+  NSLock *lock;
+}
+
++ (FinderIndex *)sharedIndex;
+
+// Loads saved indexes for `paths` or starts building them. Adds indexed roots
+// to file system monitor. Must be called on main thread.
+- (void)prepareForPaths:(NSArray *)paths;
+
+// Returns paths of files and directories under `path` which names match
+// `expression`, or nil if `path` is not indexed yet. `unindexedPaths` is set
+// to directories under `path` the index knows nothing about.
+// May be called from any thread.
+- (NSArray *)pathsMatching:(NSRegularExpression *)expression
+                    inPath:(NSString *)path
+                showHidden:(BOOL)showHidden
+                 unindexed:(NSArray **)unindexedPaths
+                 operation:(NSOperation *)operation;
+
+@end
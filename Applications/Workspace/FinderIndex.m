@@ -0,0 +1,1281 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2026 NEXTSPACE Team
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#import <AppKit/AppKit.h>
+#import <SystemKit/OSEFileSystemMonitor.h>
+
+#import "Controller.h"
+#import "FinderIndex.h"
+
+//=============================================================================
+// Index file
+//=============================================================================
+// File contains header, root path, entries (one for each file and directory
+// in walk order, parents before children), trigram table sorted by trigram,
+// postings (entry numbers for each trigram, ascending) and names of entries.
+// Numbers are in host byte order: index is never shared between machines.
+
+#define FI_MAGIC "WSFINDX1"
+#define FI_VERSION 1
+#define FI_NO_PARENT 0xffffffff
+#define FI_MAX_DEPTH 256
+
+// Index older than that is rebuilt in background on the next search...
+#define FI_MAX_AGE (60 * 60)
+// ...as well as index with that many files created since it was built
+#define FI_MAX_ADDED 1024
+
+enum {
+  FIDirectory = 1 << 0,
+  FIHidden = 1 << 1,      // name starts with '.' or is listed in .hidden
+  FIMountPoint = 1 << 2,  // directory on other file system, contents are not indexed
+};
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t trigram_count;
+  uint32_t posting_count;
+  uint32_t names_size;
+  uint32_t root_size;
+  double build_time;  // seconds since 1970
+  uint64_t root_offset;
+  uint64_t entries_offset;
+  uint64_t trigrams_offset;
+  uint64_t postings_offset;
+  uint64_t names_offset;
+} FIHeader;
+
+typedef struct {
+  uint32_t parent;  // FI_NO_PARENT for contents of root
+  uint32_t name;    // offset in names
+  uint32_t flags;
+} FIEntry;
+
+typedef struct {
+  uint32_t trigram;
+  uint32_t first;  // in postings
+  uint32_t count;
+} FITrigram;
+
+typedef struct {
+  void *base;
+  size_t size;
+  const FIHeader *header;
+  const char *root;
+  const FIEntry *entries;
+  const FITrigram *trigrams;
+  const uint32_t *postings;
+  const char *names;
+} FIMap;
+
+// Folds name for trigrams: ASCII is lowercased, any other character becomes
+// single 0x80 byte. Characters which match ASCII letters case-insensitively
+// are folded to these letters.
+static size_t fi_fold(const char *name, size_t len, unsigned char *out)
+{
+  const unsigned char *s = (const unsigned char *)name;
+  size_t i = 0, n = 0;
+
+  while (i < len) {
+    if (s[i] < 0x80) {
+      out[n++] = (s[i] >= 'A' && s[i] <= 'Z') ? s[i] + ('a' - 'A') : s[i];
+      i++;
+      continue;
+    }
+    if (i + 1 < len && s[i] == 0xc5 && s[i + 1] == 0xbf) {
+      out[n++] = 's';  // LATIN SMALL LETTER LONG S
+    } else if (i + 2 < len && s[i] == 0xe2 && s[i + 1] == 0x84 && s[i + 2] == 0xaa) {
+      out[n++] = 'k';  // KELVIN SIGN
+    } else {
+      out[n++] = 0x80;
+    }
+    for (i++; i < len && (s[i] & 0xc0) == 0x80; i++)
+      ;
+  }
+
+  return n;
+}
+
+static inline uint32_t fi_trigram(const unsigned char *s)
+{
+  return (s[0] << 16) | (s[1] << 8) | s[2];
+}
+
+// --- Building
+
+typedef struct {
+  FIEntry *entries;
+  uint32_t entry_count;
+  uint32_t entry_cap;
+  char *names;
+  size_t names_size;
+  size_t names_cap;
+  dev_t dev;
+  int failed;
+} FIBuilder;
+
+static uint32_t fi_add_entry(FIBuilder *b, uint32_t parent, const char *name, uint32_t flags)
+{
+  size_t len = strlen(name) + 1;
+  void *tmp;
+
+  if (b->entry_count == b->entry_cap) {
+    uint32_t cap = b->entry_cap ? b->entry_cap * 2 : 4096;
+
+    if (cap >= FI_NO_PARENT || !(tmp = realloc(b->entries, cap * sizeof(FIEntry)))) {
+      b->failed = 1;
+      return FI_NO_PARENT;
+    }
+    b->entries = tmp;
+    b->entry_cap = cap;
+  }
+  if (b->names_size + len > b->names_cap) {
+    size_t cap = b->names_cap ? b->names_cap * 2 : 64 * 1024;
+
+    if (cap > UINT32_MAX || !(tmp = realloc(b->names, cap))) {
+      b->failed = 1;
+      return FI_NO_PARENT;
+    }
+    b->names = tmp;
+    b->names_cap = cap;
+  }
+
+  memcpy(b->names + b->names_size, name, len);
+  b->entries[b->entry_count].parent = parent;
+  b->entries[b->entry_count].name = b->names_size;
+  b->entries[b->entry_count].flags = flags;
+  b->names_size += len;
+
+  return b->entry_count++;
+}
+
+// Marks entries from `first` listed in .hidden file of directory `fd`
+static void fi_mark_hidden(FIBuilder *b, int fd, uint32_t first)
+{
+  char buf[16 * 1024], *line, *next;
+  ssize_t len;
+  uint32_t i;
+  int hfd;
+
+  if ((hfd = openat(fd, ".hidden", O_RDONLY | O_CLOEXEC)) < 0)
+    return;
+  len = read(hfd, buf, sizeof(buf) - 1);
+  close(hfd);
+  if (len <= 0)
+    return;
+  buf[len] = '\0';
+
+  for (line = buf; line && *line; line = next) {
+    if ((next = strchr(line, '\n')) != NULL)
+      *next++ = '\0';
+    for (i = first; i < b->entry_count; i++) {
+      if (!strcmp(b->names + b->entries[i].name, line))
+        b->entries[i].flags |= FIHidden;
+    }
+  }
+}
+
+// Adds contents of directory `fd` (entry `dir`) and its subdirectories
+static void fi_walk(FIBuilder *b, int fd, uint32_t dir, int depth)
+{
+  DIR *d;
+  struct dirent *de;
+  struct stat st;
+  uint32_t first, last, i, flags;
+  int dfd, child, type;
+
+  if ((dfd = dup(fd)) < 0)
+    return;
+  if ((d = fdopendir(dfd)) == NULL) {
+    close(dfd);
+    return;
+  }
+
+  first = b->entry_count;
+  while ((de = readdir(d)) != NULL && !b->failed) {
+    const char *name = de->d_name;
+
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+      continue;
+
+    flags = (name[0] == '.') ? FIHidden : 0;
+    type = de->d_type;
+    if (type == DT_UNKNOWN || type == DT_DIR) {
+      if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+        continue;
+      if (S_ISDIR(st.st_mode)) {
+        type = DT_DIR;
+        flags |= FIDirectory;
+        if (st.st_dev != b->dev)
+          flags |= FIMountPoint;
+      } else if (S_ISLNK(st.st_mode)) {
+        type = DT_LNK;
+      }
+    }
+    // Finder doesn't follow nor report symbolic links
+    if (type == DT_LNK)
+      continue;
+
+    fi_add_entry(b, dir, name, flags);
+  }
+  closedir(d);
+  last = b->entry_count;
+
+  fi_mark_hidden(b, fd, first);
+
+  for (i = first; i < last && !b->failed; i++) {
+    if ((b->entries[i].flags & (FIDirectory | FIMountPoint)) != FIDirectory || depth >= FI_MAX_DEPTH)
+      continue;
+    child = openat(fd, b->names + b->entries[i].name,
+                   O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (child < 0)
+      continue;
+    fi_walk(b, child, i, depth + 1);
+    close(child);
+  }
+}
+
+static int fi_compare_pairs(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static int fi_write_region(FILE *f, uint64_t *offset, const void *data, size_t size)
+{
+  static const char zeros[8];
+  size_t pad = (8 - *offset % 8) % 8;
+
+  if (pad && fwrite(zeros, 1, pad, f) != pad)
+    return -1;
+  *offset += pad;
+  if (size && fwrite(data, 1, size, f) != size)
+    return -1;
+  *offset += size;
+
+  return 0;
+}
+
+// Writes index of `b` built from `root` into `path`. Returns 0 on success.
+static int fi_write(FIBuilder *b, const char *root, const char *path, double build_time)
+{
+  unsigned char folded[1024];
+  uint64_t *pairs = NULL;
+  size_t pair_count = 0, pair_cap = 0, n, j, k;
+  FITrigram *trigrams = NULL;
+  uint32_t *postings = NULL;
+  uint32_t trigram_count = 0, posting_count = 0, i;
+  FIHeader header;
+  uint64_t offset;
+  char tmp_path[PATH_MAX];
+  FILE *f;
+  int ret = -1;
+
+  // (trigram, entry) pairs sorted and without duplicates make the postings
+  for (i = 0; i < b->entry_count; i++) {
+    const char *name = b->names + b->entries[i].name;
+
+    n = fi_fold(name, strlen(name), folded);
+    for (j = 0; j + 2 < n; j++) {
+      if (pair_count == pair_cap) {
+        void *tmp;
+
+        pair_cap = pair_cap ? pair_cap * 2 : 64 * 1024;
+        if (!(tmp = realloc(pairs, pair_cap * sizeof(uint64_t))))
+          goto out;
+        pairs = tmp;
+      }
+      pairs[pair_count++] = ((uint64_t)fi_trigram(folded + j) << 32) | i;
+    }
+  }
+  if (pair_count > 0)
+    qsort(pairs, pair_count, sizeof(uint64_t), fi_compare_pairs);
+
+  for (j = 0, k = 0; j < pair_count; j++) {
+    if (j > 0 && pairs[j] == pairs[k - 1])
+      continue;
+    pairs[k++] = pairs[j];
+    if (k == 1 || (pairs[k - 1] >> 32) != (pairs[k - 2] >> 32))
+      trigram_count++;
+  }
+  pair_count = k;
+  if (pair_count >= UINT32_MAX)
+    goto out;
+
+  trigrams = malloc((trigram_count ? trigram_count : 1) * sizeof(FITrigram));
+  postings = malloc((pair_count ? pair_count : 1) * sizeof(uint32_t));
+  if (!trigrams || !postings)
+    goto out;
+  for (j = 0, trigram_count = 0; j < pair_count; j++) {
+    uint32_t trigram = pairs[j] >> 32;
+
+    if (trigram_count == 0 || trigrams[trigram_count - 1].trigram != trigram) {
+      trigrams[trigram_count].trigram = trigram;
+      trigrams[trigram_count].first = j;
+      trigrams[trigram_count].count = 0;
+      trigram_count++;
+    }
+    trigrams[trigram_count - 1].count++;
+    postings[posting_count++] = pairs[j] & 0xffffffff;
+  }
+  free(pairs);
+  pairs = NULL;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FI_MAGIC, sizeof(header.magic));
+  header.version = FI_VERSION;
+  header.entry_count = b->entry_count;
+  header.trigram_count = trigram_count;
+  header.posting_count = posting_count;
+  header.names_size = b->names_size;
+  header.root_size = strlen(root) + 1;
+  header.build_time = build_time;
+
+  // Region offsets are 8-byte aligned
+#define FI_ALIGN(x) (((x) + 7) & ~(uint64_t)7)
+  header.root_offset = FI_ALIGN(sizeof(header));
+  header.entries_offset = FI_ALIGN(header.root_offset + header.root_size);
+  header.trigrams_offset = FI_ALIGN(header.entries_offset + b->entry_count * sizeof(FIEntry));
+  header.postings_offset = FI_ALIGN(header.trigrams_offset + trigram_count * sizeof(FITrigram));
+  header.names_offset = FI_ALIGN(header.postings_offset + posting_count * sizeof(uint32_t));
+#undef FI_ALIGN
+
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path))
+    goto out;
+  if ((f = fopen(tmp_path, "w")) == NULL)
+    goto out;
+  offset = 0;
+  if (fi_write_region(f, &offset, &header, sizeof(header)) ||
+      fi_write_region(f, &offset, root, header.root_size) ||
+      fi_write_region(f, &offset, b->entries, b->entry_count * sizeof(FIEntry)) ||
+      fi_write_region(f, &offset, trigrams, trigram_count * sizeof(FITrigram)) ||
+      fi_write_region(f, &offset, postings, posting_count * sizeof(uint32_t)) ||
+      fi_write_region(f, &offset, b->names, b->names_size)) {
+    fclose(f);
+    unlink(tmp_path);
+    goto out;
+  }
+  if (fclose(f) != 0 || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    goto out;
+  }
+  ret = 0;
+
+out:
+  free(pairs);
+  free(trigrams);
+  free(postings);
+  return ret;
+}
+
+// Indexes `root` directory into `path` file. Returns number of entries
+// or -1 on error.
+static long fi_build(const char *root, const char *path, double build_time)
+{
+  FIBuilder b;
+  struct stat st;
+  long ret = -1;
+  int fd;
+
+  memset(&b, 0, sizeof(b));
+  if ((fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+    return -1;
+  if (fstat(fd, &st) == 0) {
+    b.dev = st.st_dev;
+    fi_walk(&b, fd, FI_NO_PARENT, 0);
+    if (!b.failed && fi_write(&b, root, path, build_time) == 0)
+      ret = b.entry_count;
+  }
+  close(fd);
+  free(b.entries);
+  free(b.names);
+
+  return ret;
+}
+
+// --- Reading
+
+static void fi_unmap(FIMap *m)
+{
+  if (m->base)
+    munmap(m->base, m->size);
+  memset(m, 0, sizeof(*m));
+}
+
+static int fi_region_valid(const FIMap *m, uint64_t offset, uint64_t count, size_t size)
+{
+  return offset % 8 == 0 && offset <= m->size && count <= (m->size - offset) / size;
+}
+
+// Maps index file at `path` and checks it. Returns 0 on success.
+static int fi_map(const char *path, FIMap *m)
+{
+  const FIHeader *h;
+  struct stat st;
+  uint32_t i;
+  int fd;
+
+  memset(m, 0, sizeof(*m));
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return -1;
+  if (fstat(fd, &st) < 0 || st.st_size < sizeof(FIHeader)) {
+    close(fd);
+    return -1;
+  }
+  m->size = st.st_size;
+  m->base = mmap(NULL, m->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (m->base == MAP_FAILED) {
+    m->base = NULL;
+    return -1;
+  }
+
+  h = m->header = m->base;
+  if (memcmp(h->magic, FI_MAGIC, sizeof(h->magic)) || h->version != FI_VERSION ||
+      !fi_region_valid(m, h->root_offset, h->root_size, 1) ||
+      !fi_region_valid(m, h->entries_offset, h->entry_count, sizeof(FIEntry)) ||
+      !fi_region_valid(m, h->trigrams_offset, h->trigram_count, sizeof(FITrigram)) ||
+      !fi_region_valid(m, h->postings_offset, h->posting_count, sizeof(uint32_t)) ||
+      !fi_region_valid(m, h->names_offset, h->names_size, 1) || h->root_size == 0 ||
+      (h->entry_count > 0 && h->names_size == 0)) {
+    fi_unmap(m);
+    return -1;
+  }
+  m->root = (const char *)m->base + h->root_offset;
+  m->entries = (const FIEntry *)((const char *)m->base + h->entries_offset);
+  m->trigrams = (const FITrigram *)((const char *)m->base + h->trigrams_offset);
+  m->postings = (const uint32_t *)((const char *)m->base + h->postings_offset);
+  m->names = (const char *)m->base + h->names_offset;
+
+  // Queries rely on these: names are terminated, parents precede children
+  if (m->root[h->root_size - 1] != '\0' ||
+      (h->names_size > 0 && m->names[h->names_size - 1] != '\0')) {
+    fi_unmap(m);
+    return -1;
+  }
+  for (i = 0; i < h->entry_count; i++) {
+    if (m->entries[i].name >= h->names_size ||
+        (m->entries[i].parent != FI_NO_PARENT && m->entries[i].parent >= i)) {
+      fi_unmap(m);
+      return -1;
+    }
+  }
+  for (i = 0; i < h->trigram_count; i++) {
+    if (m->trigrams[i].first > h->posting_count ||
+        m->trigrams[i].count > h->posting_count - m->trigrams[i].first) {
+      fi_unmap(m);
+      return -1;
+    }
+  }
+  for (i = 0; i < h->posting_count; i++) {
+    if (m->postings[i] >= h->entry_count) {
+      fi_unmap(m);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Finds directory at `rel` path relative to root. Root itself is FI_NO_PARENT.
+// Returns 0 if there's no such directory in the index.
+static int fi_find_directory(const FIMap *m, const char *rel, uint32_t *dir)
+{
+  uint32_t cur = FI_NO_PARENT, i;
+  const char *end;
+  size_t len;
+
+  while (*rel) {
+    while (*rel == '/')
+      rel++;
+    if (!*rel)
+      break;
+    end = strchr(rel, '/');
+    len = end ? (size_t)(end - rel) : strlen(rel);
+
+    // Children follow their parent
+    for (i = (cur == FI_NO_PARENT) ? 0 : cur + 1; i < m->header->entry_count; i++) {
+      const char *name = m->names + m->entries[i].name;
+
+      if (m->entries[i].parent == cur && (m->entries[i].flags & FIDirectory) &&
+          !strncmp(name, rel, len) && name[len] == '\0')
+        break;
+    }
+    if (i == m->header->entry_count)
+      return 0;
+    cur = i;
+    rel += len;
+  }
+  *dir = cur;
+
+  return 1;
+}
+
+// Returns 1 if entry `i` is inside `dir` and, unless `hidden`, no name on
+// the way from `dir` to it is hidden
+static int fi_is_visible_in(const FIMap *m, uint32_t i, uint32_t dir, int hidden)
+{
+  if (i == dir)
+    return 0;
+  while (i != dir) {
+    if (i == FI_NO_PARENT)
+      return 0;
+    if (!hidden && (m->entries[i].flags & FIHidden))
+      return 0;
+    i = m->entries[i].parent;
+  }
+
+  return 1;
+}
+
+// Writes absolute path of entry `i` into `buf`. Returns 0 if it doesn't fit.
+static int fi_entry_path(const FIMap *m, uint32_t i, char *buf, size_t size)
+{
+  uint32_t stack[FI_MAX_DEPTH + 2];
+  size_t len, n;
+  int depth = 0;
+
+  for (; i != FI_NO_PARENT; i = m->entries[i].parent) {
+    if (depth == FI_MAX_DEPTH + 2)
+      return 0;
+    stack[depth++] = i;
+  }
+
+  len = strlen(m->root);
+  if (len >= size)
+    return 0;
+  memcpy(buf, m->root, len);
+  if (len == 1 && buf[0] == '/')
+    len = 0;
+  while (depth > 0) {
+    const char *name = m->names + m->entries[stack[--depth]].name;
+
+    n = strlen(name);
+    if (len + 1 + n >= size)
+      return 0;
+    buf[len++] = '/';
+    memcpy(buf + len, name, n);
+    len += n;
+  }
+  buf[len] = '\0';
+
+  return 1;
+}
+
+static const FITrigram *fi_lookup(const FIMap *m, uint32_t trigram)
+{
+  uint32_t lo = 0, hi = m->header->trigram_count, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (m->trigrams[mid].trigram < trigram)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < m->header->trigram_count && m->trigrams[lo].trigram == trigram)
+    return &m->trigrams[lo];
+
+  return NULL;
+}
+
+static int fi_contains(const uint32_t *list, uint32_t count, uint32_t value)
+{
+  uint32_t lo = 0, hi = count, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (list[mid] < value)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo < count && list[lo] == value;
+}
+
+// Returns entries which names contain all trigrams of `literals`, ascending.
+// Caller frees returned array.
+static uint32_t *fi_candidates(const FIMap *m, char literals[][FI_MAX_LITERAL], int literal_count,
+                               uint32_t *count)
+{
+  const FITrigram *lists[FI_MAX_LITERALS * FI_MAX_LITERAL];
+  unsigned char folded[FI_MAX_LITERAL];
+  const FITrigram *shortest = NULL;
+  int list_count = 0, l, j;
+  uint32_t *result, i, n;
+  size_t len;
+
+  *count = 0;
+  for (l = 0; l < literal_count; l++) {
+    len = fi_fold(literals[l], strlen(literals[l]), folded);
+    for (j = 0; j + 2 < len; j++) {
+      const FITrigram *t = fi_lookup(m, fi_trigram(folded + j));
+
+      if (t == NULL)
+        return NULL;  // no name contains it
+      lists[list_count++] = t;
+      if (shortest == NULL || t->count < shortest->count)
+        shortest = t;
+    }
+  }
+  if (shortest == NULL || (result = malloc(shortest->count * sizeof(uint32_t) + 1)) == NULL)
+    return NULL;
+
+  for (i = 0, n = 0; i < shortest->count; i++) {
+    uint32_t entry = m->postings[shortest->first + i];
+
+    for (l = 0; l < list_count; l++) {
+      if (lists[l] != shortest &&
+          !fi_contains(m->postings + lists[l]->first, lists[l]->count, entry))
+        break;
+    }
+    if (l == list_count)
+      result[n++] = entry;
+  }
+  *count = n;
+
+  return result;
+}
+
+int FIRequiredLiterals(const char *re, char literals[][FI_MAX_LITERAL], int max)
+{
+  char run[FI_MAX_LITERAL];
+  size_t len = 0, n;
+  int count = 0, depth;
+  const char *p;
+
+  // Alternatives and inline options (e.g. (?x) ignoring spaces) change what
+  // literal characters mean
+  for (p = re; *p; p++) {
+    if (*p == '\\' && p[1])
+      p++;
+    else if (*p == '|' || (*p == '(' && p[1] == '?'))
+      return 0;
+  }
+
+#define FI_END_RUN()                                        \
+  do {                                                      \
+    if (len >= 3 && count < max) {                          \
+      memcpy(literals[count], run, len);                    \
+      literals[count++][len] = '\0';                        \
+    }                                                       \
+    len = 0;                                                \
+  } while (0)
+// Last character is optional: removes it with all UTF-8 continuation bytes
+#define FI_DROP_LAST()                                      \
+  do {                                                      \
+    while (len > 0 && ((unsigned char)run[len - 1] & 0xc0) == 0x80) \
+      len--;                                                \
+    if (len > 0)                                            \
+      len--;                                                \
+  } while (0)
+
+  for (p = re; *p;) {
+    switch (*p) {
+      case '\\':
+        p++;
+        if (*p == '\0')
+          break;
+        if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9')) {
+          // Character class, anchor, back reference or quoting
+          FI_END_RUN();
+          if (*p == 'Q')
+            return count;
+        } else if (len + 1 < FI_MAX_LITERAL) {
+          run[len++] = *p;
+        } else {
+          FI_END_RUN();
+        }
+        p++;
+        break;
+      case '[':
+        FI_END_RUN();
+        p++;
+        if (*p == '^')
+          p++;
+        if (*p == ']')
+          p++;
+        for (depth = 1; *p && depth > 0; p++) {
+          if (*p == '\\' && p[1])
+            p++;
+          else if (*p == '[')
+            depth++;
+          else if (*p == ']')
+            depth--;
+        }
+        break;
+      case '(':
+        FI_END_RUN();
+        for (p++, depth = 1; *p && depth > 0; p++) {
+          if (*p == '\\' && p[1])
+            p++;
+          else if (*p == '(')
+            depth++;
+          else if (*p == ')')
+            depth--;
+        }
+        break;
+      case '*':
+      case '?':
+        FI_DROP_LAST();
+        FI_END_RUN();
+        p++;
+        break;
+      case '{':
+        FI_DROP_LAST();
+        FI_END_RUN();
+        while (*p && *p != '}')
+          p++;
+        if (*p)
+          p++;
+        break;
+      case '+':
+      case '.':
+      case '^':
+      case '$':
+      case ')':
+      case ']':
+      case '}':
+        FI_END_RUN();
+        p++;
+        break;
+      default:
+        // Copy whole UTF-8 character
+        for (n = 1; ((unsigned char)p[n] & 0xc0) == 0x80; n++)
+          ;
+        if (len + n >= FI_MAX_LITERAL)
+          FI_END_RUN();
+        memcpy(run + len, p, n);
+        len += n;
+        p += n;
+        break;
+    }
+    // Lazy and possessive quantifiers
+    if (len == 0 && (*p == '?' || *p == '+') && p > re &&
+        (p[-1] == '*' || p[-1] == '+' || p[-1] == '?' || p[-1] == '}'))
+      p++;
+  }
+  FI_END_RUN();
+
+#undef FI_END_RUN
+#undef FI_DROP_LAST
+
+  return count;
+}
+
+//=============================================================================
+// Mapped index of one root directory
+//=============================================================================
+@interface FinderIndexFile : NSObject
+{
+  FIMap map;
+}
+- (id)initWithPath:(NSString *)path root:(NSString *)root;
+- (FIMap *)map;
+- (NSTimeInterval)age;
+@end
+
+@implementation FinderIndexFile
+
+- (void)dealloc
+{
+  fi_unmap(&map);
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)path root:(NSString *)root
+{
+  if ((self = [super init]) == nil) {
+    return nil;
+  }
+  if (fi_map([path fileSystemRepresentation], &map) != 0 ||
+      strcmp(map.root, [root fileSystemRepresentation]) != 0) {
+    NSDebugLLog(@"Finder", @"FinderIndex: index file %@ is not valid", path);
+    [self release];
+    return nil;
+  }
+
+  return self;
+}
+
+- (FIMap *)map
+{
+  return &map;
+}
+
+- (NSTimeInterval)age
+{
+  return [[NSDate date] timeIntervalSince1970] - map.header->build_time;
+}
+
+@end
+
+@interface FinderIndexRoot : NSObject
+{
+ @public
+  NSString *path;
+  FinderIndexFile *file;          // nil until built
+  NSMutableDictionary *addedPaths;  // path -> date of creation event
+  NSDate *buildStart;             // nil if not building
+  BOOL isMonitored;
+  BOOL isStale;                   // monitor lost events, must be rebuilt
+}
+@end
+
+@implementation FinderIndexRoot
+
+- (void)dealloc
+{
+  [path release];
+  [file release];
+  [addedPaths release];
+  [buildStart release];
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)aPath
+{
+  if ((self = [super init]) != nil) {
+    path = [aPath copy];
+    addedPaths = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+@end
+
+//=============================================================================
+// Index
+//=============================================================================
+@implementation FinderIndex
+
+static FinderIndex *sharedIndex = nil;
+
++ (FinderIndex *)sharedIndex
+{
+  if (sharedIndex == nil) {
+    sharedIndex = [[FinderIndex alloc] init];
+  }
+  return sharedIndex;
+}
+
+- (void)dealloc
+{
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [buildQueue cancelAllOperations];
+  [buildQueue release];
+  [roots release];
+  [lock release];
+  [indexDirectory release];
+  [super dealloc];
+}
+
+- (id)init
+{
+  if ((self = [super init]) == nil) {
+    return nil;
+  }
+
+  indexDirectory = [[NSHomeDirectory() stringByAppendingPathComponent:@"Library/Workspace/FinderIndex"] retain];
+  roots = [[NSMutableDictionary alloc] init];
+  lock = [[NSLock alloc] init];
+  buildQueue = [[NSOperationQueue alloc] init];
+  [buildQueue setMaxConcurrentOperationCount:1];
+
+  [[NSNotificationCenter defaultCenter] addObserver:self
+                                           selector:@selector(fileSystemChangedAtPaths:)
+                                               name:OSEFileSystemChangedAtPaths
+                                             object:nil];
+  return self;
+}
+
+// Index file name is a hash of root path
+- (NSString *)indexFileForRoot:(NSString *)rootPath
+{
+  const unsigned char *s = (const unsigned char *)[rootPath fileSystemRepresentation];
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+
+  for (; *s; s++) {
+    hash = (hash ^ *s) * 0x100000001b3ULL;
+  }
+  return [indexDirectory stringByAppendingPathComponent:[NSString stringWithFormat:@"%016llx.index", hash]];
+}
+
+// Returns root containing `path`, the closest one if there are several.
+// `lock` must be held.
+- (FinderIndexRoot *)rootForPath:(NSString *)path
+{
+  FinderIndexRoot *found = nil;
+
+  for (NSString *rootPath in roots) {
+    if ([path isEqualToString:rootPath] || [rootPath isEqualToString:@"/"] ||
+        [path hasPrefix:[rootPath stringByAppendingString:@"/"]]) {
+      if (found == nil || [rootPath length] > [found->path length]) {
+        found = [roots objectForKey:rootPath];
+      }
+    }
+  }
+  return found;
+}
+
+// Returns root for `path`: saved index of `path` or one of its parents
+// or new root to be built. `lock` must be held.
+- (FinderIndexRoot *)loadRootForPath:(NSString *)path
+{
+  FinderIndexRoot *root;
+  FinderIndexFile *file = nil;
+  NSString *rootPath = path;
+
+  while (file == nil) {
+    file = [[FinderIndexFile alloc] initWithPath:[self indexFileForRoot:rootPath] root:rootPath];
+    if (file != nil || [rootPath isEqualToString:@"/"]) {
+      break;
+    }
+    rootPath = [rootPath stringByDeletingLastPathComponent];
+  }
+  if (file == nil) {
+    rootPath = path;
+  }
+
+  root = [[FinderIndexRoot alloc] initWithPath:rootPath];
+  root->file = file;
+  [roots setObject:root forKey:rootPath];
+  [root release];
+
+  NSDebugLLog(@"Finder", @"FinderIndex: %@ is indexed at %@ (%@)", path, rootPath,
+              file ? @"saved" : @"not built yet");
+  return root;
+}
+
+// Starts building of `root` in build queue. `lock` must be held.
+- (void)scheduleBuildOfRoot:(FinderIndexRoot *)root
+{
+  NSInvocationOperation *build;
+
+  root->buildStart = [[NSDate alloc] init];
+  root->isStale = NO;
+  build = [[NSInvocationOperation alloc] initWithTarget:self
+                                               selector:@selector(buildRoot:)
+                                                 object:root];
+  [buildQueue addOperation:build];
+  [build release];
+}
+
+- (void)prepareForPaths:(NSArray *)paths
+{
+  FinderIndexRoot *root;
+  BOOL isDir;
+
+  for (NSString *path in paths) {
+    path = [path stringByStandardizingPath];
+    if (![[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&isDir] || !isDir) {
+      continue;
+    }
+
+    [lock lock];
+    root = [self rootForPath:path];
+    if (root == nil) {
+      root = [self loadRootForPath:path];
+    }
+    if (root->buildStart == nil &&
+        (root->file == nil || root->isStale || [root->file age] > FI_MAX_AGE ||
+         [root->addedPaths count] > FI_MAX_ADDED)) {
+      [self scheduleBuildOfRoot:root];
+    }
+    [lock unlock];
+
+    // Creation of files is tracked in directories watched by monitor. Trees
+    // in home are watched entirely, system ones may have too many directories.
+    if (root->isMonitored == NO) {
+      NSString *home = NSHomeDirectory();
+      BOOL isInHome = ([root->path isEqualToString:home] ||
+                       [root->path hasPrefix:[home stringByAppendingString:@"/"]]);
+
+      [[(Controller *)[NSApp delegate] fileSystemMonitor] addPath:root->path recursive:isInHome];
+      root->isMonitored = YES;
+    }
+  }
+}
+
+// Runs in build queue
+- (void)buildRoot:(FinderIndexRoot *)root
+{
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSString *indexPath = [self indexFileForRoot:root->path];
+  FinderIndexFile *file = nil;
+  NSTimeInterval start = [root->buildStart timeIntervalSince1970];
+  long count;
+
+  NSDebugLLog(@"Finder", @"FinderIndex: building index of %@", root->path);
+
+  [[NSFileManager defaultManager] createDirectoryAtPath:indexDirectory
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:NULL];
+  count = fi_build([root->path fileSystemRepresentation], [indexPath fileSystemRepresentation],
+                   start);
+  if (count >= 0) {
+    file = [[FinderIndexFile alloc] initWithPath:indexPath root:root->path];
+  }
+  if (file == nil) {
+    NSLog(@"Finder: failed to index %@", root->path);
+  }
+
+  [lock lock];
+  if (file != nil) {
+    [root->file release];
+    root->file = file;
+    // Files created before walk started are in the index now
+    for (NSString *path in [root->addedPaths allKeys]) {
+      if ([[root->addedPaths objectForKey:path] compare:root->buildStart] == NSOrderedAscending) {
+        [root->addedPaths removeObjectForKey:path];
+      }
+    }
+  }
+  [root->buildStart release];
+  root->buildStart = nil;
+  [lock unlock];
+
+  NSDebugLLog(@"Finder", @"FinderIndex: %@ indexed in %.2f s, %li entries", root->path,
+              [[NSDate date] timeIntervalSince1970] - start, count);
+  [pool release];
+}
+
+// "OSEFileSystemChangedAtPaths" notification callback
+- (void)fileSystemChangedAtPaths:(NSNotification *)notif
+{
+  NSArray *events = [[notif userInfo] objectForKey:@"Events"];
+  NSDate *now = [NSDate date];
+
+  [lock lock];
+  for (NSDictionary *changes in events) {
+    NSArray *operations = [changes objectForKey:@"Operations"];
+    NSString *changedPath = [changes objectForKey:@"ChangedPath"];
+    NSString *name = nil;
+    NSString *fullPath;
+    FinderIndexRoot *root;
+
+    if ([operations indexOfObject:@"Overflow"] != NSNotFound) {
+      // Creations may be lost: monitored roots are rebuilt now or after
+      // current build finishes (on next prepare)
+      for (root in [roots objectEnumerator]) {
+        if (root->isMonitored == NO) {
+          continue;
+        }
+        root->isStale = YES;
+        if (root->buildStart == nil && root->file != nil) {
+          [self scheduleBuildOfRoot:root];
+        }
+      }
+      continue;
+    }
+    if ([operations indexOfObject:@"Rename"] != NSNotFound) {
+      name = [changes objectForKey:@"ChangedFileTo"];
+    } else if ([operations indexOfObject:@"Create"] != NSNotFound) {
+      name = [changes objectForKey:@"ChangedFile"];
+    }
+    if (changedPath == nil || name == nil) {
+      continue;
+    }
+    fullPath = [changedPath stringByAppendingPathComponent:name];
+
+    root = [self rootForPath:fullPath];
+    if (root != nil && ![fullPath isEqualToString:root->path]) {
+      [root->addedPaths setObject:now forKey:fullPath];
+    }
+  }
+  [lock unlock];
+}
+
+- (BOOL)isPath:(NSString *)path hiddenInPath:(NSString *)dirPath
+{
+  NSString *rel = [path substringFromIndex:[dirPath length]];
+
+  for (NSString *component in [rel pathComponents]) {
+    if ([component hasPrefix:@"."]) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+- (NSArray *)pathsMatching:(NSRegularExpression *)expression
+                    inPath:(NSString *)path
+                showHidden:(BOOL)showHidden
+                 unindexed:(NSArray **)unindexedPaths
+                 operation:(NSOperation *)operation
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSAutoreleasePool *pool = nil;
+  NSMutableArray *results = [NSMutableArray array];
+  NSMutableArray *unindexed = [NSMutableArray array];
+  NSDictionary *added;
+  NSString *prefix, *rel, *name;
+  FinderIndexRoot *root;
+  FinderIndexFile *file;
+  FIMap *m;
+  char literals[FI_MAX_LITERALS][FI_MAX_LITERAL];
+  char buf[PATH_MAX];
+  struct stat st;
+  uint32_t dir, *candidates = NULL, count, i, n;
+  int literal_count;
+
+  path = [path stringByStandardizingPath];
+  *unindexedPaths = unindexed;
+
+  [lock lock];
+  root = [self rootForPath:path];
+  if (root == nil) {
+    // Not indexed
+    [lock unlock];
+    return nil;
+  }
+  file = [root->file retain];
+  added = [root->addedPaths copy];
+  [lock unlock];
+
+  if (file == nil) {
+    [added release];
+    return nil;
+  }
+  m = [file map];
+
+  rel = [path substringFromIndex:[root->path length]];
+  if (!fi_find_directory(m, [rel fileSystemRepresentation], &dir)) {
+    // Created after index was built
+    [unindexed addObject:path];
+    [file release];
+    [added release];
+    return results;
+  }
+
+  // Names containing literal parts of expression or all names
+  literal_count = FIRequiredLiterals([[expression pattern] UTF8String], literals, FI_MAX_LITERALS);
+  if (literal_count > 0) {
+    candidates = fi_candidates(m, literals, literal_count, &count);
+    if (candidates == NULL) {
+      count = 0;
+    }
+  } else {
+    count = m->header->entry_count;
+  }
+
+  for (n = 0; n < count; n++) {
+    if (n % 1024 == 0) {
+      if ([operation isCancelled]) {
+        break;
+      }
+      [pool release];
+      pool = [[NSAutoreleasePool alloc] init];
+    }
+    i = candidates ? candidates[n] : n;
+    if (!fi_is_visible_in(m, i, dir, showHidden)) {
+      continue;
+    }
+    name = [[NSString alloc] initWithUTF8String:m->names + m->entries[i].name];
+    if (name != nil &&
+        [expression numberOfMatchesInString:name options:0 range:NSMakeRange(0, [name length])] > 0 &&
+        fi_entry_path(m, i, buf, sizeof(buf)) && lstat(buf, &st) == 0 && !S_ISLNK(st.st_mode)) {
+      [results addObject:[fm stringWithFileSystemRepresentation:buf length:strlen(buf)]];
+    }
+    [name release];
+  }
+  [pool release];
+  free(candidates);
+
+  // Other file systems
+  for (i = (dir == FI_NO_PARENT) ? 0 : dir + 1; i < m->header->entry_count; i++) {
+    if ((m->entries[i].flags & FIMountPoint) && fi_is_visible_in(m, i, dir, showHidden) &&
+        fi_entry_path(m, i, buf, sizeof(buf))) {
+      [unindexed addObject:[fm stringWithFileSystemRepresentation:buf length:strlen(buf)]];
+    }
+  }
+  [file release];
+
+  // Created since index was built
+  prefix = [path isEqualToString:@"/"] ? path : [path stringByAppendingString:@"/"];
+  for (NSString *addedPath in [[added allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+    BOOL isInside = NO;
+
+    if (![addedPath hasPrefix:prefix] || [addedPath isEqualToString:path] ||
+        (!showHidden && [self isPath:addedPath hiddenInPath:path]) ||
+        lstat([addedPath fileSystemRepresentation], &st) != 0 || S_ISLNK(st.st_mode)) {
+      continue;
+    }
+    for (NSString *dirPath in unindexed) {
+      if ([addedPath hasPrefix:[dirPath stringByAppendingString:@"/"]]) {
+        isInside = YES;
+        break;
+      }
+    }
+    if (isInside) {
+      continue;
+    }
+    name = [addedPath lastPathComponent];
+    if ([expression numberOfMatchesInString:name options:0 range:NSMakeRange(0, [name length])] > 0 &&
+        [results indexOfObject:addedPath] == NSNotFound) {
+      [results addObject:addedPath];
+    }
+    if (S_ISDIR(st.st_mode)) {
+      [unindexed addObject:addedPath];
+    }
+  }
+  [added release];
+
+  // Contents of new directories are searched by caller
+  if ([unindexed count] > 0) {
+    NSMutableArray *indexed = [NSMutableArray arrayWithCapacity:[results count]];
+
+    for (NSString *resultPath in results) {
+      BOOL isInside = NO;
+
+      for (NSString *dirPath in unindexed) {
+        if ([resultPath hasPrefix:[dirPath stringByAppendingString:@"/"]]) {
+          isInside = YES;
+          break;
+        }
+      }
+      if (!isInside) {
+        [indexed addObject:resultPath];
+      }
+    }
+    results = indexed;
+  }
+
+  return results;
+}
+
+@end
@@ -0,0 +1,66 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2026 NEXTSPACE Team
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Icons of files shown by viewers.
+//
+// Icon which is not cached yet is resolved with -[Controller(NSWorkspace)
+// iconForFile:] later. Meanwhile icon shows folder or unknown file
+// placeholder. Controller methods share caches with the rest of
+// application, so icons are resolved on main thread in short batches
+// between events. Icons of regular files defined by extension are cached by
+// extension, others (directories, bundles, files recognized by contents) -
+// by device, inode and change time of file, so changed files get new icons.
+// Entries of changed files are dropped on file system monitor events.
+
+#import <Foundation/Foundation.h>
+
+@class NSImage;
+@class PathIcon;
+
+@interface IconService : NSObject
+{
+  NSMutableDictionary *icons;     // key -> NSImage
+  NSMutableDictionary *pathKeys;  // path -> key for entries not cached by extension
+  NSLock *lock;
+  NSMutableArray *requests;       // ISRequest waiting to be resolved
+  BOOL isResolveScheduled;
+
+  NSImage *folderPlaceholder;
+  NSImage *filePlaceholder;
+}
+
+// Must be called first on main thread
++ (IconService *)sharedService;
+
+// Sets image of `icon` to icon of file at `fullPath` at once or when it's
+// resolved. Late image is not set if `icon` shows another path by then.
+// `owner` (not retained) identifies requests to be cancelled.
+// May be called from any thread.
+- (void)setIconImageOf:(PathIcon *)icon forFile:(NSString *)fullPath owner:(id)owner;
+
+// Icons requested by `owner` which are not resolved yet are not resolved
+// at all. Called by viewer which doesn't show them anymore.
+- (void)cancelRequestsOfOwner:(id)owner;
+
+// Forgets all icons. Called when file types or applications changed.
+- (void)invalidateIcons;
+
+@end
@@ -0,0 +1,329 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Copyright (C) 2026 NEXTSPACE Team
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#import <AppKit/AppKit.h>
+#import <SystemKit/OSEFileSystemMonitor.h>
+
+#import "Controller.h"
+#import "Controller+NSWorkspace.h"
+#import <Viewers/PathIcon.h>
+#import "IconService.h"
+
+#define IS_MAX_ICONS 4096
+// Seconds main thread spends on resolving before it handles events again
+#define IS_BATCH_TIME 0.02
+
+// Key of icon which depends on file itself
+static NSString *ISKeyForFile(const struct stat *st)
+{
+  return [NSString stringWithFormat:@"%lx:%lx:%lx.%lx", (unsigned long)st->st_dev,
+                                    (unsigned long)st->st_ino, (unsigned long)st->st_ctim.tv_sec,
+                                    (unsigned long)st->st_ctim.tv_nsec];
+}
+
+// Key of icon which depends on extension only. Can't clash with file keys.
+static NSString *ISKeyForExtension(NSString *ext)
+{
+  return [@"." stringByAppendingString:ext];
+}
+
+// Icon waiting to be resolved
+@interface ISRequest : NSObject
+{
+ @public
+  PathIcon *icon;
+  NSString *path;
+  NSString *key;  // nil if file can't be examined: icon is not cached
+  id owner;       // not retained, compared only
+  BOOL isRegular;
+  BOOL isByExtension;
+}
+@end
+
+@implementation ISRequest
+
+- (void)dealloc
+{
+  [icon release];
+  [path release];
+  [key release];
+  [super dealloc];
+}
+
+@end
+
+@implementation IconService
+
+static IconService *sharedService = nil;
+
++ (IconService *)sharedService
+{
+  if (sharedService == nil) {
+    sharedService = [[IconService alloc] init];
+  }
+  return sharedService;
+}
+
+- (void)dealloc
+{
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [NSObject cancelPreviousPerformRequestsWithTarget:self];
+  [icons release];
+  [pathKeys release];
+  [requests release];
+  [lock release];
+  [folderPlaceholder release];
+  [filePlaceholder release];
+  [super dealloc];
+}
+
+- (id)init
+{
+  Controller *controller = (Controller *)[NSApp delegate];
+
+  if ((self = [super init]) == nil) {
+    return nil;
+  }
+
+  icons = [[NSMutableDictionary alloc] init];
+  pathKeys = [[NSMutableDictionary alloc] init];
+  requests = [[NSMutableArray alloc] init];
+  lock = [[NSLock alloc] init];
+
+  folderPlaceholder = [[controller folderIcon] retain];
+  filePlaceholder = [[controller unknownFiletypeIcon] retain];
+
+  [[NSNotificationCenter defaultCenter] addObserver:self
+                                           selector:@selector(fileSystemChangedAtPaths:)
+                                               name:OSEFileSystemChangedAtPaths
+                                             object:nil];
+  return self;
+}
+
+// Returns cached icon of file with extension `ext` and `key`. `lock` must
+// be held.
+- (NSImage *)cachedIconForKey:(NSString *)key extension:(NSString *)ext byExtension:(BOOL)isByExt
+{
+  NSImage *image = nil;
+
+  if (isByExt) {
+    image = [icons objectForKey:ISKeyForExtension(ext)];
+  }
+  if (image == nil && key != nil) {
+    image = [icons objectForKey:key];
+  }
+  return [[image retain] autorelease];
+}
+
+- (void)setIconImageOf:(PathIcon *)icon forFile:(NSString *)fullPath owner:(id)owner
+{
+  const char *path = [fullPath fileSystemRepresentation];
+  NSString *ext = [[fullPath pathExtension] lowercaseString];
+  NSString *key = nil;
+  NSImage *image = nil;
+  ISRequest *request;
+  struct stat st;
+  BOOL isExist, isByExtension = NO, isScheduled;
+
+  // Broken link or file which has gone - nothing to cache
+  isExist = (stat(path, &st) == 0);
+  if (isExist) {
+    key = ISKeyForFile(&st);
+    isByExtension = (S_ISREG(st.st_mode) && [ext length] > 0 && access(path, R_OK) == 0);
+
+    [lock lock];
+    image = [self cachedIconForKey:key extension:ext byExtension:isByExtension];
+    [lock unlock];
+  }
+
+  if (image != nil) {
+    [icon setIconImage:image];
+    return;
+  }
+
+  [icon setIconImage:(isExist && S_ISDIR(st.st_mode)) ? folderPlaceholder : filePlaceholder];
+
+  request = [[ISRequest alloc] init];
+  request->icon = [icon retain];
+  request->path = [fullPath copy];
+  request->key = [key retain];
+  request->owner = owner;
+  request->isRegular = (isExist && S_ISREG(st.st_mode));
+  request->isByExtension = isByExtension;
+
+  [lock lock];
+  [requests addObject:request];
+  isScheduled = isResolveScheduled;
+  isResolveScheduled = YES;
+  [lock unlock];
+  [request release];
+
+  if (isScheduled == NO) {
+    [self performSelectorOnMainThread:@selector(resolveRequests)
+                           withObject:nil
+                        waitUntilDone:NO];
+  }
+}
+
+// Returns icon of requested file resolving and caching it if needed
+- (NSImage *)iconForRequest:(ISRequest *)request
+{
+  Controller *controller = (Controller *)[NSApp delegate];
+  NSString *path = request->path;
+  NSString *ext = [[path pathExtension] lowercaseString];
+  NSImage *image, *extImage = nil;
+
+  // The same file or file of the same type may be resolved already
+  [lock lock];
+  image = [self cachedIconForKey:request->key extension:ext byExtension:request->isByExtension];
+  [lock unlock];
+  if (image != nil) {
+    return image;
+  }
+
+  image = [controller iconForFile:path];
+  if (request->key == nil) {
+    return image;
+  }
+  if ([ext length] > 0) {
+    extImage = [controller iconForFileType:ext];
+  }
+
+  [lock lock];
+  if ([icons count] >= IS_MAX_ICONS) {
+    [icons removeAllObjects];
+    [pathKeys removeAllObjects];
+  }
+  // Files of unknown extension are recognized by contents
+  if (request->isRegular && image == extImage && image != [controller unknownFiletypeIcon]) {
+    [icons setObject:image forKey:ISKeyForExtension(ext)];
+  } else {
+    [icons setObject:image forKey:request->key];
+    [pathKeys setObject:request->key forKey:path];
+  }
+  [lock unlock];
+
+  return image;
+}
+
+// Resolves requests in order of arrival for IS_BATCH_TIME and schedules
+// next batch, so events are handled in between
+- (void)resolveRequests
+{
+  NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+  NSUInteger count = 0;
+  ISRequest *request;
+  NSImage *image;
+
+  while (1) {
+    [lock lock];
+    if ([requests count] == 0) {
+      isResolveScheduled = NO;
+      [lock unlock];
+      break;
+    }
+    if ([NSDate timeIntervalSinceReferenceDate] - start >= IS_BATCH_TIME) {
+      [lock unlock];
+      [self performSelector:@selector(resolveRequests) withObject:nil afterDelay:0.0];
+      break;
+    }
+    request = [[requests objectAtIndex:0] retain];
+    [requests removeObjectAtIndex:0];
+    [lock unlock];
+
+    image = [self iconForRequest:request];
+    // Late image is not set if icon shows another path
+    if ([[[request->icon paths] lastObject] isEqualToString:request->path]) {
+      [request->icon setIconImage:image];
+    }
+    [request release];
+    count++;
+  }
+
+  NSDebugLLog(@"IconService", @"[IconService] resolved %lu icons", count);
+}
+
+- (void)cancelRequestsOfOwner:(id)owner
+{
+  NSUInteger i, count = 0;
+
+  [lock lock];
+  for (i = [requests count]; i > 0; i--) {
+    ISRequest *request = [requests objectAtIndex:i - 1];
+
+    if (request->owner == owner) {
+      [requests removeObjectAtIndex:i - 1];
+      count++;
+    }
+  }
+  [lock unlock];
+
+  NSDebugLLog(@"IconService", @"[IconService] cancelled %lu requests", count);
+}
+
+- (void)invalidateIcons
+{
+  [lock lock];
+  [icons removeAllObjects];
+  [pathKeys removeAllObjects];
+  [lock unlock];
+}
+
+- (void)removeIconOfPath:(NSString *)path
+{
+  NSString *key = [pathKeys objectForKey:path];
+
+  if (key != nil) {
+    [icons removeObjectForKey:key];
+    [pathKeys removeObjectForKey:path];
+  }
+}
+
+// "OSEFileSystemChangedAtPaths" notification callback. Changed files have
+// new keys already, so it's about memory mostly.
+- (void)fileSystemChangedAtPaths:(NSNotification *)notif
+{
+  NSArray *events = [[notif userInfo] objectForKey:@"Events"];
+
+  [lock lock];
+  for (NSDictionary *changes in events) {
+    NSString *changedPath = [changes objectForKey:@"ChangedPath"];
+    NSString *file;
+
+    if (changedPath == nil) {
+      continue;
+    }
+    [self removeIconOfPath:changedPath];
+    if ((file = [changes objectForKey:@"ChangedFile"]) != nil) {
+      [self removeIconOfPath:[changedPath stringByAppendingPathComponent:file]];
+    }
+    if ((file = [changes objectForKey:@"ChangedFileTo"]) != nil) {
+      [self removeIconOfPath:[changedPath stringByAppendingPathComponent:file]];
+    }
+  }
+  [lock unlock];
+}
+
+@end
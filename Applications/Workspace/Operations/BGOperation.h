@@ -69,6 +69,10 @@ typedef enum {
   NSString *problemDesc;
   NSString *problemSolutionDesc;
   NSArray *solutions;
+
+  // Input from tool in binary protocol (see Tools/ProgressProtocol.h)
+  BOOL isBinaryProgress;
+  NSMutableData *progressData;
 }
 
 - (id)initWithOperationType:(OperationType)opType
@@ -107,4 +111,16 @@ typedef enum {
 - (BOOL)isProgressSupported;
 - (float)progressValue;
 
+// Tool progress protocol. Binary protocol is used unless
+// "TextProgressProtocol" default is set.
+- (NSArray *)progressProtocolArguments;
+// Splits data into records and calls -processProgressRecord:... for each
+// complete one. Incomplete record is kept until next call.
+- (void)readProgressRecords:(NSData *)data;
+// Subclass responsibility
+- (void)processProgressRecord:(char)type
+                        flags:(int)flags
+                      payload:(const char *)payload
+                       length:(NSUInteger)length;
+
 @end
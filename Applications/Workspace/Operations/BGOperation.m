@@ -19,7 +19,10 @@
 // Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
 //
 
+#import <SystemKit/OSEDefaults.h>
+
 #import "Operations/BGOperation.h"
+#import "Tools/ProgressProtocol.h"
 
 @implementation BGOperation : NSObject
 
@@ -48,6 +51,9 @@
   alertUI = nil;
   message = nil;
 
+  isBinaryProgress = ![[OSEDefaults userDefaults] boolForKey:@"TextProgressProtocol"];
+  progressData = [NSMutableData new];
+
   [[NSNotificationCenter defaultCenter] postNotificationName:WMOperationDidCreateNotification
                                                       object:self];
 
@@ -67,6 +73,7 @@
   TEST_RELEASE(currFile);
 
   TEST_RELEASE(processUI);
+  TEST_RELEASE(progressData);
 
   [super dealloc];
 }
@@ -253,4 +260,49 @@
   return 0.0;
 }
 
+- (NSArray *)progressProtocolArguments
+{
+  if (isBinaryProgress) {
+    return @[ @"-ProgressFormat", @"Binary" ];
+  }
+  return @[];
+}
+
+- (void)readProgressRecords:(NSData *)data
+{
+  const char *bytes;
+  NSUInteger length, offset = 0;
+  long size;
+
+  [progressData appendData:data];
+  bytes = [progressData bytes];
+  length = [progressData length];
+
+  while ((size = ProgressRecordSize(bytes + offset, length - offset)) > 0) {
+    progress_record_t header;
+
+    memcpy(&header, bytes + offset, sizeof(header));
+    [self processProgressRecord:header.type
+                          flags:header.flags
+                        payload:bytes + offset + sizeof(header)
+                         length:header.length];
+    offset += size;
+  }
+  if (size < 0) {
+    NSDebugLLog(@"Operations", @"%@: garbage in tool output, %lu bytes dropped",
+                [self className], length - offset);
+    offset = length;
+  }
+
+  [progressData replaceBytesInRange:NSMakeRange(0, offset) withBytes:NULL length:0];
+}
+
+- (void)processProgressRecord:(char)type
+                        flags:(int)flags
+                      payload:(const char *)payload
+                       length:(NSUInteger)length
+{
+  // Subclass responsibility
+}
+
 @end
@@ -23,6 +23,7 @@
 
 #import "Operations/FileMover.h"
 #import "Processes/FileMoverUI.h"
+#import "Tools/ProgressProtocol.h"
 
 static inline void ReportGarbage(NSString *garbage)
 {
@@ -44,6 +45,7 @@ static inline void ReportGarbage(NSString *garbage)
 - (void)reportFileExists;
 - (void)reportUnknownFile;
 - (void)reportSymlinkTargetNotExist;
+- (BOOL)reportProblem:(char)type;
 
 @end
 
@@ -170,6 +172,43 @@ static inline void ReportGarbage(NSString *garbage)
   [self setState:OperationAlert];
 }
 
+// Same problem types are used in text and binary protocols
+- (BOOL)reportProblem:(char)type
+{
+  switch (type) {
+    case 'R':
+      [self reportReadError];
+      break;
+    case 'W':
+      [self reportWriteError];
+      break;
+    case 'M':
+      [self reportMoveError];
+      break;
+    case 'S':
+      [self reportSymlink];
+      break;
+    case 'D':
+      [self reportDeleteError];
+      break;
+    case 'A':
+      [self reportAttributesUnchangeable];
+      break;
+    case 'E':
+      [self reportFileExists];
+      break;
+    case 'U':
+      [self reportUnknownFile];
+      break;
+    case 'T':
+      [self reportSymlinkTargetNotExist];
+      break;
+    default:
+      return NO;
+  }
+  return YES;
+}
+
 @end
 
 @implementation FileMover (Alert)
@@ -354,10 +393,10 @@ static inline void ReportGarbage(NSString *garbage)
 
   sizerTask = [NSTask new];
   [sizerTask setLaunchPath:[[NSBundle mainBundle] pathForResource:@"Sizer" ofType:@"tool"]];
-  [sizerTask setArguments:@[
-    @"-Operation", [self typeString], @"-Source", source, @"-Destination", target, @"-Files",
-    [files description]
-  ]];
+  [sizerTask setArguments:[@[
+               @"-Operation", [self typeString], @"-Source", source, @"-Destination", target,
+               @"-Files", [files description]
+             ] arrayByAddingObjectsFromArray:[self progressProtocolArguments]]];
 
   readPipe = [NSPipe new];
   writePipe = [NSPipe new];
@@ -389,9 +428,10 @@ static inline void ReportGarbage(NSString *garbage)
 
   fileMoverTask = [NSTask new];
   [fileMoverTask setLaunchPath:fileMoverPath];
-  [fileMoverTask setArguments:@[
-    @"-Operation", [self typeString], @"-Source", source, @"-Destination", target
-  ]];
+  [fileMoverTask setArguments:[@[
+                   @"-Operation", [self typeString], @"-Source", source, @"-Destination", target
+                 ] arrayByAddingObjectsFromArray:[self progressProtocolArguments]]];
+  [progressData setLength:0];
   // Transfer '-Files' argument as environment variable to omit parameter
   // length limit
   if (files) {
@@ -501,49 +541,19 @@ static inline void ReportGarbage(NSString *garbage)
 //
 //--- NSTask management ------------------------------------------------------
 //
-- (void)readInput:(NSNotification *)notif
+// Text protocol: lines of tab separated fields
+- (void)readProgressLines:(NSData *)data
 {
-  NSTask *task = (isSizing ? sizerTask : fileMoverTask);
   NSString *input;
   NSMutableArray *lines;
   NSEnumerator *e;
   NSString *line;
-  NSData *data = nil;
-
-  // NSDebugLLog(@"FileMover", @"==== [FileOperation readInput]");
-
-  // === LOCK
-  while (inputLock && [inputLock tryLock] == NO) {
-    NSDebugLLog(@"FileMover", @"[FileMover readInput] LOCK FAILED! Waiting...");
-    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
-  }
-  // ===
-
-  NS_DURING
-  {
-    if (task != nil && ![task isRunning] && notif == nil) {
-      // Grab data left in input from '-terminate'd NSTask
-      NSDebugLLog(@"FileMover", @"==== [FileMover readInput] last read");
-      data = [[readPipe fileHandleForReading] readDataToEndOfFile];
-    } else {
-      data = [[readPipe fileHandleForReading] availableData];
-    }
-  }
-  NS_HANDLER
-  {
-    NSDebugLLog(@"FileMover", @"==== [FileMover readInput] EXCEPTION");
-    [inputLock unlock];
-    return;
-  }
-  NS_ENDHANDLER
 
   // NSUTF8StringEncoding is important in case of non ASCII file names
   input = [[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease];
 
   if (input == nil) {
     NSDebugLLog(@"FileMover", @"==== [FileMover readInput] NIL");
-    [inputLock unlock];
-    [[readPipe fileHandleForReading] waitForDataInBackgroundAndNotify];
     return;
   }
 
@@ -625,7 +635,8 @@ static inline void ReportGarbage(NSString *garbage)
         ASSIGN(currSourceDir, [args objectAtIndex:3]);
         ASSIGN(currTargetDir, [args objectAtIndex:4]);
 
-        if (numberOfFiles > 0) {
+        // Sizer sends intermediate totals while it's still running
+        if (!isSizing && numberOfFiles > 0) {
           numberOfFilesDone++;
           // NSDebugLLog(@"FileMover", @"numberOfFilesDone: %llu (%llu)", numberOfFilesDone,
           //             numberOfFiles);
@@ -704,38 +715,122 @@ static inline void ReportGarbage(NSString *garbage)
           }
         }
         break;
-      case 'R':
-        [self reportReadError];
-        break;
-      case 'W':
-        [self reportWriteError];
-        break;
-      case 'M':
-        [self reportMoveError];
-        break;
-      case 'S':
-        [self reportSymlink];
-        break;
-      case 'D':
-        [self reportDeleteError];
-        break;
-      case 'A':
-        [self reportAttributesUnchangeable];
-        break;
-      case 'E':
-        [self reportFileExists];
-        break;
-      case 'U':
-        [self reportUnknownFile];
+      default:
+        if ([self reportProblem:msgType] == NO) {
+          ReportGarbage(line);
+        }
         break;
-      case 'T':
-        [self reportSymlinkTargetNotExist];
+    }
+  }
+}
+
+// Binary protocol
+- (void)processProgressRecord:(char)type
+                        flags:(int)flags
+                      payload:(const char *)payload
+                       length:(NSUInteger)length
+{
+  const char *strings[4];
+
+  switch (type) {
+    case '0':
+    case '1':
+      if (ProgressRecordStrings(payload, length, 0, strings, 1) < 1) {
         break;
-      default:
-        ReportGarbage(line);
+      }
+      ASSIGN(message, [NSString stringWithUTF8String:strings[0]]);
+      ASSIGN(currFile, @"");
+      ASSIGN(currSourceDir, @"");
+      ASSIGN(currTargetDir, @"");
+      numberOfFilesDone = 0.0;
+      doneBatchSize = 0.0;
+
+      [self updateProcessView:NO];
+      break;
+    case 'F': {
+      uint32_t count;
+
+      if (length < sizeof(count) ||
+          ProgressRecordStrings(payload, length, sizeof(count), strings, 4) < 4) {
+        NSDebugLLog(@"FileMover", @"F: not enought args");
         break;
+      }
+      memcpy(&count, payload, sizeof(count));
+      ASSIGN(message, [NSString stringWithUTF8String:strings[0]]);
+      ASSIGN(currFile, [NSString stringWithUTF8String:strings[1]]);
+      ASSIGN(currSourceDir, [NSString stringWithUTF8String:strings[2]]);
+      ASSIGN(currTargetDir, [NSString stringWithUTF8String:strings[3]]);
+
+      if (!isSizing && numberOfFiles > 0) {
+        numberOfFilesDone += count;
+      }
+      if (!isSizing && [currFile isEqualToString:@""]) {
+        [self setState:OperationCompleted];
+      }
+      [self updateProcessView:NO];
+    } break;
+    case 'B':
+      if (length >= sizeof(uint64_t)) {
+        doneBatchSize += ProgressRecordNumber(payload, 0);
+        [self updateProcessView:NO];
+      }
+      break;
+    case 'Q':
+      if (length >= 2 * sizeof(uint64_t)) {
+        if (flags & PROGRESS_INCREMENT) {
+          numberOfFiles += ProgressRecordNumber(payload, 0);
+          totalBatchSize += ProgressRecordNumber(payload, 1);
+        } else {
+          numberOfFiles = ProgressRecordNumber(payload, 0);
+          totalBatchSize = ProgressRecordNumber(payload, 1);
+        }
+      }
+      break;
+    default:
+      if ([self reportProblem:type] == NO) {
+        NSDebugLLog(@"FileMover", @"Got unknown record '%c' from FileMover subprocess", type);
+      }
+      break;
+  }
+}
+
+- (void)readInput:(NSNotification *)notif
+{
+  NSTask *task = (isSizing ? sizerTask : fileMoverTask);
+  NSData *data = nil;
+
+  // NSDebugLLog(@"FileMover", @"==== [FileOperation readInput]");
+
+  // === LOCK
+  while (inputLock && [inputLock tryLock] == NO) {
+    NSDebugLLog(@"FileMover", @"[FileMover readInput] LOCK FAILED! Waiting...");
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  }
+  // ===
+
+  NS_DURING
+  {
+    if (task != nil && ![task isRunning] && notif == nil) {
+      // Grab data left in input from '-terminate'd NSTask
+      NSDebugLLog(@"FileMover", @"==== [FileMover readInput] last read");
+      data = [[readPipe fileHandleForReading] readDataToEndOfFile];
+    } else {
+      data = [[readPipe fileHandleForReading] availableData];
     }
   }
+  NS_HANDLER
+  {
+    NSDebugLLog(@"FileMover", @"==== [FileMover readInput] EXCEPTION");
+    [inputLock unlock];
+    return;
+  }
+  NS_ENDHANDLER
+
+  if (isBinaryProgress) {
+    [self readProgressRecords:data];
+  } else {
+    [self readProgressLines:data];
+  }
 
   if (task != nil && [task isRunning]) {
     [[readPipe fileHandleForReading] waitForDataInBackgroundAndNotify];
@@ -23,6 +23,7 @@
 
 #import "Operations/Sizer.h"
 #import "Processes/BGProcess.h"
+#import "Tools/ProgressProtocol.h"
 
 NSString *WMSizerGotNumbersNotification = @"WMSizerGotNumbersNotification";
 
@@ -59,10 +60,10 @@ static inline void ReportGarbage(NSString *garbage)
   // Create task for tool
   task = [NSTask new];
   [task setLaunchPath:[[NSBundle mainBundle] pathForResource:@"Sizer" ofType:@"tool"]];
-  [task setArguments:@[
-    @"-Operation", [self typeString], @"-Source", currSourceDir, @"-Destination", currTargetDir,
-    @"-Files", [fileList description]
-  ]];
+  [task setArguments:[@[
+          @"-Operation", [self typeString], @"-Source", currSourceDir, @"-Destination",
+          currTargetDir, @"-Files", [fileList description]
+        ] arrayByAddingObjectsFromArray:[self progressProtocolArguments]]];
 
   readPipe = [NSPipe new];
   writePipe = [NSPipe new];
@@ -147,48 +148,19 @@ static inline void ReportGarbage(NSString *garbage)
 //
 //--- NSTask management ------------------------------------------------------
 //
-- (void)readInput:(NSNotification *)notif
+// Text protocol: lines of tab separated fields
+- (void)readProgressLines:(NSData *)data
 {
   NSString *input;
   NSMutableArray *lines;
   NSEnumerator *e;
   NSString *line;
-  NSData *data = nil;
-
-  // NSDebugLLog(@"Sizer", @"==== [FileOperation readInput]");
-
-  // === LOCK
-  while (inputLock && [inputLock tryLock] == NO) {
-    NSDebugLLog(@"Sizer", @"[Sizer readInput] LOCK FAILED! Waiting...");
-    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
-  }
-  // ===
-
-  NS_DURING
-  {
-    if (task != nil && ![task isRunning] && notif == nil) {
-      // Grab data left in input from '-terminate'd NSTask
-      NSDebugLLog(@"Sizer", @"==== [Sizer readInput] last read");
-      data = [[readPipe fileHandleForReading] readDataToEndOfFile];
-    } else {
-      data = [[readPipe fileHandleForReading] availableData];
-    }
-  }
-  NS_HANDLER
-  {
-    NSDebugLLog(@"Sizer", @"==== [Sizer readInput] EXCEPTION");
-    [inputLock unlock];
-    return;
-  }
-  NS_ENDHANDLER
 
   // NSUTF8StringEncoding is important in case of non ASCII file names
   input = [[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease];
 
   if (input == nil) {
     NSDebugLLog(@"Sizer", @"==== [Sizer readInput] NIL");
-    // [inputLock unlock];
-    // [[readPipe fileHandleForReading] waitForDataInBackgroundAndNotify];
     return;
   }
 
@@ -336,6 +308,107 @@ static inline void ReportGarbage(NSString *garbage)
         break;
     }
   }
+}
+
+// Binary protocol
+- (void)processProgressRecord:(char)type
+                        flags:(int)flags
+                      payload:(const char *)payload
+                       length:(NSUInteger)length
+{
+  const char *strings[4];
+
+  switch (type) {
+    case '0':
+    case '1':
+      if (ProgressRecordStrings(payload, length, 0, strings, 1) < 1) {
+        break;
+      }
+      [self setState:(type == '0') ? OperationCompleted : OperationStopped];
+      if (processUI) {
+        [processUI updateWithMessage:[NSString stringWithUTF8String:strings[0]]
+                                file:@""
+                              source:@""
+                              target:@""
+                            progress:0.0];
+      }
+      break;
+    case 'F':
+      if (length < sizeof(uint32_t) ||
+          ProgressRecordStrings(payload, length, sizeof(uint32_t), strings, 3) < 3) {
+        NSDebugLLog(@"Sizer", @"F: not enought args");
+        break;
+      }
+      ASSIGN(message, [NSString stringWithUTF8String:strings[0]]);
+      ASSIGN(currFile, [NSString stringWithUTF8String:strings[1]]);
+      ASSIGN(currSourceDir, [NSString stringWithUTF8String:strings[2]]);
+
+      if (processUI) {
+        [processUI updateWithMessage:message
+                                file:currFile
+                              source:currSourceDir
+                              target:nil
+                            progress:0.0];
+      }
+      break;
+    case 'Q':
+      if (length < 2 * sizeof(uint64_t)) {
+        break;
+      }
+      if (flags & PROGRESS_INCREMENT) {
+        numberOfFiles += ProgressRecordNumber(payload, 0);
+        totalBatchSize += ProgressRecordNumber(payload, 1);
+      } else {
+        numberOfFiles = ProgressRecordNumber(payload, 0);
+        totalBatchSize = ProgressRecordNumber(payload, 1);
+      }
+      // Intermediate totals are not reported: observers expect final numbers
+      if (flags & PROGRESS_FINAL) {
+        [self reportNumbers];
+      }
+      break;
+    default:
+      NSDebugLLog(@"Sizer", @"Got unknown record '%c' from Sizer.tool", type);
+      break;
+  }
+}
+
+- (void)readInput:(NSNotification *)notif
+{
+  NSData *data = nil;
+
+  // NSDebugLLog(@"Sizer", @"==== [FileOperation readInput]");
+
+  // === LOCK
+  while (inputLock && [inputLock tryLock] == NO) {
+    NSDebugLLog(@"Sizer", @"[Sizer readInput] LOCK FAILED! Waiting...");
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  }
+  // ===
+
+  NS_DURING
+  {
+    if (task != nil && ![task isRunning] && notif == nil) {
+      // Grab data left in input from '-terminate'd NSTask
+      NSDebugLLog(@"Sizer", @"==== [Sizer readInput] last read");
+      data = [[readPipe fileHandleForReading] readDataToEndOfFile];
+    } else {
+      data = [[readPipe fileHandleForReading] availableData];
+    }
+  }
+  NS_HANDLER
+  {
+    NSDebugLLog(@"Sizer", @"==== [Sizer readInput] EXCEPTION");
+    [inputLock unlock];
+    return;
+  }
+  NS_ENDHANDLER
+
+  if (isBinaryProgress) {
+    [self readProgressRecords:data];
+  } else {
+    [self readProgressLines:data];
+  }
 
   if (task != nil && [task isRunning]) {
     [[readPipe fileHandleForReading] waitForDataInBackgroundAndNotify];
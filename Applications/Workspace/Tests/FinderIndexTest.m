@@ -0,0 +1,159 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: Tests of FinderIndex with file system monitor running.
+//
+// Copyright (C) 2026 NEXTSPACE Team
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Home directory is indexed and index files are saved into it, so the tool
+// refuses to run in non-empty home. `make check` runs it with HOME set to
+// a temporary directory.
+
+#import <AppKit/AppKit.h>
+#import <SystemKit/OSEFileSystemMonitor.h>
+
+#import "FinderIndex.h"
+
+// Seconds to wait for index build and for monitor events
+#define BUILD_TIMEOUT 10.0
+#define EVENT_TIMEOUT 5.0
+
+// FinderIndex gets monitor from application delegate
+@interface TestApplication : NSObject
+{
+  OSEFileSystemMonitor *fileSystemMonitor;
+}
+@end
+@implementation TestApplication
+
+- (id)delegate
+{
+  return self;
+}
+
+- (OSEFileSystemMonitor *)fileSystemMonitor
+{
+  if (!fileSystemMonitor) {
+    fileSystemMonitor = [OSEFileSystemMonitor sharedMonitor];
+    while ([fileSystemMonitor monitorThread] == nil) {
+      [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                               beforeDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+    }
+    [fileSystemMonitor start];
+  }
+  return fileSystemMonitor;
+}
+
+@end
+
+static int failures = 0;
+
+static void Check(BOOL isPassed, NSString *description)
+{
+  printf("%s: %s\n", isPassed ? "PASS" : "FAIL", [description UTF8String]);
+  if (!isPassed) {
+    failures++;
+  }
+}
+
+// Returns paths of files named `name` found by index in `path` or nil if
+// `path` is not indexed yet.
+static NSArray *FindName(NSString *name, NSString *path)
+{
+  NSRegularExpression *expression;
+  NSArray *unindexed = nil;
+
+  expression = [NSRegularExpression
+      regularExpressionWithPattern:[NSString stringWithFormat:@"^%@$", name]
+                           options:0
+                             error:NULL];
+  return [[FinderIndex sharedIndex] pathsMatching:expression
+                                           inPath:path
+                                       showHidden:NO
+                                        unindexed:&unindexed
+                                        operation:nil];
+}
+
+// Runs main run loop (monitor events are delivered there) until index finds
+// `filePath` by its name or `timeout` expires
+static BOOL WaitForFile(NSString *filePath, NSString *rootPath, NSTimeInterval timeout)
+{
+  NSDate *limit = [NSDate dateWithTimeIntervalSinceNow:timeout];
+  NSString *name = [filePath lastPathComponent];
+
+  while ([limit timeIntervalSinceNow] > 0) {
+    if ([FindName(name, rootPath) containsObject:filePath]) {
+      return YES;
+    }
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  }
+  return NO;
+}
+
+static BOOL CreateFile(NSString *path)
+{
+  return [[NSFileManager defaultManager] createFileAtPath:path contents:nil attributes:nil];
+}
+
+int main(int argc, const char **argv)
+{
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *home = NSHomeDirectory();
+  NSString *subdir = [home stringByAppendingPathComponent:@"Documents/Notes"];
+  NSString *existing = [subdir stringByAppendingPathComponent:@"existing.txt"];
+  NSString *inRoot = [home stringByAppendingPathComponent:@"created-in-root.txt"];
+  NSString *inSubdir = [subdir stringByAppendingPathComponent:@"created-in-subdir.txt"];
+  NSDate *limit;
+
+  for (NSString *item in [fm directoryContentsAtPath:home]) {
+    if (![item isEqualToString:@"GNUstep"] && ![item isEqualToString:@"Library"]) {
+      fprintf(stderr, "Home directory %s is not empty. Run with HOME set to empty directory.\n",
+              [home fileSystemRepresentation]);
+      return 2;
+    }
+  }
+
+  NSApp = (NSApplication *)[[TestApplication alloc] init];
+
+  [fm createDirectoryAtPath:subdir withIntermediateDirectories:YES attributes:nil error:NULL];
+  CreateFile(existing);
+
+  // Index of home is built in background
+  [[FinderIndex sharedIndex] prepareForPaths:[NSArray arrayWithObject:home]];
+  limit = [NSDate dateWithTimeIntervalSinceNow:BUILD_TIMEOUT];
+  while (FindName(@"existing.txt", home) == nil && [limit timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  }
+  Check([FindName(@"existing.txt", home) containsObject:existing],
+        @"file existed before index build is found");
+
+  // Created files are known from monitor events only
+  CreateFile(inRoot);
+  Check(WaitForFile(inRoot, home, EVENT_TIMEOUT), @"file created in indexed root is found");
+
+  CreateFile(inSubdir);
+  Check(WaitForFile(inSubdir, home, EVENT_TIMEOUT),
+        @"file created in subdirectory of indexed root is found");
+
+  [[OSEFileSystemMonitor sharedMonitor] terminate];
+  [pool release];
+
+  return failures > 0 ? 1 : 0;
+}
@@ -23,6 +23,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "ProgressProtocol.h"
 
 extern BOOL isStopped;
 extern void StopOperation();
@@ -58,7 +59,7 @@ typedef enum {
   OverwriteFile
 } ProblemSolution;
 
-// Communication messages:
+// Communication messages (text protocol, see ProgressProtocol.h for binary):
 // "F\t<message>\t<filename>\t<source dir>\t<target dir>"
 // "B\t<size>\n" - file size progress
 // "B\t<file count>\t<size>\n"
@@ -96,6 +97,14 @@ typedef enum {
   NSString *currentTargetPrefix;
 
   unsigned long long fileProgress;
+
+  // Binary protocol
+  BOOL isBinary;
+  NSString *sentMessage;
+  NSString *sentSourcePrefix;
+  NSString *sentTargetPrefix;
+  unsigned int filesProgress;
+  NSTimeInterval flushTime;
 }
 
 + (id)shared;
@@ -106,6 +115,15 @@ typedef enum {
                  bytesAdvanced:(unsigned long long)progress
                  operationType:(OperationType)opType;
 
+// Sends progress postponed by binary protocol
+- (void)flushProgress;
+
+// Sizer's totals. Text protocol sends final totals only.
+- (void)showQueuedFiles:(unsigned long long)count
+                   size:(unsigned long long)size
+              increment:(BOOL)isIncrement
+                  final:(BOOL)isFinal;
+
 - (void)finishOperation:(NSString *)opName stopped:(BOOL)isStopped;
 
 - (ProblemSolution)howToHandleProblem:(ProblemType)p;
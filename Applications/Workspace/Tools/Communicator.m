@@ -55,9 +55,61 @@ static Communicator *shared = nil;
 
   makeCleanupOnStop = YES;
 
+  isBinary = [[[NSUserDefaults standardUserDefaults] stringForKey:@"ProgressFormat"]
+      isEqualToString:@"Binary"];
+
   return self;
 }
 
+- (void)_sendRecord:(char)type flags:(uint8_t)flags payload:(const void *)payload length:(size_t)len
+{
+  progress_record_t header = {type, flags, 0, len};
+
+  fwrite(&header, sizeof(header), 1, stdout);
+  if (len > 0) {
+    fwrite(payload, len, 1, stdout);
+  }
+}
+
+// Problem and finish messages
+- (void)_sendMessage:(char)type text:(NSString *)text
+{
+  const char *string = (text != nil) ? [text UTF8String] : "";
+
+  [self flushProgress];
+  [self _sendRecord:type flags:0 payload:string length:strlen(string) + 1];
+  fflush(stdout);
+}
+
+- (void)flushProgress
+{
+  if (!isBinary) {
+    return;
+  }
+
+  if (filesProgress > 0) {
+    NSMutableData *payload = [NSMutableData new];
+
+    [payload appendBytes:&filesProgress length:sizeof(uint32_t)];
+    for (NSString *string in @[ sentMessage, sentFilename, sentSourcePrefix, sentTargetPrefix ]) {
+      const char *s = [string UTF8String];
+      [payload appendBytes:s length:strlen(s) + 1];
+    }
+    [self _sendRecord:'F' flags:0 payload:[payload bytes] length:[payload length]];
+    [payload release];
+    filesProgress = 0;
+  }
+  if (fileProgress != 0) {
+    uint64_t bytes = fileProgress;
+
+    [self _sendRecord:'B' flags:0 payload:&bytes length:sizeof(bytes)];
+    fileProgress = 0;
+  }
+  flushTime = [NSDate timeIntervalSinceReferenceDate];
+
+  fflush(stdout);
+}
+
 // filename - name of file which displayed in operation status field
 //            e.g. "Copying filename"
 // sourcePrefix - path of source dir minus 'filename'
@@ -107,7 +159,16 @@ static Communicator *shared = nil;
         break;
     }
     // Send output
-    if (![sentFilename isEqual:currentFilename] || lastOpType != opType) {
+    if (isBinary) {
+      if (![sentFilename isEqual:currentFilename] || lastOpType != opType) {
+        ASSIGN(sentFilename, currentFilename);
+        ASSIGN(sentMessage, opMessage);
+        ASSIGN(sentSourcePrefix, currentSourcePrefix);
+        ASSIGN(sentTargetPrefix, currentTargetPrefix);
+        lastOpType = opType;
+        filesProgress++;
+      }
+    } else if (![sentFilename isEqual:currentFilename] || lastOpType != opType) {
       ASSIGN(sentFilename, currentFilename);
       lastOpType = opType;
       // F\t<message>\t<filename>\t<source dir>\t<target dir>
@@ -116,6 +177,14 @@ static Communicator *shared = nil;
     }
   }
 
+  if (isBinary) {
+    // Coalesce updates: bytes and number of files are summed up
+    if ([NSDate timeIntervalSinceReferenceDate] - flushTime >= 1.0 / PROGRESS_RATE) {
+      [self flushProgress];
+    }
+    return;
+  }
+
   if (fileProgress != 0) {
     printf("B\t%llu\n", fileProgress);
     fileProgress = 0;
@@ -124,8 +193,38 @@ static Communicator *shared = nil;
   fflush(stdout);
 }
 
+- (void)showQueuedFiles:(unsigned long long)count
+                   size:(unsigned long long)size
+              increment:(BOOL)isIncrement
+                  final:(BOOL)isFinal
+{
+  if (isBinary) {
+    uint64_t numbers[2] = {count, size};
+    uint8_t flags = (isIncrement ? PROGRESS_INCREMENT : 0) | (isFinal ? PROGRESS_FINAL : 0);
+
+    [self _sendRecord:'Q' flags:flags payload:numbers length:sizeof(numbers)];
+  } else if (isFinal) {
+    if (isIncrement) {
+      printf("Q\tF\t%llu\t+\n", count);
+      printf("Q\tS\t%llu\t+\n", size);
+    } else {
+      printf("Q\tF\t%llu\n", count);
+      printf("Q\tS\t%llu\n", size);
+    }
+  }
+  fflush(stdout);
+}
+
 - (void)finishOperation:(NSString *)opName stopped:(BOOL)isStopped
 {
+  if (isBinary) {
+    [self _sendMessage:(isStopped ? '1' : '0')
+                  text:[NSString stringWithFormat:(isStopped ? @"%@ Operation Stopped"
+                                                             : @"%@ Operation Completed"),
+                                                  opName]];
+    return;
+  }
+
   if (isStopped) {
     printf("1\t%s\n", [[NSString stringWithFormat:@"%@ Operation Stopped", opName] cString]);
   } else {
@@ -134,6 +233,16 @@ static Communicator *shared = nil;
   fflush(stdout);
 }
 
+- (void)_showProblem:(char)type message:(NSString *)message
+{
+  if (isBinary) {
+    [self _sendMessage:type text:message];
+  } else {
+    printf("%c%s\n", type, message != nil ? [message cString] : "");
+    fflush(stdout);
+  }
+}
+
 - (ProblemSolution)howToHandleProblem:(ProblemType)probl
 {
   return [self howToHandleProblem:probl argument:nil];
@@ -151,8 +260,7 @@ static Communicator *shared = nil;
         return defaultReadErrorAction;
       }
 
-      printf("R%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self _showProblem:'R' message:message];
       do {
         answer = fgetc(stdin);
       } while (answer != 's' && answer != 'S' && answer != 't');
@@ -173,8 +281,7 @@ static Communicator *shared = nil;
         return defaultWriteErrorAction;
       }
 
-      printf("W%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self _showProblem:'W' message:message];
       do {
         answer = fgetc(stdin);
       } while (answer != 's' && answer != 'S' && answer != 't');
@@ -195,8 +302,7 @@ static Communicator *shared = nil;
         return defaultDeleteErrorAction;
       }
 
-      printf("D%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self _showProblem:'D' message:message];
       do {
         answer = fgetc(stdin);
       } while (answer != 's' && answer != 'S' && answer != 't');
@@ -217,8 +323,7 @@ static Communicator *shared = nil;
         return defaultMoveErrorAction;
       }
 
-      printf("M%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self _showProblem:'M' message:message];
       do {
         answer = fgetc(stdin);
       } while (answer != 's' && answer != 'S' && answer != 't');
@@ -242,8 +347,7 @@ static Communicator *shared = nil;
       // Cc - Copy the orignial
       // Nn - New Link
       // Ss - Skip
-      printf("S%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self _showProblem:'S' message:message];
       do {
         answer = fgetc(stdin);
       } while (answer != 's' && answer != 'S' && answer != 'n' && answer != 'N' && answer != 'c' &&
@@ -275,8 +379,7 @@ static Communicator *shared = nil;
         return defaultSymlinkTargetAction;
       }
 
-      printf("T%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self _showProblem:'T' message:message];
       // Nn - New Link
       // Ss - Skip
       do {
@@ -306,8 +409,7 @@ static Communicator *shared = nil;
       if (defaultAttrsAction != NOT_SET) {
         return defaultAttrsAction;
       }
-      printf("A%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self _showProblem:'A' message:message];
       do {
         answer = fgetc(stdin);
       } while (answer != 'i' && answer != 'I' && answer != 't');
@@ -327,8 +429,7 @@ static Communicator *shared = nil;
         return defaultFileExistsAction;
       }
 
-      printf("E%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self _showProblem:'E' message:message];
       do {
         answer = fgetc(stdin);
       } while (answer != 's' && answer != 'S' && answer != 'o' && answer != 'O' && answer != 't');
@@ -354,8 +455,7 @@ static Communicator *shared = nil;
         return defaultUnknownFileAction;
       }
 
-      printf("U%s\n", message != nil ? [message cString] : "");
-      fflush(stdout);
+      [self _showProblem:'U' message:message];
       do {
         answer = fgetc(stdin);
       } while (answer != 'S' && answer != 's' && answer != 't');
@@ -30,6 +30,16 @@ BOOL CopyOperation(NSString *sourceDir, NSArray *files, NSString *destDir, Opera
 BOOL CopyFile(NSString *filename, NSString *sourcePrefix, NSString *targetPrefix, BOOL traverseLink,
               OperationType opType);
 
+// Receives number of bytes processed since last call
+typedef void (*CopyProgressFunc)(unsigned long long bytes, void *data);
+
+// Returns 0 or errno value. Doesn't use Communicator, so may be called by any
+// thread. On failure `failedRead` tells if source or target has failed.
+int CopyFileContents(const char *sourcePath, const char *targetPath, CopyProgressFunc progress,
+                     void *progressData, BOOL *failedRead);
+
+double MonotonicTime(void);
+
 void DuplicateOperation(NSString *sourceDir, NSArray *files);
 
 BOOL DuplicateSymbolicLink(NSString *sourceFile, NSString *targetFile, NSDictionary *fattrs);
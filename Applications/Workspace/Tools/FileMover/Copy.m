@@ -21,10 +21,18 @@
 //
 
 #import "Copy.h"
+#import "CopyQueue.h"
 #import "NSStringAdditions.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
 
 // --- Copy
 
@@ -49,6 +57,8 @@ BOOL CopyOperation(NSString *sourceDir, NSArray *files, NSString *destDir, Opera
   NSString *file;
   BOOL opResult = YES;
 
+  ASSIGN(copyQueue, [CopyQueue queueWithDefaultWorkers]);
+
   e = [files objectEnumerator];
   while (((file = [e nextObject]) != nil) && !isStopped && (opResult == YES)) {
     NSDebugLLog(@"Tools", @"Copy operation START");
@@ -56,6 +66,11 @@ BOOL CopyOperation(NSString *sourceDir, NSArray *files, NSString *destDir, Opera
     NSDebugLLog(@"Tools", @"Copy operation END");
   }
 
+  if (copyQueue != nil) {
+    opResult = [copyQueue waitUntilDone] && opResult;
+    DESTROY(copyQueue);
+  }
+
   // We received SIGTERM signal or 'Stop' command
   // Remove created duplicates and exit
   if (isStopped) {
@@ -110,21 +125,239 @@ BOOL CopyDirectory(NSString *sourceDir, NSString *targetDir, NSDictionary *fileA
     CopyFile(filename, sourceDir, targetDir, NO, opType);
   }
 
-  if (chmod([targetDir cString], [fileAttributes filePosixPermissions]) == -1) {
+  if (copyQueue != nil) {
+    [copyQueue setPermissions:[fileAttributes filePosixPermissions] ofDirectory:targetDir];
+  } else if (chmod([targetDir cString], [fileAttributes filePosixPermissions]) == -1) {
     [comm howToHandleProblem:AttributesUnchangeable argument:[NSString errnoDescription]];
   }
 
   return YES;
 }
 
+// --- Regular file data transfer
+
+// Bytes transferred by one system call. Keeps stop requests and progress
+// reports responsive while kernel copies multi-gigabyte files.
+#define COPY_CHUNK_SIZE (8 * 1024 * 1024)
+#define COPY_BUFFER_SIZE (256 * 1024)
+// Minimal interval between progress reports (seconds)
+#define PROGRESS_INTERVAL 0.1
+
+// Ordered from the fastest. Copying falls back to the next method if the
+// current one is not supported for source and target file pair.
+typedef enum { CopyFileRange, CopySendfile, CopyBuffered } CopyMethod;
+
+typedef struct {
+  int read_fd;
+  int write_fd;
+  CopyMethod method;
+  char *buffer;
+} CopyContext;
+
+double MonotonicTime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static BOOL CanFallBack(int error)
+{
+  return (error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP ||
+          error == ENOTSUP);
+}
+
+// Writes whole buffer handling short writes. Returns -1 on error.
+static ssize_t WriteAll(int fd, const char *buf, size_t len)
+{
+  size_t written = 0;
+  ssize_t n;
+
+  while (written < len) {
+    n = write(fd, buf + written, len - written);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    written += n;
+  }
+  return written;
+}
+
+// Copies at most `len` bytes at `offset` of source into the same offset of
+// target. Returns number of bytes copied, 0 on unexpected end of file or -1
+// on error (errno is set, `*failedRead` tells which side has failed).
+static ssize_t CopyChunk(CopyContext *ctx, off_t offset, size_t len, BOOL *failedRead)
+{
+  ssize_t n;
+
+  *failedRead = NO;
+
+  if (ctx->method == CopyFileRange) {
+    off_t in_ofs = offset, out_ofs = offset;
+
+    n = copy_file_range(ctx->read_fd, &in_ofs, ctx->write_fd, &out_ofs, len, 0);
+    if (n >= 0 || !CanFallBack(errno)) {
+      return n;
+    }
+    ctx->method = CopySendfile;
+  }
+
+  if (lseek(ctx->write_fd, offset, SEEK_SET) < 0) {
+    return -1;
+  }
+
+  if (ctx->method == CopySendfile) {
+    off_t in_ofs = offset;
+
+    n = sendfile(ctx->write_fd, ctx->read_fd, &in_ofs, len);
+    if (n >= 0 || !CanFallBack(errno)) {
+      return n;
+    }
+    ctx->method = CopyBuffered;
+  }
+
+  if (ctx->buffer == NULL && (ctx->buffer = malloc(COPY_BUFFER_SIZE)) == NULL) {
+    return -1;
+  }
+  do {
+    n = pread(ctx->read_fd, ctx->buffer, MIN(len, COPY_BUFFER_SIZE), offset);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    *failedRead = (n < 0);
+    return n;
+  }
+  return WriteAll(ctx->write_fd, ctx->buffer, n);
+}
+
+// Data is copied by the kernel without passing through user space: blocks are
+// shared with reflink where file system supports it, otherwise copied with
+// copy_file_range() or sendfile(). Holes of sparse files are preserved.
+int CopyFileContents(const char *sourcePath, const char *targetPath, CopyProgressFunc progress,
+                     void *progressData, BOOL *failedRead)
+{
+  CopyContext ctx = {-1, -1, CopyFileRange, NULL};
+  struct stat st;
+  off_t offset, data, hole;
+  ssize_t n;
+  int error = 0;
+
+  *failedRead = YES;
+  ctx.read_fd = open(sourcePath, O_RDONLY);
+  if (ctx.read_fd < 0 || fstat(ctx.read_fd, &st) < 0) {
+    error = errno;
+    goto copyContentsEnd;
+  }
+  *failedRead = NO;
+  ctx.write_fd = open(targetPath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (ctx.write_fd < 0) {
+    error = errno;
+    goto copyContentsEnd;
+  }
+
+  offset = 0;
+#ifdef FICLONE
+  if (st.st_size > 0 && ioctl(ctx.write_fd, FICLONE, ctx.read_fd) == 0) {
+    offset = st.st_size;
+    progress(st.st_size, progressData);
+  }
+#endif
+
+  // Copy data segments skipping holes
+  for (; offset < st.st_size && !__atomic_load_n(&isStopped, __ATOMIC_RELAXED); offset = hole) {
+    data = lseek(ctx.read_fd, offset, SEEK_DATA);
+    if (data < 0) {
+      // ENXIO: there's only a hole up to the end of file,
+      // otherwise SEEK_DATA is not supported - copy everything.
+      data = (errno == ENXIO) ? st.st_size : offset;
+    }
+    hole = (data < st.st_size) ? lseek(ctx.read_fd, data, SEEK_HOLE) : st.st_size;
+    if (hole < 0 || hole > st.st_size) {
+      hole = st.st_size;
+    }
+    if (data > offset) {
+      progress(data - offset, progressData);
+    }
+
+    while (data < hole && !__atomic_load_n(&isStopped, __ATOMIC_RELAXED)) {
+      n = CopyChunk(&ctx, data, MIN(hole - data, COPY_CHUNK_SIZE), failedRead);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n == 0) {
+        // File was truncated while copying
+        hole = st.st_size = data;
+        break;
+      }
+      if (n < 0) {
+        error = errno;
+        goto copyContentsEnd;
+      }
+      data += n;
+      progress(n, progressData);
+    }
+  }
+
+  // Trailing hole has no data to copy - set the size explicitly
+  if (!__atomic_load_n(&isStopped, __ATOMIC_RELAXED) && ftruncate(ctx.write_fd, st.st_size) < 0) {
+    error = errno;
+  }
+
+copyContentsEnd:
+  if (ctx.read_fd >= 0) {
+    close(ctx.read_fd);
+  }
+  if (ctx.write_fd >= 0) {
+    close(ctx.write_fd);
+  }
+  free(ctx.buffer);
+
+  return error;
+}
+
+typedef struct {
+  NSString *sourceFile;
+  NSString *targetFile;
+  OperationType opType;
+  unsigned long long done;
+  unsigned long long reported;
+  double reportTime;
+} CopyProgress;
+
+// Reports progress not more often than every PROGRESS_INTERVAL seconds.
+// Zero `bytes` forces report of everything not reported yet.
+static void ReportCopyProgress(unsigned long long bytes, void *data)
+{
+  CopyProgress *p = data;
+  double now;
+
+  p->done += bytes;
+  if (p->done == p->reported) {
+    return;
+  }
+  now = MonotonicTime();
+  if (bytes != 0 && (now - p->reportTime) < PROGRESS_INTERVAL) {
+    return;
+  }
+  [[Communicator shared] showProcessingFilename:[p->sourceFile lastPathComponent]
+                                   sourcePrefix:[p->sourceFile stringByDeletingLastPathComponent]
+                                   targetPrefix:[p->targetFile stringByDeletingLastPathComponent]
+                                  bytesAdvanced:p->done - p->reported
+                                  operationType:p->opType];
+  p->reported = p->done;
+  p->reportTime = now;
+}
+
 BOOL CopyRegular(NSString *sourceFile, NSString *targetFile, NSDictionary *fileAttributes,
                  OperationType opType)
 {
-  NSUInteger doneSize = 0;
-  NSString *sourceDir = [sourceFile stringByDeletingLastPathComponent];
-  NSString *targetDir = [targetFile stringByDeletingLastPathComponent];
   NSFileManager *fm = [NSFileManager defaultManager];
   Communicator *comm = [Communicator shared];
+  CopyProgress progress = {sourceFile, targetFile, opType, 0, 0, MonotonicTime()};
+  BOOL failedRead;
 
   if ([fm fileExistsAtPath:targetFile]) {
     ProblemSolution sol = [comm howToHandleProblem:FileExists];
@@ -137,67 +370,34 @@ BOOL CopyRegular(NSString *sourceFile, NSString *targetFile, NSDictionary *fileA
     }
   }
 
-  if (![fm createFileAtPath:targetFile contents:nil attributes:nil]) {
-    [comm howToHandleProblem:WriteError];
-    return NO;
+  // Data is copied by worker threads, directory traversal goes on
+  if (copyQueue != nil) {
+    [copyQueue addFile:sourceFile
+                toPath:targetFile
+            attributes:fileAttributes
+         operationType:opType];
+    return YES;
   }
 
-  if ([fm fileExistsAtPath:targetFile] == NO) {
-    if ([fm createFileAtPath:targetFile contents:nil attributes:nil] == NO) {
-      return NO;
-    }
-  }
-
-  {
-    int read_fd, write_fd;
-    ssize_t bytes_read = 1;
-    size_t block_size = 64 * 1024;
-    void *buf;
-
-    read_fd = open([sourceFile cString], O_RDONLY);
-    if (read_fd < 0) {
-      [comm howToHandleProblem:ReadError];
-      return NO;
-    }
-    write_fd = open([targetFile cString], O_WRONLY);
-    if (write_fd < 0) {
-      [comm howToHandleProblem:WriteError];
-      close(read_fd);
-      return NO;
-    }
-    buf = malloc(64 * 1024);
-
-    while (!isStopped && bytes_read) {
-      bytes_read = read(read_fd, buf, block_size);
-      if (bytes_read > 0) {
-        write(write_fd, buf, bytes_read);
-      }
-      doneSize += bytes_read;
-      [comm showProcessingFilename:[sourceFile lastPathComponent]
-                      sourcePrefix:sourceDir
-                      targetPrefix:targetDir
-                     bytesAdvanced:(NSUInteger)bytes_read
-                     operationType:opType];
-    }
-    close(read_fd);
-    close(write_fd);
-    free(buf);
+  errno = CopyFileContents([sourceFile cString], [targetFile cString], ReportCopyProgress,
+                           &progress, &failedRead);
+  if (errno != 0) {
+    [comm howToHandleProblem:(failedRead ? ReadError : WriteError)
+                    argument:[NSString errnoDescription]];
+    return NO;
   }
 
   if (!isStopped) {
-    int result = chmod([targetFile cString], [fileAttributes filePosixPermissions]);
-    if (result == -1) {
+    if (chmod([targetFile cString], [fileAttributes filePosixPermissions]) == -1) {
       [comm howToHandleProblem:AttributesUnchangeable argument:[NSString errnoDescription]];
     }
 
-    if (doneSize < [fileAttributes fileSize]) {
-      [comm showProcessingFilename:[sourceFile lastPathComponent]
-                      sourcePrefix:sourceDir
-                      targetPrefix:targetDir
-                     bytesAdvanced:[fileAttributes fileSize] - doneSize
-                     operationType:opType];
+    // Size was counted from attributes, file may have changed since then
+    if (progress.done < [fileAttributes fileSize]) {
+      progress.done = [fileAttributes fileSize];
     }
   }
+  ReportCopyProgress(0, &progress);
 
   return YES;
 }
@@ -354,10 +554,13 @@ void DuplicateOperation(NSString *sourceDir, NSArray *files)
   }
 
   // Proceed with duplicating...
+  ASSIGN(copyQueue, [CopyQueue queueWithDefaultWorkers]);
   e = [files objectEnumerator];
   while (((file = [e nextObject]) != nil) && !isStopped) {
     DuplicateFile(file, sourceDir, NO);
   }
+  [copyQueue waitUntilDone];
+  DESTROY(copyQueue);
 
   // We received SIGTERM signal or 'Stop' command
   // Remove created duplicates and exit
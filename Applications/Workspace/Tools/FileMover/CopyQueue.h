@@ -0,0 +1,63 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: The FileOperation tool's parallel copying of files contents.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#import <Foundation/Foundation.h>
+#import "../Communicator.h"
+
+// Number of copying threads is set with "CopyWorkers" default (e.g.
+// `-CopyWorkers 8` argument). Value of 1 disables parallel copying.
+#define DEFAULT_COPY_WORKERS 4
+
+struct copy_queue;
+
+// Directory tree is traversed (directories are created, problems resolved
+// with user) by the main thread while contents of regular files are copied
+// by worker threads. Progress and errors of workers are passed to
+// Communicator from the main thread.
+@interface CopyQueue : NSObject
+{
+  struct copy_queue *queue;
+  NSMutableArray *directories;
+  double reportTime;
+  BOOL failed;
+}
+
+// Returns nil if parallel copying is disabled.
++ (id)queueWithDefaultWorkers;
+
+- (id)initWithWorkers:(int)count;
+
+// Copies contents and permissions. Target file must not exist.
+- (void)addFile:(NSString *)sourceFile
+            toPath:(NSString *)targetFile
+        attributes:(NSDictionary *)fileAttributes
+     operationType:(OperationType)opType;
+
+// Directory permissions are applied after all files inside are copied.
+- (void)setPermissions:(NSUInteger)mode ofDirectory:(NSString *)path;
+
+// Returns NO if some file was not copied.
+- (BOOL)waitUntilDone;
+
+@end
+
+// Active queue of copy operation
+extern CopyQueue *copyQueue;
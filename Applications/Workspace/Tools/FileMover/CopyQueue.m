@@ -0,0 +1,336 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#import "Copy.h"
+#import "CopyQueue.h"
+#import "NSStringAdditions.h"
+
+// Jobs waiting for worker. Scanner waits while queue is full.
+#define QUEUE_CAPACITY 1024
+// Minimal interval between progress reports (seconds)
+#define PROGRESS_INTERVAL 0.1
+
+CopyQueue *copyQueue = nil;
+
+typedef struct copy_job {
+  struct copy_queue *queue;
+  char *source;
+  char *target;
+  mode_t mode;
+  unsigned long long size;
+  unsigned long long done;
+  // Result
+  int error;
+  ProblemType problem;
+  struct copy_job *next;
+} copy_job_t;
+
+struct copy_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t has_jobs;  // signalled to workers
+  pthread_cond_t changed;   // job was taken or finished; signalled to main thread
+  copy_job_t *jobs[QUEUE_CAPACITY];
+  int head;
+  int count;
+  int active;               // jobs taken by workers
+  copy_job_t *failed;       // jobs to report, in reverse order
+  BOOL finish;
+  unsigned long long bytes; // copied but not reported yet
+  OperationType opType;
+  pthread_t *threads;
+  int threads_count;
+};
+
+static void FreeJob(copy_job_t *job)
+{
+  free(job->source);
+  free(job->target);
+  free(job);
+}
+
+static void JobProgress(unsigned long long bytes, void *data)
+{
+  copy_job_t *job = data;
+
+  job->done += bytes;
+  __atomic_add_fetch(&job->queue->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+static void CopyJob(copy_job_t *job)
+{
+  BOOL failedRead;
+
+  job->error = CopyFileContents(job->source, job->target, JobProgress, job, &failedRead);
+  if (job->error != 0) {
+    job->problem = failedRead ? ReadError : WriteError;
+    return;
+  }
+  if (__atomic_load_n(&isStopped, __ATOMIC_RELAXED)) {
+    return;
+  }
+  if (chmod(job->target, job->mode) == -1) {
+    job->error = errno;
+    job->problem = AttributesUnchangeable;
+  }
+  // Size was counted from attributes, file may have changed since then
+  if (job->done < job->size) {
+    JobProgress(job->size - job->done, job);
+  }
+}
+
+static void *CopyWorker(void *arg)
+{
+  struct copy_queue *q = arg;
+  copy_job_t *job;
+
+  while (1) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->finish) {
+      pthread_cond_wait(&q->has_jobs, &q->lock);
+    }
+    if (q->count == 0) {
+      pthread_mutex_unlock(&q->lock);
+      break;
+    }
+    job = q->jobs[q->head];
+    q->head = (q->head + 1) % QUEUE_CAPACITY;
+    q->count--;
+    q->active++;
+    pthread_cond_signal(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+
+    if (!__atomic_load_n(&isStopped, __ATOMIC_RELAXED)) {
+      CopyJob(job);
+    }
+
+    pthread_mutex_lock(&q->lock);
+    q->active--;
+    if (job->error != 0) {
+      job->next = q->failed;
+      q->failed = job;
+    } else {
+      FreeJob(job);
+    }
+    pthread_cond_signal(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+  }
+
+  return NULL;
+}
+
+// Must be called with locked mutex. Wakes up periodically to report progress.
+static void WaitForChange(struct copy_queue *q)
+{
+  struct timespec ts;
+  long nsec;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  nsec = ts.tv_nsec + (long)(PROGRESS_INTERVAL * 1e9);
+  ts.tv_sec += nsec / 1000000000;
+  ts.tv_nsec = nsec % 1000000000;
+  pthread_cond_timedwait(&q->changed, &q->lock, &ts);
+}
+
+@implementation CopyQueue
+
++ (id)queueWithDefaultWorkers
+{
+  NSUserDefaults *df = [NSUserDefaults standardUserDefaults];
+  int count = DEFAULT_COPY_WORKERS;
+
+  if ([df objectForKey:@"CopyWorkers"] != nil) {
+    count = [df integerForKey:@"CopyWorkers"];
+  }
+  if (count <= 1) {
+    return nil;
+  }
+
+  return [[[self alloc] initWithWorkers:count] autorelease];
+}
+
+- (id)initWithWorkers:(int)count
+{
+  [super init];
+
+  queue = calloc(1, sizeof(struct copy_queue));
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->has_jobs, NULL);
+  pthread_cond_init(&queue->changed, NULL);
+
+  queue->threads = calloc(count, sizeof(pthread_t));
+  for (int i = 0; i < count; i++) {
+    if (pthread_create(&queue->threads[queue->threads_count], NULL, CopyWorker, queue) == 0) {
+      queue->threads_count++;
+    }
+  }
+  if (queue->threads_count == 0) {
+    [self release];
+    return nil;
+  }
+  NSDebugLLog(@"Tools", @"CopyQueue: %i workers started", queue->threads_count);
+
+  directories = [NSMutableArray new];
+  reportTime = MonotonicTime();
+
+  return self;
+}
+
+- (void)dealloc
+{
+  copy_job_t *job;
+
+  pthread_mutex_lock(&queue->lock);
+  queue->finish = YES;
+  pthread_cond_broadcast(&queue->has_jobs);
+  pthread_mutex_unlock(&queue->lock);
+
+  for (int i = 0; i < queue->threads_count; i++) {
+    pthread_join(queue->threads[i], NULL);
+  }
+  while ((job = queue->failed) != NULL) {
+    queue->failed = job->next;
+    FreeJob(job);
+  }
+
+  pthread_cond_destroy(&queue->changed);
+  pthread_cond_destroy(&queue->has_jobs);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue->threads);
+  free(queue);
+
+  [directories release];
+
+  [super dealloc];
+}
+
+// Passes workers progress and problems to Communicator.
+// Called by main thread with unlocked mutex.
+- (void)_processResults:(BOOL)force
+{
+  Communicator *comm = [Communicator shared];
+  copy_job_t *failedJobs, *job, *reversed = NULL;
+  unsigned long long bytes;
+  double now = MonotonicTime();
+
+  if (!force && (now - reportTime) < PROGRESS_INTERVAL) {
+    return;
+  }
+  reportTime = now;
+
+  bytes = __atomic_exchange_n(&queue->bytes, 0, __ATOMIC_RELAXED);
+  if (bytes > 0) {
+    [comm showProcessingFilename:nil
+                    sourcePrefix:nil
+                    targetPrefix:nil
+                   bytesAdvanced:bytes
+                   operationType:queue->opType];
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  failedJobs = queue->failed;
+  queue->failed = NULL;
+  pthread_mutex_unlock(&queue->lock);
+
+  while ((job = failedJobs) != NULL) {
+    failedJobs = job->next;
+    job->next = reversed;
+    reversed = job;
+  }
+  while ((job = reversed) != NULL) {
+    reversed = job->next;
+    if (!isStopped) {
+      [comm howToHandleProblem:job->problem
+                      argument:[NSString stringWithFormat:@"%s: %s", job->target,
+                                                          strerror(job->error)]];
+    }
+    if (job->problem != AttributesUnchangeable) {
+      failed = YES;
+    }
+    FreeJob(job);
+  }
+}
+
+- (void)addFile:(NSString *)sourceFile
+            toPath:(NSString *)targetFile
+        attributes:(NSDictionary *)fileAttributes
+     operationType:(OperationType)opType
+{
+  copy_job_t *job = calloc(1, sizeof(copy_job_t));
+
+  job->queue = queue;
+  job->source = strdup([sourceFile cString]);
+  job->target = strdup([targetFile cString]);
+  job->mode = [fileAttributes filePosixPermissions];
+  job->size = [fileAttributes fileSize];
+
+  pthread_mutex_lock(&queue->lock);
+  queue->opType = opType;
+  while (queue->count == QUEUE_CAPACITY) {
+    WaitForChange(queue);
+    pthread_mutex_unlock(&queue->lock);
+    [self _processResults:NO];
+    pthread_mutex_lock(&queue->lock);
+  }
+  queue->jobs[(queue->head + queue->count) % QUEUE_CAPACITY] = job;
+  queue->count++;
+  pthread_cond_signal(&queue->has_jobs);
+  pthread_mutex_unlock(&queue->lock);
+
+  [self _processResults:NO];
+}
+
+- (void)setPermissions:(NSUInteger)mode ofDirectory:(NSString *)path
+{
+  [directories addObject:@[ path, [NSNumber numberWithUnsignedInteger:mode] ]];
+}
+
+- (BOOL)waitUntilDone
+{
+  Communicator *comm = [Communicator shared];
+
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count > 0 || queue->active > 0) {
+    WaitForChange(queue);
+    pthread_mutex_unlock(&queue->lock);
+    [self _processResults:NO];
+    pthread_mutex_lock(&queue->lock);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  [self _processResults:YES];
+
+  // Directories were added after their contents, so subdirectories become
+  // read-only (if they should) before parent directory.
+  for (NSArray *dir in directories) {
+    if (chmod([[dir objectAtIndex:0] cString], [[dir objectAtIndex:1] unsignedIntegerValue]) ==
+        -1) {
+      [comm howToHandleProblem:AttributesUnchangeable argument:[NSString errnoDescription]];
+    }
+  }
+  [directories removeAllObjects];
+
+  return !failed;
+}
+
+@end
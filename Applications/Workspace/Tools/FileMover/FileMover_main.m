@@ -52,7 +52,7 @@ void SignalHandler(int sig)
   }
 }
 
-void StopOperation() { isStopped = YES; }
+void StopOperation() { __atomic_store_n(&isStopped, YES, __ATOMIC_RELAXED); }
 
 int main(int argc, const char **argv)
 {
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Measures FileMover.tool copy time of synthetic directory tree with
+# different number of copying threads ("CopyWorkers" default).
+# Source tree is created in temporary directory next to copies, so both are
+# on the same file system; set TMPDIR to benchmark other disks.
+#
+# Usage: CopyTreeBenchmark.sh <path to FileMover.tool> [directories]
+#          [files per directory] [file size in KiB] [workers list]
+# Example: CopyTreeBenchmark.sh ../FileMover.tool 200 1000 4 "1 2 4 8"
+
+TOOL=$1
+DIRS=${2:-100}
+FILES=${3:-500}
+SIZE_KB=${4:-4}
+WORKERS=${5:-"1 2 4 8"}
+
+if [ -d "$TOOL" ]; then
+  TOOL="$TOOL/FileMover"
+fi
+if [ ! -x "$TOOL" ]; then
+  echo "Usage: $0 <path to FileMover.tool> [directories] [files] [KiB] [workers]"
+  exit 1
+fi
+
+WORK=$(mktemp -d /tmp/CopyTreeBenchmark.XXXXXX) || exit 1
+trap 'chmod -R u+w "$WORK"; rm -rf "$WORK"' EXIT
+
+echo "Creating $DIRS directories with $FILES files of $SIZE_KB KiB..."
+mkdir -p "$WORK/src/tree"
+head -c $((SIZE_KB * 1024)) /dev/urandom > "$WORK/sample"
+d=0
+while [ $d -lt "$DIRS" ]; do
+  dir="$WORK/src/tree/$((d % 10))/dir$d"
+  mkdir -p "$dir"
+  f=0
+  while [ $f -lt "$FILES" ]; do
+    cp "$WORK/sample" "$dir/file$f"
+    f=$((f + 1))
+  done
+  d=$((d + 1))
+done
+# Read-only directory checks that permissions are applied after contents
+chmod a-w "$WORK/src/tree/0"
+sync
+
+for w in $WORKERS; do
+  mkdir -p "$WORK/dst$w"
+  START=$(date +%s.%N)
+  # Any problem reported by tool is answered with "Stop"
+  yes t | Files='("tree")' "$TOOL" -Operation Copy -Source "$WORK/src" \
+    -Destination "$WORK/dst$w" -CopyWorkers "$w" > /dev/null
+  END=$(date +%s.%N)
+
+  if diff -r "$WORK/src/tree" "$WORK/dst$w/tree" > /dev/null; then
+    RESULT=OK
+  else
+    RESULT=MISMATCH
+  fi
+  echo "$w $START $END $RESULT" | awk -v n=$((DIRS * FILES)) '{
+    t = $3 - $2;
+    printf("Workers: %2d  Time: %7.3f s  Files/s: %9.1f  %s\n", $1, t, n / t, $4);
+  }'
+  chmod -R u+w "$WORK/dst$w"
+  rm -rf "$WORK/dst$w"
+done
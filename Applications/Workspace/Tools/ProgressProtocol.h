@@ -0,0 +1,109 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: Binary progress records sent by FileMover and Sizer tools
+//              to Workspace operations.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#ifndef __WORKSPACE_PROGRESS_PROTOCOL_H__
+#define __WORKSPACE_PROGRESS_PROTOCOL_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// Tool sends binary records if started with "-ProgressFormat Binary"
+// arguments, otherwise text lines described in Communicator.h are sent.
+//
+// Record is a header followed by `length` bytes of payload. Record types are
+// the same characters as in text protocol:
+//   'F' - processed file: uint32_t number of files processed since last
+//         'F' record, then 4 NUL-terminated UTF-8 strings: message,
+//         filename, source directory, target directory
+//   'B' - uint64_t bytes processed since last 'B' record
+//   'Q' - uint64_t files count, uint64_t batch size; `flags` may contain
+//         PROGRESS_INCREMENT (add to totals) and PROGRESS_FINAL (sizing
+//         has finished)
+//   '0' - operation completed, '1' - operation stopped:
+//         NUL-terminated message
+//   'R', 'W', 'D', 'M', 'S', 'T', 'A', 'E', 'U' - problem:
+//         NUL-terminated message; tool waits for the answer on stdin
+// Numbers are in host byte order: tools run on the same machine.
+// Progress records ('F' and 'B') are sent not more often than
+// PROGRESS_RATE times per second.
+
+typedef struct {
+  uint8_t type;
+  uint8_t flags;
+  uint16_t reserved;
+  uint32_t length;
+} progress_record_t;
+
+#define PROGRESS_INCREMENT 0x01
+#define PROGRESS_FINAL 0x02
+
+#define PROGRESS_RATE 30
+#define PROGRESS_RECORD_MAX (64 * 1024)
+
+// Returns size of the complete record at the start of `buf`, 0 if more data
+// is needed or -1 if data is not a valid record.
+static inline long ProgressRecordSize(const char *buf, size_t len)
+{
+  progress_record_t header;
+
+  if (len < sizeof(header)) {
+    return 0;
+  }
+  memcpy(&header, buf, sizeof(header));
+  if (header.type < '0' || header.type > 'Z' || header.length > PROGRESS_RECORD_MAX) {
+    return -1;
+  }
+  if (len < sizeof(header) + header.length) {
+    return 0;
+  }
+  return sizeof(header) + header.length;
+}
+
+// Payload may be unaligned
+static inline uint64_t ProgressRecordNumber(const char *payload, int index)
+{
+  uint64_t value;
+
+  memcpy(&value, payload + index * sizeof(value), sizeof(value));
+  return value;
+}
+
+// Finds `count` NUL-terminated strings in payload starting at `offset`.
+// Returns number of strings found.
+static inline int ProgressRecordStrings(const char *payload, size_t length, size_t offset,
+                                        const char **strings, int count)
+{
+  const char *end;
+  int i;
+
+  for (i = 0; i < count && offset < length; i++) {
+    end = memchr(payload + offset, '\0', length - offset);
+    if (end == NULL) {
+      break;
+    }
+    strings[i] = payload + offset;
+    offset = end - payload + 1;
+  }
+  return i;
+}
+
+#endif
@@ -21,110 +21,394 @@
 
 #import "Size.h"
 
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Number of threads is the number of processors but not more than this
+#define SIZER_THREADS_MAX 8
+// Interval between sending intermediate totals (seconds)
+#define REPORT_INTERVAL 0.25
+
 static unsigned long long batchSize = 0;
 static unsigned long filecount = 0;
 
+// --- Hard links
+
+// Files with several hard links are counted once. Set of (device, inode)
+// pairs is small usually, so open addressing with linear probing is enough.
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+} inode_key_t;
+
+static struct {
+  pthread_mutex_t lock;
+  inode_key_t *keys;
+  size_t size;  // power of 2
+  size_t count;
+} inodes = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0};
+
+static size_t InodeHash(dev_t dev, ino_t ino)
+{
+  unsigned long long h = ((unsigned long long)dev << 32) ^ ino;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (size_t)h;
+}
+
+// Returns YES if inode was not seen before. Must be called with lock held.
+static BOOL InodeSetInsert(dev_t dev, ino_t ino)
+{
+  size_t i;
+
+  if (inodes.count * 2 >= inodes.size) {
+    inode_key_t *old_keys = inodes.keys;
+    size_t old_size = inodes.size;
+
+    inodes.size = old_size ? old_size * 2 : 1024;
+    inodes.keys = calloc(inodes.size, sizeof(inode_key_t));
+    inodes.count = 0;
+    for (i = 0; i < old_size; i++) {
+      if (old_keys[i].ino != 0) {
+        InodeSetInsert(old_keys[i].dev, old_keys[i].ino);
+      }
+    }
+    free(old_keys);
+  }
+
+  for (i = InodeHash(dev, ino) & (inodes.size - 1); inodes.keys[i].ino != 0;
+       i = (i + 1) & (inodes.size - 1)) {
+    if (inodes.keys[i].dev == dev && inodes.keys[i].ino == ino) {
+      return NO;
+    }
+  }
+  inodes.keys[i].dev = dev;
+  inodes.keys[i].ino = ino;
+  inodes.count++;
+
+  return YES;
+}
+
+// Size of file to add to batch size
+static unsigned long long FileSize(struct stat *st, OperationType opType)
+{
+  BOOL isFirstLink;
+
+  if (opType == DeleteOp) {
+    return 0;
+  }
+  if (st->st_nlink > 1 && st->st_ino != 0) {
+    pthread_mutex_lock(&inodes.lock);
+    isFirstLink = InodeSetInsert(st->st_dev, st->st_ino);
+    pthread_mutex_unlock(&inodes.lock);
+    if (!isFirstLink) {
+      return 0;
+    }
+  }
+  return st->st_size;
+}
+
+// --- Directory walk
+
+typedef struct dir_item {
+  char *path;
+  struct dir_item *next;
+} dir_item_t;
+
+// Directories are taken from the stack by worker threads. Subdirectories
+// found are pushed back, so large subtrees are spread across all workers.
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t has_work;  // signalled to workers
+  pthread_cond_t finished;  // signalled to main thread
+  dir_item_t *stack;
+  int busy;                 // directories being read
+  char *current;            // last directory taken, for status display
+  OperationType opType;
+} walk = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0,
+        NULL, SizingOp};
+
+static void PushDirectories(dir_item_t *first, dir_item_t *last)
+{
+  pthread_mutex_lock(&walk.lock);
+  last->next = walk.stack;
+  walk.stack = first;
+  pthread_cond_broadcast(&walk.has_work);
+  pthread_mutex_unlock(&walk.lock);
+}
+
+static dir_item_t *NewDirItem(const char *dir, const char *name)
+{
+  dir_item_t *item = malloc(sizeof(dir_item_t));
+  size_t dir_len = strlen(dir);
+  size_t name_len = name ? strlen(name) : 0;
+
+  item->path = malloc(dir_len + name_len + 2);
+  memcpy(item->path, dir, dir_len);
+  if (name) {
+    item->path[dir_len++] = '/';
+    memcpy(item->path + dir_len, name, name_len);
+  }
+  item->path[dir_len + name_len] = '\0';
+  item->next = NULL;
+
+  return item;
+}
+
+// Counts entries of directory without descending into subdirectories:
+// they are pushed to the stack.
+static void SizeDirectory(const char *path)
+{
+  DIR *dir;
+  struct dirent *entry;
+  struct stat st;
+  dir_item_t *subdirs = NULL, *last = NULL, *item;
+  unsigned long long size = 0;
+  unsigned long count = 0;
+  BOOL isDir;
+
+  dir = opendir(path);
+  if (dir == NULL) {
+    return;
+  }
+
+  // readdir() reads entries with getdents64() in large batches
+  while ((entry = readdir(dir)) != NULL && !isStopped) {
+    if (entry->d_name[0] == '.' &&
+        (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+      continue;
+    }
+    count++;
+
+    // Deletion needs only number of files: stat() is avoided if possible
+    if (entry->d_type == DT_DIR) {
+      isDir = YES;
+    } else if (walk.opType == DeleteOp && entry->d_type != DT_UNKNOWN) {
+      isDir = NO;
+    } else if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+      isDir = S_ISDIR(st.st_mode);
+      if (!isDir) {
+        size += FileSize(&st, walk.opType);
+      }
+    } else {
+      continue;
+    }
+
+    if (isDir) {
+      item = NewDirItem(path, entry->d_name);
+      if (last == NULL) {
+        last = item;
+      }
+      item->next = subdirs;
+      subdirs = item;
+    }
+  }
+  closedir(dir);
+
+  __atomic_add_fetch(&batchSize, size, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&filecount, count, __ATOMIC_RELAXED);
+
+  if (subdirs) {
+    PushDirectories(subdirs, last);
+  }
+}
+
+static void *SizeWorker(void *arg)
+{
+  dir_item_t *item;
+
+  while (1) {
+    pthread_mutex_lock(&walk.lock);
+    while (walk.stack == NULL && walk.busy > 0 && !isStopped) {
+      pthread_cond_wait(&walk.has_work, &walk.lock);
+    }
+    if (walk.stack == NULL || isStopped) {
+      // Nothing left to read and nobody can add more
+      pthread_cond_broadcast(&walk.has_work);
+      pthread_cond_signal(&walk.finished);
+      pthread_mutex_unlock(&walk.lock);
+      break;
+    }
+    item = walk.stack;
+    walk.stack = item->next;
+    walk.busy++;
+    free(walk.current);
+    walk.current = strdup(item->path);
+    pthread_mutex_unlock(&walk.lock);
+
+    SizeDirectory(item->path);
+    free(item->path);
+    free(item);
+
+    pthread_mutex_lock(&walk.lock);
+    walk.busy--;
+    pthread_mutex_unlock(&walk.lock);
+  }
+
+  return NULL;
+}
+
+static int SizeThreadsCount(void)
+{
+  int count = [[NSProcessInfo processInfo] processorCount];
+
+  return MAX(1, MIN(count, SIZER_THREADS_MAX));
+}
+
 @implementation Size
 
-// Recursive calculation of the 'dir' contents
-- (void)calculateBatchSizeInDirectory:(NSString *)dir
-                        operationType:(OperationType)opType
-                         communicator:(Communicator *)comm
+// Sends totals counted so far
+- (void)_reportTotalsFinal:(BOOL)isFinal
+                 increment:(BOOL)isIncrement
+              communicator:(Communicator *)comm
+{
+  [comm showQueuedFiles:__atomic_load_n(&filecount, __ATOMIC_RELAXED)
+                   size:__atomic_load_n(&batchSize, __ATOMIC_RELAXED)
+              increment:isIncrement
+                  final:isFinal];
+}
+
+- (void)_showCurrentDirectory:(Communicator *)comm
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  NSArray *dirContents = [fm directoryContentsAtPath:dir];
   NSString *path = nil;
-  NSDictionary *fattrs = nil;
 
-  for (NSString *file in dirContents) {
-    path = [dir stringByAppendingPathComponent:file];
-    fattrs = [fm fileAttributesAtPath:path traverseLink:NO];
+  pthread_mutex_lock(&walk.lock);
+  if (walk.current) {
+    path = [NSString stringWithCString:walk.current];
+  }
+  pthread_mutex_unlock(&walk.lock);
 
+  if (path) {
     [comm showProcessingFilename:[path lastPathComponent]
                     sourcePrefix:[path stringByDeletingLastPathComponent]
                     targetPrefix:nil
                    bytesAdvanced:0
                    operationType:SizingOp];
+  }
+}
 
-    if ([[fattrs fileType] isEqualToString:NSFileTypeDirectory]) {
-      // Recursion
-      [self calculateBatchSizeInDirectory:path operationType:opType communicator:comm];
-    } else {
-      if (opType != DeleteOp) {
-        batchSize += [fattrs fileSize];
-      }
-      filecount++;
+// Walks directories on the stack with worker threads. Main thread sends
+// intermediate totals meanwhile.
+- (void)_walkDirectoriesSendIncrement:(BOOL)isIncrement communicator:(Communicator *)comm
+{
+  int count = SizeThreadsCount();
+  pthread_t threads[count];
+  struct timespec ts;
+  long nsec;
+  int i, started = 0;
+
+  if (walk.stack == NULL) {
+    return;
+  }
+
+  for (i = 0; i < count; i++) {
+    if (pthread_create(&threads[started], NULL, SizeWorker, NULL) == 0) {
+      started++;
+    }
+  }
+  if (started == 0) {
+    SizeWorker(NULL);
+    return;
+  }
+
+  pthread_mutex_lock(&walk.lock);
+  while ((walk.stack != NULL || walk.busy > 0) && !isStopped) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    nsec = ts.tv_nsec + (long)(REPORT_INTERVAL * 1e9);
+    ts.tv_sec += nsec / 1000000000;
+    ts.tv_nsec = nsec % 1000000000;
+    pthread_cond_timedwait(&walk.finished, &walk.lock, &ts);
+
+    pthread_mutex_unlock(&walk.lock);
+    [self _showCurrentDirectory:comm];
+    // Increments can't be sent before the whole batch is counted
+    if (!isIncrement) {
+      [self _reportTotalsFinal:NO increment:NO communicator:comm];
     }
-    filecount++;
+    pthread_mutex_lock(&walk.lock);
+  }
+  pthread_cond_broadcast(&walk.has_work);
+  pthread_mutex_unlock(&walk.lock);
+
+  for (i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
 
-    if (isStopped == YES)
-      return;
+  // Left after stop
+  while (walk.stack) {
+    dir_item_t *item = walk.stack;
+    walk.stack = item->next;
+    free(item->path);
+    free(item);
   }
+  free(walk.current);
+  walk.current = NULL;
 }
 
-// Should update with printf:
-//           number of files: "Q\tF\t%u\t+"   <----(Queued Files)
-//                batch size: "Q\tS\t%llu\t+" <----(Queued Size)
-// If field #4 contains '+' it is an update to the totals (sendIncrement:YES).
-// Currently FileOperation.m gets this numbers if no other message types
-// detected "F" "B"
 - (void)calculateBatchSizeInDirectory:(NSString *)sourceDir
                                 files:(NSArray *)filenames
                         operationType:(OperationType)opType
                         sendIncrement:(BOOL)isIncrement
                          communicator:(Communicator *)comm
 {
+  const char *source;
+  dir_item_t *item;
+  struct stat st;
+
   isStopped = NO;
 
   // if (opType == LinkOp || opType == MoveOp)
   if (opType == LinkOp) {
-    if (isIncrement) {
-      printf("Q\tF\t%lu\t+\n", [filenames count]);
-    } else {
-      printf("Q\tF\t%lu\n", [filenames count]);
-    }
-    fflush(stdout);
+    [comm showQueuedFiles:[filenames count] size:0 increment:isIncrement final:YES];
     return;
   }
 
+  walk.opType = opType;
+  source = [sourceDir fileSystemRepresentation];
+
   if (!filenames) {  // Process all FS heirarchy starting from -Source directory
-    [self calculateBatchSizeInDirectory:sourceDir operationType:opType communicator:comm];
+    item = NewDirItem(source, NULL);
+    PushDirectories(item, item);
   } else {  // Process objects specified in -Files located in -Source
-    NSFileManager *fm = [NSFileManager defaultManager];
-    NSString *path = nil;
-    NSDictionary *fattrs = nil;
-
     for (NSString *file in filenames) {
-      path = [sourceDir stringByAppendingPathComponent:file];
-      fattrs = [fm fileAttributesAtPath:path traverseLink:NO];
-
       [comm showProcessingFilename:[file lastPathComponent]
                       sourcePrefix:sourceDir
                       targetPrefix:nil
                      bytesAdvanced:0
                      operationType:SizingOp];
 
-      if ([[fattrs fileType] isEqualToString:NSFileTypeDirectory]) {  // recursive
-        [self calculateBatchSizeInDirectory:path operationType:opType communicator:comm];
-      } else {
-        if (opType != DeleteOp) {
-          batchSize += [fattrs fileSize];
-        }
+      item = NewDirItem(source, [file fileSystemRepresentation]);
+      if (lstat(item->path, &st) == 0) {
         filecount++;
+        if (S_ISDIR(st.st_mode)) {  // recursive
+          PushDirectories(item, item);
+          item = NULL;
+        } else {
+          batchSize += FileSize(&st, opType);
+        }
+      }
+      if (item) {
+        free(item->path);
+        free(item);
+      }
+      if (isStopped == YES) {
+        break;
       }
-      if (isStopped == YES)
-        return;
     }
   }
 
-  if (isIncrement) {
-    printf("Q\tF\t%lu\t+\n", filecount);
-    printf("Q\tS\t%llu\t+\n", batchSize);
-  } else {
-    printf("Q\tF\t%lu\n", filecount);
-    printf("Q\tS\t%llu\n", batchSize);
+  [self _walkDirectoriesSendIncrement:isIncrement communicator:comm];
+  if (!isStopped) {
+    [self _reportTotalsFinal:YES increment:isIncrement communicator:comm];
   }
-  fflush(stdout);
 }
 
 @end
@@ -217,6 +217,7 @@
 @interface BrowserViewer (Private)
 
 - (void)ensureBrowserHasEmptyColumn;
+- (void)loadCell:(BrowserCell *)bc forFile:(NSString *)filePath;
 
 @end
 
@@ -630,6 +631,98 @@
   return [view becomeFirstResponder];
 }
 
+- (void)loadCell:(BrowserCell *)bc forFile:(NSString *)filePath
+{
+  NSString *wmFileType = nil;
+  NSString *fmFileType = nil;
+  NSString *appName = nil;
+
+  [(NSWorkspace *)[NSApp delegate] getInfoForFile:filePath
+                                      application:&appName
+                                             type:&wmFileType];
+
+  if (![wmFileType isEqualToString:NSDirectoryFileType] &&
+      ![wmFileType isEqualToString:NSFilesystemFileType]) {
+    [bc setLeaf:YES];
+  }
+
+  // Modify display attributes and set title of cell
+  fmFileType = [[fileManager fileAttributesAtPath:filePath
+                                     traverseLink:NO] fileType];
+  if ([fmFileType isEqualToString:NSFileTypeSymbolicLink]) {
+    [bc setFont:[NSFont fontWithName:@"Helvetica-Oblique" size:12.0]];
+  }
+
+  [bc setTitle:[filePath lastPathComponent]];
+  [bc setLoaded:YES];
+}
+
+- (void)updatePath:(NSString *)relativePath
+          contents:(NSArray *)contents
+      changedFiles:(NSSet *)changedFiles
+{
+  NSSet        *names = [NSSet setWithArray:contents];
+  NSMutableSet *selectedNames = [NSMutableSet set];
+  NSMutableSet *shownNames = [NSMutableSet set];
+  NSString     *dirPath, *name;
+  NSMatrix     *mtrx;
+  NSInteger    column, row;
+  NSUInteger   i;
+
+  for (column = [view lastColumn]; column >= 0; column--) {
+    if ([[view pathToColumn:column] isEqualToString:relativePath]) {
+      break;
+    }
+  }
+  if (column < 0 || (mtrx = [view matrixInColumn:column]) == nil) {
+    return;
+  }
+
+  NSDebugLLog(@"Browser", @"[Browser:%@] updatePath:%@ changed:%@", [view path], relativePath,
+              changedFiles);
+
+  for (NSCell *cell in [mtrx selectedCells]) {
+    [selectedNames addObject:[cell stringValue]];
+  }
+
+  // Remove files which are gone or replaced
+  for (row = [mtrx numberOfRows] - 1; row >= 0; row--) {
+    name = [[mtrx cellAtRow:row column:0] stringValue];
+    if ([names containsObject:name] == NO || [changedFiles containsObject:name]) {
+      [mtrx removeRow:row];
+    } else {
+      [shownNames addObject:name];
+    }
+  }
+
+  // Insert new files. Files which are left are in the same order as in
+  // `contents` unless their sorting attributes were changed.
+  dirPath = [rootPath stringByAppendingPathComponent:relativePath];
+  for (i = 0; i < [contents count]; i++) {
+    name = [contents objectAtIndex:i];
+    if (i < [mtrx numberOfRows] &&
+        [[[mtrx cellAtRow:i column:0] stringValue] isEqualToString:name]) {
+      continue;
+    }
+    if ([shownNames containsObject:name]) {
+      [self reloadColumn:column];
+      return;
+    }
+    [mtrx insertRow:i];
+    [self loadCell:[mtrx cellAtRow:i column:0]
+           forFile:[dirPath stringByAppendingPathComponent:name]];
+  }
+
+  [mtrx deselectAllCells];
+  for (i = 0; i < [mtrx numberOfRows]; i++) {
+    if ([selectedNames containsObject:[[mtrx cellAtRow:i column:0] stringValue]]) {
+      [mtrx selectCellAtRow:i column:0];
+    }
+  }
+  [mtrx sizeToCells];
+  [view displayColumn:column];
+}
+
 //=============================================================================
 // NSBrowser delegate methods
 //=============================================================================
@@ -675,36 +768,9 @@
       // Fill column
       // for (NSString *filename in dc) {
       for (int i = 0; i < [dc count]; i++) {
-        NSString    *fileName;
-        NSString    *filePath;
-        NSString    *wmFileType = nil;
-        NSString    *fmFileType = nil;
-        NSString    *appName = nil;
-        BrowserCell *bc;
-
         // [matrix addRow];
-        bc = [matrix cellAtRow:i column:0];
-
-        fileName = [dc objectAtIndex:i];
-        filePath = [fPath stringByAppendingPathComponent:fileName];
-        [(NSWorkspace *)[NSApp delegate] getInfoForFile:filePath
-                                            application:&appName
-                                                   type:&wmFileType];
-
-        if (![wmFileType isEqualToString:NSDirectoryFileType] &&
-            ![wmFileType isEqualToString:NSFilesystemFileType]) {
-          [bc setLeaf:YES];
-        }
-
-        // Modify display attributes and set title of cell
-        fmFileType = [[fileManager fileAttributesAtPath:filePath
-                                           traverseLink:NO] fileType];
-        if ([fmFileType isEqualToString:NSFileTypeSymbolicLink]) {
-          [bc setFont:[NSFont fontWithName:@"Helvetica-Oblique" size:12.0]];
-        }
-      
-        [bc setTitle:fileName];
-        [bc setLoaded:YES];
+        [self loadCell:[matrix cellAtRow:i column:0]
+               forFile:[fPath stringByAppendingPathComponent:[dc objectAtIndex:i]]];
         // [sender displayColumn:column];
       }
       [dc release];
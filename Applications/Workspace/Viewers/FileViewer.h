@@ -69,6 +69,12 @@
 
   NSTimer *checkTimer;
 
+  // File system changes waiting to be applied to viewer:
+  // absolute directory path -> set of changed file names or NSNull if
+  // directory should be reloaded
+  NSMutableDictionary *pendingChanges;
+  NSTimer *pendingChangesTimer;
+
   // Preferences
   BOOL showHiddenFiles;
   NSInteger sortFilesBy;
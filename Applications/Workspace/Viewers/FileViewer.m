@@ -264,6 +264,7 @@
 
   // Start filesystem event monitor
   fileSystemMonitor = [[NSApp delegate] fileSystemMonitor];
+  pendingChanges = [[NSMutableDictionary alloc] init];
 
   NSDebugLLog(@"FileViewer", @"[FileViewer -init] %@", relativePath);
 
@@ -458,6 +459,7 @@
     [processManager releaseBackInfoLabel:operationInfo];
   }
   TEST_RELEASE(lock);
+  TEST_RELEASE(pendingChanges);
 
   NSDebugLLog(@"Memory", @"FileViewer %@: dealloc END", rootPath);
 
@@ -1182,6 +1184,9 @@
   if (!isRootViewer && fileSystemMonitor) {
     [fileSystemMonitor removePath:[rootPath stringByAppendingPathComponent:displayedPath]];
   }
+  // Timer retains FileViewer
+  [pendingChangesTimer invalidate];
+  pendingChangesTimer = nil;
 
   if (isRootViewer) {
     [df setObject:[displayedPath stringByAppendingPathComponent:file] forKey:@"RootViewerPath"];
@@ -1312,7 +1317,8 @@
 //   "ChangedPath"   - source directory path
 //   "ChangedFile"   - source file name
 //   "ChangedFileTo" - destination file name
-//   "Operations"    - array of operations: Write, Rename, Delete, Link
+//   "Operations"    - array of operations: Write, Rename, Delete, Link,
+//                     Overflow (events were lost, nothing else is set)
 - (void)fileSystemChangedAtPath:(NSNotification *)notif
 {
   id object = [notif object];
@@ -1330,14 +1336,22 @@
     return;
   }
 
+  operations = [changes objectForKey:@"Operations"];
+
+  if ([operations indexOfObject:@"Overflow"] != NSNotFound) {
+    NSDebugLLog(@"FileViewer", @"[FileViewer:%@] OSEFileSystem lost events, reloading",
+                [self displayedPath]);
+    ASSIGN(selection, [self checkSelection:selection atPath:displayedPath]);
+    [self displayPath:displayedPath selection:selection sender:self];
+    return;
+  }
+
   NSString *commonPath = NXTIntersectionPath(selectedPath, changedPath);
   if (([commonPath length] < [changedPath length]) || ([commonPath length] < [rootPath length])) {
     // No intersection or changed path is out of our focus.
     return;
   }
 
-  operations = [changes objectForKey:@"Operations"];
-
   NSDebugLLog(@"FileViewer", @"[FileViewer:%@] OSEFileSystem got filesystem changes %@ at %@",
               [self displayedPath], operations, changedPath);
 
@@ -1408,8 +1422,8 @@
     } else {
       NSDebugLLog(@"FileViewer", @"One of not selected (but displayed) row name changed");
       // One of not selected (but displayed) row name changed
-      // Reload column in browser for changed directory contents
-      [_viewer reloadPath:[self pathFromAbsolutePath:changedPath]];
+      [self addChangedFile:changedFile atPath:changedPath];
+      [self addChangedFile:changedFileTo atPath:changedPath];
     }
   } else if (([operations indexOfObject:@"Write"] != NSNotFound)) {
     // Write - monitored object was changed (Create, Delete)
@@ -1417,20 +1431,107 @@
                 @"[FileViewer] OSEFileSystem: 'Write' "
                 @"operation occured for %@/(%@) selected path %@ selection %@",
                 changedPath, changedFile, selectedPath, selection);
+    [self addChangedFile:changedFile atPath:changedPath];
+  } else if (([operations indexOfObject:@"Attributes"] != NSNotFound)) {
+    NSDebugLLog(@"FileViewer",
+                @"[FileViewer] OSEFileSystem: 'Attributes' "
+                @"operation occured for %@ (%@) selection %@",
+                changedPath, selectedPath, selection);
+    [self displayPath:displayedPath selection:selection sender:self];
+  }
+}
+
+// Changes are collected for FV_CHANGES_DELAY seconds and applied at once.
+// Directory with more than FV_CHANGES_MAX changed files is reloaded.
+#define FV_CHANGES_DELAY 0.1
+#define FV_CHANGES_MAX 256
+
+- (void)addChangedFile:(NSString *)fileName atPath:(NSString *)dirPath
+{
+  id files = [pendingChanges objectForKey:dirPath];
+
+  if (files == [NSNull null]) {
+    // Will be reloaded anyway
+  } else if (fileName == nil || [files count] >= FV_CHANGES_MAX) {
+    [pendingChanges setObject:[NSNull null] forKey:dirPath];
+  } else if (files == nil) {
+    [pendingChanges setObject:[NSMutableSet setWithObject:fileName] forKey:dirPath];
+  } else {
+    [files addObject:fileName];
+  }
+
+  if (pendingChangesTimer == nil) {
+    pendingChangesTimer = [NSTimer scheduledTimerWithTimeInterval:FV_CHANGES_DELAY
+                                                           target:self
+                                                         selector:@selector(applyPendingChanges:)
+                                                         userInfo:nil
+                                                          repeats:NO];
+  }
+}
+
+// Returns YES if changes of `fileNames` in `dirPath` may be applied to
+// viewer without changing displayed path and selection
+- (BOOL)canUpdateFiles:(NSSet *)fileNames atPath:(NSString *)dirPath
+{
+  NSString *selectedPath = [self absolutePath];
+  NSString *filePath;
+
+  if ([dirPath isEqualToString:selectedPath]) {
+    for (NSString *fileName in selection) {
+      if ([fileNames containsObject:fileName]) {
+        return NO;
+      }
+    }
+  }
+  selectedPath = [selectedPath stringByAppendingString:@"/"];
+  for (NSString *fileName in fileNames) {
+    filePath = [[dirPath stringByAppendingPathComponent:fileName] stringByAppendingString:@"/"];
+    if ([selectedPath hasPrefix:filePath]) {
+      return NO;
+    }
+  }
+
+  return YES;
+}
+
+- (void)applyPendingChanges:(NSTimer *)timer
+{
+  NSDictionary *changes = [pendingChanges copy];
+  NSString *relativePath;
+  NSArray *contents;
+  BOOL isReloaded = NO;
+  id files;
 
+  pendingChangesTimer = nil;
+  [pendingChanges removeAllObjects];
+
+  for (NSString *dirPath in changes) {
+    files = [changes objectForKey:dirPath];
+    relativePath = [self pathFromAbsolutePath:dirPath];
+
+    if (files != [NSNull null] && [self canUpdateFiles:files atPath:dirPath]) {
+      NSDebugLLog(@"FileViewer", @"[FileViewer] update %@: %@", dirPath, files);
+      contents = [self directoryContentsAtPath:relativePath forPath:[self absolutePath]];
+      if (contents != nil) {
+        [_viewer updatePath:relativePath contents:contents changedFiles:files];
+        continue;
+      }
+    }
+
+    NSDebugLLog(@"FileViewer", @"[FileViewer] reload %@", dirPath);
     // Check selection before path will be reloaded
     ASSIGN(selection, [self checkSelection:selection atPath:displayedPath]);
     // Reload changed directory contents without changing path
-    [_viewer reloadPath:[self pathFromAbsolutePath:changedPath]];
+    [_viewer reloadPath:relativePath];
+    isReloaded = YES;
+  }
+  [changes release];
 
+  if (isReloaded) {
     // Check existance of path components and update ivars, other views
     [self displayPath:displayedPath selection:selection sender:_viewer];
-  } else if (([operations indexOfObject:@"Attributes"] != NSNotFound)) {
-    NSDebugLLog(@"FileViewer",
-                @"[FileViewer] OSEFileSystem: 'Attributes' "
-                @"operation occured for %@ (%@) selection %@",
-                changedPath, selectedPath, selection);
-    [self displayPath:displayedPath selection:selection sender:self];
+  } else {
+    [self updateDiskInfo];
   }
 }
 
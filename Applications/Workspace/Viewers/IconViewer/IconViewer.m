@@ -28,6 +28,7 @@
 #import <Viewers/FileViewer.h>
 #import <Viewers/PathIcon.h>
 #import <Viewers/PathView.h>
+#import <IconService.h>
 #import "IconViewer.h"
 
 //=============================================================================
@@ -115,8 +116,8 @@
 
     anIcon = [[PathIcon alloc] init];
     [anIcon setLabelString:filename];
-    [anIcon setIconImage:[[NSApp delegate] iconForFile:path]];
     [anIcon setPaths:[NSArray arrayWithObject:path]];
+    [[IconService sharedService] setIconImageOf:anIcon forFile:path owner:iconView];
 
     [iconsToAdd addObject:anIcon];
     if ([selectedFiles containsObject:filename]) {
@@ -272,6 +273,7 @@ static NSRect viewFrame;
     [itemsLoader removeObserver:self forKeyPath:@"isFinished"];
     [itemsLoader release];
   }
+  [[IconService sharedService] cancelRequestsOfOwner:iconView];
 
   TEST_RELEASE(_owner);
   TEST_RELEASE(rootPath);
@@ -442,6 +444,7 @@ static NSRect viewFrame;
   }
 
   if (updateOnDisplay == NO) {
+    [[IconService sharedService] cancelRequestsOfOwner:iconView];
     ASSIGN(currentPath, dirPath);
     [iconView removeAllIcons];
   }
@@ -487,6 +490,61 @@ static NSRect viewFrame;
 
   [self displayPath:reloadPath selection:selection];
 }
+- (void)updatePath:(NSString *)relativePath
+          contents:(NSArray *)contents
+      changedFiles:(NSSet *)changedFiles
+{
+  NSMutableDictionary *shownIcons;
+  NSMutableArray *icons;
+  NSMutableSet *selectedIcons;
+  NSSet *oldSelection;
+  NSString *dirPath, *path;
+  PathIcon *icon;
+
+  if ([relativePath isEqualToString:currentPath] == NO) {
+    return;
+  }
+  if (itemsLoader != nil && [itemsLoader isFinished] == NO) {
+    [self reloadPath:relativePath];
+    return;
+  }
+
+  NSDebugLLog(@"IconViewer", @"[IconViewer] updatePath: %@, changed: %@", relativePath,
+              changedFiles);
+
+  shownIcons = [NSMutableDictionary dictionary];
+  for (icon in [iconView icons]) {
+    if ([icon isKindOfClass:[PathIcon class]]) {
+      [shownIcons setObject:icon forKey:[icon labelString]];
+    }
+  }
+  oldSelection = [iconView selectedIcons];
+
+  // Icons of files which are left are reused
+  dirPath = [rootPath stringByAppendingPathComponent:relativePath];
+  icons = [NSMutableArray arrayWithCapacity:[contents count]];
+  selectedIcons = [NSMutableSet set];
+  for (NSString *filename in contents) {
+    path = [dirPath stringByAppendingPathComponent:filename];
+    icon = [shownIcons objectForKey:filename];
+    if (icon == nil) {
+      icon = [[[PathIcon alloc] init] autorelease];
+      [icon setLabelString:filename];
+      [icon setPaths:[NSArray arrayWithObject:path]];
+      [[IconService sharedService] setIconImageOf:icon forFile:path owner:iconView];
+    } else if ([changedFiles containsObject:filename]) {
+      [[IconService sharedService] setIconImageOf:icon forFile:path owner:iconView];
+    }
+    [icons addObject:icon];
+    if ([oldSelection containsObject:icon]) {
+      [selectedIcons addObject:icon];
+    }
+  }
+
+  [iconView fillWithIcons:icons];
+  [iconView selectIcons:selectedIcons];
+}
+
 - (void)open:sender
 {
   NSSet *selected = [iconView selectedIcons];
@@ -56,6 +56,12 @@
 
 - (void)reloadPathWithSelection:(NSString *)selection;  // Reload contents of selected directory
 - (void)reloadPath:(NSString *)reloadPath;
+// Brings displayed directory at `relativePath` in line with `contents`
+// (sorted file names) without reloading it: removes files which are gone,
+// inserts new ones and refreshes `changedFiles` which were replaced.
+- (void)updatePath:(NSString *)relativePath
+          contents:(NSArray *)contents
+      changedFiles:(NSSet *)changedFiles;
 
 - (void)scrollToRange:(NSRange)range;
 
@@ -0,0 +1,178 @@
+/*
+ * Measures painting of client-side shadows during interactive resize.
+ *
+ * Window is resized from 64x48 to 1920x1440 in small steps; for every step
+ * shadow is created and painted into offscreen picture with per-window
+ * shadow image (as it's done for windows smaller than the shadow) and with
+ * shared shadow tiles. Reports milliseconds per step including X server
+ * time and checks that both ways paint the same shadow.
+ *
+ * Needs X server with Render extension. Build in this directory with:
+ *   cc -O2 -o ShadowResizeBenchmark ShadowResizeBenchmark.c \
+ *      -lXrender -lXcomposite -lXdamage -lXfixes -lXext -lX11 -lm
+ *
+ * Usage: ShadowResizeBenchmark [shadow radius] [shadow opacity]
+ */
+
+/* composer is built without WM logging */
+#define __WORKSPACE_WM_LOG__
+#define WMLogError(fmt, args...) fprintf(stderr, fmt "\n", ##args)
+#define WMLogInfo(fmt, args...) fprintf(stderr, fmt "\n", ##args)
+
+#include "../wmcomposer.c"
+
+#define MAX_WIDTH 1920
+#define MAX_HEIGHT 1440
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static Picture create_buffer(Display *dpy)
+{
+  Pixmap pixmap;
+  Picture picture;
+
+  pixmap = XCreatePixmap(dpy, root_window, MAX_WIDTH + Gsize, MAX_HEIGHT + Gsize, 32);
+  picture = XRenderCreatePicture(dpy, pixmap, XRenderFindStandardFormat(dpy, PictStandardARGB32),
+                                 0, NULL);
+  XFreePixmap(dpy, pixmap);
+  return picture;
+}
+
+static void clear_buffer(Display *dpy, Picture buffer)
+{
+  XRenderColor clear = {0, 0, 0, 0};
+
+  XRenderFillRectangle(dpy, PictOpSrc, buffer, &clear, 0, 0, MAX_WIDTH + Gsize,
+                       MAX_HEIGHT + Gsize);
+}
+
+/* Creates and paints shadow of width x height window, returns shadow size */
+static void paint_shadow(Display *dpy, Picture buffer, Bool tiled, int width, int height,
+                         int *swidth, int *sheight)
+{
+  Picture shadow;
+  CMPShadowTiles *tiles;
+
+  if (tiled) {
+    tiles = get_shadow_tiles(dpy, shadowOpacity);
+    *swidth = width + Gsize;
+    *sheight = height + Gsize;
+    paint_shadow_tiles(dpy, tiles, buffer, 0, 0, *swidth, *sheight);
+  } else {
+    shadow = create_shadow_picture(dpy, shadowOpacity, None, width, height, swidth, sheight);
+    XRenderComposite(dpy, PictOpOver, black_picture, shadow, buffer, 0, 0, 0, 0, 0, 0, *swidth,
+                     *sheight);
+    XRenderFreePicture(dpy, shadow);
+  }
+}
+
+/* Returns milliseconds per resize step */
+static double sweep(Display *dpy, Picture buffer, Bool tiled, int *steps)
+{
+  double start;
+  int width, height, swidth, sheight;
+
+  *steps = 0;
+  XSync(dpy, False);
+  start = now();
+  for (width = 64, height = 48; width <= MAX_WIDTH; width += 8, height += 6) {
+    paint_shadow(dpy, buffer, tiled, width, height, &swidth, &sheight);
+    (*steps)++;
+  }
+  XSync(dpy, False);
+
+  return (now() - start) / *steps;
+}
+
+static Bool same_shadows(Display *dpy, Picture buffer, Pixmap pixmap, int width, int height)
+{
+  XImage *image[2];
+  int swidth, sheight, i, y;
+  Bool same = True;
+
+  for (i = 0; i < 2; i++) {
+    clear_buffer(dpy, buffer);
+    paint_shadow(dpy, buffer, i, width, height, &swidth, &sheight);
+    image[i] = XGetImage(dpy, pixmap, 0, 0, swidth, sheight, AllPlanes, ZPixmap);
+  }
+  for (y = 0; y < sheight && same; y++) {
+    same = !memcmp(image[0]->data + y * image[0]->bytes_per_line,
+                   image[1]->data + y * image[1]->bytes_per_line, swidth * 4);
+  }
+  XDestroyImage(image[0]);
+  XDestroyImage(image[1]);
+
+  return same;
+}
+
+int main(int argc, char **argv)
+{
+  static const int sizes[][2] = {{64, 48}, {65, 300}, {640, 480}, {1917, 1003}};
+  Picture buffer, check;
+  Pixmap pixmap;
+  double image_ms, tiles_ms;
+  int i, steps, failed = 0;
+
+  if (argc > 1) {
+    shadowRadius = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    shadowOpacity = atof(argv[2]);
+  }
+  if (shadowRadius <= 0 || shadowOpacity <= 0 || shadowOpacity > 1) {
+    fprintf(stderr, "usage: %s [shadow radius] [shadow opacity]\n", argv[0]);
+    return 2;
+  }
+
+  dpy = XOpenDisplay(NULL);
+  if (!dpy) {
+    fprintf(stderr, "Can't open display\n");
+    return 1;
+  }
+  if (!XRenderQueryExtension(dpy, &render_event, &render_error)) {
+    fprintf(stderr, "No Render extension\n");
+    return 1;
+  }
+  scr = DefaultScreen(dpy);
+  root_window = RootWindow(dpy, scr);
+  compMode = CompClientShadows;
+  gaussianMap = make_gaussian_map(dpy, shadowRadius);
+  presum_gaussian(gaussianMap);
+  black_picture = create_solid_picture(dpy, True, 1, 0, 0, 0);
+  buffer = create_buffer(dpy);
+
+  image_ms = sweep(dpy, buffer, False, &steps);
+  tiles_ms = sweep(dpy, buffer, True, &steps);
+  printf("radius %d, opacity %.2f, %d resize steps up to %dx%d\n", shadowRadius, shadowOpacity,
+         steps, MAX_WIDTH, MAX_HEIGHT);
+  printf("  shadow image  %8.3f ms per step\n", image_ms);
+  printf("  shadow tiles  %8.3f ms per step  x%.1f\n", tiles_ms, image_ms / tiles_ms);
+
+  /* separate picture to read back */
+  pixmap = XCreatePixmap(dpy, root_window, MAX_WIDTH + Gsize, MAX_HEIGHT + Gsize, 32);
+  check = XRenderCreatePicture(dpy, pixmap, XRenderFindStandardFormat(dpy, PictStandardARGB32), 0,
+                               NULL);
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (sizes[i][0] < Gsize || sizes[i][1] < Gsize) {
+      continue;
+    }
+    if (!same_shadows(dpy, check, pixmap, sizes[i][0], sizes[i][1])) {
+      printf("  %dx%d: MISMATCH\n", sizes[i][0], sizes[i][1]);
+      failed = 1;
+    }
+  }
+  printf("  %s\n", failed ? "shadows differ" : "shadows are the same");
+
+  XRenderFreePicture(dpy, check);
+  XFreePixmap(dpy, pixmap);
+  XRenderFreePicture(dpy, buffer);
+  XCloseDisplay(dpy);
+
+  return failed;
+}
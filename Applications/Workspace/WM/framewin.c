@@ -26,6 +26,7 @@
 #include <X11/Xutil.h>
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 #include <wraster.h>
@@ -64,6 +65,9 @@ static void paintButton(WCoreWindow *button, WTexture *texture, unsigned long co
 
 static void updateTitlebar(WFrameWindow *fwin);
 
+static void releaseTitleTexture(WFrameWindow *fwin, int state);
+static void releaseResizebarTexture(WFrameWindow *fwin);
+
 static void allocFrameBorderPixel(Colormap colormap, const char *color_name, unsigned long **pixel);
 
 static void allocFrameBorderPixel(Colormap colormap, const char *color_name, unsigned long **pixel)
@@ -179,12 +183,8 @@ void wFrameWindowUpdateBorders(WFrameWindow *fwin, int flags)
       updateTitlebar(fwin);
     } else {
       /* we had a titlebar, but now we don't need it anymore */
-      for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++) {
-        FREE_PIXMAP(fwin->title_back[i]);
-        if (wPreferences.titlebar_style == TS_NEW) {
-          FREE_PIXMAP(fwin->lbutton_back[i]);
-          FREE_PIXMAP(fwin->rbutton_back[i]);
-        }
+      for (i = 0; i < 3; i++) {
+        releaseTitleTexture(fwin, i);
       }
       if (fwin->left_button)
         wCoreDestroy(fwin->left_button);
@@ -299,6 +299,7 @@ void wFrameWindowUpdateBorders(WFrameWindow *fwin, int flags)
       fwin->bottom_width = 0;
       wCoreDestroy(fwin->resizebar);
       fwin->resizebar = NULL;
+      releaseResizebarTexture(fwin);
     }
   }
 
@@ -386,13 +387,10 @@ void wFrameWindowDestroy(WFrameWindow *fwin)
   if (fwin->title)
     wfree(fwin->title);
 
-  for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++) {
-    FREE_PIXMAP(fwin->title_back[i]);
-    if (wPreferences.titlebar_style == TS_NEW) {
-      FREE_PIXMAP(fwin->lbutton_back[i]);
-      FREE_PIXMAP(fwin->rbutton_back[i]);
-    }
+  for (i = 0; i < 3; i++) {
+    releaseTitleTexture(fwin, i);
   }
+  releaseResizebarTexture(fwin);
 
   wfree(fwin);
 }
@@ -501,6 +499,264 @@ void wFrameWindowShowButton(WFrameWindow *fwin, int flags)
   }
 }
 
+/******** Texture pixmap cache ********/
+
+/*
+ * Rendered titlebar (with buttons backgrounds in new titlebar style) and
+ * resizebar pixmaps are shared by frames with the same texture and size.
+ * Unused pixmaps are kept for a while: resized and new windows often get the
+ * size some window had. Textures which look the same at any width (vertical
+ * gradients, tiles) are rendered once per height into a stretch image
+ * wide enough for any window, frame images are cut from it.
+ */
+
+#define FRAME_TEXTURE_BUCKETS 64
+#define FRAME_TEXTURE_UNUSED_MAX 16
+
+typedef struct WFrameTexture {
+  struct WFrameTexture *next;
+  int refcount;
+  unsigned long last_use;
+
+  /* key, texture is NULL if it was destroyed while pixmaps are in use */
+  WTexture *texture;
+  int is_resizebar;
+  int titlebar_style;
+  int width;
+  int height;
+  int left; /* button or resizebar corner width */
+  int right;
+
+  Pixmap title; /* or resizebar */
+  Pixmap lbutton;
+  Pixmap rbutton;
+} WFrameTexture;
+
+typedef struct WFrameStretch {
+  struct WFrameStretch *next;
+  WTexture *texture;
+  RImage *image;
+} WFrameStretch;
+
+typedef struct WFrameTextureCache {
+  WFrameTexture *buckets[FRAME_TEXTURE_BUCKETS];
+  WFrameStretch *stretches;
+  int unused_count;
+  unsigned long use_count;
+} WFrameTextureCache;
+
+static WFrameTextureCache *frameTextureCache(WScreen *scr)
+{
+  if (!scr->frame_texture_cache)
+    scr->frame_texture_cache = wmalloc(sizeof(WFrameTextureCache));
+
+  return scr->frame_texture_cache;
+}
+
+static inline unsigned frameTextureHash(WTexture *texture, int width, int height)
+{
+  return (((uintptr_t)texture >> 4) ^ (width * 31) ^ height) % FRAME_TEXTURE_BUCKETS;
+}
+
+static Bool isStretchableTexture(WTexture *texture)
+{
+  switch (texture->any.type) {
+    case WTEX_VGRADIENT:
+    case WTEX_MVGRADIENT:
+    case WTEX_IGRADIENT:
+    case WTEX_TVGRADIENT:
+      return True;
+    case WTEX_PIXMAP:
+      return texture->pixmap.subtype == WTP_TILE;
+    default:
+      return False;
+  }
+}
+
+/* Returns flat image of texture of the given size */
+static RImage *renderFrameImage(WScreen *scr, WTexture *texture, int width, int height)
+{
+  WFrameTextureCache *cache;
+  WFrameStretch *stretch;
+  RImage *image;
+
+  if (!isStretchableTexture(texture))
+    return wTextureRenderImage(texture, width, height, WREL_FLAT);
+
+  cache = frameTextureCache(scr);
+  for (stretch = cache->stretches; stretch; stretch = stretch->next) {
+    if (stretch->texture == texture && stretch->image->height == height)
+      break;
+  }
+  if (!stretch || stretch->image->width < width) {
+    image = wTextureRenderImage(texture, WMAX(width, scr->width + 1), height, WREL_FLAT);
+    if (!image)
+      return NULL;
+    if (!stretch) {
+      stretch = wmalloc(sizeof(WFrameStretch));
+      stretch->texture = texture;
+      stretch->next = cache->stretches;
+      cache->stretches = stretch;
+    } else {
+      RReleaseImage(stretch->image);
+    }
+    stretch->image = image;
+  }
+
+  return RGetSubImage(stretch->image, 0, 0, width, height);
+}
+
+static void destroyFrameTexture(WFrameTexture *entry)
+{
+  FREE_PIXMAP(entry->title);
+  FREE_PIXMAP(entry->lbutton);
+  FREE_PIXMAP(entry->rbutton);
+  wfree(entry);
+}
+
+static void unlinkFrameTexture(WFrameTextureCache *cache, WFrameTexture *entry)
+{
+  WFrameTexture **link;
+
+  link = &cache->buckets[frameTextureHash(entry->texture, entry->width, entry->height)];
+  while (*link != entry)
+    link = &(*link)->next;
+  *link = entry->next;
+}
+
+static void renderTexture(WScreen *scr, WTexture *texture, int width, int height, int bwidth,
+                          int bheight, int left, int right, Pixmap *title, Pixmap *lbutton,
+                          Pixmap *rbutton);
+static void renderResizebarTexture(WScreen *scr, WTexture *texture, int width, int height,
+                                   int cwidth, Pixmap *pmap);
+
+/* Returns rendered pixmaps, renders them if there are no cached ones */
+static WFrameTexture *acquireFrameTexture(WScreen *scr, WTexture *texture, int is_resizebar,
+                                          int width, int height, int left, int right)
+{
+  WFrameTextureCache *cache = frameTextureCache(scr);
+  unsigned hash = frameTextureHash(texture, width, height);
+  WFrameTexture *entry;
+
+  for (entry = cache->buckets[hash]; entry; entry = entry->next) {
+    if (entry->texture == texture && entry->is_resizebar == is_resizebar &&
+        entry->width == width && entry->height == height && entry->left == left &&
+        entry->right == right && entry->titlebar_style == wPreferences.titlebar_style) {
+      if (entry->refcount++ == 0)
+        cache->unused_count--;
+      return entry;
+    }
+  }
+
+  entry = wmalloc(sizeof(WFrameTexture));
+  entry->refcount = 1;
+  entry->texture = texture;
+  entry->is_resizebar = is_resizebar;
+  entry->titlebar_style = wPreferences.titlebar_style;
+  entry->width = width;
+  entry->height = height;
+  entry->left = left;
+  entry->right = right;
+
+  if (is_resizebar)
+    renderResizebarTexture(scr, texture, width, height, left, &entry->title);
+  else
+    renderTexture(scr, texture, width, height, height, height, left, right, &entry->title,
+                  &entry->lbutton, &entry->rbutton);
+
+  entry->next = cache->buckets[hash];
+  cache->buckets[hash] = entry;
+
+  return entry;
+}
+
+static void releaseFrameTexture(WScreen *scr, WFrameTexture *entry)
+{
+  WFrameTextureCache *cache = scr->frame_texture_cache;
+  WFrameTexture *oldest, *tmp;
+  int i;
+
+  if (!entry || --entry->refcount > 0)
+    return;
+
+  if (!entry->texture) {
+    destroyFrameTexture(entry);
+    return;
+  }
+
+  entry->last_use = ++cache->use_count;
+  if (++cache->unused_count <= FRAME_TEXTURE_UNUSED_MAX)
+    return;
+
+  oldest = NULL;
+  for (i = 0; i < FRAME_TEXTURE_BUCKETS; i++) {
+    for (tmp = cache->buckets[i]; tmp; tmp = tmp->next) {
+      if (tmp->refcount == 0 && (!oldest || tmp->last_use < oldest->last_use))
+        oldest = tmp;
+    }
+  }
+  unlinkFrameTexture(cache, oldest);
+  destroyFrameTexture(oldest);
+  cache->unused_count--;
+}
+
+void wFrameWindowForgetTexture(WScreen *scr, WTexture *texture)
+{
+  WFrameTextureCache *cache = scr->frame_texture_cache;
+  WFrameTexture *entry, *next;
+  WFrameStretch **link, *stretch;
+  int i;
+
+  if (!cache)
+    return;
+
+  for (i = 0; i < FRAME_TEXTURE_BUCKETS; i++) {
+    for (entry = cache->buckets[i]; entry; entry = next) {
+      next = entry->next;
+      if (entry->texture != texture)
+        continue;
+
+      unlinkFrameTexture(cache, entry);
+      if (entry->refcount == 0) {
+        destroyFrameTexture(entry);
+        cache->unused_count--;
+      } else {
+        /* destroyed by the last frame using it */
+        entry->texture = NULL;
+      }
+    }
+  }
+
+  for (link = &cache->stretches; *link;) {
+    stretch = *link;
+    if (stretch->texture == texture) {
+      *link = stretch->next;
+      RReleaseImage(stretch->image);
+      wfree(stretch);
+    } else {
+      link = &stretch->next;
+    }
+  }
+}
+
+static void releaseTitleTexture(WFrameWindow *fwin, int state)
+{
+  releaseFrameTexture(fwin->screen_ptr, fwin->title_cache[state]);
+  fwin->title_cache[state] = NULL;
+  fwin->title_back[state] = None;
+  fwin->lbutton_back[state] = None;
+  fwin->rbutton_back[state] = None;
+}
+
+static void releaseResizebarTexture(WFrameWindow *fwin)
+{
+  releaseFrameTexture(fwin->screen_ptr, fwin->resizebar_cache);
+  fwin->resizebar_cache = NULL;
+  fwin->resizebar_back[0] = None;
+}
+
+/**************************************/
+
 static void renderTexture(WScreen *scr, WTexture *texture, int width, int height, int bwidth,
                           int bheight, int left, int right, Pixmap *title, Pixmap *lbutton,
                           Pixmap *rbutton)
@@ -513,7 +769,7 @@ static void renderTexture(WScreen *scr, WTexture *texture, int width, int height
   *lbutton = None;
   *rbutton = None;
 
-  img = wTextureRenderImage(texture, width, height, WREL_FLAT);
+  img = renderFrameImage(scr, texture, width, height);
   if (!img) {
     WMLogWarning(_("could not render texture: %s"), RMessageForError(RErrorCode));
     return;
@@ -585,7 +841,7 @@ static void renderResizebarTexture(WScreen *scr, WTexture *texture, int width, i
 
   *pmap = None;
 
-  img = wTextureRenderImage(texture, width, height, WREL_FLAT);
+  img = renderFrameImage(scr, texture, width, height);
   if (!img) {
     WMLogWarning(_("could not render texture: %s"), RMessageForError(RErrorCode));
     return;
@@ -661,45 +917,44 @@ static void updateTexture(WFrameWindow *fwin)
 
 static void remakeTexture(WFrameWindow *fwin, int state)
 {
-  Pixmap pmap, lpmap, rpmap;
+  WScreen *scr = fwin->screen_ptr;
+  WFrameTexture *entry;
 
   if (fwin->title_texture[state] && fwin->titlebar) {
-    FREE_PIXMAP(fwin->title_back[state]);
-    if (wPreferences.titlebar_style == TS_NEW) {
-      FREE_PIXMAP(fwin->lbutton_back[state]);
-      FREE_PIXMAP(fwin->rbutton_back[state]);
-    }
-
+    entry = NULL;
     if (fwin->title_texture[state]->any.type != WTEX_SOLID) {
       int left, right;
-      int width;
 
       /* eventually surrounded by if new_style */
       left = fwin->left_button && !fwin->flags.hide_left_button && !fwin->flags.lbutton_dont_fit;
       right = fwin->right_button && !fwin->flags.hide_right_button && !fwin->flags.rbutton_dont_fit;
 
-      width = fwin->core->width + 1;
-
-      renderTexture(fwin->screen_ptr, fwin->title_texture[state], width, fwin->titlebar->height,
-                    fwin->titlebar->height, fwin->titlebar->height, left, right, &pmap, &lpmap,
-                    &rpmap);
+      /* acquired before release: pixmaps are not rerendered if size hasn't changed */
+      entry = acquireFrameTexture(scr, fwin->title_texture[state], False, fwin->core->width + 1,
+                                  fwin->titlebar->height, left, right);
+    }
+    releaseTitleTexture(fwin, state);
 
-      fwin->title_back[state] = pmap;
+    fwin->title_cache[state] = entry;
+    if (entry) {
+      fwin->title_back[state] = entry->title;
       if (wPreferences.titlebar_style == TS_NEW) {
-        fwin->lbutton_back[state] = lpmap;
-        fwin->rbutton_back[state] = rpmap;
+        fwin->lbutton_back[state] = entry->lbutton;
+        fwin->rbutton_back[state] = entry->rbutton;
       }
     }
   }
   if (fwin->resizebar_texture && fwin->resizebar_texture[0] && fwin->resizebar && state == 0) {
-    FREE_PIXMAP(fwin->resizebar_back[0]);
-
+    entry = NULL;
     if (fwin->resizebar_texture[0]->any.type != WTEX_SOLID) {
-      renderResizebarTexture(fwin->screen_ptr, fwin->resizebar_texture[0], fwin->resizebar->width,
-                             fwin->resizebar->height, fwin->resizebar_corner_width, &pmap);
-
-      fwin->resizebar_back[0] = pmap;
+      entry = acquireFrameTexture(scr, fwin->resizebar_texture[0], True, fwin->resizebar->width,
+                                  fwin->resizebar->height, fwin->resizebar_corner_width, 0);
     }
+    releaseResizebarTexture(fwin);
+
+    fwin->resizebar_cache = entry;
+    if (entry)
+      fwin->resizebar_back[0] = entry->title;
 
     /* this part should be in updateTexture() */
     if (fwin->resizebar_texture[0]->any.type != WTEX_SOLID)
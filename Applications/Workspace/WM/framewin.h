@@ -75,6 +75,10 @@ typedef struct WFrameWindow {
   Pixmap lbutton_back[3];
   Pixmap rbutton_back[3];
 
+  /* shared pixmaps *_back point to, see wFrameWindowForgetTexture() */
+  struct WFrameTexture *title_cache[3];
+  struct WFrameTexture *resizebar_cache;
+
   WPixmap *lbutton_image;
   WPixmap *rbutton_image;
 
@@ -157,4 +161,8 @@ void wFrameWindowHideButton(WFrameWindow *fwin, int flags);
 
 int wFrameWindowChangeTitle(WFrameWindow *fwin, const char *new_title);
 
+/* Drops cached titlebar and resizebar pixmaps rendered with the texture.
+   Must be called before texture is destroyed. */
+void wFrameWindowForgetTexture(WScreen *scr, union WTexture *texture);
+
 #endif /* __WORKSPACE_WM_FRAMEWINDOW__ */
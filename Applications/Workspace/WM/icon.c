@@ -393,6 +393,14 @@ RImage *wIconValidateIconSize(RImage *icon, int max_size)
   return icon;
 }
 
+/* Loads image from file through wraster image cache and scales it the same way
+ * as wIconValidateIconSize(). Returned image is shared with the cache. */
+RImage *wIconLoadValidImage(RContext *rcontext, const char *file, int max_size)
+{
+  /* We should hold "ICON_BORDER" to include the icon border */
+  return RLoadFittedImage(rcontext, file, 0, max_size + ICON_BORDER, max_size - ICON_BORDER);
+}
+
 int wIconChangeImageFile(WIcon *icon, const char *file)
 {
   WScreen *scr = icon->core->screen_ptr;
@@ -203,6 +203,8 @@ typedef struct _WScreen {
   GC draw_gc;    /* gc for drawing misc things */
   GC mono_gc;    /* gc for 1 bit drawables */
 
+  struct WFrameTextureCache *frame_texture_cache; /* titlebar and resizebar pixmaps */
+
   struct WPixmap *b_pixmaps[PRED_BPIXMAPS]; /* internal pixmaps for buttons*/
   struct WPixmap *menu_radio_indicator;     /* left menu indicator */
   struct WPixmap *menu_check_indicator;     /* left menu indicator for checkmark */
@@ -37,6 +37,7 @@
 
 #include "WM.h"
 #include "texture.h"
+#include "framewin.h"
 
 #include <window.h>
 #include <defaults.h>
@@ -134,6 +135,8 @@ void wTextureDestroy(WScreen *scr, WTexture *texture)
    * some stupid servers don't like white or black being freed...
    */
 #define CANFREE(c) (c != scr->black_pixel && c != scr->white_pixel && c != 0)
+  wFrameWindowForgetTexture(scr, texture);
+
   switch (texture->any.type) {
     case WTEX_SOLID:
       XFreeGC(dpy, texture->solid.light_gc);
@@ -427,7 +427,8 @@ char *get_icon_filename(const char *winstance, const char *wclass, const char *c
   return file_path;
 }
 
-/* This function returns the image picture for the file_name file */
+/* This function returns the image picture for the file_name file.
+ * Returned image may be shared with wraster image cache: it must not be modified. */
 RImage *get_rimage_from_file(WScreen *scr, const char *file_name, int max_size)
 {
   RImage *image = NULL;
@@ -436,6 +437,13 @@ RImage *get_rimage_from_file(WScreen *scr, const char *file_name, int max_size)
     return NULL;
   }
 
+  /* Scaled icons are cached by wraster: large icon is loaded and scaled once */
+  image = wIconLoadValidImage(scr->rcontext, file_name, max_size);
+  if (image) {
+    return image;
+  }
+
+  /* Formats not supported by wraster are loaded with NSImage */
   image = WSCreateRasterImage(file_name, scr);
   if (!image) {
     WMLogWarning(_("error loading image file \"%s\": %s"), file_name, RMessageForError(RErrorCode));
@@ -42,13 +42,30 @@
 #include <X11/extensions/Xrender.h>
 #include <X11/extensions/shape.h>
 
+#include "core/log_utils.h"
+
 typedef struct _ignore {
   struct _ignore *next;
   unsigned long sequence;
 } CMPIgnoreSequence;
 
+/*
+ * Shadow of window big enough to have all parts of the shadow is painted
+ * from pieces of a shadow image shared by windows with the same shadow
+ * opacity. Corners are painted as is, edges and center are repeated.
+ */
+#define SHADOW_OPACITY_LEVELS 26
+
+typedef struct _shadow_tiles {
+  Picture corners;    /* (2 * Gsize + 1) square shadow, corners are Gsize squares */
+  Picture horizontal; /* its middle column: top and bottom edges */
+  Picture vertical;   /* its middle row: left and right edges */
+  Picture center;     /* its center pixel */
+} CMPShadowTiles;
+
 typedef struct _win {
-  struct _win *next;
+  struct _win *next;      /* in stacking order, topmost first */
+  struct _win *hash_next; /* in window_hash bucket */
   Window id;
   Pixmap pixmap;
   XWindowAttributes a;
@@ -60,7 +77,8 @@ typedef struct _win {
   Picture shadowPict;
   XserverRegion borderSize;
   XserverRegion extents;
-  Picture shadow;
+  Picture shadow;              /* or */
+  CMPShadowTiles *shadow_tiles; /* shared, not freed with window */
   int shadow_dx;
   int shadow_dy;
   int shadow_width;
@@ -94,6 +112,11 @@ typedef struct _fade {
 
 static Display *dpy;
 static CMPWindow *list;
+
+/* windows by id, lookups are done for almost every event */
+#define WINDOW_HASH_BITS 8
+#define WINDOW_HASH_SIZE (1 << WINDOW_HASH_BITS)
+static CMPWindow *window_hash[WINDOW_HASH_SIZE];
 static CMPFade *fades;
 static int scr;
 static Window root_window;
@@ -150,6 +173,7 @@ static unsigned int get_window_opacity_property(Display *dpy, CMPWindow *w, unsi
 
 static XserverRegion window_extents_region(Display *dpy, CMPWindow *w);
 static XserverRegion window_border_size(Display *dpy, CMPWindow *w);
+static Bool discard_window_shadow(Display *dpy, CMPWindow *w);
     
 static void wComposerDiscardEventIgnore(Display *dpy, unsigned long sequence);
 static void wComposerSetEventIgnore(Display *dpy, unsigned long sequence);
@@ -171,10 +195,26 @@ static int fade_time = 0;
 static Bool excludeDockShadows = False;
 static Bool autoRedirect = False;
 
+/* Damage is accumulated and painted at most once per paint_interval */
+static int paint_interval = 16;
+static int paint_time = 0; /* time of the next paint */
+
+/* Statistics logged every STATS_INTERVAL milliseconds if enabled */
+#define STATS_INTERVAL 5000
+static Bool showStatistics = False;
+static struct {
+  int start;                 /* time counting started */
+  unsigned long frames;      /* paint_all() calls */
+  double composite_time;     /* in paint_all(), milliseconds */
+  unsigned long long damage; /* area reported by Damage and Expose events, pixels */
+  unsigned long damage_events;
+} stats;
+
 /* For shadow precomputation */
 static int Gsize = -1;
 static unsigned char *shadowCorner = NULL;
 static unsigned char *shadowTop = NULL;
+static CMPShadowTiles *shadowTiles[SHADOW_OPACITY_LEVELS];
 
 static int get_time_in_milliseconds(void)
 {
@@ -184,6 +224,14 @@ static int get_time_in_milliseconds(void)
   return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+static double get_time_in_milliseconds_fine(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
 // ----------------------------------------------------------------------------------------------
 // Fading
 // ----------------------------------------------------------------------------------------------
@@ -271,9 +319,7 @@ static void set_fade(Display *dpy, CMPWindow *w, double start, double finish, do
   f->gone = gone;
   w->opacity = f->cur * OPAQUE;
   determine_mode(dpy, w);
-  if (w->shadow) {
-    XRenderFreePicture(dpy, w->shadow);
-    w->shadow = None;
+  if (discard_window_shadow(dpy, w)) {
     w->extents = window_extents_region(dpy, w);
   }
 }
@@ -328,9 +374,7 @@ static void run_fades(Display *dpy)
       }
     }
     determine_mode(dpy, w);
-    if (w->shadow) {
-      XRenderFreePicture(dpy, w->shadow);
-      w->shadow = None;
+    if (discard_window_shadow(dpy, w)) {
       w->extents = window_extents_region(dpy, w);
     }
     /* Must do this last as it might destroy f->w in callbacks */
@@ -585,48 +629,174 @@ static XImage *create_shadow_image(Display *dpy, double opacity, int width, int
   return ximage;
 }
 
+/* Uploads part of 8-bit `image` to new alpha-only picture */
+static Picture create_alpha_picture(Display *dpy, XImage *image, int x, int y, int width,
+                                    int height, Bool repeat)
+{
+  Pixmap pixmap;
+  Picture picture;
+  XRenderPictureAttributes pa;
+  GC gc;
+
+  pixmap = XCreatePixmap(dpy, root_window, width, height, 8);
+  if (!pixmap) {
+    return None;
+  }
+
+  pa.repeat = repeat;
+  picture = XRenderCreatePicture(dpy, pixmap, XRenderFindStandardFormat(dpy, PictStandardA8),
+                                 CPRepeat, &pa);
+  if (!picture) {
+    XFreePixmap(dpy, pixmap);
+    return None;
+  }
+
+  gc = XCreateGC(dpy, pixmap, 0, NULL);
+  if (!gc) {
+    XFreePixmap(dpy, pixmap);
+    XRenderFreePicture(dpy, picture);
+    return None;
+  }
+
+  XPutImage(dpy, pixmap, gc, image, x, y, 0, 0, width, height);
+  XFreeGC(dpy, gc);
+  XFreePixmap(dpy, pixmap);
+  return picture;
+}
+
 static Picture create_shadow_picture(Display *dpy, double opacity, Picture alpha_pict,
                                             int width, int height, int *wp, int *hp)
 {
   XImage *shadowImage;
-  Pixmap shadowPixmap;
   Picture shadowPicture;
-  GC gc;
 
   shadowImage = create_shadow_image(dpy, opacity, width, height);
   if (!shadowImage) {
     return None;
   }
-  shadowPixmap = XCreatePixmap(dpy, root_window, shadowImage->width, shadowImage->height, 8);
-  if (!shadowPixmap) {
-    XDestroyImage(shadowImage);
-    return None;
+
+  shadowPicture = create_alpha_picture(dpy, shadowImage, 0, 0, shadowImage->width,
+                                       shadowImage->height, False);
+  if (shadowPicture) {
+    *wp = shadowImage->width;
+    *hp = shadowImage->height;
   }
+  XDestroyImage(shadowImage);
+  return shadowPicture;
+}
 
-  shadowPicture = XRenderCreatePicture(dpy, shadowPixmap,
-                                       XRenderFindStandardFormat(dpy, PictStandardA8), 0, NULL);
-  if (!shadowPicture) {
-    XDestroyImage(shadowImage);
-    XFreePixmap(dpy, shadowPixmap);
-    return (Picture)None;
+/* Returns shadow tiles for the opacity, creates them once */
+static CMPShadowTiles *get_shadow_tiles(Display *dpy, double opacity)
+{
+  CMPShadowTiles *tiles;
+  XImage *image;
+  int opacity_int = (int)(opacity * 25);
+  int size = 2 * Gsize + 1;
+
+  if (Gsize <= 0 || opacity_int < 0 || opacity_int >= SHADOW_OPACITY_LEVELS) {
+    return NULL;
+  }
+  if (shadowTiles[opacity_int]) {
+    return shadowTiles[opacity_int];
   }
 
-  gc = XCreateGC(dpy, shadowPixmap, 0, NULL);
-  if (!gc) {
-    XDestroyImage(shadowImage);
-    XFreePixmap(dpy, shadowPixmap);
-    XRenderFreePicture(dpy, shadowPicture);
-    return (Picture)None;
+  /* shadow of window with 1 pixel wide top, side and center sections */
+  image = create_shadow_image(dpy, opacity, Gsize + 1, Gsize + 1);
+  if (!image) {
+    return NULL;
   }
+  tiles = calloc(1, sizeof(CMPShadowTiles));
+  if (tiles) {
+    tiles->corners = create_alpha_picture(dpy, image, 0, 0, size, size, False);
+    tiles->horizontal = create_alpha_picture(dpy, image, Gsize, 0, 1, size, True);
+    tiles->vertical = create_alpha_picture(dpy, image, 0, Gsize, size, 1, True);
+    tiles->center = create_alpha_picture(dpy, image, Gsize, Gsize, 1, 1, True);
+    if (!tiles->corners || !tiles->horizontal || !tiles->vertical || !tiles->center) {
+      if (tiles->corners)
+        XRenderFreePicture(dpy, tiles->corners);
+      if (tiles->horizontal)
+        XRenderFreePicture(dpy, tiles->horizontal);
+      if (tiles->vertical)
+        XRenderFreePicture(dpy, tiles->vertical);
+      if (tiles->center)
+        XRenderFreePicture(dpy, tiles->center);
+      free(tiles);
+      tiles = NULL;
+    }
+  }
+  XDestroyImage(image);
 
-  XPutImage(dpy, shadowPixmap, gc, shadowImage, 0, 0, 0, 0, shadowImage->width,
-            shadowImage->height);
-  *wp = shadowImage->width;
-  *hp = shadowImage->height;
-  XFreeGC(dpy, gc);
-  XDestroyImage(shadowImage);
-  XFreePixmap(dpy, shadowPixmap);
-  return shadowPicture;
+  shadowTiles[opacity_int] = tiles;
+  return tiles;
+}
+
+/* Paints shadow from tiles: 9 composites whatever the size is */
+static void paint_shadow_tiles(Display *dpy, CMPShadowTiles *tiles, Picture dest, int x, int y,
+                               int width, int height)
+{
+  int g = Gsize;
+  int inner_width = width - 2 * g;
+  int inner_height = height - 2 * g;
+  int right = x + width - g;
+  int bottom = y + height - g;
+
+  XRenderComposite(dpy, PictOpOver, black_picture, tiles->corners, dest, 0, 0, 0, 0, x, y, g, g);
+  XRenderComposite(dpy, PictOpOver, black_picture, tiles->corners, dest, 0, 0, g + 1, 0, right, y,
+                   g, g);
+  XRenderComposite(dpy, PictOpOver, black_picture, tiles->corners, dest, 0, 0, 0, g + 1, x,
+                   bottom, g, g);
+  XRenderComposite(dpy, PictOpOver, black_picture, tiles->corners, dest, 0, 0, g + 1, g + 1,
+                   right, bottom, g, g);
+  if (inner_width > 0) {
+    XRenderComposite(dpy, PictOpOver, black_picture, tiles->horizontal, dest, 0, 0, 0, 0, x + g,
+                     y, inner_width, g);
+    XRenderComposite(dpy, PictOpOver, black_picture, tiles->horizontal, dest, 0, 0, 0, g + 1,
+                     x + g, bottom, inner_width, g);
+  }
+  if (inner_height > 0) {
+    XRenderComposite(dpy, PictOpOver, black_picture, tiles->vertical, dest, 0, 0, 0, 0, x, y + g,
+                     g, inner_height);
+    XRenderComposite(dpy, PictOpOver, black_picture, tiles->vertical, dest, 0, 0, g + 1, 0, right,
+                     y + g, g, inner_height);
+  }
+  if (inner_width > 0 && inner_height > 0) {
+    XRenderComposite(dpy, PictOpOver, black_picture, tiles->center, dest, 0, 0, 0, 0, x + g,
+                     y + g, inner_width, inner_height);
+  }
+}
+
+/* Creates shadow picture or finds shadow tiles for the window */
+static void create_window_shadow(Display *dpy, CMPWindow *w, double opacity)
+{
+  int width = w->a.width + w->a.border_width * 2;
+  int height = w->a.height + w->a.border_width * 2;
+
+  /* shadow is at least 2 * Gsize wide and high, has all of the corners */
+  if (width >= Gsize && height >= Gsize) {
+    w->shadow_tiles = get_shadow_tiles(dpy, opacity);
+    if (w->shadow_tiles) {
+      w->shadow_width = width + Gsize;
+      w->shadow_height = height + Gsize;
+      return;
+    }
+  }
+  w->shadow = create_shadow_picture(dpy, opacity, w->alphaPict, width, height, &w->shadow_width,
+                                    &w->shadow_height);
+}
+
+/* Returns True if window had a shadow */
+static Bool discard_window_shadow(Display *dpy, CMPWindow *w)
+{
+  if (w->shadow) {
+    XRenderFreePicture(dpy, w->shadow);
+    w->shadow = None;
+    return True;
+  }
+  if (w->shadow_tiles) {
+    w->shadow_tiles = NULL;
+    return True;
+  }
+  return False;
 }
 
 static Picture create_solid_picture(Display *dpy, Bool argb, double a, double r, double g, double b)
@@ -713,6 +883,7 @@ static void paint_all(Display *dpy, XserverRegion region)
 {
   CMPWindow *w;
   CMPWindow *t = NULL;
+  double start = get_time_in_milliseconds_fine();
 
   if (!region) {
     XRectangle r;
@@ -814,10 +985,16 @@ static void paint_all(Display *dpy, XserverRegion region)
         break;
       case CompClientShadows:
         /* don't bother drawing shadows on desktop windows */
-        if (w->shadow && w->windowType != winDesktopAtom) {
+        if (w->windowType == winDesktopAtom) {
+          break;
+        }
+        if (w->shadow) {
           XRenderComposite(dpy, PictOpOver, black_picture, w->shadow, root_picture_buffer, 0, 0, 0, 0,
                            w->a.x + w->shadow_dx, w->a.y + w->shadow_dy, w->shadow_width,
                            w->shadow_height);
+        } else if (w->shadow_tiles) {
+          paint_shadow_tiles(dpy, w->shadow_tiles, root_picture_buffer, w->a.x + w->shadow_dx,
+                             w->a.y + w->shadow_dy, w->shadow_width, w->shadow_height);
         }
         break;
     }
@@ -856,6 +1033,46 @@ static void paint_all(Display *dpy, XserverRegion region)
     XRenderComposite(dpy, PictOpSrc, root_picture_buffer, None, root_picture, 0, 0, 0, 0, 0, 0, root_width,
                      root_height);
   }
+
+  stats.frames++;
+  stats.composite_time += get_time_in_milliseconds_fine() - start;
+}
+
+static void log_statistics(void)
+{
+  int now = get_time_in_milliseconds();
+  double seconds;
+
+  if (!stats.start) {
+    stats.start = now;
+    return;
+  }
+  if (now - stats.start < STATS_INTERVAL) {
+    return;
+  }
+
+  seconds = (now - stats.start) / 1000.0;
+  WMLogInfo("Composer: %.1f frames/s, %.2f ms per frame, %.0f damaged pixels/s in %lu events",
+            stats.frames / seconds, stats.frames ? stats.composite_time / stats.frames : 0.0,
+            stats.damage / seconds, stats.damage_events);
+
+  memset(&stats, 0, sizeof(stats));
+  stats.start = now;
+}
+
+/* Milliseconds till accumulated damage should be painted, -1 if there's none */
+static int paint_timeout(void)
+{
+  int delta;
+
+  if (!allDamage || autoRedirect) {
+    return -1;
+  }
+  delta = paint_time - get_time_in_milliseconds();
+  if (delta < 0) {
+    delta = 0;
+  }
+  return delta;
 }
 
 static void add_damage_region(Display *dpy, XserverRegion damage)
@@ -871,11 +1088,16 @@ static void add_damage_region(Display *dpy, XserverRegion damage)
 // ----------------------------------------------------------------------------------------------
 // Windows
 // ----------------------------------------------------------------------------------------------
+static inline unsigned window_hash_index(Window id)
+{
+  return ((unsigned)id * 2654435761u) >> (32 - WINDOW_HASH_BITS);
+}
+
 static CMPWindow *find_window(Display *dpy, Window id)
 {
   CMPWindow *w;
 
-  for (w = list; w; w = w->next) {
+  for (w = window_hash[window_hash_index(id)]; w; w = w->hash_next) {
     if (w->id == id) {
       return w;
     }
@@ -883,6 +1105,18 @@ static CMPWindow *find_window(Display *dpy, Window id)
   return NULL;
 }
 
+static void window_hash_remove(CMPWindow *w)
+{
+  CMPWindow **prev;
+
+  for (prev = &window_hash[window_hash_index(w->id)]; *prev; prev = &(*prev)->hash_next) {
+    if (*prev == w) {
+      *prev = w->hash_next;
+      break;
+    }
+  }
+}
+
 static XserverRegion window_extents_region(Display *dpy, CMPWindow *w)
 {
   XRectangle r;
@@ -903,14 +1137,12 @@ static XserverRegion window_extents_region(Display *dpy, CMPWindow *w)
       } else {
         w->shadow_dx = shadowOffsetX;
         w->shadow_dy = shadowOffsetY;
-        if (!w->shadow) {
+        if (!w->shadow && !w->shadow_tiles) {
           double opacity = shadowOpacity;
           if (w->mode == WINDOW_TRANS) {
             opacity = opacity * ((double)w->opacity) / ((double)OPAQUE);
           }
-          w->shadow = create_shadow_picture(dpy, opacity, w->alphaPict, w->a.width + w->a.border_width * 2,
-                                     w->a.height + w->a.border_width * 2, &w->shadow_width,
-                                     &w->shadow_height);
+          create_window_shadow(dpy, w, opacity);
         }
       }
       sr.x = w->a.x + w->shadow_dx;
@@ -1030,10 +1262,7 @@ static void finish_unmap_window(Display *dpy, CMPWindow *w)
     XFixesDestroyRegion(dpy, w->borderSize);
     w->borderSize = None;
   }
-  if (w->shadow) {
-    XRenderFreePicture(dpy, w->shadow);
-    w->shadow = None;
-  }
+  discard_window_shadow(dpy, w);
   if (w->borderClip) {
     XFixesDestroyRegion(dpy, w->borderClip);
     w->borderClip = None;
@@ -1231,6 +1460,7 @@ static void add_window(Display *dpy, Window id, Window prev)
   new->borderSize = None;
   new->extents = None;
   new->shadow = None;
+  new->shadow_tiles = NULL;
   new->shadow_dx = 0;
   new->shadow_dy = 0;
   new->shadow_width = 0;
@@ -1244,6 +1474,8 @@ static void add_window(Display *dpy, Window id, Window prev)
 
   new->next = *p;
   *p = new;
+  new->hash_next = window_hash[window_hash_index(id)];
+  window_hash[window_hash_index(id)] = new;
   if (new->a.map_state == IsViewable) {
     map_window(dpy, id, new->damage_sequence - 1, True);
   }
@@ -1313,10 +1545,7 @@ static void configure_window(Display *dpy, XConfigureEvent *ce)
         w->picture = None;
       }
     }
-    if (w->shadow) {
-      XRenderFreePicture(dpy, w->shadow);
-      w->shadow = None;
-    }
+    discard_window_shadow(dpy, w);
   }
   w->a.width = ce->width;
   w->a.height = ce->height;
@@ -1366,6 +1595,7 @@ static void finish_destroy_window(Display *dpy, Window id, Bool gone)
         finish_unmap_window(dpy, w);
       }
       *prev = w->next;
+      window_hash_remove(w);
       if (w->picture) {
         wComposerSetEventIgnore(dpy, NextRequest(dpy));
         XRenderFreePicture(dpy, w->picture);
@@ -1379,10 +1609,7 @@ static void finish_destroy_window(Display *dpy, Window id, Bool gone)
         XRenderFreePicture(dpy, w->shadowPict);
         w->shadowPict = None;
       }
-      if (w->shadow) {
-        XRenderFreePicture(dpy, w->shadow);
-        w->shadow = None;
-      }
+      discard_window_shadow(dpy, w);
       if (w->damage != None) {
         wComposerSetEventIgnore(dpy, NextRequest(dpy));
         XDamageDestroy(dpy, w->damage);
@@ -1523,6 +1750,8 @@ static void wComposerProcessDamageEvent(Display *dpy, XDamageNotifyEvent *de)
   if (!w) {
     return;
   }
+  stats.damage += de->area.width * de->area.height;
+  stats.damage_events++;
   repair_window(dpy, w);
 }
 
@@ -1560,7 +1789,7 @@ static void wComposerProcessShapeEvent(Display *dpy, XShapeEvent *se)
     XFixesDestroyRegion(dpy, region1);
 
     /* ask for repaint of the old and new region */
-    paint_all(dpy, region0);
+    add_damage_region(dpy, region0);
   }
 }
 
@@ -1613,6 +1842,8 @@ void wComposerProcessEvent(Display *dpy, XEvent ev)
           expose_rects[n_expose].width = ev.xexpose.width;
           expose_rects[n_expose].height = ev.xexpose.height;
           n_expose++;
+          stats.damage += ev.xexpose.width * ev.xexpose.height;
+          stats.damage_events++;
           if (ev.xexpose.count == 0) {
             add_damage_region(dpy, XFixesCreateRegion(dpy, expose_rects, n_expose));
             n_expose = 0;
@@ -1645,9 +1876,7 @@ void wComposerProcessEvent(Display *dpy, XEvent ev)
             } else {
               w->opacity = get_window_opacity_property(dpy, w, OPAQUE);
               determine_mode(dpy, w);
-              if (w->shadow) {
-                XRenderFreePicture(dpy, w->shadow);
-                w->shadow = None;
+              if (discard_window_shadow(dpy, w)) {
                 w->extents = window_extents_region(dpy, w);
               }
             }
@@ -1665,15 +1894,11 @@ void wComposerProcessEvent(Display *dpy, XEvent ev)
   }
 }
 
-#include "core/log_utils.h"
 void wComposerRunLoop()
 {
   struct pollfd ufd;
   XEvent ev;
-  // XRectangle *expose_rects = NULL;
-  // int size_expose = 0;
-  // int n_expose = 0;
-  // int p;
+  int timeout, delta;
 
   WMLogError("Composer: Entering runloop with X connection: %i", ConnectionNumber(dpy));
 
@@ -1685,11 +1910,14 @@ void wComposerRunLoop()
 
   for (;;) {
     do {
-      if (autoRedirect) {
-        XFlush(dpy);
-      }
+      XFlush(dpy);
       if (!QLength(dpy)) {
-        if (poll(&ufd, 1, fade_timeout()) == 0) {
+        timeout = fade_timeout();
+        delta = paint_timeout();
+        if (delta >= 0 && (timeout < 0 || delta < timeout)) {
+          timeout = delta;
+        }
+        if (poll(&ufd, 1, timeout) == 0) {
           run_fades(dpy);
           break;
         }
@@ -1701,13 +1929,15 @@ void wComposerRunLoop()
       wComposerProcessEvent(dpy, ev);
     } while (QLength(dpy));
 
-    if (allDamage && !autoRedirect) {
-      // static int paint;
+    /* paint damage of all events received during the frame at once */
+    if (allDamage && !autoRedirect && paint_timeout() == 0) {
       paint_all(dpy, allDamage);
-      // paint++;
-      XSync(dpy, False);
       allDamage = None;
       is_clip_changed = False;
+      paint_time = get_time_in_milliseconds() + paint_interval;
+    }
+    if (showStatistics) {
+      log_statistics();
     }
   }
 }
@@ -1875,6 +2105,10 @@ Bool wComposerInitialize()
   // CompServerShadows - use window alpha for shadow; sharp, but precise
   // CompClientShadows - use window extents for shadow, blurred
   compMode = CompSimple;
+  // Minimal time between repaints in milliseconds, damage is accumulated meanwhile
+  paint_interval = 16;
+  // True - log frame rate, composite time and damaged area every 5 seconds
+  showStatistics = False;
 
   dpy = XOpenDisplay(display);
   if (!dpy) {
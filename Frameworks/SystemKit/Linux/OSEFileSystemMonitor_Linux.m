@@ -23,42 +23,373 @@
 
 #ifdef LINUX
 
-// Supress clang message: 
-// "warning: category is implementing a method which will also be implemented 
+// Supress clang message:
+// "warning: category is implementing a method which will also be implemented
 // by its primary class [-Wobjc-protocol-method-implementation]"
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wobjc-protocol-method-implementation"
 
 #import <OSEFileSystemMonitor.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/inotify.h>
 #include <unistd.h>
-#include <poll.h>
-#include <sys/ioctl.h>
+#include <fts.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FSM_EVENTS (IN_CREATE|IN_DELETE|IN_DELETE_SELF|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB)
+#define FSM_BUFFER_SIZE (64 * 1024)
+#define FSM_MAX_EVENTS (FSM_BUFFER_SIZE / sizeof(struct inotify_event))
+
+// Watched directory. It's found by descriptor for every event and by path
+// on _addPath:/_removePath: calls, so it's linked into two hash tables.
+typedef struct fsm_watch
+{
+  int              wd;          // -1 if there's no inotify watch
+  int              link_count;  // number of _addPath: calls
+  int              tree_count;  // number of _addTree: calls covering this directory
+  unsigned         hash;        // of path
+  char             *path;
+  NSString         *pathString;
+  unsigned         batch;       // last read() batch with events of directory
+  unsigned         group;       // index of directory in that batch
+  struct fsm_watch *next_wd;
+  struct fsm_watch *next_path;
+} fsm_watch_t;
+
+enum {
+  FSM_CREATE,
+  FSM_DELETE,
+  FSM_MODIFY,
+  FSM_ATTRIB,
+  FSM_MOVED_FROM,
+  FSM_MOVED_TO
+};
+
+// Raw event of read() batch
+typedef struct fsm_event
+{
+  fsm_watch_t *watch;
+  unsigned    index;
+  int         kind;
+  BOOL        isConsumed;  // MOVED_TO which was paired with MOVED_FROM
+  uint32_t    cookie;
+  const char  *name;
+} fsm_event_t;
+
+// Watch list changes which are made after events of batch were sent
+enum {
+  FSM_TREE_ADD,
+  FSM_TREE_REMOVE,
+  FSM_WATCH_LOST
+};
+typedef struct fsm_change
+{
+  int  type;
+  int  wd;
+  int  count;
+  char *path;
+} fsm_change_t;
 
 int in_fd = -1;
 
-NSMutableDictionary *_pathFDList = nil;
-NSLock              *monitorLock = nil;
+static fsm_watch_t **wd_table = NULL;
+static fsm_watch_t **path_table = NULL;
+static size_t      table_size = 0;   // power of 2
+static size_t      watch_count = 0;
+static BOOL        isWatchingDescriptor = NO;
+
+static unsigned fsm_path_hash(const char *path)
+{
+  unsigned hash = 2166136261u;
+
+  while (*path)
+    {
+      hash = (hash ^ (unsigned char)*path++) * 16777619u;
+    }
+  return hash;
+}
+
+static void fsm_link_descriptor(fsm_watch_t *watch)
+{
+  fsm_watch_t **bucket = &wd_table[watch->wd & (table_size - 1)];
+
+  watch->next_wd = *bucket;
+  *bucket = watch;
+}
+
+static void fsm_unlink_descriptor(fsm_watch_t *watch)
+{
+  fsm_watch_t **w = &wd_table[watch->wd & (table_size - 1)];
+
+  while (*w && *w != watch)
+    w = &(*w)->next_wd;
+  if (*w)
+    *w = watch->next_wd;
+  watch->next_wd = NULL;
+}
+
+static fsm_watch_t *fsm_watch_for_descriptor(int wd)
+{
+  fsm_watch_t *watch;
+
+  if (table_size == 0 || wd < 0)
+    return NULL;
+
+  for (watch = wd_table[wd & (table_size - 1)]; watch; watch = watch->next_wd)
+    {
+      if (watch->wd == wd)
+        return watch;
+    }
+  return NULL;
+}
+
+static fsm_watch_t *fsm_watch_for_path(const char *path)
+{
+  fsm_watch_t *watch;
+  unsigned    hash;
+
+  if (table_size == 0)
+    return NULL;
+
+  hash = fsm_path_hash(path);
+  for (watch = path_table[hash & (table_size - 1)]; watch; watch = watch->next_path)
+    {
+      if (watch->hash == hash && strcmp(watch->path, path) == 0)
+        return watch;
+    }
+  return NULL;
+}
+
+static void fsm_table_grow(void)
+{
+  fsm_watch_t **old_table = path_table;
+  size_t      old_size = table_size;
+  size_t      i;
+
+  table_size = table_size ? table_size * 2 : 64;
+  wd_table = realloc(wd_table, table_size * sizeof(fsm_watch_t *));
+  memset(wd_table, 0, table_size * sizeof(fsm_watch_t *));
+  path_table = calloc(table_size, sizeof(fsm_watch_t *));
+
+  for (i = 0; i < old_size; i++)
+    {
+      fsm_watch_t *watch = old_table[i], *next;
+
+      for (; watch; watch = next)
+        {
+          fsm_watch_t **bucket = &path_table[watch->hash & (table_size - 1)];
+
+          next = watch->next_path;
+          watch->next_path = *bucket;
+          *bucket = watch;
+          if (watch->wd >= 0)
+            fsm_link_descriptor(watch);
+        }
+    }
+  free(old_table);
+}
+
+// Returns watch of `path` creating it if needed. Watch may have no inotify
+// watch (wd == -1) if path can't be watched, `error` is set to errno of
+// inotify_add_watch() then and to 0 otherwise.
+static fsm_watch_t *fsm_watch_add(const char *path, int *error)
+{
+  fsm_watch_t *watch = fsm_watch_for_path(path);
+
+  *error = 0;
+
+  if (watch == NULL)
+    {
+      fsm_watch_t **bucket;
+
+      if (watch_count >= table_size)
+        fsm_table_grow();
+
+      watch = calloc(1, sizeof(fsm_watch_t));
+      watch->wd = -1;
+      watch->path = strdup(path);
+      watch->hash = fsm_path_hash(path);
+      watch->pathString = [[[NSFileManager defaultManager]
+                             stringWithFileSystemRepresentation:path
+                                                         length:strlen(path)] retain];
+      bucket = &path_table[watch->hash & (table_size - 1)];
+      watch->next_path = *bucket;
+      *bucket = watch;
+      watch_count++;
+    }
+
+  if (watch->wd < 0)
+    {
+      watch->wd = inotify_add_watch(in_fd, path, FSM_EVENTS);
+      if (watch->wd >= 0)
+        fsm_link_descriptor(watch);
+      else
+        *error = errno;
+    }
+
+  return watch;
+}
+
+// Removes watch which is not used anymore
+static void fsm_watch_release(fsm_watch_t *watch)
+{
+  fsm_watch_t **w;
+
+  if (watch->link_count > 0 || watch->tree_count > 0)
+    return;
+
+  if (watch->wd >= 0)
+    {
+      fsm_unlink_descriptor(watch);
+      // Different paths of the same directory share inotify watch
+      if (fsm_watch_for_descriptor(watch->wd) == NULL)
+        inotify_rm_watch(in_fd, watch->wd);
+    }
+
+  w = &path_table[watch->hash & (table_size - 1)];
+  while (*w != watch)
+    w = &(*w)->next_path;
+  *w = watch->next_path;
+  watch_count--;
+
+  [watch->pathString release];
+  free(watch->path);
+  free(watch);
+}
+
+static BOOL fsm_is_in_tree(const char *path, const char *root, size_t root_length)
+{
+  if (strncmp(path, root, root_length) != 0)
+    return NO;
+  return (path[root_length] == '\0' || path[root_length] == '/'
+          || (root_length > 0 && root[root_length - 1] == '/'));
+}
+
+// Watches all directories of tree at `root`. Directories created inside are
+// added by checkForEvents, but contents created before watch was added are
+// not reported.
+static void fsm_tree_add(const char *root, int count)
+{
+  char   *paths[] = {(char *)root, NULL};
+  FTS    *fts;
+  FTSENT *entry;
+
+  if ((fts = fts_open(paths, FTS_PHYSICAL | FTS_COMFOLLOW | FTS_NOCHDIR | FTS_NOSTAT,
+                      NULL)) == NULL)
+    return;
+
+  while ((entry = fts_read(fts)) != NULL)
+    {
+      fsm_watch_t *watch;
+      int          error;
+
+      if (entry->fts_info != FTS_D)
+        continue;
+
+      watch = fsm_watch_add(entry->fts_path, &error);
+      watch->tree_count += count;
+      if (error == ENOSPC)
+        {
+          NSLog(@"OSEFileSystemMonitorThread(Linux): inotify watch limit reached "
+                "at %s. Check /proc/sys/fs/inotify/max_user_watches.", entry->fts_path);
+          break;
+        }
+    }
+  fts_close(fts);
+}
+
+static void fsm_tree_remove(const char *root, int count)
+{
+  size_t root_length = strlen(root);
+  size_t i;
+
+  for (i = 0; i < table_size; i++)
+    {
+      fsm_watch_t *watch = path_table[i], *next;
+
+      for (; watch; watch = next)
+        {
+          next = watch->next_path;
+          if (watch->tree_count > 0 && fsm_is_in_tree(watch->path, root, root_length))
+            {
+              watch->tree_count = MAX(0, watch->tree_count - count);
+              fsm_watch_release(watch);
+            }
+        }
+    }
+}
+
+// Watched directory was removed or unmounted: kernel has removed its watch
+static void fsm_watch_lost(fsm_watch_t *watch)
+{
+  fsm_unlink_descriptor(watch);
+  watch->wd = -1;
+  watch->tree_count = 0;
+  fsm_watch_release(watch);
+}
+
+static char *fsm_path_append(const char *path, const char *name)
+{
+  size_t length = strlen(path);
+  char   *result = malloc(length + strlen(name) + 2);
+
+  strcpy(result, path);
+  if (length == 0 || path[length - 1] != '/')
+    result[length++] = '/';
+  strcpy(result + length, name);
+
+  return result;
+}
+
+// Events of the same directory go together in order they have occured
+static int fsm_event_compare(const void *a, const void *b)
+{
+  const fsm_event_t *e1 = a, *e2 = b;
+
+  if (e1->watch->group != e2->watch->group)
+    return (e1->watch->group < e2->watch->group) ? -1 : 1;
+  return (e1->index < e2->index) ? -1 : 1;
+}
+
+// Attributes change of file which was reported already in the same batch
+// doesn't need to be reported again
+static BOOL fsm_is_duplicate(fsm_event_t *events, size_t start, size_t i)
+{
+  size_t j;
+
+  if (events[i].kind != FSM_ATTRIB && events[i].kind != FSM_MODIFY)
+    return NO;
+
+  for (j = start; j < i; j++)
+    {
+      if ((events[j].kind == events[i].kind || events[j].kind == FSM_CREATE
+           || events[j].kind == FSM_MOVED_TO)
+          && strcmp(events[j].name, events[i].name) == 0)
+        return YES;
+    }
+  return NO;
+}
 
 @implementation OSEFileSystemMonitorThread (Linux)
 
-// So all kqueue related ivars must be shared:
-//   in_fd - initify descriptor
-//   _pathFDList - list of file descriptors to monitor. It's a dictionary 
-//                 which conatins pairs of "path = file descriptor'
+// All inotify related variables are shared:
+//   in_fd - inotify descriptor
+//   wd_table, path_table - watched directories found by inotify watch
+//                          descriptor and by path
 - (id)initWithConnection:(NSConnection *)conn
 {
   self = [super init];
 
-  // Initialize OS-specific part
-  _pathFDList = [[NSMutableDictionary alloc] init];
-
   // inotify
   if (in_fd < 0)
     {
-      // Creates a new kernel event queue and returns a descriptor.
-      if ((in_fd = inotify_init()) < 0)
+      // Descriptor is read when run loop reports it's ready, so reading
+      // must never block.
+      if ((in_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
 	{
 	  NSLog(@"OSEFileSystemMonitorThread(Linux): Could not open inotify(7)"
                 " descriptor. Error: %s.\n", strerror(errno));
@@ -68,13 +399,11 @@ NSLock              *monitorLock = nil;
   monitorOwner = (OSEFileSystemMonitor *)[conn rootProxy];
 
   threadDict = [[NSThread currentThread] threadDictionary];
-  [threadDict setValue:[NSNumber numberWithBool:NO] 
+  [threadDict setValue:[NSNumber numberWithBool:NO]
 		forKey:@"ThreadShouldExitNow"];
-  [threadDict setValue:[NSNumber numberWithBool:NO] 
+  [threadDict setValue:[NSNumber numberWithBool:NO]
 		forKey:@"ThreadShouldCheckForEvents"];
 
-  monitorLock = [[NSLock alloc] init];
-
   return self;
 }
 
@@ -82,42 +411,13 @@ NSLock              *monitorLock = nil;
 {
   NSDebugLLog(@"OSEFileSystemMonitor", @"OSEFileSystemMonitorThread(Linux): dealloc");
 
-  [monitorLock release];
-  
   [super dealloc];
 }
 
-// _pathFDList:
-// {
-//   "/Users/me/Temporary"= {
-//     Descriptor = 28;
-//     LinkCount = 2;
-//   }
-// }
-- (NSString *)_pathForDescriptor:(int)wd
-{
-  NSNumber *aDescriptor = [NSNumber numberWithInt:wd];
-  NSArray  *pathList = [_pathFDList allKeys];
-
-  for (NSString *path in pathList)
-    {
-      NSDictionary *element = [_pathFDList objectForKey:path];
-      if ([[element objectForKey:@"Descriptor"] isEqualToValue:aDescriptor])
-        return path;
-    }
-
-  return nil;
-}
-
 - (void)_addPath:(NSString *)absolutePath
 {
-  NSString     *pathString;
-  char         *path;
-  int          path_fd = -1;
-  int          i, count, link_count;
-  NSNumber     *pathFD;
-
-  NSDictionary *pathDict;
+  fsm_watch_t *watch;
+  int         error;
 
   // Sanity checks
   if (in_fd < 0)
@@ -133,41 +433,18 @@ NSLock              *monitorLock = nil;
       return;
     }
 
-  // Main code
-  pathString = [NSString stringWithString:absolutePath];
-
-  if ((pathDict = [_pathFDList objectForKey:pathString]) == nil)
-    {
-      link_count = 0;
-      //IN_CREATE|IN_DELETE|IN_DELETE_SELF|IN_MODIFY|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB);
-      path_fd = inotify_add_watch(in_fd, [pathString cString],
-                                  IN_CREATE|IN_DELETE|IN_DELETE_SELF|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB);
-    }
-  else
-    {
-      link_count = [[pathDict objectForKey:@"LinkCount"] intValue];
-      path_fd = [[pathDict objectForKey:@"Descriptor"] intValue];
-    }
-
-  // Increment LinkCount
-  link_count++;
-  pathDict = [NSDictionary
-               dictionaryWithObjectsAndKeys:
-                    [NSNumber numberWithInt:path_fd], @"Descriptor",
-                    [NSNumber numberWithInt:link_count], @"LinkCount", nil];
-
-  [_pathFDList setObject:pathDict forKey:pathString];
+  watch = fsm_watch_add([absolutePath fileSystemRepresentation], &error);
+  watch->link_count++;
 
   NSDebugLLog(@"OSEFileSystemMonitor",
-              @"OSEFileSystemMonitorThread(Linux): addEventMonitorPath: %@ -- %@", 
-              pathString, _pathFDList);
+              @"OSEFileSystemMonitorThread(Linux): addEventMonitorPath: %@ -- "
+              "descriptor: %i (%s), links: %i (%lu watches)",
+              absolutePath, watch->wd, strerror(error), watch->link_count, watch_count);
 }
 
 - (void)_removePath:(NSString *)absolutePath
 {
-  NSDictionary *pathDict;
-  unsigned int path_fd;
-  int          i, count = [_pathFDList count], link_count;
+  fsm_watch_t *watch;
 
   // Validate conditions
   if (in_fd < 0)
@@ -182,32 +459,49 @@ NSLock              *monitorLock = nil;
       return;
     }
 
-  // Get path descriptor
-  if ((pathDict = [_pathFDList objectForKey:absolutePath]) == nil)
+  watch = fsm_watch_for_path([absolutePath fileSystemRepresentation]);
+  if (watch == NULL || watch->link_count == 0)
     {
       NSLog(@"OSEFileSystemMonitorThread(Linux): ERROR no info for monitor at path %@ found!", absolutePath);
       return;
     }
-  path_fd = [[pathDict objectForKey:@"Descriptor"] intValue];
 
-  // Decrement LinkCount
-  link_count = [[pathDict objectForKey:@"LinkCount"] intValue];
-  if (link_count == 1)
+  // Last link: deliver pending events of path before watch will be removed
+  if (watch->link_count == 1 && watch->tree_count == 0)
     {
-      // Last link: remove path from dictionary and watch list
-      inotify_rm_watch(in_fd, path_fd);
       [self checkForEvents];
-      [_pathFDList removeObjectForKey:absolutePath];
+      if ((watch = fsm_watch_for_path([absolutePath fileSystemRepresentation])) == NULL)
+        return;
     }
-  else
+  watch->link_count--;
+  fsm_watch_release(watch);
+}
+
+- (oneway void)_addTree:(NSString *)absolutePath
+{
+  if (in_fd < 0 || absolutePath == nil || [absolutePath isEqualToString:@""])
     {
-      link_count--;
-      pathDict = [NSDictionary
-                   dictionaryWithObjectsAndKeys:
-                        [NSNumber numberWithInt:path_fd], @"Descriptor",
-                        [NSNumber numberWithInt:link_count], @"LinkCount", nil];
-      [_pathFDList setObject:pathDict forKey:absolutePath];
+      NSLog(@"OSEFileSystemMonitorThread(Linux): ERROR trying to add tree %@!", absolutePath);
+      return;
     }
+
+  fsm_tree_add([absolutePath fileSystemRepresentation], 1);
+
+  NSDebugLLog(@"OSEFileSystemMonitor",
+              @"OSEFileSystemMonitorThread(Linux): addTree: %@ (%lu watches)",
+              absolutePath, watch_count);
+}
+
+- (oneway void)_removeTree:(NSString *)absolutePath
+{
+  if (in_fd < 0 || absolutePath == nil || [absolutePath isEqualToString:@""])
+    {
+      NSLog(@"OSEFileSystemMonitorThread(Linux): ERROR trying to remove tree %@!", absolutePath);
+      return;
+    }
+
+  [self checkForEvents];
+  fsm_tree_remove([absolutePath fileSystemRepresentation], 1);
 }
 
 - (oneway void)_startThread
@@ -223,10 +517,19 @@ NSLock              *monitorLock = nil;
                   "ThreadShouldExitNow");
       return;
     }
-  
-  // Start checking for events
-  [threadDict setValue:[NSNumber numberWithBool:YES] 
+
+  // Start checking for events: thread run loop waits for inotify descriptor
+  // along with its ports.
+  [threadDict setValue:[NSNumber numberWithBool:YES]
 		forKey:@"ThreadShouldCheckForEvents"];
+  if (in_fd >= 0 && isWatchingDescriptor == NO)
+    {
+      [[NSRunLoop currentRunLoop] addEvent:(void *)(intptr_t)in_fd
+                                      type:ET_RDESC
+                                   watcher:self
+                                   forMode:NSDefaultRunLoopMode];
+      isWatchingDescriptor = YES;
+    }
 }
 
 - (oneway void)_stopThread
@@ -235,196 +538,294 @@ NSLock              *monitorLock = nil;
               @"OSEFileSystemMonitorThread(Linux): stopEventMonitorThread: "
               "inotify descriptor %i", in_fd);
 
-  // Stop checking for events
-  [threadDict setValue:[NSNumber numberWithBool:NO] 
+  // Stop checking for events. Kernel keeps them queued until start.
+  [threadDict setValue:[NSNumber numberWithBool:NO]
 		forKey:@"ThreadShouldCheckForEvents"];
+  if (isWatchingDescriptor)
+    {
+      [[NSRunLoop currentRunLoop] removeEvent:(void *)(intptr_t)in_fd
+                                         type:ET_RDESC
+                                      forMode:NSDefaultRunLoopMode
+                                          all:YES];
+      isWatchingDescriptor = NO;
+    }
 }
 
 - (oneway void)_terminateThread
 {
-  NSEnumerator *e;
-  NSString     *pathString;
+  size_t i;
 
   [self _stopThread];
 
-  //Close all opened descriptors
-  e = [[_pathFDList allKeys] objectEnumerator];
-  while ((pathString = [e nextObject]) != nil)
+  // Remove all watches
+  for (i = 0; i < table_size; i++)
     {
-      [self _removePath:pathString];
+      fsm_watch_t *watch = path_table[i], *next;
+
+      for (; watch; watch = next)
+        {
+          next = watch->next_path;
+          watch->link_count = 0;
+          watch->tree_count = 0;
+          fsm_watch_release(watch);
+        }
     }
+  free(wd_table);
+  free(path_table);
+  wd_table = path_table = NULL;
+  table_size = 0;
 
-  // Close kernel queue descriptor
+  // Close inotify descriptor
   close(in_fd);
   in_fd = -1;
 
-  [_pathFDList release];
- 
   // Instruct thread to exit
   [threadDict setValue:[NSNumber numberWithBool:YES]
 		forKey:@"ThreadShouldExitNow"];
 }
 
-// #define EVENT_SIZE  ( sizeof (struct inotify_event) )
-// #define BUF_LEN     ( 1024 * ( EVENT_SIZE + 16 ) )
+// RunLoopEvents protocol method
+- (void)receivedEvent:(void *)data
+                 type:(RunLoopEventType)type
+                extra:(void *)extra
+              forMode:(NSString *)mode
+{
+  if (type == ET_RDESC && (intptr_t)data == in_fd)
+    {
+      [self checkForEvents];
+    }
+}
 
+// Reads one batch of events. Events are grouped by directory and sent to
+// monitor owner at once:
+// (
+//   {
+//     Operations = (Rename);
+//     ChangedPath = "/Users/me";
+//     ChangedFile = "111.txt";
+//     ChangedFileTo = "222.txt"; // only for rename
+//   },
+//   ...
+// )
+// MOVED_FROM and MOVED_TO with the same cookie in one directory make Rename.
+// Repeated attributes changes of the same file are reported once. Overflow
+// of kernel queue is reported as { Operations = (Overflow); } at the end.
 - (void)checkForEvents
 {
-  int           ret, i;
-  struct pollfd pfd = { in_fd, POLLIN, 0 };
+  static char         buffer[FSM_BUFFER_SIZE]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  static fsm_event_t  events[FSM_MAX_EVENTS];
+  static fsm_change_t changes[FSM_MAX_EVENTS];
+  static unsigned     batch = 0;
+  static NSArray      *opsCreate, *opsDelete, *opsWrite, *opsAttributes;
+  static NSArray      *opsMovedFrom, *opsRename, *opsOverflow;
+  NSFileManager       *fm;
+  NSMutableArray      *eventList;
+  ssize_t             length;
+  size_t              i, count = 0, changesCount = 0, start, end;
+  unsigned            groups = 0;
+  BOOL                isOverflow = NO;
 
-  // NSLog(@"OSEFileSystemMonitorThread [checkForFSEvents]: checking for events...");
-
-  // Sanity check
-  if (!_pathFDList || [[_pathFDList allKeys] count] <= 0)
+  if (in_fd < 0)
     return;
 
-  // Determine if inotify(7) file descriptor has events to read
-  ret = poll(&pfd, 1, 10); // timeout of 50ms
-  if (ret < 0)
+  // Descriptor is always drained: run loop watches it while anything is
+  // queued, e.g. IN_IGNORED of the last removed watch.
+  length = read(in_fd, buffer, sizeof(buffer));
+  if (length <= 0)
     {
-      fprintf(stderr, "poll failed: %s\n", strerror(errno));
+      if (length < 0 && errno != EAGAIN && errno != EINTR)
+        {
+          fprintf(stderr, "An error occurred reading inotify events. "
+                  "The error was %i: %s.\n", errno, strerror(errno));
+        }
+      return;
     }
-  else if (ret > 0)
+  if (watch_count == 0)
+    return;
+
+  batch++;
+  for (i = 0; i < (size_t)length;)
     {
-      int          event_count, i;
-      unsigned int data_size;
-      // Find size of available data
-      ioctl(in_fd, FIONREAD, &data_size);
-      // Define buffer based on found size of available data
-      char buffer[data_size];
-
-      event_count = read(in_fd, buffer, data_size);
-      
-      if (event_count < 0)
+      struct inotify_event *event = (struct inotify_event *)&buffer[i];
+      fsm_watch_t          *watch = fsm_watch_for_descriptor(event->wd);
+      fsm_event_t          *e = &events[count];
+
+      i += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW)
         {
-          // An error occurred.
-          fprintf(stderr, "An error occurred (event count %d).  " \
-                  "The error was %i: %s.\n", 
-                  event_count, errno, strerror(errno));
-          return;
+          NSLog(@"OSEFileSystemMonitorThread(Linux): inotify event queue overflow.");
+          isOverflow = YES;
+          continue;
         }
-
-      // eventList
-      // 3 =
-      // {
-      //   Operations = (Rename);
-      //   ChangedPath = "/Users/me";
-      //   ChangedFile = "111.txt";
-      //   ChangedPathTo = "222.txt"; // only for rename
-      // };
-      NSMutableDictionary *eventList = [[NSMutableDictionary alloc] init];
-      NSMutableDictionary *eventInfo = nil;
-      i = 0;
-      while (i < event_count)
+      if (watch == NULL)
+        continue;
+      if (event->mask & IN_IGNORED)
         {
-          struct inotify_event *event = (struct inotify_event *)&buffer[i];
-          NSString *path = [self _pathForDescriptor:event->wd];
-          NSString *file = [NSString stringWithCString:event->name];
-          NSString *watchDescriptor = [NSString stringWithFormat:@"%i", event->wd];
-          NSArray  *operations = nil, *exOps = nil;
-
-          if ((eventInfo = [eventList objectForKey:watchDescriptor]) != nil)
-            {
-              exOps = [eventInfo objectForKey:@"Operations"];
-            }
+          changes[changesCount].type = FSM_WATCH_LOST;
+          changes[changesCount].wd = event->wd;
+          changes[changesCount++].path = NULL;
+          continue;
+        }
+      if (event->len == 0 || event->name[0] == '\0')
+        continue;
+
+      if (event->mask & IN_CREATE)
+        e->kind = FSM_CREATE;
+      else if (event->mask & (IN_DELETE | IN_DELETE_SELF))
+        e->kind = FSM_DELETE;
+      else if (event->mask & IN_MODIFY)
+        // During file downloading generates event every 10-20ms.
+        // Currently it's switched off in fsm_watch_add().
+        e->kind = FSM_MODIFY;
+      else if (event->mask & IN_ATTRIB)
+        e->kind = FSM_ATTRIB;
+      else if (event->mask & IN_MOVED_FROM)
+        e->kind = FSM_MOVED_FROM;
+      else if (event->mask & IN_MOVED_TO)
+        e->kind = FSM_MOVED_TO;
+      else
+        continue;
+
+      if (watch->batch != batch)
+        {
+          watch->batch = batch;
+          watch->group = groups++;
+        }
+      e->watch = watch;
+      e->index = count++;
+      e->isConsumed = NO;
+      e->cookie = event->cookie;
+      e->name = event->name;
+
+      // Directories of watched tree are watched as they appear and unwatched
+      // as they go away. Watch list is changed after events are sent because
+      // events above refer to watches.
+      if ((event->mask & IN_ISDIR) && watch->tree_count > 0)
+        {
+          if (e->kind == FSM_CREATE || e->kind == FSM_MOVED_TO)
+            changes[changesCount].type = FSM_TREE_ADD;
+          else if (e->kind == FSM_MOVED_FROM)
+            changes[changesCount].type = FSM_TREE_REMOVE;
           else
-            {
-              eventInfo = [NSMutableDictionary new];
-            }
-          
-          if (event->len)
-            {
-              if (event->mask & IN_CREATE)
-                {
-                  operations = [NSArray arrayWithObjects:@"Write", @"Create", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
+            continue;
+          changes[changesCount].count = watch->tree_count;
+          changes[changesCount++].path = fsm_path_append(watch->path, event->name);
+        }
+    }
 
-                  // fprintf(stderr, ">>> The %s was created.\n", event->name);
-                }
-              else if ((event->mask & IN_DELETE) || (event->mask & IN_DELETE_SELF))
-                {
-                  operations = [NSArray arrayWithObjects:@"Write", @"Delete", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
+  if (opsCreate == nil)
+    {
+      opsCreate = [[NSArray alloc] initWithObjects:@"Write", @"Create", nil];
+      opsDelete = [[NSArray alloc] initWithObjects:@"Write", @"Delete", nil];
+      opsWrite = [[NSArray alloc] initWithObjects:@"Write", nil];
+      opsAttributes = [[NSArray alloc] initWithObjects:@"Attributes", nil];
+      opsMovedFrom = [[NSArray alloc] initWithObjects:@"Write", @"MovedFrom", nil];
+      opsRename = [[NSArray alloc] initWithObjects:@"Rename", nil];
+      opsOverflow = [[NSArray alloc] initWithObjects:@"Overflow", nil];
+    }
 
-                  // fprintf(stderr, ">>> The %s was deleted.\n", event->name);
-                }
-              else if (event->mask & IN_MODIFY)
-                {
-                  // During file downloading generates event every 10-20ms.
-                  // Currently it's switched off in _addPath:.
-                  operations = [NSArray arrayWithObjects:@"Write", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
+  qsort(events, count, sizeof(fsm_event_t), fsm_event_compare);
 
-                  // fprintf(stderr, ">>> The %s was modified.\n", event->name);
-                }
-              else if (event->mask & IN_ATTRIB)
-                {
-                  operations = [NSArray arrayWithObjects:@"Attributes", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
+  fm = [NSFileManager defaultManager];
+  eventList = [[NSMutableArray alloc] init];
+  for (start = 0; start < count; start = end)
+    {
+      fsm_watch_t *watch = events[start].watch;
 
-                  // fprintf(stderr, ">>> The %s attributes was modified.\n", event->name);
-                }
-              else if (event->mask & IN_MOVED_FROM)
-                {
-                  operations = [NSArray arrayWithObjects:@"Write", @"MovedFrom", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-                  
-                  // fprintf(stderr, ">>> The %s was moved from.\n", event->name);
-                }
-              else if (event->mask & IN_MOVED_TO)
-                {
-                  NSString *fileTo = nil;
+      for (end = start + 1; end < count && events[end].watch == watch; end++)
+        ;
 
-                  if (exOps &&
-                      ([exOps indexOfObject:@"MovedFrom"] != NSNotFound))
-                    {
-                      fileTo = [NSString stringWithCString:event->name];
-                      
-                      operations = [NSArray arrayWithObjects:@"Rename", nil];
-                      // ChangedPath & ChangedFile was added in IN_MOVED_FROM part
-                      [eventInfo setObject:fileTo forKey:@"ChangedFileTo"];
-                      
-                      // fprintf(stderr, ">>> The %s was renamed to %s.\n",
-                      //         [file cString], event->name);
-                    }
-                  else
-                    {
-                      operations = [NSArray arrayWithObjects:@"Write", @"Create", nil];
-                      [eventInfo setObject:path forKey:@"ChangedPath"];
-                      [eventInfo setObject:file forKey:@"ChangedFile"];
+      for (i = start; i < end; i++)
+        {
+          fsm_event_t *e = &events[i];
+          NSArray     *operations = nil;
+          NSString    *fileTo = nil;
+          size_t      j;
 
-                      // fprintf(stderr, ">>> The %s was moved to.\n", event->name);
-                    }
-                }
-              
-              if (exOps)
+          if (e->isConsumed || fsm_is_duplicate(events, start, i))
+            continue;
+
+          switch (e->kind)
+            {
+            case FSM_CREATE:
+              operations = opsCreate;
+              break;
+            case FSM_DELETE:
+              operations = opsDelete;
+              break;
+            case FSM_MODIFY:
+              operations = opsWrite;
+              break;
+            case FSM_ATTRIB:
+              operations = opsAttributes;
+              break;
+            case FSM_MOVED_FROM:
+              operations = opsMovedFrom;
+              for (j = i + 1; j < end; j++)
                 {
-                  operations = [exOps arrayByAddingObjectsFromArray:operations];
+                  if (events[j].kind == FSM_MOVED_TO && !events[j].isConsumed
+                      && events[j].cookie == e->cookie)
+                    {
+                      events[j].isConsumed = YES;
+                      operations = opsRename;
+                      fileTo = [fm stringWithFileSystemRepresentation:events[j].name
+                                                               length:strlen(events[j].name)];
+                      break;
+                    }
                 }
-              [eventInfo setObject:operations forKey:@"Operations"];
-              [eventList setObject:eventInfo forKey:watchDescriptor];
+              break;
+            case FSM_MOVED_TO:
+              // Moved from unwatched place
+              operations = opsCreate;
+              break;
             }
 
-          i += sizeof(struct inotify_event) + event->len;
+          [eventList addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                  operations, @"Operations",
+                                  watch->pathString, @"ChangedPath",
+                                  [fm stringWithFileSystemRepresentation:e->name
+                                                                  length:strlen(e->name)],
+                                  @"ChangedFile",
+                                  fileTo, @"ChangedFileTo", nil]];
         }
+    }
 
-      // Now we have an eventList dictionary which contains information about
-      // all read file system events
-      if (eventList && [[eventList allKeys] count] > 0)
+  // Events were lost: receivers must rescan what they watch
+  if (isOverflow)
+    {
+      [eventList addObject:[NSDictionary dictionaryWithObject:opsOverflow
+                                                       forKey:@"Operations"]];
+    }
+
+  if ([eventList count] > 0)
+    {
+      NSDebugLLog(@"OSEFileSystemMonitor",
+                  @"[NXFSM_Linux] send eventList: %@", eventList);
+      [monitorOwner handleEvents:eventList];
+    }
+  [eventList release];
+
+  for (i = 0; i < changesCount; i++)
+    {
+      fsm_change_t *change = &changes[i];
+      fsm_watch_t  *watch;
+
+      switch (change->type)
         {
-          NSDebugLLog(@"OSEFileSystemMonitor",
-                      @"[NXFSM_Linux] send eventList: %@", eventList);
-          for (NSString *wd in [eventList allKeys])
-            {
-              [monitorOwner handleEvent:[eventList objectForKey:wd]];
-            }
+        case FSM_TREE_ADD:
+          fsm_tree_add(change->path, change->count);
+          break;
+        case FSM_TREE_REMOVE:
+          fsm_tree_remove(change->path, change->count);
+          break;
+        case FSM_WATCH_LOST:
+          if ((watch = fsm_watch_for_descriptor(change->wd)) != NULL)
+            fsm_watch_lost(watch);
+          break;
         }
+      free(change->path);
     }
 }
 
@@ -45,6 +45,10 @@ extern NSString *NXTShowHiddenFiles;
 
 @interface OSEFileManager : NSFileManager
 {
+  // libmagic results cache
+  NSLock *fileTypeLock;
+  NSMutableDictionary *fileTypeCache;  // (device, inode) -> entry
+  NSMutableDictionary *fileTypeKeys;   // path -> (device, inode)
 }
 
 + (OSEFileManager *)defaultManager;
@@ -70,9 +74,13 @@ extern NSString *NXTShowHiddenFiles;
 - (NSString *)absolutePathForCommand:(NSString *)command;
 - (BOOL)directoryExistsAtPath:(NSString *)path;
 
-// libmagic
+// libmagic. Methods are thread safe. Results are cached until file is
+// changed (modification time or size) or OSEFileSystemMonitor reports a change.
 - (NSString *)mimeTypeForFile:(NSString *)fullPath;
 - (NSString *)mimeEncodingForFile:(NSString *)fullPath;
 - (NSString *)descriptionForFile:(NSString *)fullPath;
+// Returns dictionary of path -> MIME type. Files that can't be
+// classified are omitted.
+- (NSDictionary *)mimeTypesForFiles:(NSArray *)fullPaths;
 
 @end
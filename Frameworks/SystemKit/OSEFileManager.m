@@ -23,15 +23,19 @@
 //
 
 #include <magic.h> // libmagic
+#include <sys/stat.h>
 
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSUserDefaults.h>
 #import <Foundation/NSFileManager.h>
 #import <Foundation/NSArray.h>
 #import <Foundation/NSDebug.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSNotification.h>
 
 #import "OSEDefaults.h"
 #import "OSEFileManager.h"
+#import "OSEFileSystemMonitor.h"
 
 NSString *NXTSortFilesBy = @"SortFilesBy";
 NSString *NXTShowHiddenFiles = @"ShowHiddenFiles";
@@ -133,8 +137,105 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
 
 @end
 
+// --- libmagic handles
+
+// Loading of magic database takes tens of milliseconds, so loaded handles are
+// kept for reuse. Handle can't be used by several threads at once: each
+// thread takes its own from the pool.
+#define MAGIC_POOL_SIZE 4
+// Cached results limit. Cache is emptied when it's reached.
+#define FILE_TYPE_CACHE_SIZE 8192
+
+static magic_t magicPool[MAGIC_POOL_SIZE];
+static int magicPoolCount = 0;
+static NSLock *magicPoolLock = nil;
+
+static magic_t MagicAcquire(int flags)
+{
+  magic_t cookie = NULL;
+
+  [magicPoolLock lock];
+  if (magicPoolCount > 0) {
+    cookie = magicPool[--magicPoolCount];
+  }
+  [magicPoolLock unlock];
+
+  if (cookie == NULL) {
+    cookie = magic_open(flags);
+    if (cookie && magic_load(cookie, NULL) != 0) {
+      NSDebugLLog(@"OSEFileManager", @"libmagic: %s", magic_error(cookie));
+      magic_close(cookie);
+      cookie = NULL;
+    }
+  } else {
+    magic_setflags(cookie, flags);
+  }
+
+  return cookie;
+}
+
+static void MagicRelease(magic_t cookie)
+{
+  if (cookie == NULL) {
+    return;
+  }
+  [magicPoolLock lock];
+  if (magicPoolCount < MAGIC_POOL_SIZE) {
+    magicPool[magicPoolCount++] = cookie;
+    cookie = NULL;
+  }
+  [magicPoolLock unlock];
+
+  if (cookie) {
+    magic_close(cookie);
+  }
+}
+
+static NSString *MagicFile(magic_t cookie, int flags, NSString *fullPath)
+{
+  const char *result;
+
+  if (cookie == NULL) {
+    return nil;
+  }
+  magic_setflags(cookie, flags);
+  result = magic_file(cookie, [fullPath fileSystemRepresentation]);
+
+  return (result != NULL) ? [NSString stringWithCString:result] : nil;
+}
+
+typedef enum { OSEFileMIMEType = 0, OSEFileMIMEEncoding = 1, OSEFileDescription = 2 } OSEFileTypeKind;
+
+// Cached libmagic results of one file
+@interface OSEFileTypeEntry : NSObject
+{
+@public
+  struct timespec mtime;
+  off_t size;
+  NSString *results[3];  // indexed by OSEFileTypeKind
+}
+@end
+@implementation OSEFileTypeEntry
+- (void)dealloc
+{
+  for (int i = 0; i < 3; i++) {
+    [results[i] release];
+  }
+  [super dealloc];
+}
+@end
+
+static int magicFlags[3] = {MAGIC_MIME_TYPE, MAGIC_MIME_ENCODING, MAGIC_NONE};
+
 @implementation OSEFileManager
 
++ (void)initialize
+{
+  if (magicPoolLock == nil) {
+    magicPoolLock = [NSLock new];
+  }
+}
+
 + (OSEFileManager *)defaultManager
 {
   if (sharedManager == nil) {
@@ -147,11 +248,24 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
 {
   self = [super init];
 
+  fileTypeLock = [NSLock new];
+  fileTypeCache = [NSMutableDictionary new];
+  fileTypeKeys = [NSMutableDictionary new];
+
+  [[NSNotificationCenter defaultCenter] addObserver:self
+                                           selector:@selector(_fileSystemChanged:)
+                                               name:OSEFileSystemChangedAtPath
+                                             object:nil];
+
   return self;
 }
 
 - (void)dealloc
 {
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [fileTypeCache release];
+  [fileTypeKeys release];
+  [fileTypeLock release];
   [super dealloc];
 }
 
@@ -446,58 +560,156 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
 
 
 // --- Files (libmagic)
-- (NSString *)mimeTypeForFile:(NSString *)fullPath
-{
-  magic_t    cookie;
-  const char *mime_type;
-  NSString   *mimeType;
-  
-  cookie = magic_open(MAGIC_MIME_TYPE);
-  magic_load(cookie, NULL);
-
-  mime_type = magic_file(cookie, [fullPath cString]);
-  
-  mimeType = [NSString stringWithCString:mime_type];
 
-  magic_close(cookie);
+// Results of changed files are removed. Files without change events are
+// checked against modification time and size on every lookup.
+- (void)_fileSystemChanged:(NSNotification *)notif
+{
+  NSDictionary *event = [notif userInfo];
+  NSString *dir = [event objectForKey:@"ChangedPath"];
+  NSString *file = [event objectForKey:@"ChangedFile"];
+  NSString *fileTo = [event objectForKey:@"ChangedFileTo"];
+  NSMutableArray *paths = [NSMutableArray array];
+
+  if ([[event objectForKey:@"Operations"] containsObject:@"Overflow"]) {
+    [fileTypeLock lock];
+    [fileTypeCache removeAllObjects];
+    [fileTypeKeys removeAllObjects];
+    [fileTypeLock unlock];
+    return;
+  }
+  if (dir == nil) {
+    return;
+  }
 
-  return mimeType;
+  [fileTypeLock lock];
+  if (file == nil) {
+    // Directory itself changed: forget everything inside
+    NSString *prefix = [dir hasSuffix:@"/"] ? dir : [dir stringByAppendingString:@"/"];
+    for (NSString *path in [fileTypeKeys allKeys]) {
+      if ([path hasPrefix:prefix]) {
+        [paths addObject:path];
+      }
+    }
+  } else {
+    [paths addObject:[dir stringByAppendingPathComponent:file]];
+    if (fileTo) {
+      [paths addObject:[dir stringByAppendingPathComponent:fileTo]];
+    }
+  }
+  for (NSString *path in paths) {
+    id key = [fileTypeKeys objectForKey:path];
+    if (key) {
+      [fileTypeCache removeObjectForKey:key];
+      [fileTypeKeys removeObjectForKey:path];
+    }
+  }
+  [fileTypeLock unlock];
 }
 
-- (NSString *)mimeEncodingForFile:(NSString *)fullPath
+// Returns cached result for `kind` or classifies file with `cookie` (taken
+// from the pool if NULL) and caches result.
+- (NSString *)_fileType:(OSEFileTypeKind)kind
+                forFile:(NSString *)fullPath
+                 cookie:(magic_t)cookie
 {
-  magic_t    cookie;
-  const char *mime_enc;
-  NSString   *mimeEncoding;
-  
-  cookie = magic_open(MAGIC_MIME_ENCODING);
-  magic_load(cookie, NULL);
+  struct stat st;
+  struct {
+    dev_t dev;
+    ino_t ino;
+  } inode;
+  NSData *key;
+  OSEFileTypeEntry *entry;
+  NSString *result;
+  BOOL ownCookie = NO;
+
+  if (fullPath == nil || stat([fullPath fileSystemRepresentation], &st) != 0) {
+    // Let libmagic describe the problem
+    cookie = MagicAcquire(magicFlags[kind]);
+    result = MagicFile(cookie, magicFlags[kind], fullPath);
+    MagicRelease(cookie);
+    return result;
+  }
 
-  mime_enc = magic_file(cookie, [fullPath cString]);
-  
-  mimeEncoding = [NSString stringWithCString:mime_enc];
+  memset(&inode, 0, sizeof(inode));
+  inode.dev = st.st_dev;
+  inode.ino = st.st_ino;
+  key = [NSData dataWithBytes:&inode length:sizeof(inode)];
+
+  [fileTypeLock lock];
+  entry = [fileTypeCache objectForKey:key];
+  if (entry && entry->size == st.st_size && entry->mtime.tv_sec == st.st_mtim.tv_sec &&
+      entry->mtime.tv_nsec == st.st_mtim.tv_nsec && entry->results[kind] != nil) {
+    result = [[entry->results[kind] retain] autorelease];
+    [fileTypeLock unlock];
+    return result;
+  }
+  [fileTypeLock unlock];
+
+  if (cookie == NULL) {
+    cookie = MagicAcquire(magicFlags[kind]);
+    ownCookie = YES;
+  }
+  result = MagicFile(cookie, magicFlags[kind], fullPath);
+  if (ownCookie) {
+    MagicRelease(cookie);
+  }
+  if (result == nil) {
+    return nil;
+  }
 
-  magic_close(cookie);
+  [fileTypeLock lock];
+  entry = [fileTypeCache objectForKey:key];
+  if (entry == nil || entry->size != st.st_size || entry->mtime.tv_sec != st.st_mtim.tv_sec ||
+      entry->mtime.tv_nsec != st.st_mtim.tv_nsec) {
+    if ([fileTypeCache count] >= FILE_TYPE_CACHE_SIZE) {
+      [fileTypeCache removeAllObjects];
+      [fileTypeKeys removeAllObjects];
+    }
+    entry = [OSEFileTypeEntry new];
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    [fileTypeCache setObject:entry forKey:key];
+    [entry release];
+  }
+  ASSIGN(entry->results[kind], result);
+  [fileTypeKeys setObject:key forKey:fullPath];
+  [fileTypeLock unlock];
 
-  return mimeEncoding;
+  return result;
+}
+
+- (NSString *)mimeTypeForFile:(NSString *)fullPath
+{
+  return [self _fileType:OSEFileMIMEType forFile:fullPath cookie:NULL];
+}
+
+- (NSString *)mimeEncodingForFile:(NSString *)fullPath
+{
+  return [self _fileType:OSEFileMIMEEncoding forFile:fullPath cookie:NULL];
 }
 
 - (NSString *)descriptionForFile:(NSString *)fullPath
 {
-  magic_t    cookie;
-  const char *description;
-  NSString   *fileDescription;
-  
-  cookie = magic_open(MAGIC_NONE);
-  magic_load(cookie, NULL);
+  return [self _fileType:OSEFileDescription forFile:fullPath cookie:NULL];
+}
 
-  description = magic_file(cookie, [fullPath cString]);
-  
-  fileDescription = [NSString stringWithCString:description];
-  
-  magic_close(cookie);
+- (NSDictionary *)mimeTypesForFiles:(NSArray *)fullPaths
+{
+  NSMutableDictionary *types = [NSMutableDictionary dictionaryWithCapacity:[fullPaths count]];
+  magic_t cookie = MagicAcquire(MAGIC_MIME_TYPE);
+  NSString *type;
+
+  // One handle for the whole batch
+  for (NSString *path in fullPaths) {
+    type = [self _fileType:OSEFileMIMEType forFile:path cookie:cookie];
+    if (type != nil) {
+      [types setObject:type forKey:path];
+    }
+  }
+  MagicRelease(cookie);
 
-  return fileDescription;
+  return types;
 }
 
 @end
@@ -41,7 +41,16 @@
 
 #import <Foundation/Foundation.h>
 
+// Posted for every change. userInfo holds "Operations", "ChangedPath",
+// "ChangedFile" and "ChangedFileTo" (for rename). "Operations" = ("Overflow")
+// without other keys means that kernel dropped events: any watched path may
+// have changed.
 extern NSString *OSEFileSystemChangedAtPath;
+// Posted once for every batch of changes read from kernel before
+// OSEFileSystemChangedAtPath notifications of the batch. userInfo holds
+// "Events" - array of dictionaries like OSEFileSystemChangedAtPath userInfo
+// grouped by "ChangedPath".
+extern NSString *OSEFileSystemChangedAtPaths;
 
 @class OSEFileSystemMonitorThread;
 
@@ -69,6 +78,11 @@ extern NSString *OSEFileSystemChangedAtPath;
 // returns file descriptor
 - (void)addPath:(NSString *)absolutePath;
 - (void)removePath:(NSString *)absolutePath;
+// Recursive mode watches all directories under `absolutePath` including ones
+// created later. Must be balanced with removePath:recursive:YES. Tree is
+// walked on monitor thread: method returns without waiting for it.
+- (void)addPath:(NSString *)absolutePath recursive:(BOOL)isRecursive;
+- (void)removePath:(NSString *)absolutePath recursive:(BOOL)isRecursive;
 
 // --- Monitor managing
 - (void)start;
@@ -77,6 +91,7 @@ extern NSString *OSEFileSystemChangedAtPath;
 - (void)resume;
 - (void)terminate;
 - (void)handleEvent:(NSDictionary *)event;
+- (oneway void)handleEvents:(bycopy NSArray *)events;
 
 @end
 
@@ -93,6 +108,8 @@ extern NSString *OSEFileSystemChangedAtPath;
 - (id)initWithConnection:(NSConnection *)conn;
 - (void)_addPath:(NSString *)absolutePath;
 - (void)_removePath:(NSString *)absolutePath;
+- (oneway void)_addTree:(NSString *)absolutePath;
+- (oneway void)_removeTree:(NSString *)absolutePath;
 
 - (oneway void)_startThread;
 - (oneway void)_stopThread;
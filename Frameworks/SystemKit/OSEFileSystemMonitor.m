@@ -26,6 +26,7 @@ static OSEFileSystemMonitor *_fileSystemMonitor = nil;
 static NSConnection        *mainConnection;
 
 NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
+NSString *OSEFileSystemChangedAtPaths = @"OSEFileSystemChangedAtPaths";
 
 @implementation OSEFileSystemMonitor
 
@@ -102,6 +103,18 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
 
 // Adds all components of 'absolutePath' to event monitor starting from '/'
 - (void)addPath:(NSString *)absolutePath
+{
+  [self addPath:absolutePath recursive:NO];
+}
+
+- (void)removePath:(NSString *)absolutePath
+{
+  [self removePath:absolutePath recursive:NO];
+}
+
+// Recursive mode adds all components of 'absolutePath' but the last one and
+// the whole tree of the last one.
+- (void)addPath:(NSString *)absolutePath recursive:(BOOL)isRecursive
 {
   NSArray    *pathComponents = [absolutePath pathComponents];
   NSUInteger count = [pathComponents count];
@@ -119,14 +132,17 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
                stringByAppendingPathComponent:[pathComponents objectAtIndex:i]];
       if ([[NSFileManager defaultManager] isReadableFileAtPath:path])
         {
-          [monitorThread _addPath:path];
+          if (isRecursive && i == count - 1)
+            [monitorThread _addTree:path];
+          else
+            [monitorThread _addPath:path];
         }
     }
   
   [self resume];
 }
 
-- (void)removePath:(NSString *)absolutePath
+- (void)removePath:(NSString *)absolutePath recursive:(BOOL)isRecursive
 {
   NSArray    *pathComponents = [absolutePath pathComponents];
   NSUInteger count = [pathComponents count];
@@ -142,7 +158,10 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
     {
       path = [path
                stringByAppendingPathComponent:[pathComponents objectAtIndex:i]];
-      [monitorThread _removePath:path];
+      if (isRecursive && i == count - 1)
+        [monitorThread _removeTree:path];
+      else
+        [monitorThread _removePath:path];
     }
   
   NSDebugLLog(@"OSEFileSystemMonitor",
@@ -257,6 +276,27 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
                     userInfo:event];
 }
 
+// Called from monitor thread with all events read at once. Monitor thread
+// doesn't wait for events to be handled.
+- (oneway void)handleEvents:(bycopy NSArray *)events
+{
+  NSDebugLLog(@"OSEFileSystemMonitor", @"OSEFileSystemMonitor: %lu FS events occured",
+              [events count]);
+
+  if (monitorThreadPaused != NO || monitorThreadStopped != NO || monitorThreadTerminated != NO) {
+    return;
+  }
+
+  [[NSNotificationCenter defaultCenter]
+        postNotificationName:OSEFileSystemChangedAtPaths
+                      object:self
+                    userInfo:[NSDictionary dictionaryWithObject:events forKey:@"Events"]];
+
+  for (NSDictionary *event in events) {
+    [self handleEvent:event];
+  }
+}
+
 @end
 
 @implementation OSEFileSystemMonitorThread
@@ -290,15 +330,11 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
   threadDict = [[NSThread currentThread] threadDictionary];
   while (!exitNow)
     {
-      // Process AppKit and Foundation events
+      // Process AppKit and Foundation events and kernel events. OS-specific
+      // part adds kernel events descriptor to run loop on _startThread and
+      // calls checkForEvents when it's ready.
       [runLoop runMode:NSDefaultRunLoopMode 
-            beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
-
-      // Process kernel events
-      if ([[threadDict valueForKey:@"ThreadShouldCheckForEvents"] boolValue])
-	{
-          [threadObject checkForEvents];
-	}
+            beforeDate:[NSDate distantFuture]];
 
       // Check to see if an input source handler changed the exitNow value.
       exitNow = [[threadDict valueForKey:@"ThreadShouldExitNow"] boolValue];
@@ -346,6 +382,24 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
   // OS specific part
 }
 
+- (oneway void)_addTree:(NSString *)absolutePath
+{
+  NSDebugLLog(@"OSEFileSystemMonitor",
+              @"OSEFileSystemMonitorThread: addTree:%@: "
+              "No OS-specific code found!", absolutePath);
+  // OS specific part
+  [self _addPath:absolutePath];
+}
+
+- (oneway void)_removeTree:(NSString *)absolutePath
+{
+  NSDebugLLog(@"OSEFileSystemMonitor",
+              @"OSEFileSystemMonitorThread: removeTree:%@: "
+              "No OS-specific code found!", absolutePath);
+  // OS specific part
+  [self _removePath:absolutePath];
+}
+
 - (oneway void)_startThread
 {
   // OS specific part
@@ -370,7 +424,7 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
               "No OS-specific code found!");
 }
 
-// Overriden method must call handleEvents:atPath: if events available
+// Overriden method must call handleEvents: if events available
 - (void)checkForEvents
 {
   // OS specific part
@@ -38,6 +38,7 @@
 
 + (void)initializeBackend
 {
+  NSUserDefaults *ud = [NSUserDefaults standardUserDefaults];
   float gamma;
 
   NSDebugLLog(@"back-art", @"Initializing libart/freetype backend");
@@ -45,8 +46,11 @@
   [NSGraphicsContext setDefaultContextClass:[ARTContext class]];
   [FTFontInfo initializeBackend];
 
-  gamma = [[NSUserDefaults standardUserDefaults] floatForKey:@"back-art-text-gamma"];
+  gamma = [ud floatForKey:@"back-art-text-gamma"];
   artcontext_setup_gamma(gamma);
+
+  if ([ud objectForKey:@"back-art-simd"] != nil)
+    artcontext_setup_simd([ud boolForKey:@"back-art-simd"]);
 }
 
 + (Class)GStateClass
@@ -304,6 +304,57 @@ ourself.
 
 /* end of pixel formats */
 
+
+/*
+Vectorized compositing functions for the 32-bit formats, see blit_simd.m.
+They need vector extensions of clang or gcc 12 and later; the scalar
+functions above are used where they are not available, and for the
+other formats.
+*/
+
+/* most pixels processed at a time by any instance */
+#define SIMD_MAX_PIXELS 8
+
+#if (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)) && !defined(BLIT_NO_SIMD)
+#define BLIT_SIMD 1
+
+/* baseline instruction set of the compiler */
+#define SIMD_INSTANCE simd_a3
+#define SIMD_TARGET
+#define SIMD_PIXELS 4
+#define SIMD_ALPHA 3
+#define SIMD_SCALAR rgba
+#include "blit_simd.m"
+
+#define SIMD_INSTANCE simd_a0
+#define SIMD_TARGET
+#define SIMD_PIXELS 4
+#define SIMD_ALPHA 0
+#define SIMD_SCALAR argb
+#include "blit_simd.m"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BLIT_SIMD_AVX2 1
+
+#define SIMD_INSTANCE avx2_a3
+#define SIMD_TARGET __attribute__((target("avx2")))
+#define SIMD_PIXELS 8
+#define SIMD_ALPHA 3
+#define SIMD_SCALAR rgba
+#include "blit_simd.m"
+
+#define SIMD_INSTANCE avx2_a0
+#define SIMD_TARGET __attribute__((target("avx2")))
+#define SIMD_PIXELS 8
+#define SIMD_ALPHA 0
+#define SIMD_SCALAR argb
+#include "blit_simd.m"
+#endif
+
+#endif /* BLIT_SIMD */
+
+static int use_simd = 1;
+
 static draw_info_t draw_infos[DI_NUM] = {
 
 #define C(x) \
@@ -383,6 +434,28 @@ static int byte_ofs_of_mask(unsigned int m) {
     return -1;
 }
 
+/* Replaces compositing functions of 32-bit formats with vectorized ones */
+static void setup_simd(draw_info_t *di)
+{
+#ifdef BLIT_SIMD
+#ifdef BLIT_SIMD_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    NSDebugLLog(@"back-art", @"using AVX2 compositing");
+    if (di->inline_alpha_ofs == 3)
+      avx2_a3_setup(di);
+    else
+      avx2_a0_setup(di);
+    return;
+  }
+#endif
+  NSDebugLLog(@"back-art", @"using vector compositing");
+  if (di->inline_alpha_ofs == 3)
+    simd_a3_setup(di);
+  else
+    simd_a0_setup(di);
+#endif
+}
+
 void artcontext_setup_draw_info(draw_info_t *di, unsigned int red_mask,
                                 unsigned int green_mask, unsigned int blue_mask,
                                 int bpp) {
@@ -426,6 +499,8 @@ void artcontext_setup_draw_info(draw_info_t *di, unsigned int red_mask,
   *di = draw_infos[t];
   if (!di->render_run_alpha)
     *di = draw_infos[DI_FALLBACK];
+  if (di->inline_alpha && use_simd)
+    setup_simd(di);
   if (di->how == DI_FALLBACK) {
     NSLog(@"gnustep-back(art): Unrecognized color masks: %08x:%08x:%08x %i",
           red_mask, green_mask, blue_mask, bpp);
@@ -436,6 +511,12 @@ void artcontext_setup_draw_info(draw_info_t *di, unsigned int red_mask,
   }
 }
 
+void artcontext_setup_simd(int enable)
+{
+  NSDebugLLog(@"back-art", @"simd=%i", enable);
+  use_simd = enable;
+}
+
 void artcontext_setup_gamma(float gamma)
 {
   int i;
@@ -502,3 +583,193 @@ PlusL    dst=src+dst  , clamp to 1.0; dsta=srca+dsta, clamp to 1.0
 PlusD    dst=src+dst-1, clamp to 0.0; dsta=srca+dsta, clamp to 1.0
 
 */
+
+
+#ifdef BLIT_TEST
+/*
+Conformance test and benchmark of the compositing functions of 32-bit
+formats: every vectorized function is run on the same pixels as the
+scalar one and the results are compared, then both are timed. Pixels
+are random with alpha 0 and 255 mixed in, runs of all lengths up to a
+few vectors check the pixels left over. Exits with non-zero status if
+any result differs.
+
+  clang -DBLIT_TEST -O2 `gnustep-config --objc-flags` blit-main.m \
+    `gnustep-config --base-libs` -lm -o blit-test
+  ./blit-test [pixels [iterations]]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+
+#define TEST_OP(name) {#name, offsetof(draw_info_t, name)}
+static const struct {
+  const char *name;
+  size_t offset;
+} test_ops[] = {
+    TEST_OP(composite_sover_aa), TEST_OP(composite_sover_ao),
+    TEST_OP(composite_sin_aa),   TEST_OP(composite_sin_oa),
+    TEST_OP(composite_sout_aa),  TEST_OP(composite_sout_oa),
+    TEST_OP(composite_satop_aa), TEST_OP(composite_dover_aa),
+    TEST_OP(composite_dover_oa), TEST_OP(composite_din_aa),
+    TEST_OP(composite_dout_aa),  TEST_OP(composite_datop_aa),
+    TEST_OP(composite_xor_aa),   TEST_OP(composite_plusl_aa),
+    TEST_OP(composite_plusl_oa), TEST_OP(composite_plusl_ao),
+    TEST_OP(composite_plusl_oo), TEST_OP(composite_plusd_aa),
+    TEST_OP(composite_plusd_oa), TEST_OP(composite_plusd_ao),
+    TEST_OP(composite_plusd_oo), TEST_OP(dissolve_aa),
+    TEST_OP(dissolve_oa),        TEST_OP(dissolve_ao),
+    TEST_OP(dissolve_oo),
+};
+
+typedef void (*composite_func_t)(composite_run_t *c, int num);
+
+static composite_func_t test_func(draw_info_t *di, int op)
+{
+  return *(composite_func_t *)((char *)di + test_ops[op].offset);
+}
+
+static double test_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void test_fill(unsigned char *p, int num, int alpha_ofs)
+{
+  int i;
+
+  for (i = 0; i < num * 4; i++)
+    p[i] = rand();
+  /* opaque and transparent pixels are special cases of most operators */
+  for (i = 0; i < num; i++) {
+    switch (rand() % 4) {
+    case 0:
+      p[i * 4 + alpha_ofs] = 0;
+      break;
+    case 1:
+      p[i * 4 + alpha_ofs] = 255;
+      break;
+    }
+  }
+}
+
+/* Returns non-zero if results differ from the ones of the scalar function */
+static int test_compare(composite_func_t scalar, composite_func_t simd, unsigned char *src,
+                        unsigned char *dst, unsigned char *a, unsigned char *b, int num)
+{
+  composite_run_t c;
+  int len, start;
+
+  memset(&c, 0, sizeof(c));
+  for (len = 1; len <= SIMD_MAX_PIXELS * 4 + 3 && len <= num; len++) {
+    memcpy(a, dst, num * 4);
+    memcpy(b, dst, num * 4);
+    for (start = 0; start + len <= num; start += len) {
+      c.fraction = rand();
+      c.src = src + start * 4;
+      c.dst = a + start * 4;
+      scalar(&c, len);
+      c.dst = b + start * 4;
+      simd(&c, len);
+    }
+    if (memcmp(a, b, num * 4))
+      return 1;
+  }
+
+  return 0;
+}
+
+static double test_time(composite_func_t func, unsigned char *src, unsigned char *dst, int num,
+                        int iterations)
+{
+  composite_run_t c;
+  double start;
+  int i;
+
+  memset(&c, 0, sizeof(c));
+  c.src = src;
+  c.dst = dst;
+  c.fraction = 0x80;
+  start = test_now();
+  for (i = 0; i < iterations; i++)
+    func(&c, num);
+
+  return (double)num * iterations / (test_now() - start) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+  static const struct {
+    int how;
+    const char *name;
+  } formats[] = {{DI_32_RGBA, "RGBA"}, {DI_32_BGRA, "BGRA"},
+                 {DI_32_ARGB, "ARGB"}, {DI_32_ABGR, "ABGR"}};
+  int num = 1024, iterations = 2000;
+  unsigned char *src, *dst, *a, *b;
+  draw_info_t simd;
+  int f, op, failed = 0, total = 0;
+
+  if (argc > 1)
+    num = atoi(argv[1]);
+  if (argc > 2)
+    iterations = atoi(argv[2]);
+  if (num <= 0 || iterations <= 0) {
+    fprintf(stderr, "usage: %s [pixels [iterations]]\n", argv[0]);
+    return 2;
+  }
+
+#ifndef BLIT_SIMD
+  printf("vectorized compositing is not supported by the compiler\n");
+  return 0;
+#endif
+#ifdef BLIT_SIMD_AVX2
+  printf("instruction set: %s\n", __builtin_cpu_supports("avx2") ? "AVX2" : "baseline");
+#endif
+  printf("%d pixels, %d iterations: scalar / vector Mpixel/s\n", num, iterations);
+
+  src = malloc(num * 4);
+  dst = malloc(num * 4);
+  a = malloc(num * 4);
+  b = malloc(num * 4);
+  srand(1);
+
+  for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+    draw_info_t *scalar = &draw_infos[formats[f].how];
+
+    simd = *scalar;
+    setup_simd(&simd);
+    test_fill(src, num, scalar->inline_alpha_ofs);
+    test_fill(dst, num, scalar->inline_alpha_ofs);
+
+    printf("%s\n", formats[f].name);
+    for (op = 0; op < sizeof(test_ops) / sizeof(test_ops[0]); op++) {
+      composite_func_t sf = test_func(scalar, op), vf = test_func(&simd, op);
+      double scalar_rate, simd_rate;
+      int bad;
+
+      bad = test_compare(sf, vf, src, dst, a, b, num);
+      memcpy(a, dst, num * 4);
+      scalar_rate = test_time(sf, src, a, num, iterations);
+      memcpy(a, dst, num * 4);
+      simd_rate = test_time(vf, src, a, num, iterations);
+      printf("  %-20s %8.1f %8.1f  x%.1f  %s\n", test_ops[op].name, scalar_rate, simd_rate,
+             simd_rate / scalar_rate, bad ? "MISMATCH" : "ok");
+      failed += bad;
+      total++;
+    }
+  }
+
+  free(src);
+  free(dst);
+  free(a);
+  free(b);
+
+  printf("%d of %d functions differ\n", failed, total);
+  return failed != 0;
+}
+#endif /* BLIT_TEST */
@@ -147,5 +147,7 @@ void artcontext_setup_draw_info(draw_info_t *di, unsigned int red_mask,
                                 unsigned int green_mask, unsigned int blue_mask,
                                 int bpp);
 void artcontext_setup_gamma(float gamma);
+/* Use vectorized compositing functions where available, on by default */
+void artcontext_setup_simd(int enable);
 
 #endif
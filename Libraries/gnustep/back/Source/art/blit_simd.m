@@ -0,0 +1,413 @@
+/*
+   Copyright (C) 2026 NEXTSPACE Team
+
+   This file is part of GNUstep.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the
+   Free Software Foundation, 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+  Vectorized compositing functions for the 32-bit formats with inline
+  alpha. Included from blit-main.m once per instruction set and alpha
+  byte offset with these macros defined:
+
+  SIMD_INSTANCE  prefix of the function names
+  SIMD_TARGET    function attributes (instruction set)
+  SIMD_PIXELS    number of pixels in a vector
+  SIMD_ALPHA     offset of the alpha byte in a pixel, 0 or 3
+  SIMD_SCALAR    prefix of the scalar functions for the same alpha offset,
+                 they process the pixels left over
+
+  Color components are processed the same way regardless of their order,
+  so one instance serves both formats with the same alpha offset.
+
+  Each function processes SIMD_PIXELS pixels at a time: components are
+  widened to 16 bits, computed with the formula of the scalar function
+  and truncated back to bytes.
+  Special cases of the scalar functions that the formula doesn't give
+  exactly are applied with masks, so results are identical to blit.m.
+*/
+
+#define SPRE(r) M2PRE(r, SIMD_INSTANCE)
+
+typedef unsigned char SPRE(u8) __attribute__((vector_size(SIMD_PIXELS * 4)));
+typedef unsigned short SPRE(u16) __attribute__((vector_size(SIMD_PIXELS * 8)));
+
+#define simd_u8 SPRE(u8)
+#define simd_u16 SPRE(u16)
+
+/* index of the alpha lane of pixel `p`, once for each of its lanes */
+#define A_ SIMD_ALPHA
+#define SIMD_ALPHA_INDEX(p) (p) * 4 + A_, (p) * 4 + A_, (p) * 4 + A_, (p) * 4 + A_
+
+static inline __attribute__((always_inline)) SIMD_TARGET simd_u8 SPRE(load)(const unsigned char *p)
+{
+  simd_u8 v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline __attribute__((always_inline)) SIMD_TARGET void SPRE(store)(unsigned char *p,
+                                                                          simd_u8 v)
+{
+  memcpy(p, &v, sizeof(v));
+}
+
+/* alpha of each pixel in all of its lanes */
+static inline __attribute__((always_inline)) SIMD_TARGET simd_u8 SPRE(alpha)(simd_u8 v)
+{
+#if SIMD_PIXELS == 4
+  return __builtin_shufflevector(v, v, SIMD_ALPHA_INDEX(0), SIMD_ALPHA_INDEX(1),
+                                 SIMD_ALPHA_INDEX(2), SIMD_ALPHA_INDEX(3));
+#else
+  return __builtin_shufflevector(v, v, SIMD_ALPHA_INDEX(0), SIMD_ALPHA_INDEX(1),
+                                 SIMD_ALPHA_INDEX(2), SIMD_ALPHA_INDEX(3), SIMD_ALPHA_INDEX(4),
+                                 SIMD_ALPHA_INDEX(5), SIMD_ALPHA_INDEX(6), SIMD_ALPHA_INDEX(7));
+#endif
+}
+
+/* 0xff in alpha lanes */
+#define SIMD_ALPHA_LANES_4 (A_ == 0 ? 0xff : 0), 0, 0, (A_ == 3 ? 0xff : 0)
+#if SIMD_PIXELS == 4
+#define SIMD_ALPHA_LANES                                                \
+  ((simd_u8){SIMD_ALPHA_LANES_4, SIMD_ALPHA_LANES_4, SIMD_ALPHA_LANES_4, \
+             SIMD_ALPHA_LANES_4})
+#else
+#define SIMD_ALPHA_LANES                                                \
+  ((simd_u8){SIMD_ALPHA_LANES_4, SIMD_ALPHA_LANES_4, SIMD_ALPHA_LANES_4, \
+             SIMD_ALPHA_LANES_4, SIMD_ALPHA_LANES_4, SIMD_ALPHA_LANES_4, \
+             SIMD_ALPHA_LANES_4, SIMD_ALPHA_LANES_4})
+#endif
+
+/* color lanes of `c` and alpha lanes of `a` */
+static inline __attribute__((always_inline)) SIMD_TARGET simd_u8 SPRE(merge)(simd_u8 c, simd_u8 a)
+{
+  simd_u8 al = SIMD_ALPHA_LANES;
+
+  return (c & ~al) | (a & al);
+}
+
+/* `a` where `mask` is set, `b` elsewhere */
+static inline __attribute__((always_inline)) SIMD_TARGET simd_u8 SPRE(select)(simd_u8 mask,
+                                                                              simd_u8 a, simd_u8 b)
+{
+  return (a & mask) | (b & ~mask);
+}
+
+#define W16(v) __builtin_convertvector(v, simd_u16)
+#define N16(v) __builtin_convertvector(v, simd_u8)
+#define MASK(e) ((simd_u8)(e))
+
+/* s + ((d * x + 0xff) >> 8), truncated */
+static inline __attribute__((always_inline)) SIMD_TARGET simd_u8 SPRE(over)(simd_u8 s, simd_u8 d,
+                                                                            simd_u8 x)
+{
+  return N16(W16(s) + ((W16(d) * W16(x) + 0xff) >> 8));
+}
+
+/*
+  (a * x + b * y + 0xff) >> 8; the sum doesn't fit in 16 bits, so the
+  products are shifted separately and the carry of low bytes is added
+*/
+static inline __attribute__((always_inline)) SIMD_TARGET simd_u8
+    SPRE(lerp)(simd_u8 a, simd_u8 x, simd_u8 b, simd_u8 y)
+{
+  simd_u16 p = W16(a) * W16(x), q = W16(b) * W16(y);
+
+  return N16((p >> 8) + (q >> 8) + (((p & 0xff) + (q & 0xff) + 0xff) >> 8));
+}
+
+/*
+  Loop over the vectors; the body computes `r` from `s` and `d`, the
+  pixels left over are passed to `scalar`.
+*/
+#define SIMD_BEGIN                                        \
+  unsigned char *sp = c->src, *dp = c->dst;               \
+  simd_u8 s, d, r;                                        \
+                                                          \
+  for (; num >= SIMD_PIXELS; num -= SIMD_PIXELS) {        \
+    s = SPRE(load)(sp);                                   \
+    d = SPRE(load)(dp);
+
+#define SIMD_END(scalar)                                  \
+    SPRE(store)(dp, r);                                   \
+    sp += SIMD_PIXELS * 4;                                \
+    dp += SIMD_PIXELS * 4;                                \
+  }                                                       \
+  if (num) {                                              \
+    composite_run_t rest = *c;                            \
+                                                          \
+    rest.src = sp;                                        \
+    rest.dst = dp;                                        \
+    M2PRE(scalar, SIMD_SCALAR)(&rest, num);               \
+  }
+
+static SIMD_TARGET void SPRE(sover_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 sa = SPRE(alpha)(s);
+  r = SPRE(select)(MASK(sa == 0), d, SPRE(over)(s, d, 255 - sa));
+  SIMD_END(sover_aa)
+}
+
+static SIMD_TARGET void SPRE(sover_ao)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 sa = SPRE(alpha)(s);
+  r = SPRE(select)(MASK(sa == 0), d, SPRE(merge)(SPRE(over)(s, d, 255 - sa), d));
+  SIMD_END(sover_ao)
+}
+
+static SIMD_TARGET void SPRE(sin_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  r = N16((W16(s) * W16(SPRE(alpha)(d)) + 0xff) >> 8);
+  SIMD_END(sin_aa)
+}
+
+static SIMD_TARGET void SPRE(sin_oa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  s |= SIMD_ALPHA_LANES;
+  r = N16((W16(s) * W16(SPRE(alpha)(d)) + 0xff) >> 8);
+  SIMD_END(sin_oa)
+}
+
+static SIMD_TARGET void SPRE(sout_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  r = N16((W16(s) * W16(255 - SPRE(alpha)(d)) + 0xff) >> 8);
+  SIMD_END(sout_aa)
+}
+
+static SIMD_TARGET void SPRE(sout_oa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 x = 255 - SPRE(alpha)(d);
+  r = SPRE(merge)(N16((W16(s) * W16(x) + 0x80) >> 8), x);
+  r = SPRE(select)(MASK(x == 255), s | SIMD_ALPHA_LANES, r);
+  SIMD_END(sout_oa)
+}
+
+static SIMD_TARGET void SPRE(satop_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 sa = SPRE(alpha)(s), da = SPRE(alpha)(d);
+  r = SPRE(merge)(SPRE(lerp)(s, da, d, 255 - sa), d);
+  r = SPRE(select)(MASK((da == 0) | ((da == 255) & (sa == 0))), d, r);
+  SIMD_END(satop_aa)
+}
+
+static SIMD_TARGET void SPRE(dover_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 da = SPRE(alpha)(d);
+  r = N16(W16(d) + ((W16(s) * W16(255 - da) + 0x80) >> 8));
+  r = SPRE(select)(MASK(da == 0), s, r);
+  SIMD_END(dover_aa)
+}
+
+static SIMD_TARGET void SPRE(dover_oa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 da = SPRE(alpha)(d);
+  r = N16(W16(d) + ((W16(s) * W16(255 - da) + 0x80) >> 8));
+  r = SPRE(select)(MASK(da == 0), s, r) | SIMD_ALPHA_LANES;
+  SIMD_END(dover_oa)
+}
+
+static SIMD_TARGET void SPRE(din_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 sa = SPRE(alpha)(s);
+  r = SPRE(select)(MASK(sa == 255), d, N16((W16(d) * W16(sa) + 0x80) >> 8));
+  SIMD_END(din_aa)
+}
+
+static SIMD_TARGET void SPRE(dout_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 x = 255 - SPRE(alpha)(s);
+  r = SPRE(select)(MASK(x == 255), d, N16((W16(d) * W16(x) + 0x80) >> 8));
+  SIMD_END(dout_aa)
+}
+
+static SIMD_TARGET void SPRE(datop_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 sa = SPRE(alpha)(s), da = SPRE(alpha)(d);
+  r = SPRE(merge)(SPRE(lerp)(d, sa, s, 255 - da), s);
+  r = SPRE(select)(MASK((da == 0) & (sa == 0)), d, r);
+  r = SPRE(select)(MASK((da == 0) & (sa == 255)), s, r);
+  SIMD_END(datop_aa)
+}
+
+static SIMD_TARGET void SPRE(xor_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  simd_u8 sa = SPRE(alpha)(s), da = SPRE(alpha)(d);
+  r = SPRE(lerp)(d, 255 - sa, s, 255 - da);
+  r = SPRE(select)(MASK((da == 0) & (sa == 0)), d, r);
+  SIMD_END(xor_aa)
+}
+
+static inline __attribute__((always_inline)) SIMD_TARGET simd_u8 SPRE(add)(simd_u8 s, simd_u8 d)
+{
+  simd_u8 sum = s + d;
+
+  return sum | MASK(sum < d);
+}
+
+static SIMD_TARGET void SPRE(plusl_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  r = SPRE(add)(s, d);
+  SIMD_END(plusl_aa)
+}
+
+static SIMD_TARGET void SPRE(plusl_oa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  r = SPRE(add)(s, d) | SIMD_ALPHA_LANES;
+  SIMD_END(plusl_oa)
+}
+
+static SIMD_TARGET void SPRE(plusl_ao_oo)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  r = SPRE(merge)(SPRE(add)(s, d), d);
+  SIMD_END(plusl_ao_oo)
+}
+
+/* max(s + d, 255) - 255 */
+static inline __attribute__((always_inline)) SIMD_TARGET simd_u8 SPRE(sub)(simd_u8 s, simd_u8 d)
+{
+  simd_u8 sum = s + d;
+
+  return (sum + 1) & MASK(sum < d);
+}
+
+static SIMD_TARGET void SPRE(plusd_aa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  r = SPRE(merge)(SPRE(sub)(s, d), SPRE(add)(s, d));
+  SIMD_END(plusd_aa)
+}
+
+static SIMD_TARGET void SPRE(plusd_oa)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  r = SPRE(sub)(s, d) | SIMD_ALPHA_LANES;
+  SIMD_END(plusd_oa)
+}
+
+static SIMD_TARGET void SPRE(plusd_ao_oo)(composite_run_t *c, int num)
+{
+  SIMD_BEGIN
+  r = SPRE(merge)(SPRE(sub)(s, d), d);
+  SIMD_END(plusd_ao_oo)
+}
+
+/* source scaled by fraction over destination */
+static inline __attribute__((always_inline)) SIMD_TARGET simd_u8 SPRE(dissolve)(simd_u8 s,
+                                                                                simd_u8 d,
+                                                                                int fraction)
+{
+  s = N16((W16(s) * (unsigned short)fraction + 0xff) >> 8);
+  return SPRE(over)(s, d, 255 - SPRE(alpha)(s));
+}
+
+static SIMD_TARGET void SPRE(dissolve_aa)(composite_run_t *c, int num)
+{
+  int fraction = c->fraction;
+  SIMD_BEGIN
+  r = SPRE(dissolve)(s, d, fraction);
+  SIMD_END(dissolve_aa)
+}
+
+static SIMD_TARGET void SPRE(dissolve_ao)(composite_run_t *c, int num)
+{
+  int fraction = c->fraction;
+  SIMD_BEGIN
+  r = SPRE(merge)(SPRE(dissolve)(s, d, fraction), d);
+  SIMD_END(dissolve_ao)
+}
+
+static SIMD_TARGET void SPRE(dissolve_oa)(composite_run_t *c, int num)
+{
+  int fraction = c->fraction;
+  SIMD_BEGIN
+  r = SPRE(dissolve)(s | SIMD_ALPHA_LANES, d, fraction);
+  SIMD_END(dissolve_oa)
+}
+
+static SIMD_TARGET void SPRE(dissolve_oo)(composite_run_t *c, int num)
+{
+  int fraction = c->fraction;
+  SIMD_BEGIN
+  r = SPRE(merge)(SPRE(dissolve)(s | SIMD_ALPHA_LANES, d, fraction), d);
+  SIMD_END(dissolve_oo)
+}
+
+/* Replaces compositing functions of `di` with the ones above */
+static void SPRE(setup)(draw_info_t *di)
+{
+  di->composite_sover_aa = SPRE(sover_aa);
+  di->composite_sover_ao = SPRE(sover_ao);
+  di->composite_sin_aa = SPRE(sin_aa);
+  di->composite_sin_oa = SPRE(sin_oa);
+  di->composite_sout_aa = SPRE(sout_aa);
+  di->composite_sout_oa = SPRE(sout_oa);
+  di->composite_satop_aa = SPRE(satop_aa);
+  di->composite_dover_aa = SPRE(dover_aa);
+  di->composite_dover_oa = SPRE(dover_oa);
+  di->composite_din_aa = SPRE(din_aa);
+  di->composite_dout_aa = SPRE(dout_aa);
+  di->composite_datop_aa = SPRE(datop_aa);
+  di->composite_xor_aa = SPRE(xor_aa);
+  di->composite_plusl_aa = SPRE(plusl_aa);
+  di->composite_plusl_oa = SPRE(plusl_oa);
+  di->composite_plusl_ao = SPRE(plusl_ao_oo);
+  di->composite_plusl_oo = SPRE(plusl_ao_oo);
+  di->composite_plusd_aa = SPRE(plusd_aa);
+  di->composite_plusd_oa = SPRE(plusd_oa);
+  di->composite_plusd_ao = SPRE(plusd_ao_oo);
+  di->composite_plusd_oo = SPRE(plusd_ao_oo);
+  di->dissolve_aa = SPRE(dissolve_aa);
+  di->dissolve_oa = SPRE(dissolve_oa);
+  di->dissolve_ao = SPRE(dissolve_ao);
+  di->dissolve_oo = SPRE(dissolve_oo);
+}
+
+#undef SPRE
+#undef simd_u8
+#undef simd_u16
+#undef A_
+#undef SIMD_ALPHA_INDEX
+#undef SIMD_ALPHA_LANES_4
+#undef SIMD_ALPHA_LANES
+#undef W16
+#undef N16
+#undef MASK
+#undef SIMD_BEGIN
+#undef SIMD_END
+#undef SIMD_INSTANCE
+#undef SIMD_TARGET
+#undef SIMD_PIXELS
+#undef SIMD_ALPHA
+#undef SIMD_SCALAR
@@ -38,6 +38,9 @@
 #define XShmSegmentInfo int
 #endif
 
+/* Maximum number of rectangles waiting for the ShmCompletion event */
+#define XWINDOWBUFFER_MAX_PENDING 16
+
 struct XWindowBuffer_depth_info_s {
   /* The drawing depth according to X. Usually the number of bits of color
      data in each pixel. */
@@ -90,14 +93,21 @@ struct XWindowBuffer_depth_info_s {
 
   /* While a XShmPutImage is in progress we don't try to call it
      again. The pending updates are stored here, and when we get the
-     ShmCompletion event, we handle them. */
-  int pending_put; /* There are pending updates */
+     ShmCompletion event, we handle them. Rectangles are merged when they
+     overlap or when there are too many of them. */
+  int num_pending; /* Number of pending update rectangles */
   struct {
     int x, y, w, h;
-  } pending_rect; /* in this rectangle. */
+  } pending_rects[XWINDOWBUFFER_MAX_PENDING];
 
   int pending_event; /* We're waiting for the ShmCompletion event. */
 
+  /* Bytes of image data sent to the server. Counted over periods of
+     about a second, upload_rate is bytes per second of the last one. */
+  unsigned long long bytes_uploaded;
+  double upload_start;
+  double upload_rate;
+
   /* This is for the ugly shape-hack */
   unsigned char *old_shape;
   int old_shape_size;
@@ -139,6 +149,12 @@ struct XWindowBuffer_depth_info_s {
 */
 - (void)needsAlpha;
 
+/*
+  Returns the number of bytes per second uploaded to the X server for this
+  window, measured over the last second of updates.
+*/
+- (double)bytesUploadedPerSecond;
+
 - (void)_gotShmCompletion;
 - (void)_exposeRect:(NSRect)r;
 + (void)_gotShmCompletion:(Drawable)d;
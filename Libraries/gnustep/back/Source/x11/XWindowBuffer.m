@@ -24,6 +24,8 @@
 
 #include <config.h>
 
+#include <Foundation/NSDate.h>
+#include <Foundation/NSDebug.h>
 #include <Foundation/NSUserDefaults.h>
 
 #include "x11/XGServer.h"
@@ -275,7 +277,7 @@ no_xshm:
           wi->alpha = NULL;
         }
 
-      wi->pending_put = wi->pending_event = 0;
+      wi->num_pending = wi->pending_event = 0;
 
       wi->ximage = NULL;
 
@@ -425,39 +427,151 @@ no_xshm:
 
 extern int XShmGetEventBase(Display *d);
 
+static inline void union_rect(int *x, int *y, int *w, int *h,
+                              int rx, int ry, int rw, int rh)
+{
+  int x1 = MAX(*x + *w, rx + rw);
+  int y1 = MAX(*y + *h, ry + rh);
+
+  *x = MIN(*x, rx);
+  *y = MIN(*y, ry);
+  *w = x1 - *x;
+  *h = y1 - *y;
+}
+
+- (void) _countUploadWidth: (int)w height: (int)h
+{
+  double now = [NSDate timeIntervalSinceReferenceDate];
+
+  bytes_uploaded += (unsigned long long)w * h * bytes_per_pixel;
+  if (upload_start == 0)
+    {
+      upload_start = now;
+    }
+  else if (now - upload_start >= 1.0)
+    {
+      upload_rate = bytes_uploaded / (now - upload_start);
+      NSDebugLLog(@"XWindowBuffer", @"window %lu: %.0f bytes/s uploaded",
+                  window->ident, upload_rate);
+      bytes_uploaded = 0;
+      upload_start = now;
+    }
+}
+
+- (double) bytesUploadedPerSecond
+{
+  double elapsed = [NSDate timeIntervalSinceReferenceDate] - upload_start;
+
+  /* no updates for a while */
+  if (upload_start != 0 && elapsed >= 1.0)
+    return bytes_uploaded / elapsed;
+  return upload_rate;
+}
+
+/* Adds rectangle to be put when the ShmCompletion event comes. */
+- (void) _addPendingX: (int)x y: (int)y w: (int)w h: (int)h
+{
+  long growth, best_growth;
+  int i, best;
+
+  /* Merge with the rectangles it overlaps; the union may overlap other
+     ones, so start over after each merge. */
+  i = 0;
+  while (i < num_pending)
+    {
+      if (x < pending_rects[i].x + pending_rects[i].w
+          && pending_rects[i].x < x + w
+          && y < pending_rects[i].y + pending_rects[i].h
+          && pending_rects[i].y < y + h)
+        {
+          union_rect(&x, &y, &w, &h,
+                     pending_rects[i].x, pending_rects[i].y,
+                     pending_rects[i].w, pending_rects[i].h);
+          pending_rects[i] = pending_rects[--num_pending];
+          i = 0;
+        }
+      else
+        {
+          i++;
+        }
+    }
+
+  if (num_pending == XWINDOWBUFFER_MAX_PENDING)
+    {
+      /* Full: merge with the rectangle whose bounding box with this one
+         is the smallest increase in area. */
+      best = 0;
+      best_growth = -1;
+      for (i = 0; i < num_pending; i++)
+        {
+          int ux = x, uy = y, uw = w, uh = h;
+
+          union_rect(&ux, &uy, &uw, &uh,
+                     pending_rects[i].x, pending_rects[i].y,
+                     pending_rects[i].w, pending_rects[i].h);
+          growth = (long)uw * uh - (long)pending_rects[i].w * pending_rects[i].h;
+          if (best_growth < 0 || growth < best_growth)
+            {
+              best = i;
+              best_growth = growth;
+            }
+        }
+      union_rect(&x, &y, &w, &h,
+                 pending_rects[best].x, pending_rects[best].y,
+                 pending_rects[best].w, pending_rects[best].h);
+      pending_rects[best] = pending_rects[--num_pending];
+      [self _addPendingX: x y: y w: w h: h];
+      return;
+    }
+
+  pending_rects[num_pending].x = x;
+  pending_rects[num_pending].y = y;
+  pending_rects[num_pending].w = w;
+  pending_rects[num_pending].h = h;
+  num_pending++;
+}
+
 - (void) _gotShmCompletion
 {
 #ifdef XSHM
+  int i, n;
+
   if (!use_shm)
     return;
 
   pending_event = 0;
-  if (pending_put)
+
+  /* The window might have shrunk meanwhile */
+  for (i = n = 0; i < num_pending; i++)
     {
-      pending_put = 0;
-      if (pending_rect.x + pending_rect.w > window->xframe.size.width)
-        {
-          pending_rect.w = window->xframe.size.width - pending_rect.x;
-          if (pending_rect.w <= 0)
-            return;
-        }
-      if (pending_rect.y + pending_rect.h > window->xframe.size.height)
-        {
-          pending_rect.h = window->xframe.size.height - pending_rect.y;
-          if (pending_rect.h <= 0)
-            return;
-        }
+      pending_rects[n] = pending_rects[i];
+      if (pending_rects[n].x + pending_rects[n].w > window->xframe.size.width)
+        pending_rects[n].w = window->xframe.size.width - pending_rects[n].x;
+      if (pending_rects[n].y + pending_rects[n].h > window->xframe.size.height)
+        pending_rects[n].h = window->xframe.size.height - pending_rects[n].y;
+      if (pending_rects[n].w > 0 && pending_rects[n].h > 0)
+        n++;
+    }
+  num_pending = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      /* Put requests are processed in order, so the event for the last
+         one means that all of them are done. */
       if (!XShmPutImage(display, drawable, gc, ximage,
-                        pending_rect.x, pending_rect.y,
-                        pending_rect.x, pending_rect.y,
-                        pending_rect.w, pending_rect.h,
-                        1))
+                        pending_rects[i].x, pending_rects[i].y,
+                        pending_rects[i].x, pending_rects[i].y,
+                        pending_rects[i].w, pending_rects[i].h,
+                        i == n - 1))
         {
           NSLog(@"XShmPutImage failed?");
         }
       else
         {
-          pending_event = 1;
+          [self _countUploadWidth: pending_rects[i].w
+                           height: pending_rects[i].h];
+          if (i == n - 1)
+            pending_event = 1;
         }
     }
 //        XFlush(window->display);
@@ -593,39 +707,10 @@ static int warn = 0;
 
       if (pending_event)
         {
-          if (!pending_put)
-            {
-              pending_put = 1;
-              pending_rect.x = x;
-              pending_rect.y = y;
-              pending_rect.w = w;
-              pending_rect.h = h;
-            }
-          else
-            {
-              if (x < pending_rect.x)
-                {
-                  pending_rect.w += pending_rect.x - x;
-                  pending_rect.x = x;
-                }
-              if (x + w > pending_rect.x + pending_rect.w)
-                {
-                  pending_rect.w = x + w - pending_rect.x;
-                }
-              if (y < pending_rect.y)
-                {
-                  pending_rect.h += pending_rect.y - y;
-                  pending_rect.y = y;
-                }
-              if (y + h > pending_rect.y + pending_rect.h)
-                {
-                  pending_rect.h = y + h - pending_rect.y;
-                }
-            }
+          [self _addPendingX: x y: y w: w h: h];
         }
       else
         {
-          pending_put = 0;
           if (!XShmPutImage(display, drawable, gc, ximage,
                             x, y, x, y, w, h, 1))
             {
@@ -633,6 +718,7 @@ static int warn = 0;
             }
           else
             {
+              [self _countUploadWidth: w height: h];
               pending_event = 1;
             }
         }
@@ -654,6 +740,7 @@ static int warn = 0;
     if (ximage)
     {
       XPutImage(display, drawable, gc, ximage, x, y, x, y, w, h);
+      [self _countUploadWidth: w height: h];
     }
 }
 
@@ -0,0 +1,628 @@
+/* combine.c - pixel blending kernels
+ *
+ * Raster graphics library
+ *
+ * Copyright (c) 2026 NEXTSPACE Team
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+/*
+ * Scalar kernels are the reference: vector kernels must produce the same
+ * bytes. Alpha combination uses the same single precision operations as the
+ * scalar code (multiply, multiply, add, truncate) for that reason.
+ * Vector kernels are selected at run time by r_combine_best_kernels(),
+ * WRASTER_NO_SIMD environment variable forces scalar ones.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "wraster.h"
+#include "combine.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COMBINE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define COMBINE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Products must be rounded before addition: compilers would fuse them into
+ * FMA instructions on CPUs that have them and results would depend on build flags */
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+/* ---------------------------------------------------------------------------
+ * Scalar
+ */
+
+/* Based on Gimp 1.1.24 alpha channel combination */
+static void alpha_scalar(unsigned char *d, const unsigned char *s, int s_has_alpha, int width,
+                         int opacity)
+{
+  int x;
+  int t, sa;
+  int alpha;
+  float ratio, cratio;
+
+  for (x = 0; x < width; x++) {
+    sa = s_has_alpha ? *(s + 3) : 255;
+
+    if (opacity != 255) {
+      t = sa * opacity + 0x80;
+      sa = ((t >> 8) + t) >> 8;
+    }
+
+    t = *(d + 3) * (255 - sa) + 0x80;
+    alpha = sa + (((t >> 8) + t) >> 8);
+
+    if (sa == 0 || alpha == 0) {
+      ratio = 0;
+      cratio = 1.0;
+    } else if (sa == alpha) {
+      ratio = 1.0;
+      cratio = 0;
+    } else {
+      ratio = (float)sa / alpha;
+      cratio = 1.0F - ratio;
+    }
+
+    *d = (int)*d * cratio + (int)*s * ratio;
+    s++;
+    d++;
+    *d = (int)*d * cratio + (int)*s * ratio;
+    s++;
+    d++;
+    *d = (int)*d * cratio + (int)*s * ratio;
+    s++;
+    d++;
+    *d = alpha;
+    d++;
+
+    if (s_has_alpha)
+      s++;
+  }
+}
+
+static void opaque_scalar(unsigned char *d, const unsigned char *s, int count, int opacity)
+{
+  int i;
+  int c_opacity = 255 - opacity;
+
+  for (i = 0; i < count; i++) {
+    *d = (((int)*d * c_opacity) + ((int)*s * opacity)) / 256;
+    d++;
+    s++;
+  }
+}
+
+static void color_scalar(unsigned char *d, int width, const RColor *color)
+{
+  int i;
+  int alpha, nalpha;
+  int r = color->red, g = color->green, b = color->blue;
+
+  for (i = 0; i < width; i++) {
+    alpha = *(d + 3);
+    nalpha = 255 - alpha;
+
+    *d = (((int)*d * alpha) + (r * nalpha)) / 256;
+    d++;
+    *d = (((int)*d * alpha) + (g * nalpha)) / 256;
+    d++;
+    *d = (((int)*d * alpha) + (b * nalpha)) / 256;
+    d++;
+    d++;
+  }
+}
+
+static const RCombineKernels scalar_kernels = {"scalar", alpha_scalar, opaque_scalar,
+                                               color_scalar};
+
+/* Vector kernels keep intermediate values in 16 bit lanes */
+#define OPACITY_IN_RANGE(o) ((o) >= 0 && (o) <= 255)
+
+/* Source pixels without alpha are expanded to RGBA with alpha 255 */
+static inline void load_rgb_pixels(uint32_t *p, const unsigned char *s, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++, s += 3) {
+    p[i] = (uint32_t)s[0] | ((uint32_t)s[1] << 8) | ((uint32_t)s[2] << 16) | 0xff000000U;
+  }
+}
+
+#ifdef COMBINE_X86
+
+/* ---------------------------------------------------------------------------
+ * SSE2: 4 RGBA pixels per iteration
+ */
+
+/* ((t >> 8) + t) >> 8 where t = x * y + 0x80: the scalar rounding of x * y / 255 */
+static inline __m128i sse2_mul_div255(__m128i x, __m128i y)
+{
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, y), _mm_set1_epi16(0x80));
+
+  return _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(t, 8), t), 8);
+}
+
+/* Copies alpha of each of 2 pixels to all its 16 bit channels */
+static inline __m128i sse2_alpha16(__m128i p)
+{
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, 0xff), 0xff);
+}
+
+/* One pixel in 32 bit lanes: blended color channels and `alpha` as alpha */
+static inline __m128i sse2_blend_pixel(__m128i d, __m128i s, __m128i sa, __m128i alpha)
+{
+  const __m128i alpha_mask = _mm_set_epi32(-1, 0, 0, 0);
+  __m128 fa = _mm_max_ps(_mm_cvtepi32_ps(alpha), _mm_set1_ps(1.0F));
+  __m128 ratio = _mm_div_ps(_mm_cvtepi32_ps(sa), fa);
+  __m128 cratio = _mm_sub_ps(_mm_set1_ps(1.0F), ratio);
+  __m128 r = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(d), cratio),
+                        _mm_mul_ps(_mm_cvtepi32_ps(s), ratio));
+  __m128i c = _mm_cvttps_epi32(r);
+
+  return _mm_or_si128(_mm_andnot_si128(alpha_mask, c), _mm_and_si128(alpha_mask, alpha));
+}
+
+/* 2 pixels in 16 bit lanes; returns them in 32 bit lanes */
+static inline void sse2_blend_pair(__m128i d, __m128i s, int opacity, __m128i *p0, __m128i *p1)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sa = sse2_alpha16(s);
+  __m128i alpha;
+
+  if (opacity != 255) {
+    sa = sse2_mul_div255(sa, _mm_set1_epi16(opacity));
+  }
+  alpha = _mm_add_epi16(
+      sa, sse2_mul_div255(sse2_alpha16(d), _mm_sub_epi16(_mm_set1_epi16(255), sa)));
+
+  *p0 = sse2_blend_pixel(_mm_unpacklo_epi16(d, zero), _mm_unpacklo_epi16(s, zero),
+                         _mm_unpacklo_epi16(sa, zero), _mm_unpacklo_epi16(alpha, zero));
+  *p1 = sse2_blend_pixel(_mm_unpackhi_epi16(d, zero), _mm_unpackhi_epi16(s, zero),
+                         _mm_unpackhi_epi16(sa, zero), _mm_unpackhi_epi16(alpha, zero));
+}
+
+static void alpha_sse2(unsigned char *d, const unsigned char *s, int s_has_alpha, int width,
+                       int opacity)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int schannels = s_has_alpha ? 4 : 3;
+  uint32_t rgba[4];
+  __m128i dv, sv, p0, p1, p2, p3;
+  int x;
+
+  if (!OPACITY_IN_RANGE(opacity)) {
+    alpha_scalar(d, s, s_has_alpha, width, opacity);
+    return;
+  }
+
+  for (x = 0; x + 4 <= width; x += 4) {
+    dv = _mm_loadu_si128((const __m128i *)d);
+    if (s_has_alpha) {
+      sv = _mm_loadu_si128((const __m128i *)s);
+    } else {
+      load_rgb_pixels(rgba, s, 4);
+      sv = _mm_loadu_si128((const __m128i *)rgba);
+    }
+
+    sse2_blend_pair(_mm_unpacklo_epi8(dv, zero), _mm_unpacklo_epi8(sv, zero), opacity, &p0, &p1);
+    sse2_blend_pair(_mm_unpackhi_epi8(dv, zero), _mm_unpackhi_epi8(sv, zero), opacity, &p2, &p3);
+
+    dv = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+    _mm_storeu_si128((__m128i *)d, dv);
+
+    d += 16;
+    s += 4 * schannels;
+  }
+  alpha_scalar(d, s, s_has_alpha, width - x, opacity);
+}
+
+static void opaque_sse2(unsigned char *d, const unsigned char *s, int count, int opacity)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i op, cop, dv, sv, lo, hi;
+  int i;
+
+  if (!OPACITY_IN_RANGE(opacity)) {
+    opaque_scalar(d, s, count, opacity);
+    return;
+  }
+
+  op = _mm_set1_epi16(opacity);
+  cop = _mm_set1_epi16(255 - opacity);
+  for (i = 0; i + 16 <= count; i += 16) {
+    dv = _mm_loadu_si128((const __m128i *)(d + i));
+    sv = _mm_loadu_si128((const __m128i *)(s + i));
+    lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(dv, zero), cop),
+                       _mm_mullo_epi16(_mm_unpacklo_epi8(sv, zero), op));
+    hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(dv, zero), cop),
+                       _mm_mullo_epi16(_mm_unpackhi_epi8(sv, zero), op));
+    dv = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+    _mm_storeu_si128((__m128i *)(d + i), dv);
+  }
+  opaque_scalar(d + i, s + i, count - i, opacity);
+}
+
+static void color_sse2(unsigned char *d, int width, const RColor *color)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+  const __m128i c255 = _mm_set1_epi16(255);
+  __m128i c = _mm_set_epi16(0, color->blue, color->green, color->red, 0, color->blue,
+                            color->green, color->red);
+  __m128i dv, lo, hi, a;
+  int x;
+
+  for (x = 0; x + 4 <= width; x += 4, d += 16) {
+    dv = _mm_loadu_si128((const __m128i *)d);
+    lo = _mm_unpacklo_epi8(dv, zero);
+    a = sse2_alpha16(lo);
+    lo = _mm_add_epi16(_mm_mullo_epi16(lo, a), _mm_mullo_epi16(c, _mm_sub_epi16(c255, a)));
+    hi = _mm_unpackhi_epi8(dv, zero);
+    a = sse2_alpha16(hi);
+    hi = _mm_add_epi16(_mm_mullo_epi16(hi, a), _mm_mullo_epi16(c, _mm_sub_epi16(c255, a)));
+    lo = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+    dv = _mm_or_si128(_mm_andnot_si128(alpha_mask, lo), _mm_and_si128(alpha_mask, dv));
+    _mm_storeu_si128((__m128i *)d, dv);
+  }
+  color_scalar(d, width - x, color);
+}
+
+static const RCombineKernels sse2_kernels = {"sse2", alpha_sse2, opaque_sse2, color_sse2};
+
+/* ---------------------------------------------------------------------------
+ * AVX2: 8 RGBA pixels per iteration. Unpack and pack instructions work inside
+ * 128 bit lanes, so every step mirrors the SSE2 one.
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_mul_div255(__m256i x, __m256i y)
+{
+  __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(x, y), _mm256_set1_epi16(0x80));
+
+  return _mm256_srli_epi16(_mm256_add_epi16(_mm256_srli_epi16(t, 8), t), 8);
+}
+
+AVX2 static inline __m256i avx2_alpha16(__m256i p)
+{
+  return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(p, 0xff), 0xff);
+}
+
+AVX2 static inline __m256i avx2_blend_pixel(__m256i d, __m256i s, __m256i sa, __m256i alpha)
+{
+  const __m256i alpha_mask = _mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0);
+  __m256 fa = _mm256_max_ps(_mm256_cvtepi32_ps(alpha), _mm256_set1_ps(1.0F));
+  __m256 ratio = _mm256_div_ps(_mm256_cvtepi32_ps(sa), fa);
+  __m256 cratio = _mm256_sub_ps(_mm256_set1_ps(1.0F), ratio);
+  __m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(d), cratio),
+                           _mm256_mul_ps(_mm256_cvtepi32_ps(s), ratio));
+  __m256i c = _mm256_cvttps_epi32(r);
+
+  return _mm256_or_si256(_mm256_andnot_si256(alpha_mask, c),
+                         _mm256_and_si256(alpha_mask, alpha));
+}
+
+AVX2 static inline void avx2_blend_pair(__m256i d, __m256i s, int opacity, __m256i *p0,
+                                        __m256i *p1)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sa = avx2_alpha16(s);
+  __m256i alpha;
+
+  if (opacity != 255) {
+    sa = avx2_mul_div255(sa, _mm256_set1_epi16(opacity));
+  }
+  alpha = _mm256_add_epi16(
+      sa, avx2_mul_div255(avx2_alpha16(d), _mm256_sub_epi16(_mm256_set1_epi16(255), sa)));
+
+  *p0 = avx2_blend_pixel(_mm256_unpacklo_epi16(d, zero), _mm256_unpacklo_epi16(s, zero),
+                         _mm256_unpacklo_epi16(sa, zero), _mm256_unpacklo_epi16(alpha, zero));
+  *p1 = avx2_blend_pixel(_mm256_unpackhi_epi16(d, zero), _mm256_unpackhi_epi16(s, zero),
+                         _mm256_unpackhi_epi16(sa, zero), _mm256_unpackhi_epi16(alpha, zero));
+}
+
+AVX2 static void alpha_avx2(unsigned char *d, const unsigned char *s, int s_has_alpha,
+                            int width, int opacity)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  int schannels = s_has_alpha ? 4 : 3;
+  uint32_t rgba[8];
+  __m256i dv, sv, p0, p1, p2, p3;
+  int x;
+
+  if (!OPACITY_IN_RANGE(opacity)) {
+    alpha_scalar(d, s, s_has_alpha, width, opacity);
+    return;
+  }
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    dv = _mm256_loadu_si256((const __m256i *)d);
+    if (s_has_alpha) {
+      sv = _mm256_loadu_si256((const __m256i *)s);
+    } else {
+      load_rgb_pixels(rgba, s, 8);
+      sv = _mm256_loadu_si256((const __m256i *)rgba);
+    }
+
+    avx2_blend_pair(_mm256_unpacklo_epi8(dv, zero), _mm256_unpacklo_epi8(sv, zero), opacity,
+                    &p0, &p1);
+    avx2_blend_pair(_mm256_unpackhi_epi8(dv, zero), _mm256_unpackhi_epi8(sv, zero), opacity,
+                    &p2, &p3);
+
+    dv = _mm256_packus_epi16(_mm256_packs_epi32(p0, p1), _mm256_packs_epi32(p2, p3));
+    _mm256_storeu_si256((__m256i *)d, dv);
+
+    d += 32;
+    s += 8 * schannels;
+  }
+  alpha_sse2(d, s, s_has_alpha, width - x, opacity);
+}
+
+AVX2 static void opaque_avx2(unsigned char *d, const unsigned char *s, int count, int opacity)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i op, cop, dv, sv, lo, hi;
+  int i;
+
+  if (!OPACITY_IN_RANGE(opacity)) {
+    opaque_scalar(d, s, count, opacity);
+    return;
+  }
+
+  op = _mm256_set1_epi16(opacity);
+  cop = _mm256_set1_epi16(255 - opacity);
+  for (i = 0; i + 32 <= count; i += 32) {
+    dv = _mm256_loadu_si256((const __m256i *)(d + i));
+    sv = _mm256_loadu_si256((const __m256i *)(s + i));
+    lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(dv, zero), cop),
+                          _mm256_mullo_epi16(_mm256_unpacklo_epi8(sv, zero), op));
+    hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(dv, zero), cop),
+                          _mm256_mullo_epi16(_mm256_unpackhi_epi8(sv, zero), op));
+    dv = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+    _mm256_storeu_si256((__m256i *)(d + i), dv);
+  }
+  opaque_sse2(d + i, s + i, count - i, opacity);
+}
+
+AVX2 static void color_avx2(unsigned char *d, int width, const RColor *color)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha_mask = _mm256_set1_epi32(0xff000000);
+  const __m256i c255 = _mm256_set1_epi16(255);
+  __m256i c = _mm256_set_epi16(0, color->blue, color->green, color->red, 0, color->blue,
+                               color->green, color->red, 0, color->blue, color->green,
+                               color->red, 0, color->blue, color->green, color->red);
+  __m256i dv, lo, hi, a;
+  int x;
+
+  for (x = 0; x + 8 <= width; x += 8, d += 32) {
+    dv = _mm256_loadu_si256((const __m256i *)d);
+    lo = _mm256_unpacklo_epi8(dv, zero);
+    a = avx2_alpha16(lo);
+    lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, a),
+                          _mm256_mullo_epi16(c, _mm256_sub_epi16(c255, a)));
+    hi = _mm256_unpackhi_epi8(dv, zero);
+    a = avx2_alpha16(hi);
+    hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, a),
+                          _mm256_mullo_epi16(c, _mm256_sub_epi16(c255, a)));
+    lo = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+    dv = _mm256_or_si256(_mm256_andnot_si256(alpha_mask, lo), _mm256_and_si256(alpha_mask, dv));
+    _mm256_storeu_si256((__m256i *)d, dv);
+  }
+  color_sse2(d, width - x, color);
+}
+
+static const RCombineKernels avx2_kernels = {"avx2", alpha_avx2, opaque_avx2, color_avx2};
+
+#endif /* COMBINE_X86 */
+
+#ifdef COMBINE_NEON
+
+/* ---------------------------------------------------------------------------
+ * NEON: 8 pixels per iteration, channels are deinterleaved by vld4/vld3
+ */
+
+static inline uint16x8_t neon_mul_div255(uint16x8_t x, uint16x8_t y)
+{
+  uint16x8_t t = vaddq_u16(vmulq_u16(x, y), vdupq_n_u16(0x80));
+
+  return vshrq_n_u16(vsraq_n_u16(t, t, 8), 8);
+}
+
+static inline uint32x4_t neon_blend4(uint16x4_t d, uint16x4_t s, float32x4_t ratio,
+                                     float32x4_t cratio)
+{
+  float32x4_t r = vaddq_f32(vmulq_f32(vcvtq_f32_u32(vmovl_u16(d)), cratio),
+                            vmulq_f32(vcvtq_f32_u32(vmovl_u16(s)), ratio));
+
+  return vcvtq_u32_f32(r);
+}
+
+static inline uint8x8_t neon_blend8(uint8x8_t d, uint8x8_t s, float32x4_t ratio_lo,
+                                    float32x4_t cratio_lo, float32x4_t ratio_hi,
+                                    float32x4_t cratio_hi)
+{
+  uint16x8_t d16 = vmovl_u8(d), s16 = vmovl_u8(s);
+  uint32x4_t lo = neon_blend4(vget_low_u16(d16), vget_low_u16(s16), ratio_lo, cratio_lo);
+  uint32x4_t hi = neon_blend4(vget_high_u16(d16), vget_high_u16(s16), ratio_hi, cratio_hi);
+
+  return vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+}
+
+static inline float32x4_t neon_ratio(uint16x4_t sa, uint16x4_t alpha)
+{
+  float32x4_t fa = vmaxq_f32(vcvtq_f32_u32(vmovl_u16(alpha)), vdupq_n_f32(1.0F));
+
+  return vdivq_f32(vcvtq_f32_u32(vmovl_u16(sa)), fa);
+}
+
+static void alpha_neon(unsigned char *d, const unsigned char *s, int s_has_alpha, int width,
+                       int opacity)
+{
+  const float32x4_t one = vdupq_n_f32(1.0F);
+  uint8x8x4_t dv, sv;
+  uint8x8x3_t rgb;
+  uint16x8_t sa, alpha;
+  float32x4_t ratio_lo, ratio_hi, cratio_lo, cratio_hi;
+  int x;
+
+  if (!OPACITY_IN_RANGE(opacity)) {
+    alpha_scalar(d, s, s_has_alpha, width, opacity);
+    return;
+  }
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    dv = vld4_u8(d);
+    if (s_has_alpha) {
+      sv = vld4_u8(s);
+      s += 32;
+    } else {
+      rgb = vld3_u8(s);
+      sv.val[0] = rgb.val[0];
+      sv.val[1] = rgb.val[1];
+      sv.val[2] = rgb.val[2];
+      sv.val[3] = vdup_n_u8(255);
+      s += 24;
+    }
+
+    sa = vmovl_u8(sv.val[3]);
+    if (opacity != 255) {
+      sa = neon_mul_div255(sa, vdupq_n_u16(opacity));
+    }
+    alpha = vaddq_u16(sa, neon_mul_div255(vmovl_u8(dv.val[3]),
+                                          vsubq_u16(vdupq_n_u16(255), sa)));
+
+    ratio_lo = neon_ratio(vget_low_u16(sa), vget_low_u16(alpha));
+    ratio_hi = neon_ratio(vget_high_u16(sa), vget_high_u16(alpha));
+    cratio_lo = vsubq_f32(one, ratio_lo);
+    cratio_hi = vsubq_f32(one, ratio_hi);
+
+    dv.val[0] = neon_blend8(dv.val[0], sv.val[0], ratio_lo, cratio_lo, ratio_hi, cratio_hi);
+    dv.val[1] = neon_blend8(dv.val[1], sv.val[1], ratio_lo, cratio_lo, ratio_hi, cratio_hi);
+    dv.val[2] = neon_blend8(dv.val[2], sv.val[2], ratio_lo, cratio_lo, ratio_hi, cratio_hi);
+    dv.val[3] = vmovn_u16(alpha);
+    vst4_u8(d, dv);
+
+    d += 32;
+  }
+  alpha_scalar(d, s, s_has_alpha, width - x, opacity);
+}
+
+static void opaque_neon(unsigned char *d, const unsigned char *s, int count, int opacity)
+{
+  uint8x8_t op, cop;
+  uint8x16_t dv, sv;
+  uint16x8_t lo, hi;
+  int i;
+
+  if (!OPACITY_IN_RANGE(opacity)) {
+    opaque_scalar(d, s, count, opacity);
+    return;
+  }
+
+  op = vdup_n_u8(opacity);
+  cop = vdup_n_u8(255 - opacity);
+  for (i = 0; i + 16 <= count; i += 16) {
+    dv = vld1q_u8(d + i);
+    sv = vld1q_u8(s + i);
+    lo = vmlal_u8(vmull_u8(vget_low_u8(dv), cop), vget_low_u8(sv), op);
+    hi = vmlal_u8(vmull_u8(vget_high_u8(dv), cop), vget_high_u8(sv), op);
+    vst1q_u8(d + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+  }
+  opaque_scalar(d + i, s + i, count - i, opacity);
+}
+
+static void color_neon(unsigned char *d, int width, const RColor *color)
+{
+  uint8x8_t r = vdup_n_u8(color->red);
+  uint8x8_t g = vdup_n_u8(color->green);
+  uint8x8_t b = vdup_n_u8(color->blue);
+  uint8x8_t na;
+  uint8x8x4_t dv;
+  int x;
+
+  for (x = 0; x + 8 <= width; x += 8, d += 32) {
+    dv = vld4_u8(d);
+    na = vmvn_u8(dv.val[3]);
+    dv.val[0] = vshrn_n_u16(vmlal_u8(vmull_u8(dv.val[0], dv.val[3]), r, na), 8);
+    dv.val[1] = vshrn_n_u16(vmlal_u8(vmull_u8(dv.val[1], dv.val[3]), g, na), 8);
+    dv.val[2] = vshrn_n_u16(vmlal_u8(vmull_u8(dv.val[2], dv.val[3]), b, na), 8);
+    vst4_u8(d, dv);
+  }
+  color_scalar(d, width - x, color);
+}
+
+static const RCombineKernels neon_kernels = {"neon", alpha_neon, opaque_neon, color_neon};
+
+#endif /* COMBINE_NEON */
+
+/* ---------------------------------------------------------------------------
+ * Dispatch
+ */
+
+const RCombineKernels *r_combine_kernels(RCombineLevel level)
+{
+  switch (level) {
+  case RCombineScalar:
+    return &scalar_kernels;
+#ifdef COMBINE_X86
+  case RCombineSSE2:
+    return __builtin_cpu_supports("sse2") ? &sse2_kernels : NULL;
+  case RCombineAVX2:
+    return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif
+#ifdef COMBINE_NEON
+  case RCombineNEON:
+    return &neon_kernels;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+const RCombineKernels *r_combine_best_kernels(void)
+{
+  static const RCombineKernels *best = NULL;
+  RCombineLevel level;
+
+  /* Concurrent callers store the same value */
+  if (best == NULL) {
+    const RCombineKernels *kernels = &scalar_kernels;
+
+    if (getenv("WRASTER_NO_SIMD") == NULL) {
+      for (level = RCombineSSE2; level <= RCombineNEON; level++) {
+        const RCombineKernels *k = r_combine_kernels(level);
+        if (k != NULL) {
+          kernels = k;
+        }
+      }
+    }
+    best = kernels;
+  }
+
+  return best;
+}
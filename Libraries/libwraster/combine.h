@@ -0,0 +1,67 @@
+/*
+ * Raster graphics library
+ *
+ * Copyright (c) 2026 NEXTSPACE Team
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+/*
+ * Pixel blending kernels used by RCombine* functions
+ *
+ * The functions here are for WRaster library's internal use only,
+ * Please use functions in 'wraster.h' in applications
+ */
+
+#ifndef __WRASTER_COMBINE_H__
+#define __WRASTER_COMBINE_H__
+
+typedef enum {
+  RCombineScalar, /* reference implementation */
+  RCombineSSE2,
+  RCombineAVX2,
+  RCombineNEON
+} RCombineLevel;
+
+/*
+ * Every kernel processes one row and gives results identical to the scalar one.
+ */
+typedef struct RCombineKernels {
+  const char *name;
+
+  /* RGBA (or RGB if `s_has_alpha` is 0) source over RGBA destination,
+   * see RCombineAlpha() */
+  void (*alpha)(unsigned char *d, const unsigned char *s, int s_has_alpha, int width,
+                int opacity);
+
+  /* d = (d * (255 - opacity) + s * opacity) / 256 for every of `count` bytes */
+  void (*opaque)(unsigned char *d, const unsigned char *s, int count, int opacity);
+
+  /* RGBA destination over solid color, alpha is left unchanged */
+  void (*color)(unsigned char *d, int width, const RColor *color);
+} RCombineKernels;
+
+/*
+ * Returns kernels of the given level or NULL if CPU doesn't support it
+ */
+const RCombineKernels *r_combine_kernels(RCombineLevel level);
+
+/*
+ * Returns the fastest kernels supported by CPU
+ */
+const RCombineKernels *r_combine_best_kernels(void);
+
+#endif
@@ -27,6 +27,7 @@
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -37,6 +38,10 @@
 #include "convert.h"
 #include "xutil.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define NFREE(n) \
   if (n)         \
   free(n)
@@ -288,13 +293,137 @@ static void convertTrueColor_generic(RXImage *ximg, RImage *image, signed char *
   }
 }
 
+/* Pixels are stored directly into XImage data if its layout is simple */
+static int isNativeXImage(XImage *image)
+{
+  static const int one = 1;
+  int byte_order = (*(const char *)&one) ? LSBFirst : MSBFirst;
+
+  return (image->byte_order == byte_order &&
+          (image->bits_per_pixel == 32 || image->bits_per_pixel == 16));
+}
+
+static inline void putPixel(XImage *image, int native, char *line, int x, int y,
+                            unsigned long pixel)
+{
+  if (!native) {
+    XPutPixel(image, x, y, pixel);
+  } else if (image->bits_per_pixel == 32) {
+    ((uint32_t *)line)[x] = pixel;
+  } else {
+    ((uint16_t *)line)[x] = pixel;
+  }
+}
+
+/* 8 bits per channel and 32 bits per pixel: no tables, no dithering */
+static void convertTrueColor_32(RXImage *ximg, RImage *image, const unsigned short roffs,
+                                const unsigned short goffs, const unsigned short boffs)
+{
+  unsigned char *ptr = image->data;
+  int channels = (HAS_ALPHA(image) ? 4 : 3);
+  uint32_t *line;
+  int x, y;
+
+  for (y = 0; y < image->height; y++) {
+    line = (uint32_t *)(ximg->image->data + y * ximg->image->bytes_per_line);
+    x = 0;
+#ifdef __SSE2__
+    if (channels == 4) {
+      const __m128i mask = _mm_set1_epi32(0xff);
+      const __m128i rs = _mm_cvtsi32_si128(roffs);
+      const __m128i gs = _mm_cvtsi32_si128(goffs);
+      const __m128i bs = _mm_cvtsi32_si128(boffs);
+      __m128i v, r, g, b;
+
+      /* 4 RGBA pixels: every channel is moved to its place in 32 bit pixel */
+      for (; x + 4 <= image->width; x += 4, ptr += 16) {
+        v = _mm_loadu_si128((const __m128i *)ptr);
+        r = _mm_sll_epi32(_mm_and_si128(v, mask), rs);
+        g = _mm_sll_epi32(_mm_and_si128(_mm_srli_epi32(v, 8), mask), gs);
+        b = _mm_sll_epi32(_mm_and_si128(_mm_srli_epi32(v, 16), mask), bs);
+        _mm_storeu_si128((__m128i *)(line + x), _mm_or_si128(_mm_or_si128(r, g), b));
+      }
+    }
+#endif
+    for (; x < image->width; x++, ptr += channels) {
+      line[x] = ((uint32_t)ptr[0] << roffs) | ((uint32_t)ptr[1] << goffs) |
+                ((uint32_t)ptr[2] << boffs);
+    }
+  }
+}
+
+static void convertTrueColor_match(RXImage *ximg, RImage *image, const unsigned short *rtable,
+                                   const unsigned short *gtable, const unsigned short *btable,
+                                   const unsigned short roffs, const unsigned short goffs,
+                                   const unsigned short boffs)
+{
+  unsigned char *ptr = image->data;
+  int channels = (HAS_ALPHA(image) ? 4 : 3);
+  int native = isNativeXImage(ximg->image);
+  unsigned long pixel;
+  char *line;
+  int x, y;
+
+  for (y = 0; y < image->height; y++) {
+    line = ximg->image->data + y * ximg->image->bytes_per_line;
+    for (x = 0; x < image->width; x++, ptr += channels) {
+      pixel = ((unsigned long)rtable[ptr[0]] << roffs) | ((unsigned long)gtable[ptr[1]] << goffs) |
+              ((unsigned long)btable[ptr[2]] << boffs);
+      putPixel(ximg->image, native, line, x, y, pixel);
+    }
+  }
+}
+
+/* 4x4 Bayer matrix dithering: cheaper than error diffusion and without its
+ * "worms", pixels don't depend on neighbours */
+static void convertTrueColor_ordered(RXImage *ximg, RImage *image, const unsigned short *rtable,
+                                     const unsigned short *gtable, const unsigned short *btable,
+                                     const unsigned short rmask, const unsigned short gmask,
+                                     const unsigned short bmask, const unsigned short roffs,
+                                     const unsigned short goffs, const unsigned short boffs)
+{
+  static const unsigned char bayer[16] = {0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5};
+  int rd[16], gd[16], bd[16];
+  unsigned char *ptr = image->data;
+  int channels = (HAS_ALPHA(image) ? 4 : 3);
+  int native = isNativeXImage(ximg->image);
+  unsigned long pixel;
+  const int *rrow, *grow, *brow;
+  char *line;
+  int i, x, y, r, g, b;
+
+  /* thresholds from -1/2 to +1/2 of the channel quantization step */
+  for (i = 0; i < 16; i++) {
+    rd[i] = (2 * bayer[i] + 1 - 16) * 0xff / (32 * rmask);
+    gd[i] = (2 * bayer[i] + 1 - 16) * 0xff / (32 * gmask);
+    bd[i] = (2 * bayer[i] + 1 - 16) * 0xff / (32 * bmask);
+  }
+
+  for (y = 0; y < image->height; y++) {
+    line = ximg->image->data + y * ximg->image->bytes_per_line;
+    rrow = rd + (y & 3) * 4;
+    grow = gd + (y & 3) * 4;
+    brow = bd + (y & 3) * 4;
+    for (x = 0; x < image->width; x++, ptr += channels) {
+      r = ptr[0] + rrow[x & 3];
+      g = ptr[1] + grow[x & 3];
+      b = ptr[2] + brow[x & 3];
+      r = r < 0 ? 0 : (r > 0xff ? 0xff : r);
+      g = g < 0 ? 0 : (g > 0xff ? 0xff : g);
+      b = b < 0 ? 0 : (b > 0xff ? 0xff : b);
+      pixel = ((unsigned long)rtable[r] << roffs) | ((unsigned long)gtable[g] << goffs) |
+              ((unsigned long)btable[b] << boffs);
+      putPixel(ximg->image, native, line, x, y, pixel);
+    }
+  }
+}
+
 static RXImage *image2TrueColor(RContext *ctx, RImage *image)
 {
   RXImage *ximg;
   unsigned short rmask, gmask, bmask;
   unsigned short roffs, goffs, boffs;
   unsigned short *rtable, *gtable, *btable;
-  int channels = (HAS_ALPHA(image) ? 4 : 3);
 
   ximg = RCreateXImage(ctx, ctx->depth, image->width, image->height);
   if (!ximg) {
@@ -319,40 +448,29 @@ static RXImage *image2TrueColor(RContext *ctx, RImage *image)
     return NULL;
   }
 
-  if (ctx->attribs->render_mode == RBestMatchRendering) {
-    int ofs;
-    unsigned long r, g, b;
-    int x, y;
-    unsigned long pixel;
-    unsigned char *ptr = image->data;
-
-    /* fake match */
+  if (rmask >= 0xff && gmask >= 0xff && bmask >= 0xff) {
+    /* 8 or more bits per channel: dithering makes no difference */
 #ifdef WRLIB_DEBUG
     fputs("true color match\n", stderr);
 #endif
-    if (rmask == 0xff && gmask == 0xff && bmask == 0xff) {
-      for (y = 0; y < image->height; y++) {
-        for (x = 0; x < image->width; x++, ptr += channels) {
-          /* reduce pixel */
-          r = ptr[0];
-          g = ptr[1];
-          b = ptr[2];
-          pixel = (r << roffs) | (g << goffs) | (b << boffs);
-          XPutPixel(ximg->image, x, y, pixel);
-        }
-      }
+    if (rmask == 0xff && gmask == 0xff && bmask == 0xff && ximg->image->bits_per_pixel == 32 &&
+        isNativeXImage(ximg->image)) {
+      convertTrueColor_32(ximg, image, roffs, goffs, boffs);
     } else {
-      for (y = 0, ofs = 0; y < image->height; y++) {
-        for (x = 0; x < image->width; x++, ofs += channels - 3) {
-          /* reduce pixel */
-          r = rtable[ptr[ofs++]];
-          g = gtable[ptr[ofs++]];
-          b = btable[ptr[ofs++]];
-          pixel = (r << roffs) | (g << goffs) | (b << boffs);
-          XPutPixel(ximg->image, x, y, pixel);
-        }
-      }
+      convertTrueColor_match(ximg, image, rtable, gtable, btable, roffs, goffs, boffs);
     }
+  } else if (ctx->attribs->render_mode == RBestMatchRendering) {
+    /* fake match */
+#ifdef WRLIB_DEBUG
+    fputs("true color match\n", stderr);
+#endif
+    convertTrueColor_match(ximg, image, rtable, gtable, btable, roffs, goffs, boffs);
+  } else if (ctx->attribs->render_mode == ROrderedDitherRendering) {
+#ifdef WRLIB_DEBUG
+    fputs("true color ordered dither\n", stderr);
+#endif
+    convertTrueColor_ordered(ximg, image, rtable, gtable, btable, rmask, gmask, bmask, roffs,
+                             goffs, boffs);
   } else {
     /* dither */
     const int dr = 0xff / rmask;
@@ -846,16 +964,9 @@ static RXImage *image2Bitmap(RContext *ctx, RImage *image, int threshold)
   return ximg;
 }
 
-int RConvertImage(RContext *context, RImage *image, Pixmap *pixmap)
+RXImage *r_convert_to_ximage(RContext *context, RImage *image)
 {
   RXImage *ximg = NULL;
-#ifdef USE_XSHM
-  Pixmap tmp;
-#endif
-
-  assert(context != NULL);
-  assert(image != NULL);
-  assert(pixmap != NULL);
 
   switch (context->vclass) {
     case TrueColor:
@@ -876,6 +987,21 @@ int RConvertImage(RContext *context, RImage *image, Pixmap *pixmap)
       break;
   }
 
+  return ximg;
+}
+
+int RConvertImage(RContext *context, RImage *image, Pixmap *pixmap)
+{
+  RXImage *ximg = NULL;
+#ifdef USE_XSHM
+  Pixmap tmp;
+#endif
+
+  assert(context != NULL);
+  assert(image != NULL);
+  assert(pixmap != NULL);
+
+  ximg = r_convert_to_ximage(context, image);
   if (!ximg) {
     return False;
   }
@@ -35,5 +35,11 @@
  */
 void r_destroy_conversion_tables(void);
 
+/*
+ * Converts image to XImage of the context visual (shared memory one if
+ * MIT-SHM is used)
+ */
+RXImage *r_convert_to_ximage(RContext *context, RImage *image);
+
 
 #endif
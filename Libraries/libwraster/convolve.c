@@ -25,6 +25,64 @@
 #include <X11/Xlib.h>
 
 #include "wraster.h"
+#include "parallel.h"
+
+#define MASK(prev, cur, next, ch)                                                              \
+  (*(prev - ch) + *prev + *(prev + ch) + *(cur - ch) + 2 * *cur + *(cur + ch) + *(next - ch) + \
+   *next + *(next + ch)) /                                                                     \
+      10
+
+/*
+ * Image is blurred in place, row by row from the top, original values of
+ * the previous and current rows are kept in buffers. Bands of rows are
+ * blurred in parallel: every band has a copy of the rows above and below
+ * it, both made before bands are processed.
+ */
+typedef struct {
+  RImage *image;
+  unsigned char *rows; /* 3 lines for every band: previous, current and the row below */
+} BlurJob;
+
+static inline void blurRows(RImage *image, unsigned y0, unsigned y1, unsigned char *prev,
+                            unsigned char *cur, const unsigned char *below, const int ch)
+{
+  unsigned lineSize = image->width * ch;
+  unsigned count = (image->width - 2) * ch;
+  unsigned char *ptr, *tmp;
+  const unsigned char *next, *p, *c, *n;
+  unsigned x, y;
+
+  for (y = y0; y < y1; y++) {
+    ptr = image->data + y * lineSize;
+    next = (y + 1 < y1) ? ptr + lineSize : below;
+    memcpy(cur, ptr, lineSize);
+
+    for (x = 0; x < count; x++) {
+      p = prev + ch + x;
+      c = cur + ch + x;
+      n = next + ch + x;
+      ptr[ch + x] = MASK(p, c, n, ch);
+    }
+
+    tmp = prev;
+    prev = cur;
+    cur = tmp;
+  }
+}
+
+static void blurBand(void *data, int band, unsigned y0, unsigned y1)
+{
+  BlurJob *job = data;
+  int ch = job->image->format == RRGBAFormat ? 4 : 3;
+  unsigned lineSize = job->image->width * ch;
+  unsigned char *prev = job->rows + 3 * band * lineSize;
+
+  /* band rows are counted from the second row of the image */
+  if (ch == 4)
+    blurRows(job->image, y0 + 1, y1 + 1, prev, prev + lineSize, prev + 2 * lineSize, 4);
+  else
+    blurRows(job->image, y0 + 1, y1 + 1, prev, prev + lineSize, prev + 2 * lineSize, 3);
+}
 
 /*
  *----------------------------------------------------------------------
@@ -32,108 +90,42 @@
  * 	Apply 3x3 1 1 1 low pass, convolution mask to image.
  *                1 2 1
  *                1 1 1 /10
+ *      Border pixels are left as is.
  *----------------------------------------------------------------------
  */
 int RBlurImage(RImage *image)
 {
-  register int x, y;
-  register int tmp;
-  unsigned char *ptr, *nptr;
-  unsigned char *pptr = NULL, *tmpp;
+  BlurJob job;
   int ch = image->format == RRGBAFormat ? 4 : 3;
-
-  pptr = malloc(image->width * ch);
-  if (!pptr) {
+  unsigned lineSize = image->width * ch;
+  unsigned rows, y0, y1;
+  unsigned char *prev;
+  int band, nbands;
+
+  if (image->width < 3 || image->height < 3)
+    return True;
+  rows = image->height - 2;
+
+  nbands = r_parallel_bands(image->width * image->height, rows);
+  job.image = image;
+  job.rows = malloc(3 * nbands * lineSize);
+  if (!job.rows) {
     RErrorCode = RERR_NOMEMORY;
     return False;
   }
-#define MASK(prev, cur, next, ch)                                                              \
-  (*(prev - ch) + *prev + *(prev + ch) + *(cur - ch) + 2 * *cur + *(cur + ch) + *(next - ch) + \
-   *next + *(next + ch)) /                                                                     \
-      10
 
-  memcpy(pptr, image->data, image->width * ch);
-
-  ptr = image->data;
-  nptr = ptr + image->width * ch;
-  tmpp = pptr;
-
-  if (ch == 3) {
-    ptr += 3;
-    nptr += 3;
-    pptr += 3;
-
-    for (y = 1; y < image->height - 1; y++) {
-      for (x = 1; x < image->width - 1; x++) {
-        tmp = *ptr;
-        *ptr = MASK(pptr, ptr, nptr, 3);
-        *pptr = tmp;
-        ptr++;
-        nptr++;
-        pptr++;
-
-        tmp = *ptr;
-        *ptr = MASK(pptr, ptr, nptr, 3);
-        *pptr = tmp;
-        ptr++;
-        nptr++;
-        pptr++;
-
-        tmp = *ptr;
-        *ptr = MASK(pptr, ptr, nptr, 3);
-        *pptr = tmp;
-        ptr++;
-        nptr++;
-        pptr++;
-      }
-      pptr = tmpp;
-      ptr += 6;
-      nptr += 6;
-      pptr += 6;
-    }
-  } else {
-    ptr += 4;
-    nptr += 4;
-    pptr += 4;
-
-    for (y = 1; y < image->height - 1; y++) {
-      for (x = 1; x < image->width - 1; x++) {
-        tmp = *ptr;
-        *ptr = MASK(pptr, ptr, nptr, 4);
-        *pptr = tmp;
-        ptr++;
-        nptr++;
-        pptr++;
-
-        tmp = *ptr;
-        *ptr = MASK(pptr, ptr, nptr, 4);
-        *pptr = tmp;
-        ptr++;
-        nptr++;
-        pptr++;
-
-        tmp = *ptr;
-        *ptr = MASK(pptr, ptr, nptr, 4);
-        *pptr = tmp;
-        ptr++;
-        nptr++;
-        pptr++;
-
-        tmp = *ptr;
-        *ptr = MASK(pptr, ptr, nptr, 4);
-        *pptr = tmp;
-        ptr++;
-        nptr++;
-        pptr++;
-      }
-      pptr = tmpp;
-      ptr += 8;
-      nptr += 8;
-      pptr += 8;
-    }
+  for (band = 0; band < nbands; band++) {
+    y0 = (unsigned long)rows * band / nbands + 1;
+    y1 = (unsigned long)rows * (band + 1) / nbands + 1;
+    prev = job.rows + 3 * band * lineSize;
+
+    memcpy(prev, image->data + (y0 - 1) * lineSize, lineSize);
+    memcpy(prev + 2 * lineSize, image->data + y1 * lineSize, lineSize);
   }
 
-  free(tmpp);
+  r_parallel_run(blurBand, &job, rows, nbands);
+
+  free(job.rows);
 
   return True;
 }
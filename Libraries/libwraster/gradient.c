@@ -28,6 +28,7 @@
 #include <assert.h>
 
 #include "wraster.h"
+#include "parallel.h"
 
 static RImage *renderHGradient(unsigned width, unsigned height, int r0, int g0, int b0, int rf,
                                int gf, int bf);
@@ -85,6 +86,66 @@ RImage *RRenderGradient(unsigned width, unsigned height, const RColor *from, con
   return NULL;
 }
 
+/*
+ * Large images are rendered by bands of rows in parallel. Every band
+ * computes colors of its first row from scratch, the results are the same
+ * as of sequential rendering.
+ */
+
+static void copyFirstLineBand(void *data, int band, unsigned y0, unsigned y1)
+{
+  RImage *image = data;
+  unsigned lineSize = image->width * 3;
+  unsigned i;
+
+  for (i = (y0 > 0) ? y0 : 1; i < y1; i++) {
+    memcpy(&(image->data[i * lineSize]), image->data, lineSize);
+  }
+}
+
+/* copy the first line to the other lines */
+static void copyFirstLine(RImage *image)
+{
+  r_parallel_run(copyFirstLineBand, image, image->height,
+                 r_parallel_bands(image->width * image->height, image->height));
+}
+
+typedef struct {
+  RImage *image;
+  const unsigned char *line; /* gradient line, 2 * width - 1 pixels */
+  float a;
+} DiagonalJob;
+
+static void copyDiagonalBand(void *data, int band, unsigned y0, unsigned y1)
+{
+  DiagonalJob *job = data;
+  unsigned lineSize = job->image->width * 3;
+  float offset;
+  unsigned j;
+
+  /* offset is accumulated the same way for every band to get the same rounding */
+  for (j = 0, offset = 0.0; j < y0; j++) {
+    offset += job->a;
+  }
+  for (j = y0; j < y1; j++) {
+    memcpy(&(job->image->data[j * lineSize]), &job->line[3 * (int)offset], lineSize);
+    offset += job->a;
+  }
+}
+
+/* copy the gradient line to the image lines with corresponding offset */
+static void copyDiagonalLines(RImage *image, RImage *line)
+{
+  DiagonalJob job;
+
+  job.image = image;
+  job.line = line->data;
+  job.a = ((float)(image->width - 1)) / ((float)(image->height - 1));
+
+  r_parallel_run(copyDiagonalBand, &job, image->height,
+                 r_parallel_bands(image->width * image->height, image->height));
+}
+
 /*
  *----------------------------------------------------------------------
  * renderHGradient--
@@ -103,7 +164,6 @@ static RImage *renderHGradient(unsigned width, unsigned height, int r0, int g0,
 {
   int i;
   long r, g, b, dr, dg, db;
-  unsigned lineSize = width * 3;
   RImage *image;
   unsigned char *ptr;
 
@@ -130,10 +190,7 @@ static RImage *renderHGradient(unsigned width, unsigned height, int r0, int g0,
     b += db;
   }
 
-  /* copy the first line to the other lines */
-  for (i = 1; i < height; i++) {
-    memcpy(&(image->data[i * lineSize]), image->data, lineSize);
-  }
+  copyFirstLine(image);
   return image;
 }
 
@@ -192,35 +249,51 @@ static inline unsigned char *renderGradientWidth(unsigned char *ptr, unsigned wi
  *      None
  *----------------------------------------------------------------------
  */
+typedef struct {
+  RImage *image;
+  long r, g, b, dr, dg, db;
+} VGradientJob;
+
+static void renderVGradientBand(void *data, int band, unsigned y0, unsigned y1)
+{
+  VGradientJob *job = data;
+  unsigned char *ptr = job->image->data + y0 * job->image->width * 3;
+  long r, g, b;
+  unsigned i;
+
+  r = job->r + y0 * job->dr;
+  g = job->g + y0 * job->dg;
+  b = job->b + y0 * job->db;
+
+  for (i = y0; i < y1; i++) {
+    ptr = renderGradientWidth(ptr, job->image->width, r >> 16, g >> 16, b >> 16);
+    r += job->dr;
+    g += job->dg;
+    b += job->db;
+  }
+}
+
 static RImage *renderVGradient(unsigned width, unsigned height, int r0, int g0, int b0, int rf,
                                int gf, int bf)
 {
-  int i;
-  long r, g, b, dr, dg, db;
-  RImage *image;
-  unsigned char *ptr;
+  VGradientJob job;
 
-  image = RCreateImage(width, height, False);
-  if (!image) {
+  job.image = RCreateImage(width, height, False);
+  if (!job.image) {
     return NULL;
   }
-  ptr = image->data;
 
-  r = r0 << 16;
-  g = g0 << 16;
-  b = b0 << 16;
+  job.r = r0 << 16;
+  job.g = g0 << 16;
+  job.b = b0 << 16;
 
-  dr = ((rf - r0) << 16) / (int)height;
-  dg = ((gf - g0) << 16) / (int)height;
-  db = ((bf - b0) << 16) / (int)height;
+  job.dr = ((rf - r0) << 16) / (int)height;
+  job.dg = ((gf - g0) << 16) / (int)height;
+  job.db = ((bf - b0) << 16) / (int)height;
 
-  for (i = 0; i < height; i++) {
-    ptr = renderGradientWidth(ptr, width, r >> 16, g >> 16, b >> 16);
-    r += dr;
-    g += dg;
-    b += db;
-  }
-  return image;
+  r_parallel_run(renderVGradientBand, &job, height, r_parallel_bands(width * height, height));
+
+  return job.image;
 }
 
 /*
@@ -241,9 +314,6 @@ static RImage *renderDGradient(unsigned width, unsigned height, int r0, int g0,
                                int gf, int bf)
 {
   RImage *image, *tmp;
-  int j;
-  float a, offset;
-  unsigned char *ptr;
 
   if (width == 1)
     return renderVGradient(width, height, r0, g0, b0, rf, gf, bf);
@@ -261,16 +331,7 @@ static RImage *renderDGradient(unsigned width, unsigned height, int r0, int g0,
     return NULL;
   }
 
-  ptr = tmp->data;
-
-  a = ((float)(width - 1)) / ((float)(height - 1));
-  width = width * 3;
-
-  /* copy the first line to the other lines with corresponding offset */
-  for (j = 0, offset = 0.0; j < width * height; j += width) {
-    memcpy(&(image->data[j]), &ptr[3 * (int)offset], width);
-    offset += a;
-  }
+  copyDiagonalLines(image, tmp);
 
   RReleaseImage(tmp);
   return image;
@@ -280,7 +341,6 @@ static RImage *renderMHGradient(unsigned width, unsigned height, RColor **colors
 {
   int i, j, k;
   long r, g, b, dr, dg, db;
-  unsigned lineSize = width * 3;
   RImage *image;
   unsigned char *ptr;
   unsigned width2;
@@ -331,79 +391,78 @@ static RImage *renderMHGradient(unsigned width, unsigned height, RColor **colors
     *ptr++ = (unsigned char)(b >> 16);
   }
 
-  /* copy the first line to the other lines */
-  for (i = 1; i < height; i++) {
-    memcpy(&(image->data[i * lineSize]), image->data, lineSize);
-  }
+  copyFirstLine(image);
   return image;
 }
 
-static RImage *renderMVGradient(unsigned width, unsigned height, RColor **colors, int count)
+typedef struct {
+  RImage *image;
+  RColor **colors;
+  int count;
+  unsigned height2; /* of every color transition */
+} MVGradientJob;
+
+static void renderMVGradientBand(void *data, int band, unsigned y0, unsigned y1)
 {
-  int i, j, k;
+  MVGradientJob *job = data;
+  RColor **colors = job->colors;
+  unsigned char *ptr = job->image->data + y0 * job->image->width * 3;
+  unsigned gradientHeight = (job->count - 1) * job->height2;
   long r, g, b, dr, dg, db;
-  unsigned lineSize = width * 3;
-  RImage *image;
-  unsigned char *ptr, *tmp;
-  unsigned height2;
+  unsigned i, j, k;
+
+  for (k = y0; k < y1 && k < gradientHeight; k++) {
+    /* row `j` of transition from colors[i - 1] to colors[i] */
+    i = k / job->height2 + 1;
+    j = k % job->height2;
+
+    dr = ((int)(colors[i]->red - colors[i - 1]->red) << 16) / (int)job->height2;
+    dg = ((int)(colors[i]->green - colors[i - 1]->green) << 16) / (int)job->height2;
+    db = ((int)(colors[i]->blue - colors[i - 1]->blue) << 16) / (int)job->height2;
+
+    r = (colors[i - 1]->red << 16) + j * dr;
+    g = (colors[i - 1]->green << 16) + j * dg;
+    b = (colors[i - 1]->blue << 16) + j * db;
+
+    ptr = renderGradientWidth(ptr, job->image->width, r >> 16, g >> 16, b >> 16);
+  }
+
+  /* the rest is filled with the last color */
+  for (; k < y1; k++) {
+    ptr = renderGradientWidth(ptr, job->image->width, colors[job->count - 1]->red,
+                              colors[job->count - 1]->green, colors[job->count - 1]->blue);
+  }
+}
+
+static RImage *renderMVGradient(unsigned width, unsigned height, RColor **colors, int count)
+{
+  MVGradientJob job;
 
   assert(count > 2);
 
-  image = RCreateImage(width, height, False);
-  if (!image) {
+  job.image = RCreateImage(width, height, False);
+  if (!job.image) {
     return NULL;
   }
-  ptr = image->data;
 
   if (count > height)
     count = height;
 
+  job.colors = colors;
+  job.count = count;
   if (count > 1)
-    height2 = height / (count - 1);
+    job.height2 = height / (count - 1);
   else
-    height2 = height;
-
-  k = 0;
-
-  r = colors[0]->red << 16;
-  g = colors[0]->green << 16;
-  b = colors[0]->blue << 16;
-
-  for (i = 1; i < count; i++) {
-    dr = ((int)(colors[i]->red - colors[i - 1]->red) << 16) / (int)height2;
-    dg = ((int)(colors[i]->green - colors[i - 1]->green) << 16) / (int)height2;
-    db = ((int)(colors[i]->blue - colors[i - 1]->blue) << 16) / (int)height2;
-
-    for (j = 0; j < height2; j++) {
-      ptr = renderGradientWidth(ptr, width, r >> 16, g >> 16, b >> 16);
-      r += dr;
-      g += dg;
-      b += db;
-      k++;
-    }
-    r = colors[i]->red << 16;
-    g = colors[i]->green << 16;
-    b = colors[i]->blue << 16;
-  }
+    job.height2 = height;
 
-  if (k < height) {
-    tmp = ptr;
-    ptr = renderGradientWidth(ptr, width, r >> 16, g >> 16, b >> 16);
-    for (j = k + 1; j < height; j++) {
-      memcpy(ptr, tmp, lineSize);
-      ptr += lineSize;
-    }
-  }
+  r_parallel_run(renderMVGradientBand, &job, height, r_parallel_bands(width * height, height));
 
-  return image;
+  return job.image;
 }
 
 static RImage *renderMDGradient(unsigned width, unsigned height, RColor **colors, int count)
 {
   RImage *image, *tmp;
-  float a, offset;
-  int j;
-  unsigned char *ptr;
 
   assert(count > 2);
 
@@ -433,74 +492,77 @@ static RImage *renderMDGradient(unsigned width, unsigned height, RColor **colors
     RReleaseImage(image);
     return NULL;
   }
-  ptr = tmp->data;
+  copyDiagonalLines(image, tmp);
 
-  a = ((float)(width - 1)) / ((float)(height - 1));
-  width = width * 3;
-
-  /* copy the first line to the other lines with corresponding offset */
-  for (j = 0, offset = 0; j < width * height; j += width) {
-    memcpy(&(image->data[j]), &ptr[3 * (int)offset], width);
-    offset += a;
-  }
   RReleaseImage(tmp);
   return image;
 }
 
+typedef struct {
+  RImage *image;
+  int thickness1, thickness2;
+  long r1, g1, b1, dr1, dg1, db1;
+  long r2, g2, b2, dr2, dg2, db2;
+} InterwovenGradientJob;
+
+/* Returns 0 if row `i` belongs to stripe of the first gradient, 1 otherwise */
+static inline int interwovenStripe(InterwovenGradientJob *job, unsigned i)
+{
+  if (job->thickness1 <= 0)
+    return 0;
+  if (job->thickness2 <= 0)
+    return i >= job->thickness1;
+
+  return (i % (job->thickness1 + job->thickness2)) >= job->thickness1;
+}
+
+static void renderInterwovenGradientBand(void *data, int band, unsigned y0, unsigned y1)
+{
+  InterwovenGradientJob *job = data;
+  unsigned char *ptr = job->image->data + y0 * job->image->width * 3;
+  unsigned i;
+
+  for (i = y0; i < y1; i++) {
+    if (interwovenStripe(job, i) == 0)
+      ptr = renderGradientWidth(ptr, job->image->width, (job->r1 + i * job->dr1) >> 16,
+                                (job->g1 + i * job->dg1) >> 16, (job->b1 + i * job->db1) >> 16);
+    else
+      ptr = renderGradientWidth(ptr, job->image->width, (job->r2 + i * job->dr2) >> 16,
+                                (job->g2 + i * job->dg2) >> 16, (job->b2 + i * job->db2) >> 16);
+  }
+}
+
 RImage *RRenderInterwovenGradient(unsigned width, unsigned height, RColor colors1[2],
                                   int thickness1, RColor colors2[2], int thickness2)
 {
-  int i, k, l, ll;
-  long r1, g1, b1, dr1, dg1, db1;
-  long r2, g2, b2, dr2, dg2, db2;
-  RImage *image;
-  unsigned char *ptr;
+  InterwovenGradientJob job;
 
-  image = RCreateImage(width, height, False);
-  if (!image) {
+  job.image = RCreateImage(width, height, False);
+  if (!job.image) {
     return NULL;
   }
-  ptr = image->data;
 
-  r1 = colors1[0].red << 16;
-  g1 = colors1[0].green << 16;
-  b1 = colors1[0].blue << 16;
+  job.thickness1 = thickness1;
+  job.thickness2 = thickness2;
 
-  r2 = colors2[0].red << 16;
-  g2 = colors2[0].green << 16;
-  b2 = colors2[0].blue << 16;
+  job.r1 = colors1[0].red << 16;
+  job.g1 = colors1[0].green << 16;
+  job.b1 = colors1[0].blue << 16;
 
-  dr1 = ((colors1[1].red - colors1[0].red) << 16) / (int)height;
-  dg1 = ((colors1[1].green - colors1[0].green) << 16) / (int)height;
-  db1 = ((colors1[1].blue - colors1[0].blue) << 16) / (int)height;
+  job.r2 = colors2[0].red << 16;
+  job.g2 = colors2[0].green << 16;
+  job.b2 = colors2[0].blue << 16;
 
-  dr2 = ((colors2[1].red - colors2[0].red) << 16) / (int)height;
-  dg2 = ((colors2[1].green - colors2[0].green) << 16) / (int)height;
-  db2 = ((colors2[1].blue - colors2[0].blue) << 16) / (int)height;
+  job.dr1 = ((colors1[1].red - colors1[0].red) << 16) / (int)height;
+  job.dg1 = ((colors1[1].green - colors1[0].green) << 16) / (int)height;
+  job.db1 = ((colors1[1].blue - colors1[0].blue) << 16) / (int)height;
 
-  for (i = 0, k = 0, l = 0, ll = thickness1; i < height; i++) {
-    if (k == 0)
-      ptr = renderGradientWidth(ptr, width, r1 >> 16, g1 >> 16, b1 >> 16);
-    else
-      ptr = renderGradientWidth(ptr, width, r2 >> 16, g2 >> 16, b2 >> 16);
-
-    if (++l == ll) {
-      if (k == 0) {
-        k = 1;
-        ll = thickness2;
-      } else {
-        k = 0;
-        ll = thickness1;
-      }
-      l = 0;
-    }
-    r1 += dr1;
-    g1 += dg1;
-    b1 += db1;
+  job.dr2 = ((colors2[1].red - colors2[0].red) << 16) / (int)height;
+  job.dg2 = ((colors2[1].green - colors2[0].green) << 16) / (int)height;
+  job.db2 = ((colors2[1].blue - colors2[0].blue) << 16) / (int)height;
 
-    r2 += dr2;
-    g2 += dg2;
-    b2 += db2;
-  }
-  return image;
+  r_parallel_run(renderInterwovenGradientBand, &job, height,
+                 r_parallel_bands(width * height, height));
+
+  return job.image;
 }
@@ -37,11 +37,37 @@
 #include "imgformat.h"
 #include "wr_i18n.h"
 
+/*
+ * Loaded images are cached in memory. Entry is identified by file name, image
+ * index and size: scaled variants of the same image are cached separately
+ * (width and height of original image entry are 0). Every entry knows size
+ * of the original image, so images too large to be cached are not loaded to
+ * find their cached scaled variant. Entries are found by hash
+ * and evicted in least recently used order when the number of entries or the
+ * amount of memory they use exceeds the limits.
+ */
 typedef struct RCachedImage {
+  struct RCachedImage *hash_next;
+  struct RCachedImage *lru_prev; /* more recently used */
+  struct RCachedImage *lru_next; /* less recently used */
+
   RImage *image;
+  size_t bytes;
+
   char *file;
+  unsigned hash; /* of file name */
+  int index;
+  unsigned width;
+  unsigned height;
+  unsigned orig_width; /* of image loaded from file */
+  unsigned orig_height;
+
+  /* file the image was loaded from */
+  dev_t dev;
+  ino_t ino;
+  off_t size;
   time_t last_modif; /* last time file was modified */
-  time_t last_use;   /* last time image was used */
+  time_t last_check; /* last time file was stat()'ed */
 } RCachedImage;
 
 /*
@@ -49,18 +75,39 @@ typedef struct RCachedImage {
  */
 static int RImageCacheSize = -1;
 
-#define IMAGE_CACHE_DEFAULT_NBENTRIES 8
-#define IMAGE_CACHE_MAXIMUM_NBENTRIES 256
+#define IMAGE_CACHE_DEFAULT_NBENTRIES 128
+#define IMAGE_CACHE_MAXIMUM_NBENTRIES 4096
 
 /*
  * Max. size of image (in pixels) to store in the cache
  */
 static int RImageCacheMaxImage = -1; /* 0 = any size */
 
-#define IMAGE_CACHE_DEFAULT_MAXPIXELS (64 * 64)
-#define IMAGE_CACHE_MAXIMUM_MAXPIXELS (256 * 256)
+#define IMAGE_CACHE_DEFAULT_MAXPIXELS (256 * 256)
+#define IMAGE_CACHE_MAXIMUM_MAXPIXELS (1024 * 1024)
 
-static RCachedImage *RImageCache;
+/*
+ * Memory (in kilobytes) used by images in the cache
+ */
+static int RImageCacheMemory = -1;
+
+#define IMAGE_CACHE_DEFAULT_MEMORY (8 * 1024)
+#define IMAGE_CACHE_MAXIMUM_MEMORY (256 * 1024)
+
+/*
+ * Cached file is checked for modification not more often than once in
+ * this number of seconds
+ */
+#define IMAGE_CACHE_CHECK_INTERVAL 1
+
+static struct {
+  RCachedImage **buckets;
+  unsigned mask;
+  RCachedImage *lru_first; /* most recently used */
+  RCachedImage *lru_last;  /* least recently used */
+  int count;
+  size_t bytes;
+} RImageCache;
 
 static WRImgFormat identFile(const char *path);
 
@@ -102,6 +149,7 @@ char **RSupportedFileFormats(void)
 static void init_cache(void)
 {
   char *tmp;
+  unsigned nbuckets;
 
   tmp = getenv("RIMAGE_CACHE");
   if (!tmp || sscanf(tmp, "%i", &RImageCacheSize) != 1)
@@ -119,61 +167,207 @@ static void init_cache(void)
   if (RImageCacheMaxImage > IMAGE_CACHE_MAXIMUM_MAXPIXELS)
     RImageCacheMaxImage = IMAGE_CACHE_MAXIMUM_MAXPIXELS;
 
+  tmp = getenv("RIMAGE_CACHE_MEMORY");
+  if (!tmp || sscanf(tmp, "%i", &RImageCacheMemory) != 1)
+    RImageCacheMemory = IMAGE_CACHE_DEFAULT_MEMORY;
+  if (RImageCacheMemory < 0)
+    RImageCacheMemory = 0;
+  if (RImageCacheMemory > IMAGE_CACHE_MAXIMUM_MEMORY)
+    RImageCacheMemory = IMAGE_CACHE_MAXIMUM_MEMORY;
+
+  if (RImageCacheMemory == 0)
+    RImageCacheSize = 0;
+
   if (RImageCacheSize > 0) {
-    RImageCache = malloc(sizeof(RCachedImage) * RImageCacheSize);
-    if (RImageCache == NULL) {
+    /* keep chains short: at least one bucket per entry */
+    for (nbuckets = 64; nbuckets < RImageCacheSize; nbuckets <<= 1)
+      ;
+    RImageCache.buckets = calloc(nbuckets, sizeof(RCachedImage *));
+    if (RImageCache.buckets == NULL) {
       fprintf(stderr, _("wrlib: out of memory for image cache\n"));
+      RImageCacheSize = 0;
       return;
     }
-    memset(RImageCache, 0, sizeof(RCachedImage) * RImageCacheSize);
+    RImageCache.mask = nbuckets - 1;
   }
 }
 
-void RReleaseCache(void)
+/* FNV-1a */
+static unsigned hash_file_name(const char *file)
 {
-  int i;
+  unsigned hash = 2166136261u;
 
-  if (RImageCacheSize > 0) {
-    for (i = 0; i < RImageCacheSize; i++) {
-      if (RImageCache[i].file) {
-        RReleaseImage(RImageCache[i].image);
-        free(RImageCache[i].file);
-      }
-    }
-    free(RImageCache);
-    RImageCache = NULL;
-    RImageCacheSize = -1;
+  while (*file) {
+    hash ^= (unsigned char)*file++;
+    hash *= 16777619u;
   }
+  return hash;
 }
 
-RImage *RLoadImage(RContext *context, const char *file, int index)
+static void lru_unlink(RCachedImage *entry)
 {
-  RImage *image = NULL;
-  int i;
-  struct stat st;
+  if (entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    RImageCache.lru_first = entry->lru_next;
+
+  if (entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    RImageCache.lru_last = entry->lru_prev;
+}
 
-  assert(file != NULL);
+static void lru_push_first(RCachedImage *entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = RImageCache.lru_first;
+  if (RImageCache.lru_first)
+    RImageCache.lru_first->lru_prev = entry;
+  else
+    RImageCache.lru_last = entry;
+  RImageCache.lru_first = entry;
+}
 
-  if (RImageCacheSize < 0)
-    init_cache();
+static void cache_remove(RCachedImage *entry)
+{
+  RCachedImage **link = &RImageCache.buckets[entry->hash & RImageCache.mask];
 
-  if (RImageCacheSize > 0) {
-    for (i = 0; i < RImageCacheSize; i++) {
-      if (RImageCache[i].file && strcmp(file, RImageCache[i].file) == 0) {
-        if (stat(file, &st) == 0 && st.st_mtime == RImageCache[i].last_modif) {
-          RImageCache[i].last_use = time(NULL);
-
-          return RCloneImage(RImageCache[i].image);
-
-        } else {
-          free(RImageCache[i].file);
-          RImageCache[i].file = NULL;
-          RReleaseImage(RImageCache[i].image);
-        }
-      }
+  while (*link != entry)
+    link = &(*link)->hash_next;
+  *link = entry->hash_next;
+
+  lru_unlink(entry);
+  RImageCache.count--;
+  RImageCache.bytes -= entry->bytes;
+
+  /* image is freed here only if nobody else holds a reference */
+  RReleaseImage(entry->image);
+  free(entry->file);
+  free(entry);
+}
+
+/* Removes all images (of any index and size) loaded from the file */
+static void cache_remove_file(const char *file, unsigned hash)
+{
+  RCachedImage *entry, *next;
+
+  for (entry = RImageCache.buckets[hash & RImageCache.mask]; entry; entry = next) {
+    next = entry->hash_next;
+    if (entry->hash == hash && strcmp(entry->file, file) == 0)
+      cache_remove(entry);
+  }
+}
+
+/* Size of cache entry to be found by cache_find(): original or any scaled */
+#define ANY_SIZE ((unsigned)-1)
+
+/*
+ * Returns valid cache entry and marks it as most recently used or NULL if
+ * there's no such entry or the file was changed since image was loaded
+ */
+static RCachedImage *cache_find(const char *file, int index, unsigned width, unsigned height)
+{
+  RCachedImage *entry;
+  unsigned hash;
+  time_t now;
+  struct stat st;
+
+  if (RImageCacheSize <= 0)
+    return NULL;
+
+  hash = hash_file_name(file);
+  for (entry = RImageCache.buckets[hash & RImageCache.mask]; entry; entry = entry->hash_next) {
+    if (entry->hash == hash && entry->index == index &&
+        (width == ANY_SIZE || (entry->width == width && entry->height == height)) &&
+        strcmp(entry->file, file) == 0)
+      break;
+  }
+  if (!entry)
+    return NULL;
+
+  now = time(NULL);
+  if (now - entry->last_check >= IMAGE_CACHE_CHECK_INTERVAL || now < entry->last_check) {
+    if (stat(file, &st) != 0 || st.st_dev != entry->dev || st.st_ino != entry->ino ||
+        st.st_size != entry->size || st.st_mtime != entry->last_modif) {
+      /* scaled variants are out of date too */
+      cache_remove_file(file, hash);
+      return NULL;
     }
+    entry->last_check = now;
+  }
+
+  if (entry != RImageCache.lru_first) {
+    lru_unlink(entry);
+    lru_push_first(entry);
   }
 
+  return entry;
+}
+
+/* Stores reference to the image loaded from file with attributes `st`,
+ * `original` is the image as loaded */
+static void cache_store(const char *file, int index, unsigned width, unsigned height,
+                        const struct stat *st, RImage *original, RImage *image)
+{
+  RCachedImage *entry;
+  size_t bytes, max_bytes;
+  unsigned pixels = image->width * image->height;
+
+  if (RImageCacheSize <= 0 || (RImageCacheMaxImage > 0 && pixels > (unsigned)RImageCacheMaxImage))
+    return;
+
+  bytes = sizeof(RImage) + (size_t)pixels * (image->format == RRGBAFormat ? 4 : 3);
+  max_bytes = (size_t)RImageCacheMemory * 1024;
+  if (bytes > max_bytes)
+    return;
+
+  entry = calloc(1, sizeof(RCachedImage));
+  if (entry == NULL)
+    return;
+  entry->file = strdup(file);
+  if (entry->file == NULL) {
+    free(entry);
+    return;
+  }
+  entry->hash = hash_file_name(file);
+  entry->index = index;
+  entry->width = width;
+  entry->height = height;
+  entry->orig_width = original->width;
+  entry->orig_height = original->height;
+  entry->image = RRetainImage(image);
+  entry->bytes = bytes;
+  entry->dev = st->st_dev;
+  entry->ino = st->st_ino;
+  entry->size = st->st_size;
+  entry->last_modif = st->st_mtime;
+  entry->last_check = time(NULL);
+
+  /* make room */
+  while (RImageCache.count >= RImageCacheSize || RImageCache.bytes + bytes > max_bytes)
+    cache_remove(RImageCache.lru_last);
+
+  entry->hash_next = RImageCache.buckets[entry->hash & RImageCache.mask];
+  RImageCache.buckets[entry->hash & RImageCache.mask] = entry;
+  lru_push_first(entry);
+  RImageCache.count++;
+  RImageCache.bytes += bytes;
+}
+
+void RReleaseCache(void)
+{
+  while (RImageCache.lru_first)
+    cache_remove(RImageCache.lru_first);
+
+  free(RImageCache.buckets);
+  memset(&RImageCache, 0, sizeof(RImageCache));
+  RImageCacheSize = -1;
+}
+
+static RImage *load_image_file(RContext *context, const char *file, int index)
+{
+  RImage *image = NULL;
+
   switch (identFile(file)) {
     case IM_ERROR:
       return NULL;
@@ -238,50 +432,153 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
   }
 #endif
 
-  /* store image in cache */
-  if (RImageCacheSize > 0 && image &&
-      (RImageCacheMaxImage == 0 || RImageCacheMaxImage >= image->width * image->height)) {
-    time_t oldest = time(NULL);
-    int oldest_idx = 0;
-    int done = 0;
+  return image;
+}
 
-    if (stat(file, &st) != 0) {
-      /* If we can't get the info, at least use a valid time to reduce risk of problems */
-      st.st_mtime = oldest;
-    }
+RImage *RLoadSharedImage(RContext *context, const char *file, int index)
+{
+  RCachedImage *entry;
+  RImage *image;
+  struct stat st;
 
-    for (i = 0; i < RImageCacheSize; i++) {
-      if (!RImageCache[i].file) {
-        RImageCache[i].file = malloc(strlen(file) + 1);
-        strcpy(RImageCache[i].file, file);
-        RImageCache[i].image = RCloneImage(image);
-        RImageCache[i].last_modif = st.st_mtime;
-        RImageCache[i].last_use = time(NULL);
-        done = 1;
-        break;
-      } else {
-        if (oldest > RImageCache[i].last_use) {
-          oldest = RImageCache[i].last_use;
-          oldest_idx = i;
-        }
-      }
-    }
+  assert(file != NULL);
 
-    /* if no slot available, dump least recently used one */
-    if (!done) {
-      free(RImageCache[oldest_idx].file);
-      RReleaseImage(RImageCache[oldest_idx].image);
-      RImageCache[oldest_idx].file = malloc(strlen(file) + 1);
-      strcpy(RImageCache[oldest_idx].file, file);
-      RImageCache[oldest_idx].image = RCloneImage(image);
-      RImageCache[oldest_idx].last_modif = st.st_mtime;
-      RImageCache[oldest_idx].last_use = time(NULL);
-    }
+  if (RImageCacheSize < 0)
+    init_cache();
+
+  entry = cache_find(file, index, 0, 0);
+  if (entry)
+    return RRetainImage(entry->image);
+
+  /* file is stat()'ed before reading: if it's changed while being loaded,
+   * next lookup will notice it */
+  if (RImageCacheSize > 0 && stat(file, &st) == 0) {
+    image = load_image_file(context, file, index);
+    if (image)
+      cache_store(file, index, 0, 0, &st, image, image);
+  } else {
+    image = load_image_file(context, file, index);
   }
 
   return image;
 }
 
+RImage *RLoadImage(RContext *context, const char *file, int index)
+{
+  RImage *image;
+
+  image = RLoadSharedImage(context, file, index);
+  if (!image)
+    return NULL;
+
+  return RMakeImageWritable(image);
+}
+
+RImage *RLoadScaledImage(RContext *context, const char *file, int index, unsigned width,
+                         unsigned height)
+{
+  RCachedImage *entry;
+  RImage *image, *scaled;
+  struct stat st;
+  int cacheable;
+
+  assert(file != NULL);
+
+  if (width == 0 || height == 0) {
+    RErrorCode = RERR_INTERNAL;
+    return NULL;
+  }
+
+  if (RImageCacheSize < 0)
+    init_cache();
+
+  entry = cache_find(file, index, width, height);
+  if (entry)
+    return RRetainImage(entry->image);
+
+  cacheable = (RImageCacheSize > 0 && stat(file, &st) == 0);
+
+  image = RLoadSharedImage(context, file, index);
+  if (!image || (image->width == width && image->height == height))
+    return image;
+
+  scaled = RSmoothScaleImage(image, width, height);
+  if (scaled && cacheable)
+    cache_store(file, index, width, height, &st, image, scaled);
+  RReleaseImage(image);
+
+  return scaled;
+}
+
+/* Size of image `width` x `height` fitted as described for RLoadFittedImage() */
+static Bool fit_size(unsigned max_size, unsigned size, unsigned *width, unsigned *height)
+{
+  if (*width <= max_size && *height <= max_size)
+    return False;
+
+  if (*width > *height) {
+    *height = *height * size / *width;
+    *width = size;
+  } else {
+    *width = *width * size / *height;
+    *height = size;
+  }
+  if (*width == 0)
+    *width = 1;
+  if (*height == 0)
+    *height = 1;
+
+  return True;
+}
+
+RImage *RLoadFittedImage(RContext *context, const char *file, int index, unsigned max_size,
+                         unsigned size)
+{
+  RCachedImage *entry;
+  RImage *image, *scaled;
+  unsigned width, height;
+  struct stat st;
+  int cacheable;
+
+  assert(file != NULL);
+
+  if (size == 0) {
+    RErrorCode = RERR_INTERNAL;
+    return NULL;
+  }
+
+  if (RImageCacheSize < 0)
+    init_cache();
+
+  /* any variant knows the size, file is not loaded if the right one is cached */
+  entry = cache_find(file, index, ANY_SIZE, ANY_SIZE);
+  if (entry) {
+    width = entry->orig_width;
+    height = entry->orig_height;
+    if (fit_size(max_size, size, &width, &height))
+      return RLoadScaledImage(context, file, index, width, height);
+    return RLoadSharedImage(context, file, index);
+  }
+
+  cacheable = (RImageCacheSize > 0 && stat(file, &st) == 0);
+
+  image = RLoadSharedImage(context, file, index);
+  if (!image)
+    return NULL;
+  width = image->width;
+  height = image->height;
+  if (!fit_size(max_size, size, &width, &height))
+    return image;
+
+  /* scaled here rather than by RLoadScaledImage(): original may be not cached */
+  scaled = RSmoothScaleImage(image, width, height);
+  if (scaled && cacheable)
+    cache_store(file, index, width, height, &st, image, scaled);
+  RReleaseImage(image);
+
+  return scaled;
+}
+
 char *RGetImageFileFormat(const char *file)
 {
   switch (identFile(file)) {
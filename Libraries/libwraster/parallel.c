@@ -0,0 +1,255 @@
+/* parallel.c - processing of image row bands by a pool of threads
+ *
+ * Raster graphics library
+ *
+ * Copyright (c) 2026 NEXTSPACE Team
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+/*
+ * Pool threads are started by the first job big enough to be split and
+ * sleep between jobs. The caller thread processes bands too, so pool has
+ * one thread less than the number of bands processed concurrently.
+ * Jobs are not nested: job started while another one runs (from other
+ * thread or from a band function) is processed by the caller alone.
+ * Child of fork() has no pool threads and processes everything by itself.
+ * WRASTER_THREADS environment variable sets the number of threads,
+ * 1 disables the pool.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "parallel.h"
+
+/* Bands are not smaller than that: waking up a thread costs more */
+#define PARALLEL_MIN_BAND_PIXELS (128 * 1024)
+
+#define PARALLEL_MAX_THREADS 16
+
+/* Bands per thread, more bands balance the load better */
+#define PARALLEL_BANDS_PER_THREAD 2
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t start; /* workers wait for a job */
+  pthread_cond_t done;  /* caller waits for bands processed by workers */
+
+  int nthreads; /* including caller, 0 if not initialized yet */
+  pthread_t threads[PARALLEL_MAX_THREADS];
+  int nworkers; /* started */
+  pid_t pid;    /* of process which started workers */
+  int quit;
+  int busy;
+
+  /* current job */
+  unsigned long generation;
+  RParallelFunction *function;
+  void *data;
+  unsigned rows;
+  int nbands;
+  int next_band;
+  int pending_bands;
+} pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .start = PTHREAD_COND_INITIALIZER,
+  .done = PTHREAD_COND_INITIALIZER,
+};
+
+static int default_threads(void)
+{
+  char *tmp;
+  long n = 0;
+
+  tmp = getenv("WRASTER_THREADS");
+  if (!tmp || sscanf(tmp, "%li", &n) != 1 || n < 1) {
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+      n = 1;
+  }
+  if (n > PARALLEL_MAX_THREADS)
+    n = PARALLEL_MAX_THREADS;
+
+  return n;
+}
+
+int r_parallel_threads(void)
+{
+  int n;
+
+  pthread_mutex_lock(&pool.lock);
+  if (pool.nthreads == 0)
+    pool.nthreads = default_threads();
+  n = pool.nthreads;
+  pthread_mutex_unlock(&pool.lock);
+
+  return n;
+}
+
+int r_parallel_bands(unsigned long pixels, unsigned rows)
+{
+  unsigned long nbands, max_bands;
+
+  nbands = pixels / PARALLEL_MIN_BAND_PIXELS;
+  if (nbands < 2 || rows < 2)
+    return 1;
+
+  max_bands = (unsigned long)r_parallel_threads() * PARALLEL_BANDS_PER_THREAD;
+  if (nbands > max_bands)
+    nbands = max_bands;
+  if (nbands > rows)
+    nbands = rows;
+
+  return nbands;
+}
+
+static inline void run_band(RParallelFunction *function, void *data, unsigned rows, int nbands,
+                            int band)
+{
+  function(data, band, (unsigned long)rows * band / nbands,
+           (unsigned long)rows * (band + 1) / nbands);
+}
+
+/* Processes bands of the current job until there are no more; pool.lock is held */
+static void process_bands(void)
+{
+  RParallelFunction *function = pool.function;
+  void *data = pool.data;
+  unsigned rows = pool.rows;
+  int nbands = pool.nbands;
+  int band;
+
+  while (pool.next_band < nbands) {
+    band = pool.next_band++;
+    pthread_mutex_unlock(&pool.lock);
+    run_band(function, data, rows, nbands, band);
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.pending_bands == 0)
+      pthread_cond_signal(&pool.done);
+  }
+}
+
+static void *worker_main(void *arg)
+{
+  unsigned long generation = 0;
+
+  (void)arg;
+
+  pthread_mutex_lock(&pool.lock);
+  for (;;) {
+    while (!pool.quit && generation == pool.generation)
+      pthread_cond_wait(&pool.start, &pool.lock);
+    if (pool.quit)
+      break;
+    generation = pool.generation;
+    process_bands();
+  }
+  pthread_mutex_unlock(&pool.lock);
+
+  return NULL;
+}
+
+/* pool.lock is held */
+static void start_workers(void)
+{
+  sigset_t all, old;
+
+  /* signals are handled by application threads */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+
+  pool.pid = getpid();
+  pool.generation = 0;
+  for (pool.nworkers = 0; pool.nworkers < pool.nthreads - 1; pool.nworkers++) {
+    if (pthread_create(&pool.threads[pool.nworkers], NULL, worker_main, NULL) != 0)
+      break;
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/* pool.lock is held */
+static void stop_workers(void)
+{
+  int i;
+
+  if (pool.nworkers == 0 || pool.pid != getpid())
+    return;
+
+  pool.quit = 1;
+  pthread_cond_broadcast(&pool.start);
+  pthread_mutex_unlock(&pool.lock);
+  for (i = 0; i < pool.nworkers; i++)
+    pthread_join(pool.threads[i], NULL);
+  pthread_mutex_lock(&pool.lock);
+  pool.quit = 0;
+  pool.nworkers = 0;
+}
+
+void r_parallel_set_threads(int nthreads)
+{
+  pthread_mutex_lock(&pool.lock);
+  pool.busy = 1; /* jobs started meanwhile are processed by their callers */
+  stop_workers();
+  pool.busy = 0;
+  pool.nworkers = 0; /* forked child has no threads to stop */
+  if (nthreads > PARALLEL_MAX_THREADS)
+    nthreads = PARALLEL_MAX_THREADS;
+  pool.nthreads = (nthreads > 0) ? nthreads : default_threads();
+  pthread_mutex_unlock(&pool.lock);
+}
+
+void r_parallel_run(RParallelFunction *function, void *data, unsigned rows, int nbands)
+{
+  int band;
+
+  if (nbands > 1) {
+    pthread_mutex_lock(&pool.lock);
+    if (pool.nthreads == 0)
+      pool.nthreads = default_threads();
+    if (!pool.busy && pool.nthreads > 1) {
+      if (pool.nworkers == 0 || pool.pid != getpid())
+        start_workers();
+      if (pool.nworkers > 0) {
+        pool.busy = 1;
+        pool.function = function;
+        pool.data = data;
+        pool.rows = rows;
+        pool.nbands = nbands;
+        pool.next_band = 0;
+        pool.pending_bands = nbands;
+        pool.generation++;
+        pthread_cond_broadcast(&pool.start);
+
+        process_bands();
+        while (pool.pending_bands > 0)
+          pthread_cond_wait(&pool.done, &pool.lock);
+
+        pool.busy = 0;
+        pthread_mutex_unlock(&pool.lock);
+        return;
+      }
+    }
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  for (band = 0; band < nbands; band++)
+    run_band(function, data, rows, nbands, band);
+}
@@ -0,0 +1,66 @@
+/*
+ * Raster graphics library
+ *
+ * Copyright (c) 2026 NEXTSPACE Team
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+/*
+ * Splitting of image operations into bands of rows processed by a pool
+ * of threads
+ *
+ * The functions here are for WRaster library's internal use only,
+ * Please use functions in 'wraster.h' in applications
+ */
+
+#ifndef __WRASTER_PARALLEL_H__
+#define __WRASTER_PARALLEL_H__
+
+/*
+ * Processes rows from `y0` to `y1` (not including) of the `band`.
+ * Bands of one job run concurrently: function must not write to rows of
+ * other bands or read rows other bands write to.
+ */
+typedef void RParallelFunction(void *data, int band, unsigned y0, unsigned y1);
+
+/*
+ * Returns number of bands operation on `rows` rows of `pixels` pixels in
+ * total should be split into. Returns 1 if it's not worth running in
+ * parallel.
+ */
+int r_parallel_bands(unsigned long pixels, unsigned rows);
+
+/*
+ * Calls `function` for each of `nbands` bands of `rows` rows and returns
+ * when all of them are processed. Band `i` contains rows from
+ * rows * i / nbands to rows * (i + 1) / nbands.
+ * If thread pool is busy (called from other thread) bands are processed
+ * by the caller.
+ */
+void r_parallel_run(RParallelFunction *function, void *data, unsigned rows, int nbands);
+
+/*
+ * Sets number of threads (including caller) to use, 0 sets the default:
+ * WRASTER_THREADS environment variable or number of CPUs.
+ * Stops pool threads, they are started again by the next job.
+ * Must not be called while a job runs.
+ */
+void r_parallel_set_threads(int nthreads);
+
+int r_parallel_threads(void);
+
+#endif
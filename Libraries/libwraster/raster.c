@@ -27,6 +27,8 @@
 #include <assert.h>
 
 #include "wraster.h"
+#include "combine.h"
+#include "parallel.h"
 
 char *WRasterLibVersion = "0.9";
 
@@ -110,6 +112,21 @@ RImage *RCloneImage(RImage *image)
   return new_image;
 }
 
+RImage *RMakeImageWritable(RImage *image)
+{
+  RImage *new_image;
+
+  assert(image != NULL);
+
+  if (image->refCount < 2)
+    return image;
+
+  new_image = RCloneImage(image);
+  RReleaseImage(image);
+
+  return new_image;
+}
+
 RImage *RGetSubImage(RImage *image, int x, int y, unsigned width, unsigned height)
 {
   int i, ofs;
@@ -209,7 +226,6 @@ void RCombineImagesWithOpaqueness(RImage *image, RImage *src, int opaqueness)
   register int i;
   unsigned char *d;
   unsigned char *s;
-  int c_opaqueness;
 
   assert(image->width == src->width);
   assert(image->height == src->height);
@@ -217,24 +233,11 @@ void RCombineImagesWithOpaqueness(RImage *image, RImage *src, int opaqueness)
   d = image->data;
   s = src->data;
 
-  c_opaqueness = 255 - opaqueness;
-
 #define OP opaqueness
-#define COP c_opaqueness
 
   if (!HAS_ALPHA(src)) {
     if (!HAS_ALPHA(image)) {
-      for (i = 0; i < image->width * image->height; i++) {
-        *d = (((int)*d * (int)COP) + ((int)*s * (int)OP)) / 256;
-        d++;
-        s++;
-        *d = (((int)*d * (int)COP) + ((int)*s * (int)OP)) / 256;
-        d++;
-        s++;
-        *d = (((int)*d * (int)COP) + ((int)*s * (int)OP)) / 256;
-        d++;
-        s++;
-      }
+      r_combine_best_kernels()->opaque(d, s, image->width * image->height * 3, OP);
     } else {
       RCombineAlpha(d, s, 0, image->width, image->height, 0, 0, OP);
     }
@@ -260,7 +263,6 @@ void RCombineImagesWithOpaqueness(RImage *image, RImage *src, int opaqueness)
     }
   }
 #undef OP
-#undef COP
 }
 
 static int calculateCombineArea(RImage *des, int *sx, int *sy, unsigned int *swidth,
@@ -456,7 +458,6 @@ void RCombineAreaWithOpaqueness(RImage *image, RImage *src, int sx, int sy, unsi
                                 unsigned height, int dx, int dy, int opaqueness)
 {
   int x, y, dwi, swi;
-  int c_opaqueness;
   unsigned char *s, *d;
   int dalpha = HAS_ALPHA(image);
   int dch = (dalpha ? 4 : 3);
@@ -467,30 +468,19 @@ void RCombineAreaWithOpaqueness(RImage *image, RImage *src, int sx, int sy, unsi
   d = image->data + (dy * image->width + dx) * dch;
   dwi = (image->width - width) * dch;
 
-  c_opaqueness = 255 - opaqueness;
-
 #define OP opaqueness
-#define COP c_opaqueness
 
   if (!HAS_ALPHA(src)) {
     s = src->data + (sy * src->width + sx) * 3;
     swi = (src->width - width) * 3;
 
     if (!dalpha) {
+      const RCombineKernels *kernels = r_combine_best_kernels();
+
       for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-          *d = (((int)*d * (int)COP) + ((int)*s * (int)OP)) / 256;
-          s++;
-          d++;
-          *d = (((int)*d * (int)COP) + ((int)*s * (int)OP)) / 256;
-          s++;
-          d++;
-          *d = (((int)*d * (int)COP) + ((int)*s * (int)OP)) / 256;
-          s++;
-          d++;
-        }
-        d += dwi;
-        s += swi;
+        kernels->opaque(d, s, width * 3, OP);
+        d += width * 3 + dwi;
+        s += width * 3 + swi;
       }
     } else {
       RCombineAlpha(d, s, 0, width, height, dwi, swi, OP);
@@ -524,77 +514,61 @@ void RCombineAreaWithOpaqueness(RImage *image, RImage *src, int sx, int sy, unsi
     }
   }
 #undef OP
-#undef COP
 }
 
 void RCombineImageWithColor(RImage *image, const RColor *color)
 {
-  register int i;
-  unsigned char *d;
-  int alpha, nalpha, r, g, b;
-
-  d = image->data;
-
   if (!HAS_ALPHA(image)) {
     /* Image has no alpha channel, so we consider it to be all 255.
      * Thus there are no transparent parts to be filled. */
     return;
   }
-  r = color->red;
-  g = color->green;
-  b = color->blue;
-
-  for (i = 0; i < image->width * image->height; i++) {
-    alpha = *(d + 3);
-    nalpha = 255 - alpha;
-
-    *d = (((int)*d * alpha) + (r * nalpha)) / 256;
-    d++;
-    *d = (((int)*d * alpha) + (g * nalpha)) / 256;
-    d++;
-    *d = (((int)*d * alpha) + (b * nalpha)) / 256;
-    d++;
-    d++;
+
+  r_combine_best_kernels()->color(image->data, image->width * image->height, color);
+}
+
+typedef struct {
+  RImage *image;
+  RImage *tile;
+} TileJob;
+
+static void tileBand(void *data, int band, unsigned y0, unsigned y1)
+{
+  TileJob *job = data;
+  RImage *tile = job->tile;
+  unsigned width = job->image->width;
+  int ch = HAS_ALPHA(tile) ? 4 : 3;
+  unsigned char *d = job->image->data + (unsigned long)y0 * width * ch;
+  unsigned char *s;
+  unsigned x, y, w;
+
+  for (y = y0; y < y1; y++) {
+    s = tile->data + (unsigned long)(y % tile->height) * tile->width * ch;
+    for (x = 0; x < width; x += tile->width) {
+      w = (width - x < tile->width) ? width - x : tile->width;
+      memcpy(d, s, w * ch);
+      d += w * ch;
+    }
   }
 }
 
 RImage *RMakeTiledImage(RImage *tile, unsigned width, unsigned height)
 {
-  int x, y;
-  unsigned w;
-  unsigned long tile_size = tile->width * tile->height;
-  unsigned long tx = 0;
   RImage *image;
-  unsigned char *s, *d;
+  TileJob job;
 
   if (width == tile->width && height == tile->height)
     image = RCloneImage(tile);
   else if (width <= tile->width && height <= tile->height)
     image = RGetSubImage(tile, 0, 0, width, height);
   else {
-    int has_alpha = HAS_ALPHA(tile);
+    image = RCreateImage(width, height, HAS_ALPHA(tile));
+    if (!image)
+      return NULL;
 
-    image = RCreateImage(width, height, has_alpha);
-
-    d = image->data;
-    s = tile->data;
-
-    for (y = 0; y < height; y++) {
-      for (x = 0; x < width; x += tile->width) {
-        w = (width - x < tile->width) ? width - x : tile->width;
-
-        if (has_alpha) {
-          w *= 4;
-          memcpy(d, s + tx * 4, w);
-        } else {
-          w *= 3;
-          memcpy(d, s + tx * 3, w);
-        }
-        d += w;
-      }
-
-      tx = (tx + tile->width) % tile_size;
-    }
+    job.image = image;
+    job.tile = tile;
+    r_parallel_run(tileBand, &job, height, r_parallel_bands(width * height, height));
   }
   return image;
 }
@@ -25,11 +25,16 @@
 #include <string.h>
 #include <X11/Xlib.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "wraster.h"
 #include "scale.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /*
  *----------------------------------------------------------------------
  * RScaleImage--
@@ -240,8 +245,15 @@ static double Mitchell_filter(double t)
 static double (*filterf)(double) = Mitchell_filter;
 static double fwidth = Mitchell_support;
 
+static pthread_mutex_t weights_lock = PTHREAD_MUTEX_INITIALIZER;
+static void flush_weights_cache(void);
+
 void wraster_change_filter(RScalingFilter type)
 {
+  /* Weights are created under the lock, so they never mix two filters */
+  pthread_mutex_lock(&weights_lock);
+  flush_weights_cache();
+
   switch (type) {
     case RBoxFilter:
       filterf = box_filter;
@@ -269,223 +281,385 @@ void wraster_change_filter(RScalingFilter type)
       fwidth = Mitchell_support;
       break;
   }
+  pthread_mutex_unlock(&weights_lock);
 }
 
 /*
  *	image rescaling routine
+ *
+ * Filter is applied horizontally and then vertically. Filter weights are
+ * fixed point numbers with WEIGHT_BITS fraction bits; every destination pixel
+ * has the same even number of taps (padded with zero weights), so taps are
+ * processed in pairs by SSE2 multiply-add. Weight tables are cached because
+ * the same icon sizes are scaled again and again. The cache is shared by
+ * threads: tables are reference counted, so a table which is used by one
+ * thread stays valid while another one evicts it.
+ * RGBA images are filtered with premultiplied alpha.
  */
 
-typedef struct {
-  int pixel;
-  double weight;
-} CONTRIB;
+#define WEIGHT_BITS 14
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+#define WEIGHTS_CACHE_SIZE 16
 
 typedef struct {
-  int n;      /* number of contributors */
-  CONTRIB *p; /* pointer to list of contributions */
-} CLIST;
+  unsigned src_size;
+  unsigned dst_size;
+  int ntaps;
+  int refcount;  /* cache and every RSmoothScaleImage() using it */
+  int *pixel;    /* dst_size * ntaps source pixel indexes */
+  short *weight; /* dst_size * ntaps weights */
+} RScaleWeights;
+
+/* Most recently used first. Guarded by weights_lock. */
+static RScaleWeights *weights_cache[WEIGHTS_CACHE_SIZE];
 
 /* clamp the input to the specified range */
 #define CLAMP(v, l, h) ((v) < (l) ? (l) : (v) > (h) ? (h) : v)
 
-/* return of calloc is not checked if NULL in the function below! */
-RImage *RSmoothScaleImage(RImage *src, unsigned new_width, unsigned new_height)
+/* Weights of taps `k` and `k + 1` in 16 bit halves for pmaddwd */
+#define WEIGHT_PAIR(w, k) \
+  (((unsigned)(unsigned short)(w)[(k) + 1] << 16) | (unsigned short)(w)[k])
+
+/* Must be called with weights_lock held */
+static void unref_weights(RScaleWeights *w)
 {
-  CLIST *contrib;             /* array of contribution lists */
-  RImage *tmp;                /* intermediate image */
-  double xscale, yscale;      /* zoom scale factors */
-  int i, j, k;                /* loop variables */
-  int n;                      /* pixel number */
-  double center, left, right; /* filter calculation variables */
-  double width, fscale;       /* filter calculation variables */
-  double rweight, gweight, bweight;
-  RImage *dst;
-  unsigned char *p;
-  unsigned char *sp;
-  int sch = src->format == RRGBAFormat ? 4 : 3;
-
-  dst = RCreateImage(new_width, new_height, False);
-
-  /* create intermediate image to hold horizontal zoom */
-  tmp = RCreateImage(dst->width, src->height, False);
-  xscale = (double)new_width / (double)src->width;
-  yscale = (double)new_height / (double)src->height;
-
-  /* pre-calculate filter contributions for a row */
-  contrib = (CLIST *)calloc(new_width, sizeof(CLIST));
-  if (xscale < 1.0) {
-    width = fwidth / xscale;
-    fscale = 1.0 / xscale;
-    for (i = 0; i < new_width; ++i) {
-      contrib[i].n = 0;
-      contrib[i].p = (CONTRIB *)calloc((int)ceil(width * 2 + 1), sizeof(CONTRIB));
-      center = (double)i / xscale;
-      left = ceil(center - width);
-      right = floor(center + width);
-      for (j = left; j <= right; ++j) {
-        rweight = center - (double)j;
-        rweight = (*filterf)(rweight / fscale) / fscale;
-        if (j < 0) {
-          n = -j;
-        } else if (j >= src->width) {
-          n = (src->width - j) + src->width - 1;
-        } else {
-          n = j;
-        }
-        k = contrib[i].n++;
-        contrib[i].p[k].pixel = n * sch;
-        contrib[i].p[k].weight = rweight;
+  if (w && --w->refcount == 0) {
+    free(w);
+  }
+}
+
+static void release_weights(RScaleWeights *w)
+{
+  pthread_mutex_lock(&weights_lock);
+  unref_weights(w);
+  pthread_mutex_unlock(&weights_lock);
+}
+
+/* Must be called with weights_lock held */
+static void flush_weights_cache(void)
+{
+  int i;
+
+  for (i = 0; i < WEIGHTS_CACHE_SIZE; i++) {
+    unref_weights(weights_cache[i]);
+    weights_cache[i] = NULL;
+  }
+}
+
+static RScaleWeights *create_weights(unsigned src_size, unsigned dst_size)
+{
+  RScaleWeights *w;
+  double scale = (double)dst_size / (double)src_size;
+  double width, fscale;
+  double center, sum, *fw;
+  int i, j, k, n, left, right, ntaps, total, max_k;
+
+  if (scale < 1.0) {
+    width = fwidth / scale;
+    fscale = 1.0 / scale;
+  } else {
+    width = fwidth;
+    fscale = 1.0;
+  }
+  ntaps = (int)ceil(width * 2 + 1);
+  ntaps += ntaps & 1;
+
+  w = malloc(sizeof(RScaleWeights) + dst_size * ntaps * (sizeof(int) + sizeof(short)));
+  fw = malloc(ntaps * sizeof(double));
+  if (!w || !fw) {
+    free(w);
+    free(fw);
+    RErrorCode = RERR_NOMEMORY;
+    return NULL;
+  }
+  w->src_size = src_size;
+  w->dst_size = dst_size;
+  w->ntaps = ntaps;
+  w->refcount = 1;
+  w->pixel = (int *)(w + 1);
+  w->weight = (short *)(w->pixel + dst_size * ntaps);
+
+  for (i = 0; i < dst_size; i++) {
+    int *pixel = w->pixel + i * ntaps;
+    short *weight = w->weight + i * ntaps;
+
+    center = (double)i / scale;
+    left = ceil(center - width);
+    right = floor(center + width);
+    sum = 0;
+    for (j = left, k = 0; j <= right && k < ntaps; j++, k++) {
+      fw[k] = (*filterf)((center - (double)j) / fscale) / fscale;
+      sum += fw[k];
+      /* mirror pixels outside of the image */
+      if (j < 0) {
+        n = -j;
+      } else if (j >= (int)src_size) {
+        n = (src_size - j) + src_size - 1;
+      } else {
+        n = j;
       }
+      pixel[k] = CLAMP(n, 0, (int)src_size - 1);
     }
-  } else {
-    for (i = 0; i < new_width; ++i) {
-      contrib[i].n = 0;
-      contrib[i].p = (CONTRIB *)calloc((int)ceil(fwidth * 2 + 1), sizeof(CONTRIB));
-      center = (double)i / xscale;
-      left = ceil(center - fwidth);
-      right = floor(center + fwidth);
-      for (j = left; j <= right; ++j) {
-        rweight = center - (double)j;
-        rweight = (*filterf)(rweight);
-        if (j < 0) {
-          n = -j;
-        } else if (j >= src->width) {
-          n = (src->width - j) + src->width - 1;
-        } else {
-          n = j;
-        }
-        k = contrib[i].n++;
-        contrib[i].p[k].pixel = n * sch;
-        contrib[i].p[k].weight = rweight;
+    for (; k < ntaps; k++) {
+      fw[k] = 0;
+      pixel[k] = pixel[0];
+    }
+
+    /* Normalized weights: sum of fixed point weights must be exactly 1 */
+    total = 0;
+    max_k = 0;
+    for (k = 0; k < ntaps; k++) {
+      if (sum != 0) {
+        fw[k] /= sum;
+      }
+      weight[k] = CLAMP(lround(fw[k] * WEIGHT_ONE), -32767, 32767);
+      total += weight[k];
+      if (fabs(fw[k]) > fabs(fw[max_k])) {
+        max_k = k;
       }
     }
+    weight[max_k] += WEIGHT_ONE - total;
   }
+  free(fw);
 
-  /* apply filter to zoom horizontally from src to tmp */
-  p = tmp->data;
+  return w;
+}
 
-  for (k = 0; k < tmp->height; ++k) {
-    CONTRIB *pp;
+/* Returned weights must be released with release_weights() */
+static RScaleWeights *get_weights(unsigned src_size, unsigned dst_size)
+{
+  RScaleWeights *w = NULL;
+  int i;
+
+  pthread_mutex_lock(&weights_lock);
+  for (i = 0; i < WEIGHTS_CACHE_SIZE && weights_cache[i]; i++) {
+    if (weights_cache[i]->src_size == src_size && weights_cache[i]->dst_size == dst_size) {
+      w = weights_cache[i];
+      break;
+    }
+  }
+  if (w == NULL) {
+    w = create_weights(src_size, dst_size);
+    if (w == NULL) {
+      pthread_mutex_unlock(&weights_lock);
+      return NULL;
+    }
+    i = WEIGHTS_CACHE_SIZE - 1;
+    unref_weights(weights_cache[i]);
+  }
+  /* move to front */
+  memmove(&weights_cache[1], &weights_cache[0], i * sizeof(RScaleWeights *));
+  weights_cache[0] = w;
+  w->refcount++;
+  pthread_mutex_unlock(&weights_lock);
+
+  return w;
+}
 
-    sp = src->data + src->width * k * sch;
+static inline unsigned char fixed_to_byte(int v)
+{
+  v = (v + WEIGHT_ONE / 2) >> WEIGHT_BITS;
+  return CLAMP(v, 0, 255);
+}
 
-    for (i = 0; i < tmp->width; ++i) {
-      rweight = gweight = bweight = 0.0;
+/* Filters one row of `ch` channel pixels horizontally. With SSE2 4 bytes are
+ * read for every pixel: source buffer must have 1 spare byte at the end if `ch` is 3. */
+static void scale_row(const unsigned char *s, unsigned char *d, const RScaleWeights *w, int ch)
+{
+  const int *pixel = w->pixel;
+  const short *weight = w->weight;
+  int i, k;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc, p;
+  int v0, v1;
+
+  for (i = 0; i < w->dst_size; i++, pixel += w->ntaps, weight += w->ntaps) {
+    acc = _mm_set1_epi32(WEIGHT_ONE / 2);
+    for (k = 0; k < w->ntaps; k += 2) {
+      memcpy(&v0, s + pixel[k] * ch, 4);
+      memcpy(&v1, s + pixel[k + 1] * ch, 4);
+      /* r0 r1 g0 g1 b0 b1 a0 a1 multiplied by w0 w1 w0 w1... and added in pairs */
+      p = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v0), _mm_cvtsi32_si128(v1));
+      p = _mm_unpacklo_epi8(p, zero);
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(p, _mm_set1_epi32(WEIGHT_PAIR(weight, k))));
+    }
+    acc = _mm_srai_epi32(acc, WEIGHT_BITS);
+    acc = _mm_packus_epi16(_mm_packs_epi32(acc, zero), zero);
+    v0 = _mm_cvtsi128_si32(acc);
+    memcpy(d, &v0, ch);
+    d += ch;
+  }
+#else
+  int c, acc[4];
 
-      pp = contrib[i].p;
+  for (i = 0; i < w->dst_size; i++, pixel += w->ntaps, weight += w->ntaps) {
+    for (c = 0; c < ch; c++) {
+      acc[c] = 0;
+    }
+    for (k = 0; k < w->ntaps; k++) {
+      const unsigned char *p = s + pixel[k] * ch;
 
-      for (j = 0; j < contrib[i].n; ++j) {
-        rweight += sp[pp[j].pixel] * pp[j].weight;
-        gweight += sp[pp[j].pixel + 1] * pp[j].weight;
-        bweight += sp[pp[j].pixel + 2] * pp[j].weight;
+      for (c = 0; c < ch; c++) {
+        acc[c] += p[c] * weight[k];
       }
-      *p++ = CLAMP(rweight, 0, 255);
-      *p++ = CLAMP(gweight, 0, 255);
-      *p++ = CLAMP(bweight, 0, 255);
     }
+    for (c = 0; c < ch; c++) {
+      *d++ = fixed_to_byte(acc[c]);
+    }
+  }
+#endif
+}
+
+/* Makes destination row `y` from source rows of `row_size` bytes */
+static void scale_column(const unsigned char *s, unsigned char *d, int y, const RScaleWeights *w,
+                         int row_size)
+{
+  const int *pixel = w->pixel + y * w->ntaps;
+  const short *weight = w->weight + y * w->ntaps;
+  int x = 0, k, acc;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a0, a1, a2, a3, r0, r1, lo, hi, ww;
+
+  for (; x + 16 <= row_size; x += 16) {
+    a0 = a1 = a2 = a3 = _mm_set1_epi32(WEIGHT_ONE / 2);
+    for (k = 0; k < w->ntaps; k += 2) {
+      r0 = _mm_loadu_si128((const __m128i *)(s + pixel[k] * row_size + x));
+      r1 = _mm_loadu_si128((const __m128i *)(s + pixel[k + 1] * row_size + x));
+      ww = _mm_set1_epi32(WEIGHT_PAIR(weight, k));
+      lo = _mm_unpacklo_epi8(r0, r1);
+      hi = _mm_unpackhi_epi8(r0, r1);
+      a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), ww));
+      a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), ww));
+      a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), ww));
+      a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), ww));
+    }
+    lo = _mm_packs_epi32(_mm_srai_epi32(a0, WEIGHT_BITS), _mm_srai_epi32(a1, WEIGHT_BITS));
+    hi = _mm_packs_epi32(_mm_srai_epi32(a2, WEIGHT_BITS), _mm_srai_epi32(a3, WEIGHT_BITS));
+    _mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi16(lo, hi));
   }
+#endif
 
-  /* free the memory allocated for horizontal filter weights */
-  for (i = 0; i < new_width; ++i) {
-    free(contrib[i].p);
+  for (; x < row_size; x++) {
+    acc = 0;
+    for (k = 0; k < w->ntaps; k++) {
+      acc += s[pixel[k] * row_size + x] * weight[k];
+    }
+    d[x] = fixed_to_byte(acc);
   }
-  free(contrib);
-
-  /* pre-calculate filter contributions for a column */
-  contrib = (CLIST *)calloc(dst->height, sizeof(CLIST));
-  if (yscale < 1.0) {
-    width = fwidth / yscale;
-    fscale = 1.0 / yscale;
-    for (i = 0; i < dst->height; ++i) {
-      contrib[i].n = 0;
-      contrib[i].p = (CONTRIB *)calloc((int)ceil(width * 2 + 1), sizeof(CONTRIB));
-      center = (double)i / yscale;
-      left = ceil(center - width);
-      right = floor(center + width);
-      for (j = left; j <= right; ++j) {
-        rweight = center - (double)j;
-        rweight = (*filterf)(rweight / fscale) / fscale;
-        if (j < 0) {
-          n = -j;
-        } else if (j >= tmp->height) {
-          n = (tmp->height - j) + tmp->height - 1;
-        } else {
-          n = j;
-        }
-        k = contrib[i].n++;
-        contrib[i].p[k].pixel = n * 3;
-        contrib[i].p[k].weight = rweight;
-      }
+}
+
+static void premultiply_row(const unsigned char *s, unsigned char *d, int width)
+{
+  int i, a;
+
+  for (i = 0; i < width; i++, s += 4, d += 4) {
+    a = s[3];
+    if (a == 255) {
+      memcpy(d, s, 4);
+    } else {
+      d[0] = (s[0] * a + 127) / 255;
+      d[1] = (s[1] * a + 127) / 255;
+      d[2] = (s[2] * a + 127) / 255;
+      d[3] = a;
     }
-  } else {
-    for (i = 0; i < dst->height; ++i) {
-      contrib[i].n = 0;
-      contrib[i].p = (CONTRIB *)calloc((int)ceil(fwidth * 2 + 1), sizeof(CONTRIB));
-      center = (double)i / yscale;
-      left = ceil(center - fwidth);
-      right = floor(center + fwidth);
-      for (j = left; j <= right; ++j) {
-        rweight = center - (double)j;
-        rweight = (*filterf)(rweight);
-        if (j < 0) {
-          n = -j;
-        } else if (j >= tmp->height) {
-          n = (tmp->height - j) + tmp->height - 1;
-        } else {
-          n = j;
-        }
-        k = contrib[i].n++;
-        contrib[i].p[k].pixel = n * 3;
-        contrib[i].p[k].weight = rweight;
+  }
+}
+
+static void unpremultiply_row(unsigned char *d, int width)
+{
+  int i, c, a;
+
+  for (i = 0; i < width; i++, d += 4) {
+    a = d[3];
+    if (a == 0) {
+      d[0] = d[1] = d[2] = 0;
+    } else if (a != 255) {
+      /* filter overshoot may give color above alpha */
+      for (c = 0; c < 3; c++) {
+        d[c] = (CLAMP(d[c], 0, a) * 255 + a / 2) / a;
       }
     }
   }
+}
 
-  /* apply filter to zoom vertically from tmp to dst */
-  sp = malloc(tmp->height * 3);
+RImage *RSmoothScaleImage(RImage *src, unsigned new_width, unsigned new_height)
+{
+  int ch = src->format == RRGBAFormat ? 4 : 3;
+  int src_row = src->width * ch, dst_row = new_width * ch;
+  RScaleWeights *xw, *yw;
+  unsigned char *tmp, *premultiplied = NULL;
+  const unsigned char *sp = src->data;
+  RImage *dst;
+  int y;
 
-  for (k = 0; k < new_width; ++k) {
-    CONTRIB *pp;
+  xw = get_weights(src->width, new_width);
+  yw = get_weights(src->height, new_height);
+  if (!xw || !yw) {
+    release_weights(xw);
+    release_weights(yw);
+    return NULL;
+  }
 
-    p = dst->data + k * 3;
+  dst = RCreateImage(new_width, new_height, ch == 4);
+  if (!dst) {
+    release_weights(xw);
+    release_weights(yw);
+    return NULL;
+  }
 
-    /* copy a column into a row */
-    {
-      int i;
-      unsigned char *p, *d;
+  if (ch == 4) {
+    premultiplied = malloc(src_row * src->height);
+    if (!premultiplied) {
+      release_weights(xw);
+      release_weights(yw);
+      RReleaseImage(dst);
+      RErrorCode = RERR_NOMEMORY;
+      return NULL;
+    }
+    premultiply_row(src->data, premultiplied, src->width * src->height);
+    sp = premultiplied;
+  }
 
-      d = sp;
-      for (i = tmp->height, p = tmp->data + k * 3; i-- > 0; p += tmp->width * 3) {
-        *d++ = *p;
-        *d++ = *(p + 1);
-        *d++ = *(p + 2);
+  /* The pass that shrinks more goes first: intermediate image is smaller */
+  if ((double)new_height * src->width <= (double)src->height * new_width) {
+    tmp = malloc(src_row * new_height + 1);
+    if (tmp) {
+      for (y = 0; y < new_height; y++) {
+        scale_column(sp, tmp + y * src_row, y, yw, src_row);
+      }
+      for (y = 0; y < new_height; y++) {
+        scale_row(tmp + y * src_row, dst->data + y * dst_row, xw, ch);
       }
     }
-    for (i = 0; i < new_height; ++i) {
-      rweight = gweight = bweight = 0.0;
-
-      pp = contrib[i].p;
-
-      for (j = 0; j < contrib[i].n; ++j) {
-        rweight += sp[pp[j].pixel] * pp[j].weight;
-        gweight += sp[pp[j].pixel + 1] * pp[j].weight;
-        bweight += sp[pp[j].pixel + 2] * pp[j].weight;
+  } else {
+    tmp = malloc(dst_row * src->height);
+    if (tmp) {
+      for (y = 0; y < src->height; y++) {
+        scale_row(sp + y * src_row, tmp + y * dst_row, xw, ch);
+      }
+      for (y = 0; y < new_height; y++) {
+        scale_column(tmp, dst->data + y * dst_row, y, yw, dst_row);
       }
-      *p = CLAMP(rweight, 0, 255);
-      *(p + 1) = CLAMP(gweight, 0, 255);
-      *(p + 2) = CLAMP(bweight, 0, 255);
-      p += new_width * 3;
     }
   }
-  free(sp);
+  free(premultiplied);
+  release_weights(xw);
+  release_weights(yw);
 
-  /* free the memory allocated for vertical filter weights */
-  for (i = 0; i < dst->height; ++i) {
-    free(contrib[i].p);
+  if (!tmp) {
+    RReleaseImage(dst);
+    RErrorCode = RERR_NOMEMORY;
+    return NULL;
   }
-  free(contrib);
+  free(tmp);
 
-  RReleaseImage(tmp);
+  if (ch == 4) {
+    unpremultiply_row(dst->data, new_width * new_height);
+  }
 
   return dst;
 }
@@ -0,0 +1,171 @@
+/*
+ * Benchmark of pixel blending kernels used by RCombine* functions.
+ *
+ * Runs every kernel supported by CPU on the same random data, reports
+ * Mpixel/s and checks that results are identical to the scalar kernel ones.
+ * Exits with non-zero status if they are not.
+ *
+ * usage: combinebench [width height [iterations]]
+ */
+
+#include <X11/Xlib.h>
+#include "wraster.h"
+#include "../combine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int width = 512;
+static int height = 512;
+static int iterations = 50;
+
+static unsigned char *rgba_src, *rgb_src, *rgba_dst, *rgb_dst;
+static unsigned char *work, *reference;
+
+enum { KAlphaRGBA, KAlphaRGB, KAlphaOpacity, KOpaque, KColor, KCount };
+
+static const char *kernel_names[KCount] = {"alpha (RGBA over RGBA)", "alpha (RGB over RGBA, 50%)",
+                                           "alpha (RGBA over RGBA, 50%)", "opaque (RGB over RGB)",
+                                           "color (RGBA over color)"};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Random bytes with many fully transparent and opaque pixels */
+static void fill_random(unsigned char *data, int pixels, int channels)
+{
+  int i, c;
+
+  for (i = 0; i < pixels; i++) {
+    for (c = 0; c < channels; c++) {
+      data[i * channels + c] = rand() & 0xff;
+    }
+    if (channels == 4) {
+      switch (rand() % 4) {
+      case 0:
+        data[i * 4 + 3] = 0;
+        break;
+      case 1:
+        data[i * 4 + 3] = 255;
+        break;
+      }
+    }
+  }
+}
+
+/* Runs kernel on the whole image once, row by row like RCombineArea() */
+static void run_kernel(const RCombineKernels *k, int kernel, unsigned char *d)
+{
+  static const RColor color = {0x40, 0x80, 0xc0, 0xff};
+  int y;
+
+  for (y = 0; y < height; y++) {
+    switch (kernel) {
+    case KAlphaRGBA:
+      k->alpha(d + y * width * 4, rgba_src + y * width * 4, 1, width, 255);
+      break;
+    case KAlphaRGB:
+      k->alpha(d + y * width * 4, rgb_src + y * width * 3, 0, width, 128);
+      break;
+    case KAlphaOpacity:
+      k->alpha(d + y * width * 4, rgba_src + y * width * 4, 1, width, 128);
+      break;
+    case KOpaque:
+      k->opaque(d + y * width * 3, rgb_src + y * width * 3, width * 3, 128);
+      break;
+    case KColor:
+      k->color(d + y * width * 4, width, &color);
+      break;
+    }
+  }
+}
+
+static int bench(const RCombineKernels *k, int kernel)
+{
+  const unsigned char *dst = (kernel == KOpaque) ? rgb_dst : rgba_dst;
+  size_t size = (size_t)width * height * ((kernel == KOpaque) ? 3 : 4);
+  double start, elapsed = 0;
+  int i, ok;
+
+  /* Correctness: one pass over the pristine destination */
+  memcpy(work, dst, size);
+  run_kernel(k, kernel, work);
+  if (strcmp(k->name, "scalar") == 0) {
+    memcpy(reference, work, size);
+  }
+  ok = (memcmp(work, reference, size) == 0);
+
+  for (i = 0; i < iterations; i++) {
+    memcpy(work, dst, size);
+    start = now();
+    run_kernel(k, kernel, work);
+    elapsed += now() - start;
+  }
+
+  printf("  %-8s %10.1f Mpixel/s  %s\n", k->name,
+         (double)width * height * iterations / elapsed / 1e6, ok ? "ok" : "MISMATCH");
+
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  const RCombineKernels *kernels[4];
+  int nkernels = 0, level, kernel, i;
+  int failed = 0;
+
+  if (argc > 2) {
+    width = atoi(argv[1]);
+    height = atoi(argv[2]);
+  }
+  if (argc > 3) {
+    iterations = atoi(argv[3]);
+  }
+  if (width <= 0 || height <= 0 || iterations <= 0) {
+    fprintf(stderr, "usage: %s [width height [iterations]]\n", argv[0]);
+    return 2;
+  }
+
+  /* Scalar is the first: it makes reference results */
+  for (level = RCombineScalar; level <= RCombineNEON; level++) {
+    if ((kernels[nkernels] = r_combine_kernels(level)) != NULL) {
+      nkernels++;
+    }
+  }
+
+  rgba_src = malloc((size_t)width * height * 4);
+  rgb_src = malloc((size_t)width * height * 3);
+  rgba_dst = malloc((size_t)width * height * 4);
+  rgb_dst = malloc((size_t)width * height * 3);
+  work = malloc((size_t)width * height * 4);
+  reference = malloc((size_t)width * height * 4);
+  if (!rgba_src || !rgb_src || !rgba_dst || !rgb_dst || !work || !reference) {
+    fprintf(stderr, "Cannot allocate memory!\n");
+    return 1;
+  }
+
+  srand(1);
+  fill_random(rgba_src, width * height, 4);
+  fill_random(rgb_src, width * height, 3);
+  fill_random(rgba_dst, width * height, 4);
+  fill_random(rgb_dst, width * height, 3);
+
+  printf("%dx%d pixels, %d iterations, default: %s\n", width, height, iterations,
+         r_combine_best_kernels()->name);
+  for (kernel = 0; kernel < KCount; kernel++) {
+    printf("%s\n", kernel_names[kernel]);
+    for (i = 0; i < nkernels; i++) {
+      if (!bench(kernels[i], kernel)) {
+        failed = 1;
+      }
+    }
+  }
+
+  return failed;
+}
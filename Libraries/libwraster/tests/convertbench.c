@@ -0,0 +1,277 @@
+/*
+ * Benchmark of RImage to XImage conversion.
+ *
+ * Converts 4K (3840x2160 by default) RGB and RGBA images with every rendering
+ * mode and reports Mpixel/s of the conversion alone and of RConvertImage()
+ * (conversion and upload to Pixmap). Reference conversion with XPutPixel()
+ * is measured too; its output is compared with library one in best match
+ * mode on visuals of 24 and more bits.
+ *
+ * Without X server the conversion alone is measured on a synthetic 24 bit
+ * TrueColor visual with 32 bits per pixel.
+ *
+ * usage: convertbench [width height [iterations]]
+ */
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "wraster.h"
+#include "../convert.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static Display *dpy;
+static RContext *ctx;
+static int synthetic;
+static int width = 3840;
+static int height = 2160;
+static int iterations = 10;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int mask_offset(unsigned long mask)
+{
+  int offset = 0;
+
+  while (mask && !(mask & 1)) {
+    mask >>= 1;
+    offset++;
+  }
+  return offset;
+}
+
+/* Pixel by pixel conversion without dithering, as it was done before */
+static RXImage *reference_convert(RImage *image)
+{
+  Visual *visual = ctx->visual;
+  int roffs = mask_offset(visual->red_mask);
+  int goffs = mask_offset(visual->green_mask);
+  int boffs = mask_offset(visual->blue_mask);
+  unsigned long rmask = visual->red_mask >> roffs;
+  unsigned long gmask = visual->green_mask >> goffs;
+  unsigned long bmask = visual->blue_mask >> boffs;
+  int channels = image->format == RRGBAFormat ? 4 : 3;
+  unsigned char *ptr = image->data;
+  unsigned long pixel;
+  RXImage *ximg;
+  int x, y;
+
+  ximg = RCreateXImage(ctx, ctx->depth, image->width, image->height);
+  if (!ximg) {
+    return NULL;
+  }
+  for (y = 0; y < image->height; y++) {
+    for (x = 0; x < image->width; x++, ptr += channels) {
+      pixel = (((ptr[0] * rmask + 0x7f) / 0xff) << roffs) |
+              (((ptr[1] * gmask + 0x7f) / 0xff) << goffs) |
+              (((ptr[2] * bmask + 0x7f) / 0xff) << boffs);
+      XPutPixel(ximg->image, x, y, pixel);
+    }
+  }
+  return ximg;
+}
+
+static int same_ximages(RXImage *a, RXImage *b)
+{
+  int y;
+  int line = a->image->width * a->image->bits_per_pixel / 8;
+
+  for (y = 0; y < a->image->height; y++) {
+    if (memcmp(a->image->data + y * a->image->bytes_per_line,
+               b->image->data + y * b->image->bytes_per_line, line) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Context of 24 bit TrueColor visual without X server. Display has only what
+ * XCreateImage() takes from it: byte order and pixmap formats.
+ */
+static RContext *synthetic_context(void)
+{
+  static ScreenFormat formats[] = {{NULL, 1, 1, 32}, {NULL, 24, 32, 32}};
+  static RContextAttributes attribs;
+  static Visual visual;
+  static RContext context;
+  static const int one = 1;
+  _XPrivDisplay priv;
+
+  priv = calloc(1, sizeof(*priv));
+  if (!priv) {
+    return NULL;
+  }
+  priv->byte_order = *(const char *)&one ? LSBFirst : MSBFirst;
+  priv->bitmap_unit = 32;
+  priv->bitmap_pad = 32;
+  priv->bitmap_bit_order = LSBFirst;
+  priv->nformats = sizeof(formats) / sizeof(formats[0]);
+  priv->pixmap_format = formats;
+
+  visual.class = TrueColor;
+  visual.red_mask = 0xff0000;
+  visual.green_mask = 0x00ff00;
+  visual.blue_mask = 0x0000ff;
+  visual.bits_per_rgb = 8;
+  visual.map_entries = 256;
+
+  attribs.flags = RC_RenderMode;
+  attribs.render_mode = RBestMatchRendering;
+  attribs.use_shared_memory = False;
+
+  context.dpy = (Display *)priv;
+  context.attribs = &attribs;
+  context.visual = &visual;
+  context.depth = 24;
+  context.vclass = TrueColor;
+  context.red_offset = 16;
+  context.green_offset = 8;
+  context.blue_offset = 0;
+
+  return &context;
+}
+
+static void report(const char *name, double elapsed, const char *note)
+{
+  printf("  %-24s %8.1f Mpixel/s %8.2f ms  %s\n", name,
+         (double)width * height * iterations / elapsed / 1e6, elapsed / iterations * 1e3, note);
+}
+
+static int bench(RImage *image)
+{
+  static const struct {
+    RRenderingMode mode;
+    const char *name;
+  } modes[] = {{RBestMatchRendering, "best match"},
+               {RDitheredRendering, "dithered"},
+               {ROrderedDitherRendering, "ordered dither"}};
+  RXImage *ximg, *ref = NULL;
+  Pixmap pixmap;
+  double start, elapsed;
+  const char *note;
+  int i, m, ok = 1;
+
+  printf("%s %dx%d\n", image->format == RRGBAFormat ? "RGBA" : "RGB", width, height);
+
+  start = now();
+  for (i = 0; i < iterations; i++) {
+    if (ref) {
+      RDestroyXImage(ctx, ref);
+    }
+    ref = reference_convert(image);
+  }
+  report("XPutPixel reference", now() - start, "");
+
+  for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+    ctx->attribs->render_mode = modes[m].mode;
+
+    elapsed = 0;
+    ximg = NULL;
+    for (i = 0; i < iterations; i++) {
+      if (ximg) {
+        RDestroyXImage(ctx, ximg);
+      }
+      start = now();
+      ximg = r_convert_to_ximage(ctx, image);
+      elapsed += now() - start;
+    }
+    note = "";
+    if (ctx->depth >= 24 && modes[m].mode == RBestMatchRendering) {
+      if (same_ximages(ximg, ref)) {
+        note = "ok";
+      } else {
+        note = "MISMATCH";
+        ok = 0;
+      }
+    }
+    RDestroyXImage(ctx, ximg);
+    report(modes[m].name, elapsed, note);
+
+    if (synthetic) {
+      continue;
+    }
+    start = now();
+    for (i = 0; i < iterations; i++) {
+      RConvertImage(ctx, image, &pixmap);
+      XFreePixmap(dpy, pixmap);
+    }
+    XSync(dpy, False);
+    report("  + RConvertImage", now() - start, "");
+  }
+  RDestroyXImage(ctx, ref);
+
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  RContextAttributes attr;
+  RImage *rgb, *rgba;
+  int i, failed = 0;
+
+  if (argc > 2) {
+    width = atoi(argv[1]);
+    height = atoi(argv[2]);
+  }
+  if (argc > 3) {
+    iterations = atoi(argv[3]);
+  }
+  if (width <= 0 || height <= 0 || iterations <= 0) {
+    fprintf(stderr, "usage: %s [width height [iterations]]\n", argv[0]);
+    return 2;
+  }
+
+  dpy = XOpenDisplay(NULL);
+  if (dpy) {
+    attr.flags = RC_RenderMode;
+    attr.render_mode = RBestMatchRendering;
+    ctx = RCreateContext(dpy, DefaultScreen(dpy), &attr);
+  } else {
+    fprintf(stderr, "can't open display, using synthetic visual\n");
+    synthetic = 1;
+    ctx = synthetic_context();
+  }
+  if (!ctx) {
+    fprintf(stderr, "can't create context: %s\n", RMessageForError(RErrorCode));
+    return 1;
+  }
+  printf("visual: depth %d, %s, MIT-SHM %s%s\n", ctx->depth,
+         ctx->vclass == TrueColor ? "TrueColor" : "not TrueColor",
+         ctx->attribs->use_shared_memory ? "yes" : "no", synthetic ? ", synthetic" : "");
+
+  rgb = RCreateImage(width, height, False);
+  rgba = RCreateImage(width, height, True);
+  if (!rgb || !rgba) {
+    fprintf(stderr, "can't create images: %s\n", RMessageForError(RErrorCode));
+    return 1;
+  }
+  srand(1);
+  for (i = 0; i < width * height * 3; i++) {
+    rgb->data[i] = rand() & 0xff;
+  }
+  for (i = 0; i < width * height * 4; i++) {
+    rgba->data[i] = rand() & 0xff;
+  }
+
+  failed |= !bench(rgb);
+  failed |= !bench(rgba);
+
+  RReleaseImage(rgb);
+  RReleaseImage(rgba);
+  if (synthetic) {
+    free(ctx->dpy);
+  } else {
+    XCloseDisplay(dpy);
+  }
+
+  return failed;
+}
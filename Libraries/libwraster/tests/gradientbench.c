@@ -0,0 +1,180 @@
+/*
+ * Benchmark of background rendering split into row bands.
+ *
+ * Renders gradients, tiled image and blur at 1080p, 4K and 8K (or the given
+ * size) with one thread and with the thread pool, reports milliseconds per
+ * image and checks that results are identical. Exits with non-zero status
+ * if they are not.
+ *
+ * usage: gradientbench [width height [iterations]]
+ */
+
+#include <X11/Xlib.h>
+#include "wraster.h"
+#include "../parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int iterations = 10;
+
+static RColor color1 = {0x20, 0x40, 0x80, 0xff};
+static RColor color2 = {0xf0, 0xc0, 0x10, 0xff};
+static RColor color3 = {0x80, 0x10, 0x60, 0xff};
+static RImage *tile;
+
+enum {
+  OpHGradient,
+  OpVGradient,
+  OpDGradient,
+  OpMVGradient,
+  OpMDGradient,
+  OpIGradient,
+  OpTile,
+  OpBlur,
+  OpCount
+};
+
+static const char *op_names[OpCount] = {"horizontal gradient", "vertical gradient",
+                                        "diagonal gradient",   "vertical multi gradient",
+                                        "diagonal multi gradient", "interwoven gradient",
+                                        "tiled image",         "tiled image and blur"};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static RImage *render(int op, unsigned width, unsigned height)
+{
+  RColor *colors[] = {&color1, &color2, &color3, &color1, NULL};
+  RColor colors1[2] = {color1, color2};
+  RColor colors2[2] = {color3, color1};
+  RImage *image;
+
+  switch (op) {
+  case OpHGradient:
+    return RRenderGradient(width, height, &color1, &color2, RHorizontalGradient);
+  case OpVGradient:
+    return RRenderGradient(width, height, &color1, &color2, RVerticalGradient);
+  case OpDGradient:
+    return RRenderGradient(width, height, &color1, &color2, RDiagonalGradient);
+  case OpMVGradient:
+    return RRenderMultiGradient(width, height, colors, RVerticalGradient);
+  case OpMDGradient:
+    return RRenderMultiGradient(width, height, colors, RDiagonalGradient);
+  case OpIGradient:
+    return RRenderInterwovenGradient(width, height, colors1, 3, colors2, 5);
+  case OpTile:
+    return RMakeTiledImage(tile, width, height);
+  case OpBlur:
+    image = RMakeTiledImage(tile, width, height);
+    if (image) {
+      RBlurImage(image);
+    }
+    return image;
+  }
+  return NULL;
+}
+
+/* Returns milliseconds per image, `*result` is the last image rendered */
+static double bench(int op, unsigned width, unsigned height, RImage **result)
+{
+  double start, elapsed = 0;
+  RImage *image = NULL;
+  int i;
+
+  for (i = 0; i < iterations; i++) {
+    if (image) {
+      RReleaseImage(image);
+    }
+    start = now();
+    image = render(op, width, height);
+    elapsed += now() - start;
+    if (!image) {
+      fprintf(stderr, "can't render image: %s\n", RMessageForError(RErrorCode));
+      exit(1);
+    }
+  }
+  *result = image;
+
+  return elapsed / iterations * 1e3;
+}
+
+static int bench_size(unsigned width, unsigned height, int nthreads)
+{
+  RImage *single, *parallel;
+  double single_ms, parallel_ms;
+  int op, ok, failed = 0;
+
+  printf("%ux%u\n", width, height);
+  for (op = 0; op < OpCount; op++) {
+    r_parallel_set_threads(1);
+    single_ms = bench(op, width, height, &single);
+    r_parallel_set_threads(nthreads);
+    parallel_ms = bench(op, width, height, &parallel);
+
+    ok = (memcmp(single->data, parallel->data,
+                 width * height * (single->format == RRGBAFormat ? 4 : 3)) == 0);
+    printf("  %-24s %8.2f ms %8.2f ms  x%.1f  %s\n", op_names[op], single_ms, parallel_ms,
+           single_ms / parallel_ms, ok ? "ok" : "MISMATCH");
+    failed |= !ok;
+
+    RReleaseImage(single);
+    RReleaseImage(parallel);
+  }
+
+  return failed;
+}
+
+int main(int argc, char **argv)
+{
+  static const unsigned sizes[][2] = {{1920, 1080}, {3840, 2160}, {7680, 4320}};
+  unsigned width = 0, height = 0;
+  int i, nthreads, failed = 0;
+
+  if (argc > 2) {
+    width = atoi(argv[1]);
+    height = atoi(argv[2]);
+    if (width == 0 || height == 0) {
+      fprintf(stderr, "usage: %s [width height [iterations]]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (argc > 3) {
+    iterations = atoi(argv[3]);
+    if (iterations <= 0) {
+      fprintf(stderr, "usage: %s [width height [iterations]]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  tile = RCreateImage(64, 64, True);
+  if (!tile) {
+    fprintf(stderr, "can't create image: %s\n", RMessageForError(RErrorCode));
+    return 1;
+  }
+  srand(1);
+  for (i = 0; i < 64 * 64 * 4; i++) {
+    tile->data[i] = rand() & 0xff;
+  }
+
+  nthreads = r_parallel_threads();
+  printf("%d iterations, %d threads: single thread / thread pool\n", iterations, nthreads);
+
+  if (width > 0) {
+    failed = bench_size(width, height, nthreads);
+  } else {
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      failed |= bench_size(sizes[i][0], sizes[i][1], nthreads);
+    }
+  }
+
+  RReleaseImage(tile);
+
+  return failed;
+}
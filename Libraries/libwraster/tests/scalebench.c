@@ -0,0 +1,296 @@
+/*
+ * Benchmark of RSmoothScaleImage().
+ *
+ * Scales images at icon sizes with the fixed point scaler of the library and
+ * with the double precision scaler it replaced (Graphics Gems III code, kept
+ * here as the reference), reports microseconds per image, speedup and the
+ * largest difference of a channel. Exits with non-zero status if results
+ * differ by more than rounding.
+ *
+ * usage: scalebench [iterations]
+ */
+
+#include <X11/Xlib.h>
+#include "wraster.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Largest difference of a channel tolerated: weights have 14 fraction bits */
+#define MAX_DIFFERENCE 2
+
+static int iterations = 200;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Reference scaler: RSmoothScaleImage() before fixed point weights.
+ * Mitchell filter (the default one), RGB output.
+ */
+
+#define B (1.0 / 3.0)
+#define C (1.0 / 3.0)
+#define Mitchell_support (2.0)
+
+static double Mitchell_filter(double t)
+{
+  double tt;
+
+  tt = t * t;
+  if (t < 0)
+    t = -t;
+  if (t < 1.0) {
+    t = (((12.0 - 9.0 * B - 6.0 * C) * (t * tt)) + ((-18.0 + 12.0 * B + 6.0 * C) * tt) +
+         (6.0 - 2 * B));
+    return (t / 6.0);
+  } else if (t < 2.0) {
+    t = (((-1.0 * B - 6.0 * C) * (t * tt)) + ((6.0 * B + 30.0 * C) * tt) +
+         ((-12.0 * B - 48.0 * C) * t) + (8.0 * B + 24 * C));
+    return (t / 6.0);
+  }
+  return (0.0);
+}
+
+typedef struct {
+  int pixel;
+  double weight;
+} CONTRIB;
+
+typedef struct {
+  int n;
+  CONTRIB *p;
+} CLIST;
+
+#define CLAMP(v, l, h) ((v) < (l) ? (l) : (v) > (h) ? (h) : v)
+
+static CLIST *reference_contributions(unsigned src_size, unsigned dst_size, int stride)
+{
+  CLIST *contrib;
+  double scale, width, fscale, center, weight;
+  int i, j, k, n, left, right;
+
+  scale = (double)dst_size / (double)src_size;
+  if (scale < 1.0) {
+    width = Mitchell_support / scale;
+    fscale = 1.0 / scale;
+  } else {
+    width = Mitchell_support;
+    fscale = 1.0;
+  }
+
+  contrib = (CLIST *)calloc(dst_size, sizeof(CLIST));
+  for (i = 0; i < dst_size; ++i) {
+    contrib[i].p = (CONTRIB *)calloc((int)ceil(width * 2 + 1), sizeof(CONTRIB));
+    center = (double)i / scale;
+    left = ceil(center - width);
+    right = floor(center + width);
+    for (j = left; j <= right; ++j) {
+      weight = Mitchell_filter((center - (double)j) / fscale) / fscale;
+      if (j < 0) {
+        n = -j;
+      } else if (j >= (int)src_size) {
+        n = (src_size - j) + src_size - 1;
+      } else {
+        n = j;
+      }
+      k = contrib[i].n++;
+      contrib[i].p[k].pixel = n * stride;
+      contrib[i].p[k].weight = weight;
+    }
+  }
+
+  return contrib;
+}
+
+static void free_contributions(CLIST *contrib, unsigned size)
+{
+  int i;
+
+  for (i = 0; i < size; ++i) {
+    free(contrib[i].p);
+  }
+  free(contrib);
+}
+
+static RImage *reference_scale(RImage *src, unsigned new_width, unsigned new_height)
+{
+  CLIST *contrib;
+  RImage *tmp, *dst;
+  unsigned char *p, *sp, *d;
+  double r, g, b;
+  int i, j, k;
+  int sch = src->format == RRGBAFormat ? 4 : 3;
+
+  dst = RCreateImage(new_width, new_height, False);
+  tmp = RCreateImage(new_width, src->height, False);
+
+  /* horizontally from src to tmp */
+  contrib = reference_contributions(src->width, new_width, sch);
+  p = tmp->data;
+  for (k = 0; k < tmp->height; ++k) {
+    sp = src->data + src->width * k * sch;
+    for (i = 0; i < tmp->width; ++i) {
+      CONTRIB *pp = contrib[i].p;
+
+      r = g = b = 0.0;
+      for (j = 0; j < contrib[i].n; ++j) {
+        r += sp[pp[j].pixel] * pp[j].weight;
+        g += sp[pp[j].pixel + 1] * pp[j].weight;
+        b += sp[pp[j].pixel + 2] * pp[j].weight;
+      }
+      *p++ = CLAMP(r, 0, 255);
+      *p++ = CLAMP(g, 0, 255);
+      *p++ = CLAMP(b, 0, 255);
+    }
+  }
+  free_contributions(contrib, new_width);
+
+  /* vertically from tmp to dst, column by column */
+  contrib = reference_contributions(tmp->height, new_height, 3);
+  sp = malloc(tmp->height * 3);
+  for (k = 0; k < new_width; ++k) {
+    d = sp;
+    for (i = tmp->height, p = tmp->data + k * 3; i-- > 0; p += tmp->width * 3) {
+      *d++ = p[0];
+      *d++ = p[1];
+      *d++ = p[2];
+    }
+    p = dst->data + k * 3;
+    for (i = 0; i < new_height; ++i) {
+      CONTRIB *pp = contrib[i].p;
+
+      r = g = b = 0.0;
+      for (j = 0; j < contrib[i].n; ++j) {
+        r += sp[pp[j].pixel] * pp[j].weight;
+        g += sp[pp[j].pixel + 1] * pp[j].weight;
+        b += sp[pp[j].pixel + 2] * pp[j].weight;
+      }
+      p[0] = CLAMP(r, 0, 255);
+      p[1] = CLAMP(g, 0, 255);
+      p[2] = CLAMP(b, 0, 255);
+      p += new_width * 3;
+    }
+  }
+  free(sp);
+  free_contributions(contrib, new_height);
+  RReleaseImage(tmp);
+
+  return dst;
+}
+
+/* Smooth image, so differences come from rounding rather than ringing */
+static RImage *make_source(unsigned width, unsigned height, int alpha)
+{
+  RImage *image;
+  unsigned char *p;
+  int x, y;
+
+  image = RCreateImage(width, height, alpha);
+  if (!image) {
+    fprintf(stderr, "can't create image: %s\n", RMessageForError(RErrorCode));
+    exit(1);
+  }
+  p = image->data;
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++) {
+      *p++ = x * 255 / width;
+      *p++ = y * 255 / height;
+      *p++ = (x + y) * 255 / (width + height);
+      if (alpha) {
+        *p++ = 0xff;
+      }
+    }
+  }
+
+  return image;
+}
+
+/* Returns microseconds per image, `*result` is the last image scaled */
+static double bench(RImage *(*scale)(RImage *, unsigned, unsigned), RImage *src,
+                    unsigned width, unsigned height, RImage **result)
+{
+  double start, elapsed = 0;
+  RImage *image = NULL;
+  int i;
+
+  for (i = 0; i < iterations; i++) {
+    if (image) {
+      RReleaseImage(image);
+    }
+    start = now();
+    image = scale(src, width, height);
+    elapsed += now() - start;
+    if (!image) {
+      fprintf(stderr, "can't scale image: %s\n", RMessageForError(RErrorCode));
+      exit(1);
+    }
+  }
+  *result = image;
+
+  return elapsed / iterations * 1e6;
+}
+
+static int bench_size(unsigned src_size, unsigned dst_size, int alpha)
+{
+  RImage *src, *reference, *scaled;
+  double reference_us, scaled_us;
+  unsigned char *r, *s;
+  int i, c, difference, max_difference = 0;
+  int sch = alpha ? 4 : 3;
+
+  src = make_source(src_size, src_size, alpha);
+  reference_us = bench(reference_scale, src, dst_size, dst_size, &reference);
+  scaled_us = bench(RSmoothScaleImage, src, dst_size, dst_size, &scaled);
+
+  r = reference->data;
+  s = scaled->data;
+  for (i = 0; i < dst_size * dst_size; i++, r += 3, s += sch) {
+    for (c = 0; c < 3; c++) {
+      difference = abs(r[c] - s[c]);
+      if (difference > max_difference) {
+        max_difference = difference;
+      }
+    }
+  }
+
+  printf("  %4u -> %-4u %-4s %9.1f us %9.1f us  x%.1f  max diff %d  %s\n", src_size, dst_size,
+         alpha ? "RGBA" : "RGB", reference_us, scaled_us, reference_us / scaled_us,
+         max_difference, max_difference <= MAX_DIFFERENCE ? "ok" : "MISMATCH");
+
+  RReleaseImage(src);
+  RReleaseImage(reference);
+  RReleaseImage(scaled);
+
+  return max_difference > MAX_DIFFERENCE;
+}
+
+int main(int argc, char **argv)
+{
+  static const unsigned sizes[][2] = {{512, 64}, {256, 64}, {128, 64}, {512, 128},
+                                      {256, 48}, {64, 48},  {48, 64},  {64, 256}};
+  int i, failed = 0;
+
+  if (argc > 1) {
+    iterations = atoi(argv[1]);
+    if (iterations <= 0) {
+      fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  printf("%d iterations: double precision reference / RSmoothScaleImage\n", iterations);
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    failed |= bench_size(sizes[i][0], sizes[i][1], False);
+    failed |= bench_size(sizes[i][0], sizes[i][1], True);
+  }
+
+  return failed;
+}
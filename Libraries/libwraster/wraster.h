@@ -93,7 +93,7 @@
 extern "C" {
 #endif /* __cplusplus */
 
-/* RBestMatchRendering or RDitheredRendering */
+/* RBestMatchRendering, RDitheredRendering or ROrderedDitherRendering */
 #define RC_RenderMode (1 << 0)
 
 /* number of colors per channel for colormap in PseudoColor mode */
@@ -118,7 +118,13 @@ extern "C" {
 #define RC_StandardColormap (1 << 7)
 
 /* image display modes */
-typedef enum { RDitheredRendering = 0, RBestMatchRendering = 1 } RRenderingMode;
+/* ROrderedDitherRendering is used for TrueColor visuals of less than 24 bits,
+ * other visuals are dithered with RDitheredRendering in this mode */
+typedef enum {
+  RDitheredRendering = 0,
+  RBestMatchRendering = 1,
+  ROrderedDitherRendering = 2
+} RRenderingMode;
 
 /* std colormap usage/creation modes */
 typedef enum {
@@ -339,6 +345,26 @@ RImage *RCreateImageFromDrawable(RContext *context, Drawable drawable,
 RImage *RLoadImage(RContext *context, const char *file,
                    int index) __wrlib_useresult __wrlib_nonalias __wrlib_nonnull(1, 2);
 
+/*
+ * Images loaded by RLoadSharedImage() and RLoadScaledImage() are shared with
+ * the image cache and other callers: they must not be modified. Release them
+ * with RReleaseImage(), get a private copy with RMakeImageWritable().
+ * RLoadScaledImage() returns image scaled to exactly `width` x `height`
+ * with RSmoothScaleImage(), scaled variants are cached too.
+ * RLoadFittedImage() returns image larger than `max_size` in width or height
+ * scaled down to `size` in the larger dimension (aspect ratio is kept) and
+ * smaller image as is. Cached scaled variant is found without loading the
+ * file, even if the original image is too large to be cached.
+ */
+RImage *RLoadSharedImage(RContext *context, const char *file, int index) __wrlib_useresult
+    __wrlib_nonnull(1, 2);
+
+RImage *RLoadScaledImage(RContext *context, const char *file, int index, unsigned width,
+                         unsigned height) __wrlib_useresult __wrlib_nonnull(1, 2);
+
+RImage *RLoadFittedImage(RContext *context, const char *file, int index, unsigned max_size,
+                         unsigned size) __wrlib_useresult __wrlib_nonnull(1, 2);
+
 RImage *RRetainImage(RImage *image);
 
 void RReleaseImage(RImage *image) __wrlib_nonnull(1);
@@ -359,6 +385,10 @@ Bool RSaveTitledImage(RImage *image, const char *filename, const char *format, c
  */
 RImage *RCloneImage(RImage *image) __wrlib_useresult __wrlib_nonalias __wrlib_nonnull(1);
 
+/* Returns `image` if caller holds the only reference to it, otherwise
+ * releases it and returns a copy */
+RImage *RMakeImageWritable(RImage *image) __wrlib_useresult __wrlib_nonnull(1);
+
 RImage *RGetSubImage(RImage *image, int x, int y, unsigned width,
                      unsigned height) __wrlib_useresult __wrlib_nonalias __wrlib_nonnull(1);
 